@@ -0,0 +1,132 @@
+/* Measures how many CSV rows per second can be formatted, once with the
+ * g_snprintf based formatting that the element used originally, and once
+ * with the digit pair formatting from intformat.h. Rows are formatted the
+ * same way as in gst_drift_measure_push_out_dataset(), for 2, 8 and 64
+ * channels. Some drift values are left empty, as with undetected peaks.
+ *
+ * Usage: csvformat-benchmark [<number of rows per run>] */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "intformat.h"
+
+
+#define DEFAULT_NUM_ROWS 200000
+#define MAX_ROW_LENGTH(NUM_CHANNELS) (20 + ((NUM_CHANNELS) - 1) * (1 + 21) + 1)
+#define NONE_DRIFT G_MININT64
+
+
+typedef gsize (*FormatRowFunc)(gchar *destination, guint64 timestamp, gint64 const *drifts, guint num_drifts);
+
+
+static gsize format_row_snprintf(gchar *destination, guint64 timestamp, gint64 const *drifts, guint num_drifts)
+{
+	gchar *write_pointer = destination;
+	guint i;
+
+	write_pointer += MIN(g_snprintf(write_pointer, 21, "%" G_GUINT64_FORMAT, timestamp), 20);
+
+	for (i = 0; i < num_drifts; ++i)
+	{
+		*write_pointer++ = ',';
+		if (drifts[i] != NONE_DRIFT)
+			write_pointer += MIN(g_snprintf(write_pointer, 22, "%" G_GINT64_FORMAT, drifts[i]), 21);
+	}
+
+	*write_pointer++ = '\n';
+
+	return write_pointer - destination;
+}
+
+
+static gsize format_row_digit_pairs(gchar *destination, guint64 timestamp, gint64 const *drifts, guint num_drifts)
+{
+	gchar *write_pointer = destination;
+	guint i;
+
+	write_pointer += drift_measure_format_uint64(write_pointer, timestamp);
+
+	for (i = 0; i < num_drifts; ++i)
+	{
+		*write_pointer++ = ',';
+		if (drifts[i] != NONE_DRIFT)
+			write_pointer += drift_measure_format_int64(write_pointer, drifts[i]);
+	}
+
+	*write_pointer++ = '\n';
+
+	return write_pointer - destination;
+}
+
+
+/* Formats all rows into the output and returns the number of rows per second. */
+static gdouble run(FormatRowFunc format_row, guint num_channels, guint num_rows, gint64 const *drifts, gchar *output, gsize *output_size)
+{
+	gint64 start_time, duration;
+	guint row;
+	gsize size = 0;
+
+	start_time = g_get_monotonic_time();
+
+	for (row = 0; row < num_rows; ++row)
+	{
+		guint64 timestamp = (guint64)row * 500 * G_GUINT64_CONSTANT(1000000);
+		size += format_row(output + size, timestamp, drifts + (gsize)row * (num_channels - 1), num_channels - 1);
+	}
+
+	duration = MAX(g_get_monotonic_time() - start_time, 1);
+
+	*output_size = size;
+	return num_rows / (duration / (gdouble)G_USEC_PER_SEC);
+}
+
+
+int main(int argc, char *argv[])
+{
+	static guint const channel_counts[] = { 2, 8, 64 };
+	guint num_rows = DEFAULT_NUM_ROWS;
+	guint i;
+	int ret = 0;
+
+	if (argc > 1)
+		num_rows = MAX(atoi(argv[1]), 1);
+
+	g_print("%8s %20s %20s %8s\n", "channels", "g_snprintf rows/s", "digit pairs rows/s", "speedup");
+
+	for (i = 0; i < G_N_ELEMENTS(channel_counts); ++i)
+	{
+		guint num_channels = channel_counts[i];
+		gsize num_drifts = (gsize)num_rows * (num_channels - 1);
+		gint64 *drifts = g_new(gint64, num_drifts);
+		gchar *output_before = g_malloc((gsize)num_rows * MAX_ROW_LENGTH(num_channels));
+		gchar *output_after = g_malloc((gsize)num_rows * MAX_ROW_LENGTH(num_channels));
+		gsize output_size_before, output_size_after;
+		gdouble rows_per_second_before, rows_per_second_after;
+		GRand *rand = g_rand_new_with_seed(num_channels);
+		gsize j;
+
+		/* Drifts of up to +-50 ms, with every 16th value missing. */
+		for (j = 0; j < num_drifts; ++j)
+			drifts[j] = (g_rand_int_range(rand, 0, 16) == 0) ? NONE_DRIFT : (gint64)g_rand_double_range(rand, -50e6, 50e6);
+
+		rows_per_second_before = run(format_row_snprintf, num_channels, num_rows, drifts, output_before, &output_size_before);
+		rows_per_second_after = run(format_row_digit_pairs, num_channels, num_rows, drifts, output_after, &output_size_after);
+
+		g_print("%8u %20.0f %20.0f %7.2fx\n", num_channels, rows_per_second_before, rows_per_second_after, rows_per_second_after / rows_per_second_before);
+
+		/* Both must produce exactly the same CSV data. */
+		if ((output_size_before != output_size_after) || (memcmp(output_before, output_after, output_size_before) != 0))
+		{
+			g_printerr("output mismatch with %u channels\n", num_channels);
+			ret = 1;
+		}
+
+		g_rand_free(rand);
+		g_free(output_after);
+		g_free(output_before);
+		g_free(drifts);
+	}
+
+	return ret;
+}
@@ -0,0 +1,493 @@
+/* Measures how fast pulses are detected and drifts are measured, once
+ * with the GStreamer-free detector from driftdetector.h, and once with the
+ * driftmeasure element, which is fed through pads without a pipeline (by
+ * the same harness as in the offline analysis tool; see elementharness.h).
+ *
+ * The input is a synthetic pulse train (see pulsegenerator.h) with the
+ * given number of channels, sample rate, sample format and noise level.
+ * The pulses are windowed, except with the matched filter, which gets the
+ * plain sine bursts of its default template.
+ * Channel N is delayed by N times the drift step, so every channel has a
+ * different, known drift. The whole signal is generated before the
+ * measurements start, and is then pushed as fast as possible, in buffers of
+ * the given size. Only pushing the frames and collecting the datasets is
+ * timed.
+ *
+ * The results are written to standard output as a JSON object, with one
+ * entry per measured target, containing:
+ *
+ *   frames_per_second: frames processed per second of wall clock time
+ *   realtime_factor: frames_per_second divided by the sample rate
+ *   ns_per_frame_per_channel: processing time per sample
+ *   peak_rss_bytes: peak resident set size of the process so far, which
+ *     includes the pregenerated signal (see signal_bytes)
+ *   allocations_per_pulse: malloc, calloc and realloc calls during the run,
+ *     divided by the number of pulses in the signal, or null if allocations
+ *     cannot be counted on this platform
+ *   max_abs_error_ns: largest difference between a measured and the known
+ *     drift (detector only; the element output is not parsed)
+ *
+ * Element properties can be set with --set. They do not affect the
+ * detector run, so --detection-method has to be used for the detection
+ * method, since it applies to both.
+ *
+ * Usage: detection-benchmark [OPTION...] */
+
+#define _XOPEN_SOURCE 700
+
+#include <math.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include "driftdetector.h"
+#include "elementharness.h"
+#include "gstdriftmeasure.h"
+#include "pulsegenerator.h"
+
+
+#define DEFAULT_NUM_CHANNELS 8
+#define DEFAULT_SAMPLE_RATE 48000
+#define DEFAULT_BUFFER_NUM_FRAMES 1024
+#define DEFAULT_DURATION 30.0
+#define DEFAULT_NOISE_LEVEL 0.01
+#define DEFAULT_DRIFT_STEP 123.4
+
+
+typedef struct
+{
+	guint num_channels;
+	guint sample_rate;
+	GstAudioFormat audio_format;
+	DriftMeasureSampleFormat sample_format;
+	guint bytes_per_sample;
+	gdouble noise_level;
+	gsize buffer_num_frames;
+	gdouble duration;
+	/* Delay between two neighbouring channels, in microseconds. */
+	gdouble drift_step;
+	gchar const *detection_method;
+	gchar **property_settings;
+
+	guint8 *frames;
+	gsize num_frames;
+	guint num_pulses;
+}
+BenchmarkInput;
+
+
+typedef struct
+{
+	gchar const *target;
+	gdouble seconds;
+	guint num_datasets;
+	gint num_allocations;
+	guint64 peak_rss;
+	/* Negative if not measured. */
+	gdouble max_abs_error;
+}
+BenchmarkResult;
+
+
+/* Allocations are counted by replacing malloc, calloc and realloc for
+ * the whole process, including GLib, GStreamer and the detector library.
+ * This relies on the glibc internal entry points, and would not work
+ * together with the allocator replacements of the address sanitizer. */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+
+#define CAN_COUNT_ALLOCATIONS 1
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t num, size_t size);
+extern void * __libc_realloc(void *ptr, size_t size);
+
+static gint num_allocations = 0;
+
+void * malloc(size_t size)
+{
+	g_atomic_int_inc(&num_allocations);
+	return __libc_malloc(size);
+}
+
+void * calloc(size_t num, size_t size)
+{
+	g_atomic_int_inc(&num_allocations);
+	return __libc_calloc(num, size);
+}
+
+void * realloc(void *ptr, size_t size)
+{
+	g_atomic_int_inc(&num_allocations);
+	return __libc_realloc(ptr, size);
+}
+
+#else
+
+#define CAN_COUNT_ALLOCATIONS 0
+
+static gint num_allocations = 0;
+
+#endif
+
+
+static guint64 get_peak_rss(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+	/* ru_maxrss is in kilobytes on Linux and the BSDs, but in bytes on macOS. */
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	return (guint64)(usage.ru_maxrss) * 1024;
+#endif
+}
+
+
+static gboolean generate_input(BenchmarkInput *input)
+{
+	DriftMeasurePulseGeneratorSettings generator_settings;
+	DriftMeasurePulseGenerator *generator;
+	gdouble *delays;
+	guint i;
+
+	delays = g_new(gdouble, input->num_channels);
+	for (i = 0; i < input->num_channels; ++i)
+		delays[i] = i * input->drift_step * 1000.0;
+
+	drift_measure_pulse_generator_settings_init(&generator_settings);
+	generator_settings.num_channels = input->num_channels;
+	generator_settings.sample_rate = input->sample_rate;
+	generator_settings.noise_level = input->noise_level;
+	/* The matched filter expects the sine bursts of its default template. */
+	generator_settings.windowed = (g_strcmp0(input->detection_method, "matched-filter") != 0);
+	generator_settings.delays = delays;
+	generator_settings.seed = 1;
+
+	input->num_frames = (gsize)(input->duration * input->sample_rate);
+	input->frames = g_try_malloc((gsize)(input->num_frames) * input->num_channels * input->bytes_per_sample);
+	if (input->frames == NULL)
+	{
+		g_free(delays);
+		return FALSE;
+	}
+
+	generator = drift_measure_pulse_generator_new(&generator_settings);
+	if (input->sample_format == DRIFT_MEASURE_SAMPLE_FORMAT_F32)
+		drift_measure_pulse_generator_generate_f32(generator, (gfloat *)(input->frames), input->num_frames);
+	else
+		drift_measure_pulse_generator_generate_s16(generator, (gint16 *)(input->frames), input->num_frames);
+
+	/* Only count the pulses that are complete in all channels. The
+	 * last channel is the most delayed one. */
+	input->num_pulses = 0;
+	while ((drift_measure_pulse_generator_get_pulse_time(generator, input->num_channels - 1, input->num_pulses) + generator_settings.pulse_length / 2.0) <= input->duration)
+		input->num_pulses++;
+
+	drift_measure_pulse_generator_free(generator);
+	g_free(delays);
+
+	return TRUE;
+}
+
+
+static void run_detector(BenchmarkInput const *input, BenchmarkResult *result)
+{
+	DriftMeasureDetectorSettings settings;
+	DriftMeasureDetector *detector;
+	gsize bytes_per_frame = input->num_channels * input->bytes_per_sample;
+	gsize *channel_offsets = g_new(gsize, input->num_channels);
+	gint64 *drifts = g_new(gint64, input->num_channels - 1);
+	gint64 start_time;
+	gint start_num_allocations;
+	gsize frame;
+	guint i;
+
+	drift_measure_detector_settings_init(&settings);
+	settings.sample_format = input->sample_format;
+	settings.num_channels = input->num_channels;
+	settings.sample_rate = input->sample_rate;
+	settings.interleaved = 1;
+	if (g_strcmp0(input->detection_method, "cross-correlation") == 0)
+		settings.detection_method = DRIFT_MEASURE_DETECTION_METHOD_CROSS_CORRELATION;
+	else if (g_strcmp0(input->detection_method, "matched-filter") == 0)
+		settings.detection_method = DRIFT_MEASURE_DETECTION_METHOD_MATCHED_FILTER;
+
+	for (i = 0; i < input->num_channels; ++i)
+		channel_offsets[i] = i * input->bytes_per_sample;
+
+	result->target = "detector";
+	result->num_datasets = 0;
+	result->max_abs_error = 0.0;
+
+	detector = drift_measure_detector_new(&settings);
+	g_assert(detector != NULL);
+
+	start_num_allocations = g_atomic_int_get(&num_allocations);
+	start_time = g_get_monotonic_time();
+
+	for (frame = 0; frame < input->num_frames; frame += input->buffer_num_frames)
+	{
+		gsize num_buffer_frames = MIN(input->buffer_num_frames, input->num_frames - frame);
+		guint64 timestamp;
+
+		drift_measure_detector_push_frames(detector, input->frames + frame * bytes_per_frame, bytes_per_frame, channel_offsets, num_buffer_frames);
+
+		while (drift_measure_detector_pull_dataset(detector, &timestamp, drifts))
+		{
+			result->num_datasets++;
+
+			/* The reference channel is channel 0, which is not delayed. */
+			for (i = 1; i < input->num_channels; ++i)
+			{
+				gdouble expected_drift = i * input->drift_step * 1000.0;
+				gdouble error = (drifts[i - 1] == DRIFT_MEASURE_DETECTOR_NO_DRIFT) ? G_MAXDOUBLE : fabs(drifts[i - 1] - expected_drift);
+				result->max_abs_error = MAX(result->max_abs_error, error);
+			}
+		}
+	}
+
+	result->seconds = MAX(g_get_monotonic_time() - start_time, 1) / (gdouble)G_USEC_PER_SEC;
+	result->num_allocations = g_atomic_int_get(&num_allocations) - start_num_allocations;
+	result->peak_rss = get_peak_rss();
+
+	drift_measure_detector_free(detector);
+	g_free(drifts);
+	g_free(channel_offsets);
+}
+
+
+static void count_datasets(guint8 const *data, gsize size, gpointer user_data)
+{
+	BenchmarkResult *result = user_data;
+	gsize i;
+
+	/* Each CSV row is one dataset. */
+	for (i = 0; i < size; ++i)
+	{
+		if (data[i] == '\n')
+			result->num_datasets++;
+	}
+}
+
+
+static gboolean run_element(BenchmarkInput const *input, BenchmarkResult *result)
+{
+	GstElement *element;
+	DriftMeasureElementHarness *harness;
+	GstAudioInfo audio_info;
+	GError *error = NULL;
+	gint64 start_time;
+	gint start_num_allocations;
+	GstFlowReturn flow_ret;
+
+	result->target = "element";
+	result->num_datasets = 0;
+	result->max_abs_error = -1.0;
+
+	element = GST_ELEMENT(gst_object_ref_sink(g_object_new(GST_TYPE_DRIFT_MEASURE, NULL)));
+	gst_util_set_object_arg(G_OBJECT(element), "detection-method", input->detection_method);
+	if (!drift_measure_element_harness_set_properties(element, input->property_settings, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		gst_object_unref(GST_OBJECT(element));
+		return FALSE;
+	}
+
+	gst_audio_info_init(&audio_info);
+	gst_audio_info_set_format(&audio_info, input->audio_format, input->sample_rate, input->num_channels, NULL);
+	harness = drift_measure_element_harness_new(element, "detection-benchmark", &audio_info, 0, count_datasets, result);
+
+	start_num_allocations = g_atomic_int_get(&num_allocations);
+	start_time = g_get_monotonic_time();
+
+	drift_measure_element_harness_push_frames(harness, input->frames, input->num_frames, input->buffer_num_frames);
+	/* EOS also waits for windows that are still being analyzed. */
+	flow_ret = drift_measure_element_harness_finish(harness);
+
+	result->seconds = MAX(g_get_monotonic_time() - start_time, 1) / (gdouble)G_USEC_PER_SEC;
+	result->num_allocations = g_atomic_int_get(&num_allocations) - start_num_allocations;
+	result->peak_rss = get_peak_rss();
+
+	drift_measure_element_harness_free(harness);
+	gst_object_unref(GST_OBJECT(element));
+
+	if (flow_ret != GST_FLOW_OK)
+	{
+		g_printerr("element run failed: %s\n", gst_flow_get_name(flow_ret));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/* Formats a number for the JSON output. g_print() would use the decimal
+ * separator of the locale, which is not always a point. */
+static gchar const * format_number(gchar *buffer, gchar const *format, gdouble value)
+{
+	return g_ascii_formatd(buffer, G_ASCII_DTOSTR_BUF_SIZE, format, value);
+}
+
+
+static void print_result(BenchmarkInput const *input, BenchmarkResult const *result, gboolean last)
+{
+	gdouble frames_per_second = input->num_frames / result->seconds;
+	gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+	g_print("    {\n");
+	g_print("      \"target\": \"%s\",\n", result->target);
+	g_print("      \"seconds\": %s,\n", format_number(buffer, "%.6f", result->seconds));
+	g_print("      \"datasets\": %u,\n", result->num_datasets);
+	g_print("      \"frames_per_second\": %s,\n", format_number(buffer, "%.0f", frames_per_second));
+	g_print("      \"realtime_factor\": %s,\n", format_number(buffer, "%.2f", frames_per_second / input->sample_rate));
+	g_print("      \"ns_per_frame_per_channel\": %s,\n", format_number(buffer, "%.4f", result->seconds * 1e9 / input->num_frames / input->num_channels));
+	g_print("      \"peak_rss_bytes\": %" G_GUINT64_FORMAT ",\n", result->peak_rss);
+
+	if (CAN_COUNT_ALLOCATIONS)
+		g_print("      \"allocations_per_pulse\": %s", format_number(buffer, "%.2f", (gdouble)(result->num_allocations) / MAX(input->num_pulses, 1)));
+	else
+		g_print("      \"allocations_per_pulse\": null");
+
+	if (result->max_abs_error < 0.0)
+		g_print("\n");
+	else if (result->max_abs_error == G_MAXDOUBLE)
+		g_print(",\n      \"max_abs_error_ns\": null\n");
+	else
+		g_print(",\n      \"max_abs_error_ns\": %s\n", format_number(buffer, "%.1f", result->max_abs_error));
+
+	g_print("    }%s\n", last ? "" : ",");
+}
+
+
+int main(int argc, char *argv[])
+{
+	BenchmarkInput input;
+	BenchmarkResult results[2];
+	guint num_results = 0;
+	gint num_channels = DEFAULT_NUM_CHANNELS;
+	gint sample_rate = DEFAULT_SAMPLE_RATE;
+	gint buffer_num_frames = DEFAULT_BUFFER_NUM_FRAMES;
+	gchar *format = NULL;
+	gchar *target = NULL;
+	gchar *detection_method = NULL;
+	GOptionEntry option_entries[] =
+	{
+		{ "channels", 'c', 0, G_OPTION_ARG_INT, &num_channels, "Number of channels (default: 8)", "N" },
+		{ "rate", 'r', 0, G_OPTION_ARG_INT, &sample_rate, "Sample rate (default: 48000)", "RATE" },
+		{ "format", 'f', 0, G_OPTION_ARG_STRING, &format, "Sample format, F32LE or S16LE (default: F32LE)", "FORMAT" },
+		{ "noise", 'n', 0, G_OPTION_ARG_DOUBLE, &(input.noise_level), "Standard deviation of the noise, relative to full scale (default: 0.01)", "LEVEL" },
+		{ "buffer-frames", 'b', 0, G_OPTION_ARG_INT, &buffer_num_frames, "Number of frames per pushed buffer (default: 1024)", "N" },
+		{ "duration", 'd', 0, G_OPTION_ARG_DOUBLE, &(input.duration), "Duration of the signal in seconds (default: 30)", "SECONDS" },
+		{ "drift-step", 0, 0, G_OPTION_ARG_DOUBLE, &(input.drift_step), "Delay between neighbouring channels in microseconds (default: 123.4)", "MICROSECONDS" },
+		{ "detection-method", 'm', 0, G_OPTION_ARG_STRING, &detection_method, "peak, cross-correlation or matched-filter (default: peak)", "METHOD" },
+		{ "target", 't', 0, G_OPTION_ARG_STRING, &target, "What to measure: detector, element or both (default: both)", "TARGET" },
+		{ "set", 's', 0, G_OPTION_ARG_STRING_ARRAY, &(input.property_settings), "Set a driftmeasure property for the element run (can be used multiple times)", "NAME=VALUE" },
+		{ NULL, 0, 0, 0, NULL, NULL, NULL }
+	};
+	GOptionContext *option_context;
+	GError *error = NULL;
+	gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+	guint i;
+	int ret = 0;
+
+	memset(&input, 0, sizeof(input));
+	input.noise_level = DEFAULT_NOISE_LEVEL;
+	input.duration = DEFAULT_DURATION;
+	input.drift_step = DEFAULT_DRIFT_STEP;
+
+	option_context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(option_context, option_entries, NULL);
+	g_option_context_add_group(option_context, gst_init_get_option_group());
+	if (!g_option_context_parse(option_context, &argc, &argv, &error))
+	{
+		g_printerr("%s\n", error->message);
+		return 1;
+	}
+	g_option_context_free(option_context);
+
+	if ((g_strcmp0(format, "S16LE") == 0))
+	{
+		input.audio_format = GST_AUDIO_FORMAT_S16LE;
+		input.sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_S16;
+		input.bytes_per_sample = 2;
+	}
+	else if ((format == NULL) || (g_strcmp0(format, "F32LE") == 0))
+	{
+		input.audio_format = GST_AUDIO_FORMAT_F32LE;
+		input.sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_F32;
+		input.bytes_per_sample = 4;
+	}
+	else
+	{
+		g_printerr("unsupported sample format \"%s\"\n", format);
+		return 1;
+	}
+
+	if ((detection_method != NULL) && (g_strcmp0(detection_method, "peak") != 0) && (g_strcmp0(detection_method, "cross-correlation") != 0) && (g_strcmp0(detection_method, "matched-filter") != 0))
+	{
+		g_printerr("unknown detection method \"%s\"\n", detection_method);
+		return 1;
+	}
+
+	if ((target != NULL) && (g_strcmp0(target, "both") != 0) && (g_strcmp0(target, "detector") != 0) && (g_strcmp0(target, "element") != 0))
+	{
+		g_printerr("unknown target \"%s\"\n", target);
+		return 1;
+	}
+
+	if ((num_channels < 2) || (sample_rate <= 0) || (buffer_num_frames <= 0) || (input.duration <= 1.0))
+	{
+		g_printerr("need at least 2 channels, a positive sample rate and buffer size, and a duration of more than 1 s\n");
+		return 1;
+	}
+
+	input.num_channels = num_channels;
+	input.sample_rate = sample_rate;
+	input.buffer_num_frames = buffer_num_frames;
+	input.detection_method = (detection_method != NULL) ? detection_method : "peak";
+
+	if (!generate_input(&input))
+	{
+		g_printerr("could not allocate the signal\n");
+		return 1;
+	}
+
+	if ((target == NULL) || (g_strcmp0(target, "element") != 0))
+		run_detector(&input, &(results[num_results++]));
+
+	if ((target == NULL) || (g_strcmp0(target, "detector") != 0))
+	{
+		if (run_element(&input, &(results[num_results])))
+			num_results++;
+		else
+			ret = 1;
+	}
+
+	g_print("{\n");
+	g_print("  \"benchmark\": \"detection\",\n");
+	g_print("  \"settings\": {\n");
+	g_print("    \"channels\": %u,\n", input.num_channels);
+	g_print("    \"sample_rate\": %u,\n", input.sample_rate);
+	g_print("    \"format\": \"%s\",\n", gst_audio_format_to_string(input.audio_format));
+	g_print("    \"noise_level\": %s,\n", format_number(buffer, "%g", input.noise_level));
+	g_print("    \"buffer_frames\": %" G_GSIZE_FORMAT ",\n", input.buffer_num_frames);
+	g_print("    \"duration\": %s,\n", format_number(buffer, "%g", input.duration));
+	g_print("    \"drift_step_us\": %s,\n", format_number(buffer, "%g", input.drift_step));
+	g_print("    \"detection_method\": \"%s\",\n", input.detection_method);
+	g_print("    \"pulses\": %u,\n", input.num_pulses);
+	g_print("    \"signal_bytes\": %" G_GSIZE_FORMAT "\n", input.num_frames * input.num_channels * input.bytes_per_sample);
+	g_print("  },\n");
+	g_print("  \"results\": [\n");
+	for (i = 0; i < num_results; ++i)
+		print_result(&input, &(results[i]), (i + 1) == num_results);
+	g_print("  ]\n");
+	g_print("}\n");
+
+	g_free(input.frames);
+
+	return ret;
+}
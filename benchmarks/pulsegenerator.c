@@ -0,0 +1,201 @@
+#include <math.h>
+#include <string.h>
+#include "pulsegenerator.h"
+
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+struct _DriftMeasurePulseGenerator
+{
+	DriftMeasurePulseGeneratorSettings settings;
+	/* Delays in seconds, one per channel. */
+	gdouble *delays;
+	/* Clock rates relative to the nominal sample rate, one per channel. */
+	gdouble *clock_rates;
+	GRand *rand;
+	/* Second value of the last Box-Muller pair, if have_spare_noise is TRUE. */
+	gdouble spare_noise;
+	gboolean have_spare_noise;
+	/* Index of the next frame to generate. */
+	guint64 position;
+};
+
+
+void drift_measure_pulse_generator_settings_init(DriftMeasurePulseGeneratorSettings *settings)
+{
+	memset(settings, 0, sizeof(DriftMeasurePulseGeneratorSettings));
+
+	settings->first_pulse_time = 1.0;
+	settings->pulse_interval = 1.0;
+	settings->pulse_length = 0.002;
+	settings->pulse_frequency = 1000.0;
+	settings->amplitude = 0.8;
+	settings->windowed = TRUE;
+	settings->clip_level = 1.0;
+}
+
+
+DriftMeasurePulseGenerator * drift_measure_pulse_generator_new(DriftMeasurePulseGeneratorSettings const *settings)
+{
+	DriftMeasurePulseGenerator *generator;
+	guint i;
+
+	g_assert(settings->num_channels > 0);
+	g_assert(settings->sample_rate > 0);
+	g_assert(settings->pulse_length > 0.0);
+	g_assert(settings->pulse_interval > settings->pulse_length);
+
+	generator = g_new0(DriftMeasurePulseGenerator, 1);
+	generator->settings = *settings;
+	generator->delays = g_new0(gdouble, settings->num_channels);
+	generator->clock_rates = g_new0(gdouble, settings->num_channels);
+	generator->rand = g_rand_new_with_seed(settings->seed);
+
+	for (i = 0; i < settings->num_channels; ++i)
+	{
+		if (settings->delays != NULL)
+			generator->delays[i] = settings->delays[i] * 1e-9;
+		generator->clock_rates[i] = 1.0 + ((settings->skews != NULL) ? (settings->skews[i] * 1e-6) : 0.0);
+	}
+
+	/* The copy must not point to the caller's arrays. */
+	generator->settings.delays = NULL;
+	generator->settings.skews = NULL;
+
+	return generator;
+}
+
+
+void drift_measure_pulse_generator_free(DriftMeasurePulseGenerator *generator)
+{
+	if (generator == NULL)
+		return;
+
+	g_rand_free(generator->rand);
+	g_free(generator->clock_rates);
+	g_free(generator->delays);
+	g_free(generator);
+}
+
+
+static gdouble get_noise(DriftMeasurePulseGenerator *generator)
+{
+	gdouble u1, u2, radius;
+
+	if (generator->have_spare_noise)
+	{
+		generator->have_spare_noise = FALSE;
+		return generator->spare_noise;
+	}
+
+	/* Box-Muller transform; u1 must not be 0, since its logarithm is taken. */
+	do
+		u1 = g_rand_double(generator->rand);
+	while (u1 <= 0.0);
+	u2 = g_rand_double(generator->rand);
+
+	radius = sqrt(-2.0 * log(u1));
+	generator->spare_noise = radius * sin(2.0 * M_PI * u2);
+	generator->have_spare_noise = TRUE;
+
+	return radius * cos(2.0 * M_PI * u2);
+}
+
+
+static gdouble get_jitter(DriftMeasurePulseGenerator const *generator, guint channel, guint64 pulse_index)
+{
+	/* The jitter of a pulse must be the same every time it is needed, so
+	 * it is derived from the seed, channel and pulse index with the
+	 * SplitMix64 finalizer instead of being drawn from the noise source. */
+	guint64 x = ((guint64)(generator->settings.seed) << 32) ^ ((guint64)channel << 48) ^ pulse_index;
+
+	if (generator->settings.jitter <= 0.0)
+		return 0.0;
+
+	x += G_GUINT64_CONSTANT(0x9E3779B97F4A7C15);
+	x = (x ^ (x >> 30)) * G_GUINT64_CONSTANT(0xBF58476D1CE4E5B9);
+	x = (x ^ (x >> 27)) * G_GUINT64_CONSTANT(0x94D049BB133111EB);
+	x ^= x >> 31;
+
+	/* Uniformly distributed in the -jitter .. jitter range. */
+	return ((x >> 11) * (2.0 / 9007199254740992.0) - 1.0) * generator->settings.jitter * 1e-9;
+}
+
+
+/* Returns the middle of a pulse in the time of the channel's own clock. */
+static gdouble get_pulse_channel_time(DriftMeasurePulseGenerator const *generator, guint channel, guint64 pulse_index)
+{
+	DriftMeasurePulseGeneratorSettings const *settings = &(generator->settings);
+	return settings->first_pulse_time + pulse_index * settings->pulse_interval + settings->pulse_length / 2.0 + get_jitter(generator, channel, pulse_index);
+}
+
+
+gdouble drift_measure_pulse_generator_get_pulse_time(DriftMeasurePulseGenerator const *generator, guint channel, guint64 pulse_index)
+{
+	return (get_pulse_channel_time(generator, channel, pulse_index) + generator->delays[channel]) / generator->clock_rates[channel];
+}
+
+
+static gdouble get_sample(DriftMeasurePulseGenerator *generator, guint64 frame, guint channel)
+{
+	DriftMeasurePulseGeneratorSettings const *settings = &(generator->settings);
+	gdouble t = (gdouble)frame / settings->sample_rate * generator->clock_rates[channel] - generator->delays[channel];
+	/* Index of the pulse whose middle is closest. The jitter is much
+	 * smaller than the interval, so this is the only pulse that can
+	 * overlap t. */
+	gdouble pulse_index = floor((t - settings->first_pulse_time - settings->pulse_length / 2.0) / settings->pulse_interval + 0.5);
+	gdouble value = 0.0;
+
+	if (pulse_index >= 0.0)
+	{
+		/* Position within the pulse, relative to its middle. */
+		gdouble offset = t - get_pulse_channel_time(generator, channel, (guint64)pulse_index);
+
+		if (fabs(offset) < (settings->pulse_length / 2.0))
+		{
+			if (settings->windowed)
+			{
+				gdouble window = 0.5 + 0.5 * cos(2.0 * M_PI * offset / settings->pulse_length);
+				value = settings->amplitude * window * cos(2.0 * M_PI * settings->pulse_frequency * offset);
+			}
+			else
+				value = settings->amplitude * sin(2.0 * M_PI * settings->pulse_frequency * (offset + settings->pulse_length / 2.0));
+		}
+	}
+
+	if (settings->noise_level > 0.0)
+		value += settings->noise_level * get_noise(generator);
+
+	return CLAMP(value, -settings->clip_level, settings->clip_level);
+}
+
+
+void drift_measure_pulse_generator_generate_f32(DriftMeasurePulseGenerator *generator, gfloat *frames, gsize num_frames)
+{
+	guint num_channels = generator->settings.num_channels;
+	gsize i;
+	guint channel;
+
+	for (i = 0; i < num_frames; ++i, ++(generator->position))
+	{
+		for (channel = 0; channel < num_channels; ++channel)
+			*frames++ = get_sample(generator, generator->position, channel);
+	}
+}
+
+
+void drift_measure_pulse_generator_generate_s16(DriftMeasurePulseGenerator *generator, gint16 *frames, gsize num_frames)
+{
+	guint num_channels = generator->settings.num_channels;
+	gsize i;
+	guint channel;
+
+	for (i = 0; i < num_frames; ++i, ++(generator->position))
+	{
+		for (channel = 0; channel < num_channels; ++channel)
+			*frames++ = (gint16)lrint(get_sample(generator, generator->position, channel) * 32767.0);
+	}
+}
@@ -0,0 +1,101 @@
+#ifndef PULSEGENERATOR_H
+#define PULSEGENERATOR_H
+
+#include <glib.h>
+
+
+G_BEGIN_DECLS
+
+
+/* Synthetic multichannel pulse trains.
+ *
+ * Each channel contains the same pulse train, delayed by a per-channel
+ * amount of time that does not have to be a multiple of the sample period.
+ * By default, a pulse is a cosine burst in a Hann window, so its largest
+ * value is exactly in its middle. The waveform is evaluated analytically
+ * at the delayed sample positions instead of being shifted by an
+ * interpolation filter.
+ *
+ * On top of that, each channel can have its own clock that runs slightly
+ * too fast or too slow, and each pulse can be moved by a random amount of
+ * jitter. Since all of this is known, the exact time of every pulse can be
+ * queried, which gives the true drifts to compare measurements against.
+ * Finally, gaussian noise is added, and the samples are clipped.
+ *
+ * The generator writes interleaved frames, and keeps track of its position,
+ * so a long signal can be generated in several calls. */
+
+
+typedef struct
+{
+	guint num_channels;
+	guint sample_rate;
+
+	/* Start of the first pulse, in seconds. */
+	gdouble first_pulse_time;
+	/* Time between the starts of two pulses, in seconds. */
+	gdouble pulse_interval;
+	/* Length of a pulse, in seconds. */
+	gdouble pulse_length;
+	/* Frequency of the sine inside a pulse, in Hz. */
+	gdouble pulse_frequency;
+	/* Peak amplitude of a pulse, in the 0.0 .. 1.0 range. */
+	gdouble amplitude;
+	/* If FALSE, a pulse is a plain sine burst that starts at phase 0
+	 * instead, like the default template of the matched filter. Such a
+	 * pulse has several peaks of (almost) the same height, so it is not
+	 * suitable for the peak detection method. */
+	gboolean windowed;
+	/* Standard deviation of the added gaussian noise, in the 0.0 .. 1.0 range. */
+	gdouble noise_level;
+	/* Samples are clipped to the -clip_level .. clip_level range. Must
+	 * not be larger than 1.0. */
+	gdouble clip_level;
+
+	/* Delay of each channel, in nanoseconds, with num_channels values. A
+	 * channel whose delay is larger than that of the reference channel
+	 * has a positive drift. NULL means that no channel is delayed. */
+	gdouble const *delays;
+	/* Clock rate error of each channel, in ppm, with num_channels values.
+	 * The pulses of a channel with a positive value come progressively
+	 * earlier. NULL means that all clocks are exact. */
+	gdouble const *skews;
+	/* Each pulse in each channel is moved by a random amount of time of
+	 * up to this many nanoseconds in either direction. */
+	gdouble jitter;
+
+	/* Seed for the noise and the jitter, so that runs can be reproduced. */
+	guint32 seed;
+}
+DriftMeasurePulseGeneratorSettings;
+
+
+typedef struct _DriftMeasurePulseGenerator DriftMeasurePulseGenerator;
+
+
+/* Fills settings with windowed 2 ms pulses of 1000 Hz at 0.8 of full
+ * scale, once per second starting at 1 s, without noise, clipping, delays,
+ * clock rate errors or jitter. num_channels and sample_rate still have to
+ * be set. */
+void drift_measure_pulse_generator_settings_init(DriftMeasurePulseGeneratorSettings *settings);
+
+/* The settings, including the delays and skews, are copied. */
+DriftMeasurePulseGenerator * drift_measure_pulse_generator_new(DriftMeasurePulseGeneratorSettings const *settings);
+
+void drift_measure_pulse_generator_free(DriftMeasurePulseGenerator *generator);
+
+/* Returns the time of the middle of the pulse with the given index (0
+ * being the first pulse) in the given channel, in seconds since the first
+ * frame. For windowed pulses, this is where the largest value is. */
+gdouble drift_measure_pulse_generator_get_pulse_time(DriftMeasurePulseGenerator const *generator, guint channel, guint64 pulse_index);
+
+/* Writes the next num_frames interleaved frames. */
+void drift_measure_pulse_generator_generate_f32(DriftMeasurePulseGenerator *generator, gfloat *frames, gsize num_frames);
+
+void drift_measure_pulse_generator_generate_s16(DriftMeasurePulseGenerator *generator, gint16 *frames, gsize num_frames);
+
+
+G_END_DECLS
+
+
+#endif /* PULSEGENERATOR_H */
@@ -60,7 +60,7 @@ class Pipeline:
 
 		# The pipeline topology goes as follows:
 		#
-		# pulsesrc -> tee -> queue -> audioconvert -> driftmeasure -> filesink  (1)
+		# pulsesrc -> tee -> queue -> driftmeasure -> filesink                  (1)
 		#              |
 		#              +---> queue -> audioconvert -> wavenc -> filesink        (2)
 		#
@@ -70,7 +70,11 @@ class Pipeline:
 		# The link between pulsesrc and tee is filtered to enforce a certain sample
 		# rate and channel count on pulsesrc.
 		#
-		# Both audioconvert elements have their "dithering" property set to 'none'.
+		# Branch (1) has no audioconvert element, since driftmeasure accepts the
+		# F32LE, S16LE, S24LE and S32LE formats directly, so the samples are
+		# analyzed exactly as they were captured.
+		#
+		# The audioconvert element in branch (2) has its "dithering" property set to 'none'.
 		# Dithering helps to reduce the audible impact of quantization artifacts by
 		# spreading out the quantization error. However, we do not care about that
 		# here, since we use artificial test signals. Instead, we must make sure that
@@ -91,7 +95,6 @@ class Pipeline:
 		tee = self.__create_element("tee", "tee")
 
 		csv_queue = self.__create_element("queue", "csv_queue")
-		csv_audioconvert = self.__create_element("audioconvert", "csv_audioconvert")
 		csv_driftmeasure = self.__create_element("driftmeasure", "csv_driftmeasure")
 		csv_filesink = self.__create_element("filesink", "csv_filesink")
 
@@ -108,17 +111,14 @@ class Pipeline:
 		self.pipeline.add(self.pulsesrc)
 		self.pipeline.add(tee)
 		self.pipeline.add(csv_queue)
-		self.pipeline.add(csv_audioconvert)
 		self.pipeline.add(csv_driftmeasure)
 		self.pipeline.add(csv_filesink)
 
 		self.pulsesrc.link_filtered(tee, src_caps)
 		tee.link(csv_queue)
-		csv_queue.link(csv_audioconvert)
-		csv_audioconvert.link(csv_driftmeasure)
+		csv_queue.link(csv_driftmeasure)
 		csv_driftmeasure.link(csv_filesink)
 
-		csv_audioconvert.set_property('dithering', 'none')
 		csv_driftmeasure.set_property('reference-channel', configuration.reference_channel)
 		csv_driftmeasure.set_property('peak-threshold', configuration.peak_threshold)
 		csv_driftmeasure.set_property('pulse-length', configuration.pulse_length * 1000)
@@ -126,6 +126,10 @@ class Pipeline:
 		# We do not want any CSV output if we detect a peak in the
 		# reference channel but no peaks in the other channels.
 		csv_driftmeasure.set_property('omit-output-if-no-peaks', True)
+		# Collect rows into larger buffers, but do not let them
+		# wait for more than a second before they are written.
+		csv_driftmeasure.set_property('output-batch-rows', 16)
+		csv_driftmeasure.set_property('output-batch-latency', 1000000000)
 		csv_filesink.set_property('location', configuration.output_csv_filename)
 		csv_filesink.set_property('async', False)
 		csv_filesink.set_property('buffer-mode', 'unbuffered')
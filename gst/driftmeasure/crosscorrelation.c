@@ -0,0 +1,162 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "crosscorrelation.h"
+#include "fftengine.h"
+
+
+struct _DriftMeasureCrossCorrelator
+{
+	size_t num_window_frames;
+	DriftMeasureFftPlan *plan;
+	/* Spectrum of the zero padded reference window. */
+	DriftMeasureComplex *reference_spectrum;
+	/* Transform buffer. After a correlation, it contains the correlation of
+	 * the first window in the real and that of the second in the imaginary
+	 * parts, scaled by the transform length. */
+	DriftMeasureComplex *work;
+	/* Correlation values around a peak, for interpolation. */
+	double neighbourhood[DRIFT_MEASURE_PEAK_INTERPOLATION_NEIGHBOURHOOD_SIZE];
+};
+
+
+DriftMeasureCrossCorrelator * drift_measure_cross_correlator_new(size_t num_window_frames)
+{
+	DriftMeasureCrossCorrelator *correlator;
+	size_t length = drift_measure_fft_get_length(num_window_frames * 2);
+
+	correlator = calloc(1, sizeof(DriftMeasureCrossCorrelator));
+	if (correlator == NULL)
+		return NULL;
+
+	correlator->num_window_frames = num_window_frames;
+	correlator->plan = drift_measure_fft_plan_new(length);
+	correlator->reference_spectrum = malloc(sizeof(DriftMeasureComplex) * length);
+	correlator->work = malloc(sizeof(DriftMeasureComplex) * length);
+
+	if ((correlator->plan == NULL) || (correlator->reference_spectrum == NULL) || (correlator->work == NULL))
+	{
+		drift_measure_cross_correlator_free(correlator);
+		return NULL;
+	}
+
+	return correlator;
+}
+
+
+void drift_measure_cross_correlator_free(DriftMeasureCrossCorrelator *correlator)
+{
+	if (correlator == NULL)
+		return;
+
+	drift_measure_fft_plan_free(correlator->plan);
+	free(correlator->reference_spectrum);
+	free(correlator->work);
+	free(correlator);
+}
+
+
+size_t drift_measure_cross_correlator_get_num_window_frames(DriftMeasureCrossCorrelator const *correlator)
+{
+	return correlator->num_window_frames;
+}
+
+
+void drift_measure_cross_correlator_set_reference(DriftMeasureCrossCorrelator *correlator, float const *reference)
+{
+	size_t length = drift_measure_fft_plan_get_length(correlator->plan);
+	size_t i;
+
+	for (i = 0; i < correlator->num_window_frames; ++i)
+	{
+		correlator->reference_spectrum[i].re = reference[i];
+		correlator->reference_spectrum[i].im = 0.0;
+	}
+
+	for (; i < length; ++i)
+		correlator->reference_spectrum[i].re = correlator->reference_spectrum[i].im = 0.0;
+
+	drift_measure_fft_forward(correlator->plan, correlator->reference_spectrum);
+}
+
+
+void drift_measure_cross_correlator_copy_reference(DriftMeasureCrossCorrelator *correlator, DriftMeasureCrossCorrelator const *source)
+{
+	size_t length = drift_measure_fft_plan_get_length(correlator->plan);
+	memcpy(correlator->reference_spectrum, source->reference_spectrum, sizeof(DriftMeasureComplex) * length);
+}
+
+
+/* Returns the correlation value at the given lag. part selects
+ * the real (0) or imaginary (1) parts of the work buffer. */
+static inline double get_correlation(DriftMeasureCrossCorrelator const *correlator, int part, long lag)
+{
+	size_t length = drift_measure_fft_plan_get_length(correlator->plan);
+	DriftMeasureComplex const *value = &(correlator->work[(lag >= 0) ? (size_t)lag : (length - (size_t)(-lag))]);
+	return (part == 0) ? value->re : value->im;
+}
+
+
+static double find_lag(DriftMeasureCrossCorrelator *correlator, int part, size_t max_lag, DriftMeasurePeakInterpolation interpolation)
+{
+	/* Lags beyond the window length have no overlap with the reference. */
+	long max_valid_lag = (long)(correlator->num_window_frames) - 1;
+	long lag, largest_lag = -(long)max_lag;
+	double largest = get_correlation(correlator, part, largest_lag);
+	int i;
+
+	for (lag = largest_lag + 1; lag <= (long)max_lag; ++lag)
+	{
+		double value = get_correlation(correlator, part, lag);
+		if (value > largest)
+		{
+			largest = value;
+			largest_lag = lag;
+		}
+	}
+
+	if (interpolation == DRIFT_MEASURE_PEAK_INTERPOLATION_NONE)
+		return largest_lag;
+
+	for (i = -DRIFT_MEASURE_PEAK_INTERPOLATION_HALF_LENGTH; i <= DRIFT_MEASURE_PEAK_INTERPOLATION_HALF_LENGTH; ++i)
+	{
+		lag = largest_lag + i;
+		correlator->neighbourhood[DRIFT_MEASURE_PEAK_INTERPOLATION_HALF_LENGTH + i] = (labs(lag) <= max_valid_lag) ? get_correlation(correlator, part, lag) : NAN;
+	}
+
+	return largest_lag + drift_measure_peak_interpolation_get_offset(interpolation, correlator->neighbourhood);
+}
+
+
+void drift_measure_cross_correlator_correlate(DriftMeasureCrossCorrelator *correlator, float const *first, float const *second, size_t max_lag, DriftMeasurePeakInterpolation interpolation, double *first_lag, double *second_lag)
+{
+	size_t length = drift_measure_fft_plan_get_length(correlator->plan);
+	DriftMeasureComplex *work = correlator->work;
+	size_t i;
+
+	if (max_lag >= correlator->num_window_frames)
+		max_lag = correlator->num_window_frames - 1;
+
+	/* Pack both windows into one complex signal. */
+	for (i = 0; i < correlator->num_window_frames; ++i)
+	{
+		work[i].re = first[i];
+		work[i].im = (second != NULL) ? second[i] : 0.0f;
+	}
+
+	for (; i < length; ++i)
+		work[i].re = work[i].im = 0.0;
+
+	drift_measure_fft_forward(correlator->plan, work);
+
+	/* Multiply the spectra of both windows with the conjugate of the
+	 * reference spectrum. The inverse transform then contains both
+	 * correlations. */
+	drift_measure_fft_multiply_real_pair(correlator->plan, work, correlator->reference_spectrum, 1);
+
+	drift_measure_fft_inverse(correlator->plan, work);
+
+	*first_lag = find_lag(correlator, 0, max_lag, interpolation);
+	if (second != NULL)
+		*second_lag = find_lag(correlator, 1, max_lag, interpolation);
+}
@@ -0,0 +1,69 @@
+#ifndef CROSSCORRELATION_H
+#define CROSSCORRELATION_H
+
+#include <stddef.h>
+#include "peakinterpolation.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* FFT based cross-correlation of channel windows against a reference window.
+ *
+ * The correlator is created for a fixed window length, and keeps its FFT
+ * plan and buffers around, so it can be reused for any number of windows
+ * of that length. The reference window is transformed once with
+ * drift_measure_cross_correlator_set_reference(), and then correlated with
+ * the windows of the other channels. Two channels are correlated with one
+ * forward and one inverse transform, by packing them into the real and
+ * imaginary parts of one complex signal.
+ *
+ * The windows are zero padded to twice their length, so the correlation
+ * is linear, not circular.
+ *
+ * A correlator must not be used by several threads at the same time.
+ *
+ * This correlator does not depend on GStreamer or GLib. */
+
+
+typedef struct _DriftMeasureCrossCorrelator DriftMeasureCrossCorrelator;
+
+
+/* Creates a correlator for windows with the given number of frames.
+ * Returns NULL if memory is exhausted. */
+DriftMeasureCrossCorrelator * drift_measure_cross_correlator_new(size_t num_window_frames);
+
+void drift_measure_cross_correlator_free(DriftMeasureCrossCorrelator *correlator);
+
+size_t drift_measure_cross_correlator_get_num_window_frames(DriftMeasureCrossCorrelator const *correlator);
+
+/* Sets the reference window. reference must contain as many
+ * values as the correlator's window length. */
+void drift_measure_cross_correlator_set_reference(DriftMeasureCrossCorrelator *correlator, float const *reference);
+
+/* Copies the reference window from another correlator, which must have been
+ * created for the same window length. This is much cheaper than setting the
+ * same reference window again, and allows for correlating several windows
+ * concurrently, with one correlator per thread. */
+void drift_measure_cross_correlator_copy_reference(DriftMeasureCrossCorrelator *correlator, DriftMeasureCrossCorrelator const *source);
+
+/* Correlates the first and second windows with the reference window, and
+ * stores the lag with the largest correlation for each of them in
+ * first_lag and second_lag. A positive lag means that the window is late
+ * compared to the reference. Only lags within -max_lag .. max_lag are
+ * considered; among equally large correlations, the smallest lag wins.
+ * The lags are refined with the given peak interpolation method.
+ *
+ * second may be NULL if only one window is to be correlated. second_lag
+ * is not touched then. */
+void drift_measure_cross_correlator_correlate(DriftMeasureCrossCorrelator *correlator, float const *first, float const *second, size_t max_lag, DriftMeasurePeakInterpolation interpolation, double *first_lag, double *second_lag);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* CROSSCORRELATION_H */
@@ -0,0 +1,1528 @@
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+/* For clock_gettime(). */
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "driftdetector.h"
+#include "framering.h"
+#include "crosscorrelation.h"
+#include "matchedfilter.h"
+
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+#include <time.h>
+#endif
+
+
+#define NANOSECONDS_PER_SECOND UINT64_C(1000000000)
+
+
+/* Instrumentation helpers. STATS_TIMED runs STATEMENT, and adds the time
+ * it took to the given stats field. Without instrumentation, STATEMENT
+ * is just run, and counting does nothing. */
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+#define STATS_ADD(DETECTOR, FIELD, AMOUNT) ((DETECTOR)->stats.FIELD += (AMOUNT))
+#define STATS_TIMED(DETECTOR, FIELD, STATEMENT) \
+	do \
+	{ \
+		uint64_t stats_start_time = get_monotonic_time(); \
+		STATEMENT; \
+		(DETECTOR)->stats.FIELD += get_monotonic_time() - stats_start_time; \
+	} \
+	while (0)
+#else
+#define STATS_ADD(DETECTOR, FIELD, AMOUNT) ((void)0)
+#define STATS_TIMED(DETECTOR, FIELD, STATEMENT) \
+	do \
+	{ \
+		STATEMENT; \
+	} \
+	while (0)
+#endif
+
+/* Minimum number of frames that the history has room
+ * for in addition to the frames needed for analysis. */
+#define MIN_HISTORY_HEADROOM 4096
+
+
+/* A frame in the reference channel that may turn out to be the peak
+ * the search is looking for. frame_index is absolute, that is, it
+ * counts all frames since the last reset, not just those that are
+ * currently in the history. */
+typedef struct
+{
+	uint64_t frame_index;
+	/* The sample value, normalized to the -1.0 .. 1.0 range. This
+	 * is exact for all supported formats, so comparing these values
+	 * is equivalent to comparing the native ones. */
+	double value;
+}
+PeakCandidate;
+
+
+/* A share of the per-channel analysis of one window. The shares are
+ * analyzed concurrently; each one only reads the history and writes
+ * the results of its own channels. */
+typedef struct
+{
+	DriftMeasureDetector *detector;
+	DriftMeasureFrameRing const *history;
+	unsigned int const *channels;
+	unsigned int num_channels;
+	size_t window_start;
+	size_t num_window_frames;
+	/* Correlators keep the state of one correlation at a time, so each
+	 * share needs its own one. The first share uses cross_correlator,
+	 * the others own theirs. */
+	DriftMeasureCrossCorrelator *correlator;
+}
+AnalysisTask;
+
+
+/* Channels whose window samples shall be copied by copy_window_samples(). */
+typedef struct
+{
+	size_t window_start;
+	unsigned int const *channels;
+	unsigned int num_channels;
+}
+WindowCopy;
+
+
+/* Samples of one channel around a peak, gathered for interpolation. */
+typedef struct
+{
+	unsigned int channel;
+	/* History index of the frame in the middle of the neighbourhood. */
+	size_t peak_frame;
+	double *values;
+}
+Neighbourhood;
+
+
+/* Function that is called by walk_history() for each run of frames that
+ * is contiguous in the history storage. The run starts at the given
+ * storage position; first_frame is the index of that frame in the
+ * history. */
+typedef int (*FramesFunc)(DriftMeasureDetector *detector, DriftMeasureFrameRing const *history, size_t position, size_t first_frame, size_t num_frames, void *user_data);
+
+
+struct _DriftMeasureDetectorWindow
+{
+	/* The frames around the reference peak, in the history format
+	 * of the detector the window was pulled out of. */
+	DriftMeasureFrameRing *history;
+	DriftMeasureSampleFormat sample_format;
+	unsigned int num_channels;
+	int interleaved;
+	/* Index of the reference peak frame in the history. */
+	size_t peak_frame_index;
+	uint64_t timestamp;
+};
+
+
+struct _DriftMeasureDetector
+{
+	DriftMeasureDetectorSettings settings;
+
+	/* Sample format and layout of the frames in the history, and the peak
+	 * threshold converted to the native domain of that format, so that
+	 * samples do not have to be converted before they are compared. This
+	 * is the format of the pushed frames, unless the matched filter is
+	 * used; the filter output is always in non-interleaved F32 form. */
+	DriftMeasureSampleFormat sample_format;
+	int history_interleaved;
+	size_t history_bytes_per_sample;
+	DriftMeasureSampleValue native_peak_threshold;
+
+	/* The peak search kernels to use. This is the fastest implementation
+	 * the CPU supports for the history sample format; see peakkernels.h
+	 * for details. */
+	DriftMeasurePeakKernels const *peak_kernels;
+
+	/* The frames that are kept around for analysis. As soon as the oldest
+	 * frames are no longer needed, they are discarded. The history has
+	 * room for a window plus a pulse and some headroom for new frames.
+	 * Pushed frames are copied into it once, in portions that fit. This
+	 * keeps the memory footprint fixed, no matter how many frames are
+	 * pushed at once; see setup_history(). */
+	DriftMeasureFrameRing *history;
+	/* Nonzero while the window around a reference peak is being filled.
+	 * The peak is searched for while this is zero. */
+	int analyzing;
+	/* window_size and pulse_length translated from nanoseconds to frames. */
+	size_t window_size_in_frames;
+	size_t pulse_length_in_frames;
+	/* Index of the frame in the history where the peak in the
+	 * reference channel was found. Only valid while analyzing. */
+	size_t peak_frame_index;
+	/* Number of frames that were discarded from the history so far. This
+	 * is the absolute index of the oldest frame in the history, which is
+	 * needed for generating the timestamps. */
+	uint64_t total_num_input_frames_seen;
+
+	/* Incremental peak search state. search_scan_position is the absolute
+	 * index of the first reference channel frame that has not been examined
+	 * by the search yet; frames before it are never looked at again.
+	 * candidates contains all examined frames whose values are at or
+	 * above the peak threshold and which are not followed by a frame with
+	 * a larger value. Their values are thus in descending order, and the
+	 * first candidate is always the peak of the examined frames that are
+	 * still in the history. Equal values are all kept, which preserves the
+	 * preference for the earliest frame among equally large peaks. Keeping
+	 * the followers around (and not just the largest candidate) is what
+	 * allows for discarding frames up to and including the current peak
+	 * without having to rescan the remaining history. */
+	uint64_t search_scan_position;
+	PeakCandidate *candidates;
+	size_t num_candidates;
+	size_t candidates_capacity;
+	/* Debug counters. Every frame that enters the history must be examined
+	 * exactly once by the search, so after each search pass, these two
+	 * must be equal. */
+	uint64_t num_frames_received;
+	uint64_t num_frames_scanned;
+
+	/* Per-channel peak search states for the analysis, one for each channel. */
+	DriftMeasureChannelPeak *channel_peaks;
+
+	/* Cross-correlation state. The correlator (and with it, the FFT plan)
+	 * is created for one window size, and is reused for all windows of
+	 * that size. window_samples holds the normalized samples of one window,
+	 * one channel after the other. channel_lags contains the correlation
+	 * results, one for each channel. */
+	DriftMeasureCrossCorrelator *cross_correlator;
+	float *window_samples;
+	size_t num_window_samples;
+	double *channel_lags;
+	/* Interpolated peak offsets, one for each channel,
+	 * used by the other detection methods. */
+	double *channel_peak_offsets;
+
+	/* The non-reference channels of a window are split into num_shares
+	 * shares, which are described by tasks, and run by run_tasks.
+	 * analysis_channels lists the channels that are to be analyzed. */
+	AnalysisTask *tasks;
+	void **task_pointers;
+	unsigned int num_shares;
+	DriftMeasureDetectorRunTasksFunc run_tasks;
+	void *run_tasks_user_data;
+	unsigned int *analysis_channels;
+
+	/* Matched filter state, used with DRIFT_MEASURE_DETECTION_METHOD_MATCHED_FILTER.
+	 * Pushed frames are run through the filter, and the filter output is put
+	 * into the history instead of the pushed frames, so the peak search and
+	 * analysis operate on the filter output. filter_input holds the
+	 * normalized non-interleaved samples of the pushed frames, and
+	 * filter_output the filter output for them, with the plane offsets
+	 * in filter_channel_offsets. */
+	DriftMeasureMatchedFilter *matched_filter;
+	size_t matched_filter_delay;
+	float *filter_input;
+	size_t filter_input_size;
+	float *filter_output;
+	size_t filter_output_size;
+	size_t *filter_channel_offsets;
+
+	/* Datasets that were not pulled yet. Dataset N has the timestamp
+	 * dataset_timestamps[N] and the drifts starting at
+	 * dataset_drifts[N * (num_channels - 1)]. Those before first_dataset
+	 * were pulled already. */
+	uint64_t *dataset_timestamps;
+	int64_t *dataset_drifts;
+	size_t first_dataset;
+	size_t num_datasets;
+	size_t datasets_capacity;
+
+	/* Windows that were not pulled yet, used if deferred_analysis is nonzero. */
+	int deferred_analysis;
+	DriftMeasureDetectorWindow **windows;
+	size_t first_window;
+	size_t num_windows;
+	size_t windows_capacity;
+
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	/* Gathered since the detector was created; see drift_measure_detector_get_stats(). */
+	DriftMeasureDetectorStats stats;
+#endif
+};
+
+
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+static uint64_t get_monotonic_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)(ts.tv_sec) * NANOSECONDS_PER_SECOND + (uint64_t)(ts.tv_nsec);
+}
+#endif
+
+
+static size_t get_bytes_per_sample(DriftMeasureSampleFormat sample_format)
+{
+	switch (sample_format)
+	{
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S16: return 2;
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S24: return 3;
+		default: return 4;
+	}
+}
+
+
+/* Returns the duration of the given number of frames in nanoseconds,
+ * rounded down. Unlike a plain multiplication followed by a division,
+ * this does not overflow for large frame counts. */
+static uint64_t frames_to_nanoseconds(uint64_t num_frames, unsigned int sample_rate)
+{
+	return (num_frames / sample_rate) * NANOSECONDS_PER_SECOND + (num_frames % sample_rate) * NANOSECONDS_PER_SECOND / sample_rate;
+}
+
+
+/* Returns the number of frames that cover the given duration, rounded up. */
+static size_t nanoseconds_to_frames(uint64_t nanoseconds, unsigned int sample_rate)
+{
+	return (size_t)((nanoseconds / NANOSECONDS_PER_SECOND) * sample_rate + ((nanoseconds % NANOSECONDS_PER_SECOND) * sample_rate + NANOSECONDS_PER_SECOND - 1) / NANOSECONDS_PER_SECOND);
+}
+
+
+/* Makes sure that the array has room for num_elements elements,
+ * growing it if necessary. Returns zero if memory is exhausted. */
+static int reserve_elements(void **array, size_t *capacity, size_t num_elements, size_t element_size)
+{
+	size_t new_capacity;
+	void *new_array;
+
+	if (num_elements <= *capacity)
+		return 1;
+
+	new_capacity = (*capacity > 0) ? (*capacity * 2) : 16;
+	if (new_capacity < num_elements)
+		new_capacity = num_elements;
+
+	new_array = realloc(*array, new_capacity * element_size);
+	if (new_array == NULL)
+		return 0;
+
+	*array = new_array;
+	*capacity = new_capacity;
+
+	return 1;
+}
+
+
+static int setup_history(DriftMeasureDetector *detector)
+{
+	/* Allocates the history ring buffer.
+	 *
+	 * In search mode, at most half a window is kept, plus whatever follows
+	 * a peak candidate until it is pulse_length frames away from the end.
+	 * In analysis mode, half a window is kept before the peak (see
+	 * process_history()), and half a window is needed after it. The
+	 * neighbourhoods for peak interpolation add a few frames at either end.
+	 * On top of that, there needs to be room for new frames; the more there
+	 * is, the fewer portions large pushes have to be split into. */
+
+	size_t headroom = detector->window_size_in_frames / 2;
+	size_t capacity;
+
+	if (headroom < MIN_HISTORY_HEADROOM)
+		headroom = MIN_HISTORY_HEADROOM;
+	capacity = detector->window_size_in_frames + detector->pulse_length_in_frames + 2 * DRIFT_MEASURE_PEAK_INTERPOLATION_HALF_LENGTH + headroom;
+
+	detector->history = drift_measure_frame_ring_new(capacity, detector->settings.num_channels, detector->history_bytes_per_sample, detector->history_interleaved);
+
+	return (detector->history != NULL);
+}
+
+
+static int setup_matched_filter(DriftMeasureDetector *detector, DriftMeasureDetectorSettings const *settings)
+{
+	/* Creates the matched filter. Returns zero if memory is exhausted. If
+	 * the filter cannot be created for other reasons, matched_filter stays
+	 * NULL, and the pushed frames are used directly. */
+
+	if (settings->pulse_template != NULL)
+	{
+		detector->matched_filter = drift_measure_matched_filter_new(settings->pulse_template, settings->pulse_template_length, settings->num_channels);
+	}
+	else
+	{
+		size_t template_length = (detector->pulse_length_in_frames > 0) ? detector->pulse_length_in_frames : 1;
+		float *template_values = malloc(template_length * sizeof(float));
+
+		if (template_values == NULL)
+			return 0;
+
+		drift_measure_matched_filter_generate_sine_template(template_values, template_length, settings->pulse_frequency, settings->sample_rate);
+		detector->matched_filter = drift_measure_matched_filter_new(template_values, template_length, settings->num_channels);
+
+		free(template_values);
+	}
+
+	if (detector->matched_filter != NULL)
+		detector->matched_filter_delay = drift_measure_matched_filter_get_delay(detector->matched_filter);
+
+	return 1;
+}
+
+
+void drift_measure_detector_settings_init(DriftMeasureDetectorSettings *settings)
+{
+	memset(settings, 0, sizeof(DriftMeasureDetectorSettings));
+
+	settings->sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_F32;
+	settings->interleaved = 1;
+	settings->window_size = NANOSECONDS_PER_SECOND / 2;
+	settings->pulse_length = NANOSECONDS_PER_SECOND / 500;
+	settings->peak_threshold = 0.6f;
+	settings->reference_channel = 0;
+	settings->detection_method = DRIFT_MEASURE_DETECTION_METHOD_PEAK;
+	settings->peak_interpolation = DRIFT_MEASURE_PEAK_INTERPOLATION_NONE;
+	settings->pulse_template = NULL;
+	settings->pulse_template_length = 0;
+	settings->pulse_frequency = 1000.0;
+}
+
+
+DriftMeasureDetector * drift_measure_detector_new(DriftMeasureDetectorSettings const *settings)
+{
+	DriftMeasureDetector *detector;
+	unsigned int num_channels = settings->num_channels;
+
+	if ((num_channels < 2) || (settings->sample_rate == 0) || (settings->reference_channel >= num_channels))
+		return NULL;
+
+	detector = calloc(1, sizeof(DriftMeasureDetector));
+	if (detector == NULL)
+		return NULL;
+
+	detector->settings = *settings;
+	/* The template is copied by the filter, so the pointer
+	 * would be dangling once the filter is created. */
+	detector->settings.pulse_template = NULL;
+	detector->settings.pulse_template_length = 0;
+
+	detector->window_size_in_frames = nanoseconds_to_frames(settings->window_size, settings->sample_rate);
+	detector->pulse_length_in_frames = nanoseconds_to_frames(settings->pulse_length, settings->sample_rate);
+
+	if ((settings->detection_method == DRIFT_MEASURE_DETECTION_METHOD_MATCHED_FILTER) && !setup_matched_filter(detector, settings))
+		goto error;
+
+	if (detector->matched_filter != NULL)
+	{
+		detector->sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_F32;
+		detector->history_interleaved = 0;
+		detector->history_bytes_per_sample = sizeof(float);
+	}
+	else
+	{
+		detector->sample_format = settings->sample_format;
+		detector->history_interleaved = settings->interleaved;
+		detector->history_bytes_per_sample = get_bytes_per_sample(settings->sample_format);
+	}
+
+	detector->native_peak_threshold = drift_measure_peak_kernels_convert_threshold(detector->sample_format, settings->peak_threshold);
+	detector->peak_kernels = drift_measure_peak_kernels_get_optimized(detector->sample_format);
+
+	if (!setup_history(detector))
+		goto error;
+
+	detector->channel_peaks = calloc(num_channels, sizeof(DriftMeasureChannelPeak));
+	detector->channel_lags = calloc(num_channels, sizeof(double));
+	detector->channel_peak_offsets = calloc(num_channels, sizeof(double));
+	detector->analysis_channels = calloc(num_channels, sizeof(unsigned int));
+	detector->filter_channel_offsets = calloc(num_channels, sizeof(size_t));
+	if ((detector->channel_peaks == NULL) || (detector->channel_lags == NULL) || (detector->channel_peak_offsets == NULL) || (detector->analysis_channels == NULL) || (detector->filter_channel_offsets == NULL))
+		goto error;
+
+	if (!drift_measure_detector_set_task_runner(detector, 1, NULL, NULL))
+		goto error;
+
+	drift_measure_detector_reset(detector);
+
+	return detector;
+
+error:
+	drift_measure_detector_free(detector);
+	return NULL;
+}
+
+
+void drift_measure_detector_free(DriftMeasureDetector *detector)
+{
+	unsigned int i;
+
+	if (detector == NULL)
+		return;
+
+	drift_measure_detector_reset(detector);
+
+	/* The first task uses cross_correlator, which it does not own. */
+	for (i = 1; i < detector->num_shares; ++i)
+		drift_measure_cross_correlator_free(detector->tasks[i].correlator);
+	free(detector->tasks);
+	free(detector->task_pointers);
+
+	drift_measure_frame_ring_free(detector->history);
+	free(detector->candidates);
+	free(detector->channel_peaks);
+	drift_measure_cross_correlator_free(detector->cross_correlator);
+	free(detector->window_samples);
+	free(detector->channel_lags);
+	free(detector->channel_peak_offsets);
+	free(detector->analysis_channels);
+	drift_measure_matched_filter_free(detector->matched_filter);
+	free(detector->filter_input);
+	free(detector->filter_output);
+	free(detector->filter_channel_offsets);
+	free(detector->dataset_timestamps);
+	free(detector->dataset_drifts);
+	free(detector->windows);
+	free(detector);
+}
+
+
+void drift_measure_detector_reset(DriftMeasureDetector *detector)
+{
+	size_t i;
+
+	/* The history only exists if the detector was fully set up. */
+	if (detector->history != NULL)
+		drift_measure_frame_ring_clear(detector->history);
+
+	detector->num_candidates = 0;
+	detector->search_scan_position = 0;
+	detector->num_frames_received = 0;
+	detector->num_frames_scanned = 0;
+
+	detector->total_num_input_frames_seen = 0;
+	detector->peak_frame_index = 0;
+	detector->analyzing = 0;
+
+	if (detector->matched_filter != NULL)
+		drift_measure_matched_filter_reset(detector->matched_filter);
+
+	detector->first_dataset = 0;
+	detector->num_datasets = 0;
+
+	for (i = detector->first_window; i < detector->num_windows; ++i)
+		drift_measure_detector_window_free(detector->windows[i]);
+	detector->first_window = 0;
+	detector->num_windows = 0;
+}
+
+
+int drift_measure_detector_uses_matched_filter(DriftMeasureDetector const *detector)
+{
+	return (detector->matched_filter != NULL);
+}
+
+
+size_t drift_measure_detector_get_matched_filter_delay(DriftMeasureDetector const *detector)
+{
+	return detector->matched_filter_delay;
+}
+
+
+size_t drift_measure_detector_get_history_memory_size(DriftMeasureDetector const *detector)
+{
+	return drift_measure_frame_ring_get_memory_size(detector->history);
+}
+
+
+char const * drift_measure_detector_get_peak_kernels_name(DriftMeasureDetector const *detector)
+{
+	return detector->peak_kernels->name;
+}
+
+
+void drift_measure_detector_set_peak_interpolation(DriftMeasureDetector *detector, DriftMeasurePeakInterpolation peak_interpolation)
+{
+	detector->settings.peak_interpolation = peak_interpolation;
+}
+
+
+int drift_measure_detector_set_task_runner(DriftMeasureDetector *detector, unsigned int num_shares, DriftMeasureDetectorRunTasksFunc run_tasks, void *user_data)
+{
+	AnalysisTask *tasks;
+	void **task_pointers;
+	unsigned int i;
+
+	if (num_shares == 0)
+		num_shares = 1;
+
+	detector->run_tasks = run_tasks;
+	detector->run_tasks_user_data = user_data;
+
+	if (num_shares == detector->num_shares)
+		return 1;
+
+	tasks = calloc(num_shares, sizeof(AnalysisTask));
+	task_pointers = calloc(num_shares, sizeof(void *));
+	if ((tasks == NULL) || (task_pointers == NULL))
+	{
+		free(tasks);
+		free(task_pointers);
+		return 0;
+	}
+
+	for (i = 1; i < detector->num_shares; ++i)
+		drift_measure_cross_correlator_free(detector->tasks[i].correlator);
+	free(detector->tasks);
+	free(detector->task_pointers);
+
+	for (i = 0; i < num_shares; ++i)
+		task_pointers[i] = &(tasks[i]);
+
+	detector->tasks = tasks;
+	detector->task_pointers = task_pointers;
+	detector->num_shares = num_shares;
+
+	return 1;
+}
+
+
+void drift_measure_detector_set_deferred_analysis(DriftMeasureDetector *detector, int deferred)
+{
+	detector->deferred_analysis = deferred;
+}
+
+
+static int walk_history(DriftMeasureDetector *detector, DriftMeasureFrameRing const *history, size_t first_frame, size_t num_frames, FramesFunc func, void *user_data)
+{
+	size_t current_frame = first_frame;
+	size_t end_frame = first_frame + num_frames;
+	int ret = 1;
+
+	assert(end_frame <= drift_measure_frame_ring_get_num_frames(history));
+
+	/* Hand the frames to func run by run. There are at most two
+	 * runs, since the frames only wrap around the ring once. */
+	while (ret && (current_frame < end_frame))
+	{
+		size_t position;
+		size_t num_run_frames = drift_measure_frame_ring_get_run(history, current_frame, end_frame - current_frame, &position);
+
+		ret = func(detector, history, position, current_frame, num_run_frames, user_data);
+
+		current_frame += num_run_frames;
+	}
+
+	return ret;
+}
+
+
+static int find_largest_frames(DriftMeasureDetector *detector, DriftMeasureFrameRing const *history, size_t position, size_t first_frame, size_t num_frames, void *user_data)
+{
+	/* Updates the per-channel peak search states with the largest samples
+	 * from the given frames. With interleaved data, all channels are handled
+	 * in one go, so the frames are only traversed once, no matter how many
+	 * channels there are. With non-interleaved data, each channel plane is
+	 * contiguous, so the planes are traversed one after the other. The states
+	 * have to be reset before the first call, which allows for passing frames
+	 * in several consecutive runs. */
+
+	unsigned int num_channels = detector->settings.num_channels;
+
+	(void)user_data;
+
+	/* This peak detection method is susceptible to signal noise. With
+	 * the cross-correlation detection method, the results are only used
+	 * for finding out which channels contain a pulse at all. */
+	if (detector->history_interleaved)
+	{
+		detector->peak_kernels->find_largest_frames(
+			drift_measure_frame_ring_get_samples(history, 0, position),
+			num_channels,
+			first_frame,
+			num_frames,
+			detector->native_peak_threshold,
+			detector->channel_peaks
+		);
+	}
+	else
+	{
+		unsigned int channel;
+
+		for (channel = 0; channel < num_channels; ++channel)
+		{
+			detector->peak_kernels->find_largest_frames(
+				drift_measure_frame_ring_get_samples(history, channel, position),
+				1,
+				first_frame,
+				num_frames,
+				detector->native_peak_threshold,
+				&(detector->channel_peaks[channel])
+			);
+		}
+	}
+
+	return 1;
+}
+
+
+static int copy_neighbourhood(DriftMeasureDetector *detector, DriftMeasureFrameRing const *history, size_t position, size_t first_frame, size_t num_frames, void *user_data)
+{
+	Neighbourhood *neighbourhood = user_data;
+	DriftMeasureSampleFormat sample_format = detector->sample_format;
+	size_t frame;
+
+	for (frame = 0; frame < num_frames; ++frame)
+	{
+		DriftMeasureSampleValue value = drift_measure_peak_kernels_read_sample(sample_format, drift_measure_frame_ring_get_samples(history, neighbourhood->channel, position + frame));
+		neighbourhood->values[first_frame + frame + DRIFT_MEASURE_PEAK_INTERPOLATION_HALF_LENGTH - neighbourhood->peak_frame] = drift_measure_peak_kernels_normalize_value(sample_format, value);
+	}
+
+	return 1;
+}
+
+
+static double get_interpolated_peak_offset(DriftMeasureDetector *detector, DriftMeasureFrameRing const *history, unsigned int channel, size_t peak_frame)
+{
+	/* Returns the position of the actual maximum of the signal around
+	 * the given peak frame in the given history, relative to that frame. */
+
+	double values[DRIFT_MEASURE_PEAK_INTERPOLATION_NEIGHBOURHOOD_SIZE];
+	Neighbourhood neighbourhood;
+	size_t half_length = DRIFT_MEASURE_PEAK_INTERPOLATION_HALF_LENGTH;
+	size_t start_frame, end_frame;
+	unsigned int i;
+
+	if (detector->settings.peak_interpolation == DRIFT_MEASURE_PEAK_INTERPOLATION_NONE)
+		return 0.0;
+
+	/* Neighbours outside of the history are marked as unavailable. */
+	for (i = 0; i < DRIFT_MEASURE_PEAK_INTERPOLATION_NEIGHBOURHOOD_SIZE; ++i)
+		values[i] = NAN;
+
+	start_frame = (peak_frame >= half_length) ? (peak_frame - half_length) : 0;
+	end_frame = peak_frame + half_length + 1;
+	if (end_frame > drift_measure_frame_ring_get_num_frames(history))
+		end_frame = drift_measure_frame_ring_get_num_frames(history);
+
+	neighbourhood.channel = channel;
+	neighbourhood.peak_frame = peak_frame;
+	neighbourhood.values = values;
+
+	if (!walk_history(detector, history, start_frame, end_frame - start_frame, copy_neighbourhood, &neighbourhood))
+		return 0.0;
+
+	return drift_measure_peak_interpolation_get_offset(detector->settings.peak_interpolation, values);
+}
+
+
+static int copy_window_samples(DriftMeasureDetector *detector, DriftMeasureFrameRing const *history, size_t position, size_t first_frame, size_t num_frames, void *user_data)
+{
+	WindowCopy const *window_copy = user_data;
+	size_t num_window_frames = drift_measure_cross_correlator_get_num_window_frames(detector->cross_correlator);
+	size_t sample_stride = drift_measure_frame_ring_get_frame_stride(history) / detector->history_bytes_per_sample;
+	unsigned int i;
+
+	for (i = 0; i < window_copy->num_channels; ++i)
+	{
+		unsigned int channel = window_copy->channels[i];
+
+		drift_measure_peak_kernels_normalize_samples(
+			detector->sample_format,
+			drift_measure_frame_ring_get_samples(history, channel, position),
+			sample_stride,
+			num_frames,
+			detector->window_samples + channel * num_window_frames + (first_frame - window_copy->window_start)
+		);
+	}
+
+	return 1;
+}
+
+
+static int set_reference_window(DriftMeasureDetector *detector, DriftMeasureFrameRing const *history, size_t window_start, size_t num_window_frames)
+{
+	/* Sets up cross_correlator and window_samples for windows with the
+	 * given number of frames, and sets the reference channel window. */
+
+	unsigned int num_channels = detector->settings.num_channels;
+	WindowCopy window_copy;
+
+	if ((detector->cross_correlator == NULL) || (drift_measure_cross_correlator_get_num_window_frames(detector->cross_correlator) != num_window_frames))
+	{
+		drift_measure_cross_correlator_free(detector->cross_correlator);
+		detector->cross_correlator = drift_measure_cross_correlator_new(num_window_frames);
+		if (detector->cross_correlator == NULL)
+			return 0;
+	}
+
+	if (detector->num_window_samples != (num_window_frames * num_channels))
+	{
+		free(detector->window_samples);
+		detector->num_window_samples = num_window_frames * num_channels;
+		detector->window_samples = malloc(detector->num_window_samples * sizeof(float));
+		if (detector->window_samples == NULL)
+		{
+			detector->num_window_samples = 0;
+			return 0;
+		}
+	}
+
+	window_copy.window_start = window_start;
+	window_copy.channels = &(detector->settings.reference_channel);
+	window_copy.num_channels = 1;
+
+	if (!walk_history(detector, history, window_start, num_window_frames, copy_window_samples, &window_copy))
+		return 0;
+
+	drift_measure_cross_correlator_set_reference(detector->cross_correlator, detector->window_samples + detector->settings.reference_channel * num_window_frames);
+
+	return 1;
+}
+
+
+static void run_analysis_task(void *data)
+{
+	/* Runs in the thread that pushes the frames, or in one of the threads
+	 * of the task runner. The history is not modified until all tasks are
+	 * finished, so reading it concurrently is safe. */
+
+	AnalysisTask *task = data;
+	DriftMeasureDetector *detector = task->detector;
+	unsigned int i;
+
+	if (detector->settings.detection_method == DRIFT_MEASURE_DETECTION_METHOD_CROSS_CORRELATION)
+	{
+		WindowCopy window_copy;
+		size_t num_window_frames = task->num_window_frames;
+		size_t max_lag = num_window_frames / 2;
+
+		window_copy.window_start = task->window_start;
+		window_copy.channels = task->channels;
+		window_copy.num_channels = task->num_channels;
+
+		walk_history(detector, task->history, task->window_start, num_window_frames, copy_window_samples, &window_copy);
+
+		if (task->correlator != detector->cross_correlator)
+			drift_measure_cross_correlator_copy_reference(task->correlator, detector->cross_correlator);
+
+		/* Correlate the channels in pairs, since the correlator
+		 * handles two channels with one pair of transforms. */
+		for (i = 0; i < task->num_channels; i += 2)
+		{
+			unsigned int first = task->channels[i];
+			int has_second = ((i + 1) < task->num_channels);
+			unsigned int second = has_second ? task->channels[i + 1] : 0;
+
+			drift_measure_cross_correlator_correlate(
+				task->correlator,
+				detector->window_samples + first * num_window_frames,
+				has_second ? (detector->window_samples + second * num_window_frames) : NULL,
+				max_lag,
+				detector->settings.peak_interpolation,
+				&(detector->channel_lags[first]),
+				has_second ? &(detector->channel_lags[second]) : NULL
+			);
+		}
+	}
+	else
+	{
+		for (i = 0; i < task->num_channels; ++i)
+		{
+			unsigned int channel = task->channels[i];
+			detector->channel_peak_offsets[channel] = get_interpolated_peak_offset(detector, task->history, channel, (size_t)(detector->channel_peaks[channel].largest_frame_index));
+		}
+	}
+}
+
+
+static int analyze_channels(DriftMeasureDetector *detector, DriftMeasureFrameRing const *history, size_t window_start, size_t num_window_frames)
+{
+	/* Computes the results of all non-reference channels that have a peak,
+	 * and stores them in channel_lags (with cross-correlation) or in
+	 * channel_peak_offsets (otherwise). The channels are split into
+	 * contiguous shares that are analyzed concurrently. Each channel is
+	 * analyzed the same way no matter which share it is in, so the results
+	 * do not depend on the number of shares. */
+
+	int correlate = (detector->settings.detection_method == DRIFT_MEASURE_DETECTION_METHOD_CROSS_CORRELATION);
+	unsigned int num_channels = detector->settings.num_channels;
+	unsigned int num_analysis_channels = 0, channels_per_task, num_tasks;
+	unsigned int channel, i;
+
+	for (channel = 0; channel < num_channels; ++channel)
+	{
+		if ((channel != detector->settings.reference_channel) && (detector->channel_peaks[channel].largest_frame_index != DRIFT_MEASURE_UNDEFINED_INDEX))
+			detector->analysis_channels[num_analysis_channels++] = channel;
+	}
+
+	if (num_analysis_channels == 0)
+		return 1;
+
+	if (correlate && !set_reference_window(detector, history, window_start, num_window_frames))
+		return 0;
+
+	/* Correlation shares get an even number of channels,
+	 * so that no correlator transform is half empty. */
+	channels_per_task = (num_analysis_channels + detector->num_shares - 1) / detector->num_shares;
+	if (correlate)
+		channels_per_task = (channels_per_task + 1) & ~1u;
+	num_tasks = (num_analysis_channels + channels_per_task - 1) / channels_per_task;
+
+	for (i = 0; i < num_tasks; ++i)
+	{
+		AnalysisTask *task = &(detector->tasks[i]);
+		unsigned int first_channel = i * channels_per_task;
+
+		task->detector = detector;
+		task->history = history;
+		task->channels = detector->analysis_channels + first_channel;
+		task->num_channels = num_analysis_channels - first_channel;
+		if (task->num_channels > channels_per_task)
+			task->num_channels = channels_per_task;
+		task->window_start = window_start;
+		task->num_window_frames = num_window_frames;
+
+		if (!correlate)
+			continue;
+
+		if (i == 0)
+		{
+			task->correlator = detector->cross_correlator;
+		}
+		else if ((task->correlator == NULL) || (drift_measure_cross_correlator_get_num_window_frames(task->correlator) != num_window_frames))
+		{
+			drift_measure_cross_correlator_free(task->correlator);
+			task->correlator = drift_measure_cross_correlator_new(num_window_frames);
+			if (task->correlator == NULL)
+				return 0;
+		}
+	}
+
+	if ((detector->run_tasks != NULL) && (num_tasks > 1))
+	{
+		detector->run_tasks(run_analysis_task, detector->task_pointers, num_tasks, detector->run_tasks_user_data);
+	}
+	else
+	{
+		for (i = 0; i < num_tasks; ++i)
+			run_analysis_task(&(detector->tasks[i]));
+	}
+
+	return 1;
+}
+
+
+static int analyze(DriftMeasureDetector *detector, DriftMeasureFrameRing const *history, size_t peak_frame_index, int64_t *drifts)
+{
+	/* Analyzes the window around the reference peak at peak_frame_index
+	 * in the given history, which is either the frame history or the
+	 * history of a window, and stores the drifts. */
+
+	unsigned int sample_rate = detector->settings.sample_rate;
+	unsigned int num_channels = detector->settings.num_channels;
+	size_t half_window_size_in_frames, window_start, num_window_frames;
+	double reference_peak_offset;
+	unsigned int channel;
+	unsigned int non_ref_channel;
+
+	/* Find the peaks of all channels in one pass over the window. Only the
+	 * frames within the window are looked at, even if there are more in the
+	 * history (which happens if many frames are pushed at once). Otherwise,
+	 * the next pulse could be mistaken for the peak of a channel, and the
+	 * results would depend on how many frames are pushed at once. The window
+	 * starts half a window before the reference peak; the search made sure
+	 * that there are enough frames before the peak for that. */
+	half_window_size_in_frames = detector->window_size_in_frames / 2;
+	assert(peak_frame_index >= half_window_size_in_frames);
+	window_start = peak_frame_index - half_window_size_in_frames;
+	num_window_frames = half_window_size_in_frames * 2;
+	assert((window_start + num_window_frames) <= drift_measure_frame_ring_get_num_frames(history));
+
+	for (channel = 0; channel < num_channels; ++channel)
+		detector->channel_peaks[channel].largest_frame_index = DRIFT_MEASURE_UNDEFINED_INDEX;
+
+	if (!walk_history(detector, history, window_start, num_window_frames, find_largest_frames, NULL))
+		return 0;
+
+	/* With cross-correlation, the peak search results are still used for
+	 * detecting channels without pulses, but the drift is given by the
+	 * correlation. Otherwise, if interpolation is enabled, the drift is
+	 * measured between the interpolated peak positions instead of the
+	 * peak frames. */
+	if (detector->settings.detection_method == DRIFT_MEASURE_DETECTION_METHOD_CROSS_CORRELATION)
+		reference_peak_offset = 0.0;
+	else
+		reference_peak_offset = get_interpolated_peak_offset(detector, history, detector->settings.reference_channel, peak_frame_index);
+
+	if (!analyze_channels(detector, history, window_start, num_window_frames))
+		return 0;
+
+	for (channel = 0, non_ref_channel = 0; channel < num_channels; ++channel)
+	{
+		uint64_t largest_frame_index;
+
+		/* Comparing the reference channel's peak against the
+		 * reference channel itself makes no sense, so skip it. */
+		if (channel == detector->settings.reference_channel)
+			continue;
+
+		largest_frame_index = detector->channel_peaks[channel].largest_frame_index;
+
+		if (largest_frame_index != DRIFT_MEASURE_UNDEFINED_INDEX)
+		{
+			/* The drift is the distance from the peak in this
+			 * channel to the peak in the reference channel. */
+			int64_t drift_in_frames = (int64_t)largest_frame_index - (int64_t)peak_frame_index;
+			int64_t drift_in_nanoseconds;
+
+			if ((detector->settings.detection_method != DRIFT_MEASURE_DETECTION_METHOD_CROSS_CORRELATION) && (detector->settings.peak_interpolation == DRIFT_MEASURE_PEAK_INTERPOLATION_NONE))
+			{
+				/* Scale the magnitude, since the scaling
+				 * only works with unsigned values. */
+				uint64_t magnitude = (uint64_t)((drift_in_frames < 0) ? -drift_in_frames : drift_in_frames);
+				drift_in_nanoseconds = (int64_t)frames_to_nanoseconds(magnitude, sample_rate) * ((drift_in_frames < 0) ? -1 : 1);
+			}
+			else
+			{
+				/* The drift is at most one window long, so a double
+				 * has plenty of precision for it. */
+				double fractional_drift_in_frames;
+
+				if (detector->settings.detection_method == DRIFT_MEASURE_DETECTION_METHOD_CROSS_CORRELATION)
+					fractional_drift_in_frames = detector->channel_lags[channel];
+				else
+					fractional_drift_in_frames = (double)drift_in_frames + (detector->channel_peak_offsets[channel] - reference_peak_offset);
+
+				drift_in_nanoseconds = (int64_t)floor(fractional_drift_in_frames * (double)NANOSECONDS_PER_SECOND / sample_rate + 0.5);
+			}
+
+			drifts[non_ref_channel] = drift_in_nanoseconds;
+		}
+		else
+		{
+			drifts[non_ref_channel] = DRIFT_MEASURE_DETECTOR_NO_DRIFT;
+		}
+
+		++non_ref_channel;
+	}
+
+	return 1;
+}
+
+
+static uint64_t get_peak_timestamp(DriftMeasureDetector *detector)
+{
+	/* Returns the timestamp of the current reference peak. The matched
+	 * filter output peaks at the end of the pulse, so the filter delay is
+	 * subtracted to get the position of the pulse in the pushed frames. */
+
+	uint64_t peak_frame_index = detector->peak_frame_index + detector->total_num_input_frames_seen;
+
+	peak_frame_index -= (peak_frame_index < detector->matched_filter_delay) ? peak_frame_index : detector->matched_filter_delay;
+
+	return frames_to_nanoseconds(peak_frame_index, detector->settings.sample_rate);
+}
+
+
+static int add_dataset(DriftMeasureDetector *detector)
+{
+	/* Analyzes the window around the current reference peak,
+	 * and appends the result to the pending datasets. */
+
+	size_t num_drifts = detector->settings.num_channels - 1;
+	size_t capacity = detector->datasets_capacity;
+	int analyzed;
+
+	if (!reserve_elements((void **)&(detector->dataset_timestamps), &capacity, detector->num_datasets + 1, sizeof(uint64_t)))
+		return 0;
+	capacity = detector->datasets_capacity;
+	if (!reserve_elements((void **)&(detector->dataset_drifts), &capacity, detector->num_datasets + 1, num_drifts * sizeof(int64_t)))
+		return 0;
+	detector->datasets_capacity = capacity;
+
+	STATS_TIMED(detector, analysis_time, analyzed = analyze(detector, detector->history, detector->peak_frame_index, detector->dataset_drifts + detector->num_datasets * num_drifts));
+	if (!analyzed)
+		return 0;
+	STATS_ADD(detector, num_windows_analyzed, 1);
+
+	detector->dataset_timestamps[detector->num_datasets] = get_peak_timestamp(detector);
+	++detector->num_datasets;
+
+	return 1;
+}
+
+
+static int add_window(DriftMeasureDetector *detector)
+{
+	/* Copies the frames around the current reference peak into a window,
+	 * and appends it to the pending windows. The window covers the analysis
+	 * window plus the neighbourhood needed for peak interpolation at its
+	 * edges. */
+
+	size_t margin = detector->window_size_in_frames / 2 + DRIFT_MEASURE_PEAK_INTERPOLATION_HALF_LENGTH;
+	size_t peak_frame_index = detector->peak_frame_index;
+	size_t first_frame, end_frame;
+	DriftMeasureDetectorWindow *window;
+
+	if (!reserve_elements((void **)&(detector->windows), &(detector->windows_capacity), detector->num_windows + 1, sizeof(DriftMeasureDetectorWindow *)))
+		return 0;
+
+	first_frame = (peak_frame_index >= margin) ? (peak_frame_index - margin) : 0;
+	end_frame = peak_frame_index + margin + 1;
+	if (end_frame > drift_measure_frame_ring_get_num_frames(detector->history))
+		end_frame = drift_measure_frame_ring_get_num_frames(detector->history);
+
+	window = calloc(1, sizeof(DriftMeasureDetectorWindow));
+	if (window == NULL)
+		return 0;
+
+	window->history = drift_measure_frame_ring_new(end_frame - first_frame, detector->settings.num_channels, detector->history_bytes_per_sample, detector->history_interleaved);
+	if (window->history == NULL)
+	{
+		free(window);
+		return 0;
+	}
+
+	drift_measure_frame_ring_append(window->history, detector->history, first_frame, end_frame - first_frame);
+	window->sample_format = detector->sample_format;
+	window->num_channels = detector->settings.num_channels;
+	window->interleaved = detector->history_interleaved;
+	window->peak_frame_index = peak_frame_index - first_frame;
+	window->timestamp = get_peak_timestamp(detector);
+
+	detector->windows[detector->num_windows++] = window;
+
+	return 1;
+}
+
+
+static int update_peak_candidates(DriftMeasureDetector *detector, DriftMeasureFrameRing const *history, size_t position, size_t first_frame, size_t num_frames, void *user_data)
+{
+	uint64_t first_frame_index = detector->total_num_input_frames_seen + first_frame;
+	DriftMeasureSampleFormat sample_format = detector->sample_format;
+	unsigned int reference_channel = detector->settings.reference_channel;
+	size_t frame_stride = drift_measure_frame_ring_get_frame_stride(history);
+	uint8_t const *samples;
+	unsigned int num_channels, channel;
+	size_t frame = 0;
+
+	(void)user_data;
+
+	/* The kernels see non-interleaved data as a single channel. */
+	if (detector->history_interleaved)
+	{
+		samples = drift_measure_frame_ring_get_samples(history, 0, position);
+		num_channels = detector->settings.num_channels;
+		channel = reference_channel;
+	}
+	else
+	{
+		samples = drift_measure_frame_ring_get_samples(history, reference_channel, position);
+		num_channels = 1;
+		channel = 0;
+	}
+
+	while (1)
+	{
+		PeakCandidate *candidate;
+		double sample;
+
+		/* Skip the frames that are below the threshold (which are the
+		 * vast majority) with the vectorized kernel. */
+		frame += detector->peak_kernels->find_first_frame_above_threshold(samples + frame * frame_stride, num_channels, channel, num_frames - frame, detector->native_peak_threshold);
+		if (frame >= num_frames)
+			break;
+
+		sample = drift_measure_peak_kernels_normalize_value(
+			sample_format,
+			drift_measure_peak_kernels_read_sample(sample_format, drift_measure_frame_ring_get_samples(history, reference_channel, position + frame))
+		);
+
+		/* Candidates with smaller values than this sample can never
+		 * become the peak again, since this sample is larger and is
+		 * retained in the history at least as long as they are. */
+		while ((detector->num_candidates > 0) && (detector->candidates[detector->num_candidates - 1].value < sample))
+			--detector->num_candidates;
+
+		if (!reserve_elements((void **)&(detector->candidates), &(detector->candidates_capacity), detector->num_candidates + 1, sizeof(PeakCandidate)))
+			return 0;
+
+		candidate = &(detector->candidates[detector->num_candidates++]);
+		candidate->frame_index = first_frame_index + frame;
+		candidate->value = sample;
+
+		++frame;
+	}
+
+	detector->num_frames_scanned += num_frames;
+
+	return 1;
+}
+
+
+static int scan_for_peak(DriftMeasureDetector *detector, size_t num_available_frames, uint64_t *peak_frame_index)
+{
+	uint64_t history_start = detector->total_num_input_frames_seen;
+	size_t first_unscanned_frame;
+
+	assert(num_available_frames > 0);
+	assert(detector->search_scan_position >= history_start);
+
+	*peak_frame_index = DRIFT_MEASURE_UNDEFINED_INDEX;
+
+	/* Only examine frames that were added to the history since the last
+	 * scan. The outcome of previous scans is in the peak candidates. */
+	first_unscanned_frame = (size_t)(detector->search_scan_position - history_start);
+	if (first_unscanned_frame < num_available_frames)
+	{
+		size_t num_unscanned_frames = num_available_frames - first_unscanned_frame;
+		int walked;
+
+		STATS_TIMED(detector, scan_time, walked = walk_history(detector, detector->history, first_unscanned_frame, num_unscanned_frames, update_peak_candidates, NULL));
+		if (!walked)
+			return 0;
+
+		detector->search_scan_position += num_unscanned_frames;
+		STATS_ADD(detector, num_frames_scanned, num_unscanned_frames);
+	}
+
+	assert(detector->num_frames_scanned == detector->num_frames_received);
+
+	if (detector->num_candidates > 0)
+		*peak_frame_index = detector->candidates[0].frame_index - history_start;
+
+	return 1;
+}
+
+
+static void discard_history_frames(DriftMeasureDetector *detector, size_t num_frames)
+{
+	size_t num_stale_candidates = 0;
+
+	if (num_frames > drift_measure_frame_ring_get_num_frames(detector->history))
+		num_frames = drift_measure_frame_ring_get_num_frames(detector->history);
+
+	drift_measure_frame_ring_discard(detector->history, num_frames);
+	detector->total_num_input_frames_seen += num_frames;
+	STATS_ADD(detector, num_frames_discarded, num_frames);
+
+	/* Candidates that were in the discarded frames are gone. The first of
+	 * the remaining ones is the peak of the rest of the examined frames. */
+	while ((num_stale_candidates < detector->num_candidates) && (detector->candidates[num_stale_candidates].frame_index < detector->total_num_input_frames_seen))
+		++num_stale_candidates;
+	if (num_stale_candidates > 0)
+	{
+		detector->num_candidates -= num_stale_candidates;
+		memmove(detector->candidates, detector->candidates + num_stale_candidates, detector->num_candidates * sizeof(PeakCandidate));
+	}
+
+	if (detector->search_scan_position < detector->total_num_input_frames_seen)
+		detector->search_scan_position = detector->total_num_input_frames_seen;
+}
+
+
+static void reset_to_search_mode(DriftMeasureDetector *detector)
+{
+	/* Flush the data around the peak that was last discovered. Everything
+	 * before the peak plus half the pulse size is discarded, to make sure
+	 * this same peak is not accidentally rediscovered. */
+	discard_history_frames(detector, detector->peak_frame_index + detector->pulse_length_in_frames / 2);
+	detector->peak_frame_index = 0;
+	detector->analyzing = 0;
+}
+
+
+static int process_history(DriftMeasureDetector *detector)
+{
+	/* Searches the history for peaks and analyzes them, until
+	 * more frames are needed. */
+
+	size_t half_window_size_in_frames = detector->window_size_in_frames / 2;
+
+	while (1)
+	{
+		size_t num_available_frames = drift_measure_frame_ring_get_num_frames(detector->history);
+		if (num_available_frames == 0)
+			break;
+
+		if (!detector->analyzing)
+		{
+			uint64_t peak_frame_index;
+			size_t max_num_frames_before_peak = half_window_size_in_frames + DRIFT_MEASURE_PEAK_INTERPOLATION_HALF_LENGTH;
+
+			if (!scan_for_peak(detector, num_available_frames, &peak_frame_index))
+				return 0;
+
+			if ((peak_frame_index != DRIFT_MEASURE_UNDEFINED_INDEX) && (peak_frame_index > max_num_frames_before_peak))
+			{
+				/* The analysis only needs half a window (plus the
+				 * neighbourhood for peak interpolation) before the
+				 * peak. Older frames can be discarded right away,
+				 * since the peak never moves backwards: a new peak
+				 * candidate replaces the current one only if it is
+				 * larger, and it is always newer. This keeps enough
+				 * room in the history for the frames after the peak. */
+
+				size_t num_excess_frames = (size_t)peak_frame_index - max_num_frames_before_peak;
+				discard_history_frames(detector, num_excess_frames);
+				peak_frame_index -= num_excess_frames;
+				num_available_frames -= num_excess_frames;
+			}
+
+			if (peak_frame_index == DRIFT_MEASURE_UNDEFINED_INDEX)
+			{
+				/* No peak was found anywhere. To avoid unnecessary
+				 * processing and prevent the history from getting too
+				 * large, discard the frames that were looked at, except
+				 * for the newest ones, since the next search needs
+				 * enough frames to cover the window before a peak. */
+				if (num_available_frames >= half_window_size_in_frames)
+					discard_history_frames(detector, num_available_frames - half_window_size_in_frames);
+
+				STATS_ADD(detector, num_searches_without_peak, 1);
+				break;
+			}
+			else if (peak_frame_index < half_window_size_in_frames)
+			{
+				size_t num_frames_to_discard;
+
+				/* A peak within the first half of the window cannot be
+				 * used, for two reasons:
+				 *
+				 * #1: The "peak" may actually just be a maximum of a
+				 * clipped pulse. For example, suppose that the pulse
+				 * started 500 us before the first frame. Then the first
+				 * 500 us of the pulse are missing, and the peak found
+				 * may not be the "real" peak of the pulse.
+				 *
+				 * #2: Pulses in non-reference channels may be drifting
+				 * both backwards and forwards. In order to be able to
+				 * properly detect both, there must be enough frames
+				 * before and after the pulse. */
+
+				/* Discard at least the peak frame itself, so that
+				 * the search progresses even with very short pulses. */
+				num_frames_to_discard = (size_t)peak_frame_index + ((detector->pulse_length_in_frames / 2 > 0) ? (detector->pulse_length_in_frames / 2) : 1);
+				if (num_frames_to_discard > num_available_frames)
+					num_frames_to_discard = num_available_frames;
+
+				discard_history_frames(detector, num_frames_to_discard);
+
+				STATS_ADD(detector, num_peaks_too_early, 1);
+				break;
+			}
+			else if ((num_available_frames - peak_frame_index) < detector->pulse_length_in_frames)
+			{
+				/* The peak is too close to the end of the history. It may
+				 * not be the true peak, since the rest of the pulse may
+				 * only come with the next frames. This happens when the
+				 * source captured only the first part of the pulse in one
+				 * buffer, and the rest in the next one. If the distance to
+				 * the end is smaller than the pulse length, the peak is
+				 * ignored for now. No frames are discarded, so once the
+				 * next frames are appended, the full pulse is in the
+				 * history and can be properly analyzed. */
+				STATS_ADD(detector, num_peaks_near_history_end, 1);
+				break;
+			}
+			else
+			{
+				/* There is a peak with enough frames before it. Gather
+				 * frames until there are also enough _after_ it. */
+				detector->peak_frame_index = (size_t)peak_frame_index;
+				detector->analyzing = 1;
+			}
+		}
+		else
+		{
+			/* Once there are enough frames after the peak, both before
+			 * and after the peak there are enough frames for analysis. */
+			if ((num_available_frames - detector->peak_frame_index) < half_window_size_in_frames)
+				break;
+
+			if (!(detector->deferred_analysis ? add_window(detector) : add_dataset(detector)))
+				return 0;
+
+			reset_to_search_mode(detector);
+		}
+	}
+
+	return 1;
+}
+
+
+static int filter_frames(DriftMeasureDetector *detector, uint8_t const *data, size_t frame_stride, size_t const *channel_offsets, size_t num_input_frames, size_t *num_output_frames)
+{
+	/* Runs the pushed frames through the matched filter, and stores the
+	 * non-interleaved F32 filter output, with one plane of num_output_frames
+	 * values per channel, in filter_output. Since the filter produces output
+	 * in block sized runs, there can be no output frames at all. */
+
+	unsigned int num_channels = detector->settings.num_channels;
+	size_t bytes_per_sample = get_bytes_per_sample(detector->settings.sample_format);
+	unsigned int channel;
+
+	/* Normalize and deinterleave the input samples, since
+	 * the filter expects them in that form. */
+	if (!reserve_elements((void **)&(detector->filter_input), &(detector->filter_input_size), num_input_frames * num_channels, sizeof(float)))
+		return 0;
+
+	for (channel = 0; channel < num_channels; ++channel)
+	{
+		drift_measure_peak_kernels_normalize_samples(
+			detector->settings.sample_format,
+			data + channel_offsets[channel],
+			frame_stride / bytes_per_sample,
+			num_input_frames,
+			detector->filter_input + channel * num_input_frames
+		);
+	}
+
+	*num_output_frames = drift_measure_matched_filter_get_num_output_frames(detector->matched_filter, num_input_frames);
+	if (!reserve_elements((void **)&(detector->filter_output), &(detector->filter_output_size), *num_output_frames * num_channels, sizeof(float)))
+		return 0;
+
+	drift_measure_matched_filter_process(
+		detector->matched_filter,
+		detector->filter_input,
+		num_input_frames,
+		num_input_frames,
+		detector->filter_output,
+		*num_output_frames
+	);
+
+	return 1;
+}
+
+
+int drift_measure_detector_push_frames(DriftMeasureDetector *detector, void const *data, size_t frame_stride, size_t const *channel_offsets, size_t num_frames)
+{
+	uint8_t const *bytes = data;
+	size_t frame = 0;
+
+	STATS_ADD(detector, num_frames_pushed, num_frames);
+
+	if (detector->matched_filter != NULL)
+	{
+		/* Process the filter output instead of the pushed frames. */
+		unsigned int channel;
+		int filtered;
+
+		STATS_TIMED(detector, filter_time, filtered = filter_frames(detector, bytes, frame_stride, channel_offsets, num_frames, &num_frames));
+		if (!filtered)
+			return 0;
+
+		bytes = (uint8_t const *)(detector->filter_output);
+		frame_stride = sizeof(float);
+		for (channel = 0; channel < detector->settings.num_channels; ++channel)
+			detector->filter_channel_offsets[channel] = channel * num_frames * sizeof(float);
+		channel_offsets = detector->filter_channel_offsets;
+	}
+
+	/* Copy the frames into the history in portions that fit,
+	 * and process each portion before copying the next one. */
+	while (frame < num_frames)
+	{
+		size_t num_copied_frames;
+
+		STATS_TIMED(detector, copy_time, num_copied_frames = drift_measure_frame_ring_write(detector->history, bytes + frame * frame_stride, frame_stride, channel_offsets, num_frames - frame));
+
+		/* process_history() always leaves room for new frames. */
+		assert(num_copied_frames > 0);
+		if (num_copied_frames == 0)
+			return 0;
+
+		frame += num_copied_frames;
+		detector->num_frames_received = detector->total_num_input_frames_seen + drift_measure_frame_ring_get_num_frames(detector->history);
+
+		if (!process_history(detector))
+			return 0;
+	}
+
+	return 1;
+}
+
+
+int drift_measure_detector_pull_dataset(DriftMeasureDetector *detector, uint64_t *timestamp, int64_t *drifts)
+{
+	size_t num_drifts = detector->settings.num_channels - 1;
+
+	if (detector->first_dataset >= detector->num_datasets)
+		return 0;
+
+	*timestamp = detector->dataset_timestamps[detector->first_dataset];
+	memcpy(drifts, detector->dataset_drifts + detector->first_dataset * num_drifts, num_drifts * sizeof(int64_t));
+
+	/* Once all datasets are pulled, the storage is reused from the start. */
+	if (++detector->first_dataset == detector->num_datasets)
+	{
+		detector->first_dataset = 0;
+		detector->num_datasets = 0;
+	}
+
+	return 1;
+}
+
+
+DriftMeasureDetectorWindow * drift_measure_detector_pull_window(DriftMeasureDetector *detector)
+{
+	DriftMeasureDetectorWindow *window;
+
+	if (detector->first_window >= detector->num_windows)
+		return NULL;
+
+	window = detector->windows[detector->first_window];
+
+	if (++detector->first_window == detector->num_windows)
+	{
+		detector->first_window = 0;
+		detector->num_windows = 0;
+	}
+
+	return window;
+}
+
+
+void drift_measure_detector_window_free(DriftMeasureDetectorWindow *window)
+{
+	if (window == NULL)
+		return;
+
+	drift_measure_frame_ring_free(window->history);
+	free(window);
+}
+
+
+int drift_measure_detector_analyze_window(DriftMeasureDetector *detector, DriftMeasureDetectorWindow const *window, uint64_t *timestamp, int64_t *drifts)
+{
+	size_t half_window_size_in_frames = detector->window_size_in_frames / 2;
+	int analyzed;
+
+	if ((window->sample_format != detector->sample_format) || (window->num_channels != detector->settings.num_channels) || (!(window->interleaved) != !(detector->history_interleaved)))
+		return 0;
+
+	/* With a different window size, the window may not contain the whole analysis window. */
+	if ((window->peak_frame_index < half_window_size_in_frames) || ((window->peak_frame_index + half_window_size_in_frames) > drift_measure_frame_ring_get_num_frames(window->history)))
+		return 0;
+
+	STATS_TIMED(detector, analysis_time, analyzed = analyze(detector, window->history, window->peak_frame_index, drifts));
+	if (!analyzed)
+		return 0;
+	STATS_ADD(detector, num_windows_analyzed, 1);
+
+	*timestamp = window->timestamp;
+
+	return 1;
+}
+
+
+int drift_measure_detector_get_stats(DriftMeasureDetector const *detector, DriftMeasureDetectorStats *stats)
+{
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	*stats = detector->stats;
+	return 1;
+#else
+	(void)detector;
+	memset(stats, 0, sizeof(DriftMeasureDetectorStats));
+	return 0;
+#endif
+}
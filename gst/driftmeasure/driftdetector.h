@@ -0,0 +1,233 @@
+#ifndef DRIFTDETECTOR_H
+#define DRIFTDETECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "peakkernels.h"
+#include "peakinterpolation.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Pulse detection and drift measurement.
+ *
+ * This is the complete measurement logic of the driftmeasure element,
+ * without any GStreamer specifics. Frames are pushed into the detector,
+ * which keeps them in a fixed size history and searches it for pulses in
+ * the reference channel. Once there is a whole window around such a pulse,
+ * the pulses in the other channels are located, and a dataset with the
+ * drift of each of these channels relative to the reference channel is
+ * produced. Datasets are then pulled out of the detector.
+ *
+ * All state is in the DriftMeasureDetector instance; there are no globals,
+ * so any number of detectors can be used at the same time. A detector must
+ * not be used by several threads at the same time though.
+ *
+ * Analyzing the window around a pulse can be deferred. The detector then
+ * only searches for pulses, and puts a copy of the frames around each one
+ * into a window that can be pulled out and analyzed later, for example by
+ * another thread (which must not use the detector concurrently with the
+ * thread that pushes frames).
+ *
+ * This detector does not depend on GStreamer or GLib. */
+
+
+/* Drift of a channel in which no pulse was found. */
+#define DRIFT_MEASURE_DETECTOR_NO_DRIFT INT64_MIN
+
+
+typedef enum
+{
+	/* Position of the largest sample in each channel. */
+	DRIFT_MEASURE_DETECTION_METHOD_PEAK,
+	/* Cross-correlation of each channel with the reference channel. The
+	 * peak search is still used for finding out which channels contain
+	 * a pulse at all. */
+	DRIFT_MEASURE_DETECTION_METHOD_CROSS_CORRELATION,
+	/* Position of the largest output value of a filter matched to the
+	 * pulse shape. The filter output replaces the input frames. */
+	DRIFT_MEASURE_DETECTION_METHOD_MATCHED_FILTER
+}
+DriftMeasureDetectionMethod;
+
+
+typedef struct
+{
+	/* Format of the pushed frames. */
+	DriftMeasureSampleFormat sample_format;
+	/* Must be at least 2. */
+	unsigned int num_channels;
+	unsigned int sample_rate;
+	/* Nonzero if the pushed frames are interleaved. The history then
+	 * stores them interleaved as well, which makes copying them cheaper. */
+	int interleaved;
+
+	/* Length of the window around a pulse, in nanoseconds. Drifts of up
+	 * to half a window in either direction can be measured. */
+	uint64_t window_size;
+	/* Length of a pulse, in nanoseconds. */
+	uint64_t pulse_length;
+	/* Minimum value of a pulse peak, in the -1.0 .. 1.0 range. */
+	float peak_threshold;
+	/* Must be less than num_channels. */
+	unsigned int reference_channel;
+	DriftMeasureDetectionMethod detection_method;
+	DriftMeasurePeakInterpolation peak_interpolation;
+
+	/* Template for the matched filter, with pulse_template_length values.
+	 * If pulse_template is NULL, a sine of pulse_frequency Hz, pulse_length
+	 * long, is used as template. The template is copied by the filter. */
+	float const *pulse_template;
+	size_t pulse_template_length;
+	double pulse_frequency;
+}
+DriftMeasureDetectorSettings;
+
+
+/* Counters and timings that show where the time goes, and why pulses
+ * are not detected. They are only gathered if the detector was built
+ * with DRIFT_MEASURE_INSTRUMENTATION defined. Times are in nanoseconds
+ * of the monotonic clock; each stage is timed once per call, not once
+ * per frame, so the overhead does not depend on the buffer size. */
+typedef struct
+{
+	/* Frames that were pushed into the detector. */
+	uint64_t num_frames_pushed;
+	/* Frames that were examined by the reference peak search. With the
+	 * matched filter, these are filter output frames. */
+	uint64_t num_frames_scanned;
+	/* Frames that were discarded from the history. */
+	uint64_t num_frames_discarded;
+	/* Reference peaks that were rejected because they were within the
+	 * first half window of the history. */
+	uint64_t num_peaks_too_early;
+	/* Reference peaks that were too close to the end of the history,
+	 * so that the search waited for more frames. */
+	uint64_t num_peaks_near_history_end;
+	/* Searches that found no reference peak in the history. */
+	uint64_t num_searches_without_peak;
+	/* Windows that were analyzed, including deferred ones. */
+	uint64_t num_windows_analyzed;
+
+	/* Time spent running the pushed frames through the matched filter. */
+	uint64_t filter_time;
+	/* Time spent copying frames into the history. */
+	uint64_t copy_time;
+	/* Time spent searching for reference peaks. */
+	uint64_t scan_time;
+	/* Time spent analyzing windows, including deferred ones. */
+	uint64_t analysis_time;
+}
+DriftMeasureDetectorStats;
+
+
+typedef struct _DriftMeasureDetector DriftMeasureDetector;
+typedef struct _DriftMeasureDetectorWindow DriftMeasureDetectorWindow;
+
+
+/* Function that analyzes a share of the channels of one window. */
+typedef void (*DriftMeasureDetectorTaskFunc)(void *task);
+
+/* Function that calls func for each of the num_tasks tasks, and returns
+ * once all of them are finished. The tasks are independent of each other,
+ * so they can run concurrently. The detector is not modified until they
+ * are finished. */
+typedef void (*DriftMeasureDetectorRunTasksFunc)(DriftMeasureDetectorTaskFunc func, void * const *tasks, unsigned int num_tasks, void *user_data);
+
+
+/* Fills settings with the defaults of the driftmeasure element.
+ * sample_rate and num_channels still have to be set. */
+void drift_measure_detector_settings_init(DriftMeasureDetectorSettings *settings);
+
+/* Creates a detector with the given settings. Returns NULL if the settings
+ * are invalid, or if memory is exhausted. If the matched filter cannot be
+ * created because the template is silent (which happens if the pulse
+ * frequency is a multiple of the sample rate, for example), the pushed
+ * frames are used directly instead of the filter output; see
+ * drift_measure_detector_uses_matched_filter(). */
+DriftMeasureDetector * drift_measure_detector_new(DriftMeasureDetectorSettings const *settings);
+
+void drift_measure_detector_free(DriftMeasureDetector *detector);
+
+/* Discards all frames, pending datasets and windows, as if the
+ * detector had just been created. */
+void drift_measure_detector_reset(DriftMeasureDetector *detector);
+
+/* Returns nonzero if the history contains the matched filter output. */
+int drift_measure_detector_uses_matched_filter(DriftMeasureDetector const *detector);
+
+/* Returns the delay of the matched filter output, in frames, or 0
+ * if the matched filter is not used. Timestamps are corrected for
+ * this delay, but the first datasets come that much later. */
+size_t drift_measure_detector_get_matched_filter_delay(DriftMeasureDetector const *detector);
+
+/* Returns the number of bytes that were allocated for the frame history. */
+size_t drift_measure_detector_get_history_memory_size(DriftMeasureDetector const *detector);
+
+/* Returns the name of the peak search kernels in use, for logging purposes. */
+char const * drift_measure_detector_get_peak_kernels_name(DriftMeasureDetector const *detector);
+
+/* Changes the peak interpolation method. Unlike the other settings,
+ * this does not require a new detector. */
+void drift_measure_detector_set_peak_interpolation(DriftMeasureDetector *detector, DriftMeasurePeakInterpolation peak_interpolation);
+
+/* Splits the analysis of the non-reference channels of a window into
+ * num_shares shares, which are run by run_tasks. By default, there is
+ * one share, which is analyzed directly. Returns zero if memory is
+ * exhausted. */
+int drift_measure_detector_set_task_runner(DriftMeasureDetector *detector, unsigned int num_shares, DriftMeasureDetectorRunTasksFunc run_tasks, void *user_data);
+
+/* If deferred is nonzero, windows around pulses are not analyzed while
+ * frames are pushed, but copied, and have to be pulled out with
+ * drift_measure_detector_pull_window(). */
+void drift_measure_detector_set_deferred_analysis(DriftMeasureDetector *detector, int deferred);
+
+/* Adds num_frames frames to the detector and processes them. The sample
+ * of channel C in frame F is read from:
+ *
+ *   data + channel_offsets[C] + F * frame_stride
+ *
+ * Each pulse that is found produces a dataset, or a window if the analysis
+ * is deferred. Returns zero if memory is exhausted; the detector then has
+ * to be reset. */
+int drift_measure_detector_push_frames(DriftMeasureDetector *detector, void const *data, size_t frame_stride, size_t const *channel_offsets, size_t num_frames);
+
+/* Takes the oldest pending dataset out of the detector. Its timestamp is
+ * the position of the reference pulse, in nanoseconds since the first
+ * frame that was pushed after the detector was created or reset. drifts
+ * must have room for num_channels-1 values, which are set to the drifts
+ * of the non-reference channels in nanoseconds, in channel order, or to
+ * DRIFT_MEASURE_DETECTOR_NO_DRIFT for channels without a pulse. A positive
+ * drift means that the pulse came later than in the reference channel.
+ * Returns zero if there is no pending dataset. */
+int drift_measure_detector_pull_dataset(DriftMeasureDetector *detector, uint64_t *timestamp, int64_t *drifts);
+
+/* Takes the oldest pending window out of the detector, or returns NULL if
+ * there is none. The window has its own copy of the frames around the
+ * pulse, so it stays valid after the detector is reset or freed. */
+DriftMeasureDetectorWindow * drift_measure_detector_pull_window(DriftMeasureDetector *detector);
+
+void drift_measure_detector_window_free(DriftMeasureDetectorWindow *window);
+
+/* Analyzes a window, and stores the dataset in timestamp and drifts, just
+ * like drift_measure_detector_pull_dataset() does. Returns zero if the
+ * window does not fit the detector, that is, if it was pulled out of a
+ * detector with different settings, or if memory is exhausted. */
+int drift_measure_detector_analyze_window(DriftMeasureDetector *detector, DriftMeasureDetectorWindow const *window, uint64_t *timestamp, int64_t *drifts);
+
+/* Copies the stats that were gathered since the detector was created
+ * into stats; drift_measure_detector_reset() does not clear them. If the
+ * detector was built without instrumentation, stats is zeroed, and zero
+ * is returned. */
+int drift_measure_detector_get_stats(DriftMeasureDetector const *detector, DriftMeasureDetectorStats *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DRIFTDETECTOR_H */
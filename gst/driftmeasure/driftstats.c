@@ -0,0 +1,259 @@
+#include <math.h>
+#include <stdlib.h>
+#include "driftstats.h"
+
+
+typedef struct
+{
+	/* Welford state of the current interval. */
+	uint64_t count;
+	double mean;
+	double m2;
+	int64_t min;
+	int64_t max;
+
+	int has_ewma;
+	double ewma;
+
+	/* Ring of the last window_length (timestamp, drift) pairs. */
+	uint64_t *window_timestamps;
+	int64_t *window_drifts;
+	size_t window_head;
+	size_t window_fill;
+}
+ChannelState;
+
+
+struct _DriftMeasureDriftStats
+{
+	unsigned int num_channels;
+	size_t window_length;
+	double ewma_weight;
+
+	uint64_t num_interval_measurements;
+	uint64_t interval_start;
+	uint64_t interval_end;
+
+	ChannelState *channels;
+};
+
+
+DriftMeasureDriftStats * drift_measure_drift_stats_new(unsigned int num_channels, size_t window_length, double ewma_weight)
+{
+	DriftMeasureDriftStats *stats;
+	unsigned int channel;
+
+	if ((num_channels == 0) || (window_length < 2) || !(ewma_weight >= 0.0) || !(ewma_weight <= 1.0))
+		return NULL;
+
+	stats = calloc(1, sizeof(DriftMeasureDriftStats));
+	if (stats == NULL)
+		return NULL;
+
+	stats->num_channels = num_channels;
+	stats->window_length = window_length;
+	stats->ewma_weight = ewma_weight;
+
+	stats->channels = calloc(num_channels, sizeof(ChannelState));
+	if (stats->channels == NULL)
+		goto error;
+
+	for (channel = 0; channel < num_channels; ++channel)
+	{
+		ChannelState *state = &(stats->channels[channel]);
+
+		state->window_timestamps = malloc(window_length * sizeof(uint64_t));
+		state->window_drifts = malloc(window_length * sizeof(int64_t));
+		if ((state->window_timestamps == NULL) || (state->window_drifts == NULL))
+			goto error;
+	}
+
+	drift_measure_drift_stats_reset(stats);
+
+	return stats;
+
+error:
+	drift_measure_drift_stats_free(stats);
+	return NULL;
+}
+
+
+void drift_measure_drift_stats_free(DriftMeasureDriftStats *stats)
+{
+	unsigned int channel;
+
+	if (stats == NULL)
+		return;
+
+	if (stats->channels != NULL)
+	{
+		for (channel = 0; channel < stats->num_channels; ++channel)
+		{
+			free(stats->channels[channel].window_timestamps);
+			free(stats->channels[channel].window_drifts);
+		}
+
+		free(stats->channels);
+	}
+
+	free(stats);
+}
+
+
+void drift_measure_drift_stats_reset(DriftMeasureDriftStats *stats)
+{
+	unsigned int channel;
+
+	for (channel = 0; channel < stats->num_channels; ++channel)
+	{
+		ChannelState *state = &(stats->channels[channel]);
+		state->has_ewma = 0;
+		state->ewma = 0.0;
+		state->window_head = 0;
+		state->window_fill = 0;
+	}
+
+	drift_measure_drift_stats_start_interval(stats);
+}
+
+
+void drift_measure_drift_stats_start_interval(DriftMeasureDriftStats *stats)
+{
+	unsigned int channel;
+
+	stats->num_interval_measurements = 0;
+
+	for (channel = 0; channel < stats->num_channels; ++channel)
+	{
+		ChannelState *state = &(stats->channels[channel]);
+		state->count = 0;
+		state->mean = 0.0;
+		state->m2 = 0.0;
+		state->min = INT64_MAX;
+		state->max = INT64_MIN;
+	}
+}
+
+
+void drift_measure_drift_stats_add(DriftMeasureDriftStats *stats, uint64_t timestamp, int64_t const *drifts)
+{
+	unsigned int channel;
+
+	if (stats->num_interval_measurements == 0)
+		stats->interval_start = timestamp;
+	stats->interval_end = timestamp;
+	stats->num_interval_measurements++;
+
+	for (channel = 0; channel < stats->num_channels; ++channel)
+	{
+		ChannelState *state = &(stats->channels[channel]);
+		int64_t drift = drifts[channel];
+		double delta;
+		size_t position;
+
+		if (drift == DRIFT_MEASURE_DRIFT_STATS_NO_VALUE)
+			continue;
+
+		/* Welford's algorithm. */
+		state->count++;
+		delta = drift - state->mean;
+		state->mean += delta / state->count;
+		state->m2 += delta * (drift - state->mean);
+
+		if (drift < state->min)
+			state->min = drift;
+		if (drift > state->max)
+			state->max = drift;
+
+		if (state->has_ewma)
+			state->ewma += stats->ewma_weight * (drift - state->ewma);
+		else
+		{
+			state->ewma = drift;
+			state->has_ewma = 1;
+		}
+
+		/* Append to the window, replacing the oldest pair if it is full. */
+		position = (state->window_head + state->window_fill) % stats->window_length;
+		state->window_timestamps[position] = timestamp;
+		state->window_drifts[position] = drift;
+		if (state->window_fill < stats->window_length)
+			state->window_fill++;
+		else
+			state->window_head = (state->window_head + 1) % stats->window_length;
+	}
+}
+
+
+uint64_t drift_measure_drift_stats_get_num_interval_measurements(DriftMeasureDriftStats const *stats)
+{
+	return stats->num_interval_measurements;
+}
+
+
+uint64_t drift_measure_drift_stats_get_interval_start(DriftMeasureDriftStats const *stats)
+{
+	return stats->interval_start;
+}
+
+
+uint64_t drift_measure_drift_stats_get_interval_end(DriftMeasureDriftStats const *stats)
+{
+	return stats->interval_end;
+}
+
+
+void drift_measure_drift_stats_get(DriftMeasureDriftStats const *stats, unsigned int channel, DriftMeasureChannelStats *channel_stats)
+{
+	ChannelState const *state = &(stats->channels[channel]);
+	size_t i;
+
+	channel_stats->count = state->count;
+	channel_stats->mean = state->mean;
+	channel_stats->stddev = (state->count > 1) ? sqrt(state->m2 / (state->count - 1)) : 0.0;
+	channel_stats->min = state->min;
+	channel_stats->max = state->max;
+
+	channel_stats->has_ewma = state->has_ewma;
+	channel_stats->ewma = state->ewma;
+
+	channel_stats->has_slope = 0;
+	channel_stats->slope_ppm = 0.0;
+
+	if (state->window_fill >= 2)
+	{
+		/* Timestamps are made relative to the oldest one before they
+		 * are converted to floating point, to keep their precision. Two
+		 * passes (means first, then the sums of products) avoid the
+		 * cancellation of the single pass formula. */
+		uint64_t base_timestamp = state->window_timestamps[state->window_head];
+		double mean_t = 0.0, mean_d = 0.0, sum_tt = 0.0, sum_td = 0.0;
+
+		for (i = 0; i < state->window_fill; ++i)
+		{
+			size_t position = (state->window_head + i) % stats->window_length;
+			mean_t += (double)(state->window_timestamps[position] - base_timestamp);
+			mean_d += (double)(state->window_drifts[position]);
+		}
+
+		mean_t /= state->window_fill;
+		mean_d /= state->window_fill;
+
+		for (i = 0; i < state->window_fill; ++i)
+		{
+			size_t position = (state->window_head + i) % stats->window_length;
+			double t = (double)(state->window_timestamps[position] - base_timestamp) - mean_t;
+			double d = (double)(state->window_drifts[position]) - mean_d;
+			sum_tt += t * t;
+			sum_td += t * d;
+		}
+
+		if (sum_tt > 0.0)
+		{
+			/* Drift and timestamps are both in nanoseconds,
+			 * so the slope is a ratio; scale it to ppm. */
+			channel_stats->slope_ppm = sum_td / sum_tt * 1e6;
+			channel_stats->has_slope = 1;
+		}
+	}
+}
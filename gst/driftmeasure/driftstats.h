@@ -0,0 +1,95 @@
+#ifndef DRIFTSTATS_H
+#define DRIFTSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Online statistics over the drift measurements of several channels.
+ *
+ * Measurements are added one at a time, as a timestamp and one drift per
+ * channel (all in nanoseconds). Missing drifts are passed as
+ * DRIFT_MEASURE_DRIFT_STATS_NO_VALUE and ignored. For each channel, this
+ * keeps track of:
+ *
+ * - the number of drifts, their mean and standard deviation (computed with
+ *   Welford's algorithm), and their minimum and maximum, since the start of
+ *   the current interval, which is started by
+ *   drift_measure_drift_stats_start_interval()
+ * - an exponentially weighted moving average of all drifts
+ * - the least squares slope of the drift over the timestamps of the last
+ *   window_length drifts, in ppm; this is how much faster or slower the
+ *   clock of the channel runs compared to the one of the reference channel
+ *
+ * These statistics do not depend on GStreamer or GLib. */
+
+
+#define DRIFT_MEASURE_DRIFT_STATS_NO_VALUE INT64_MIN
+
+
+typedef struct _DriftMeasureDriftStats DriftMeasureDriftStats;
+
+
+typedef struct
+{
+	/* Number of drifts in the current interval. The mean, standard
+	 * deviation, minimum, and maximum are only valid if this is nonzero. */
+	uint64_t count;
+	double mean;
+	double stddev;
+	int64_t min;
+	int64_t max;
+
+	/* Valid if has_ewma is nonzero, that is, if there were any drifts so far. */
+	int has_ewma;
+	double ewma;
+
+	/* Valid if has_slope is nonzero, that is, if the window contains
+	 * at least two drifts with different timestamps. */
+	int has_slope;
+	double slope_ppm;
+}
+DriftMeasureChannelStats;
+
+
+/* Creates statistics for num_channels channels. window_length is the
+ * number of drifts per channel the slope is computed over, and must be at
+ * least 2. ewma_weight is the weight of a new drift in the exponentially
+ * weighted moving average, between 0 and 1. Returns NULL if the arguments
+ * are invalid or memory is exhausted. */
+DriftMeasureDriftStats * drift_measure_drift_stats_new(unsigned int num_channels, size_t window_length, double ewma_weight);
+
+void drift_measure_drift_stats_free(DriftMeasureDriftStats *stats);
+
+/* Discards all measurements. */
+void drift_measure_drift_stats_reset(DriftMeasureDriftStats *stats);
+
+/* Starts a new interval. The moving average and the slope window are kept. */
+void drift_measure_drift_stats_start_interval(DriftMeasureDriftStats *stats);
+
+/* Adds a measurement. drifts contains one value per channel. */
+void drift_measure_drift_stats_add(DriftMeasureDriftStats *stats, uint64_t timestamp, int64_t const *drifts);
+
+/* Returns the number of measurements (including ones where all drifts
+ * were missing) in the current interval. */
+uint64_t drift_measure_drift_stats_get_num_interval_measurements(DriftMeasureDriftStats const *stats);
+
+/* Returns the timestamp of the first and last measurement in the current
+ * interval. Only valid if the interval contains any measurements. */
+uint64_t drift_measure_drift_stats_get_interval_start(DriftMeasureDriftStats const *stats);
+uint64_t drift_measure_drift_stats_get_interval_end(DriftMeasureDriftStats const *stats);
+
+void drift_measure_drift_stats_get(DriftMeasureDriftStats const *stats, unsigned int channel, DriftMeasureChannelStats *channel_stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DRIFTSTATS_H */
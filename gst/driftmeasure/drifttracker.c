@@ -0,0 +1,148 @@
+#include <math.h>
+#include <stdlib.h>
+#include "drifttracker.h"
+
+
+/* The filter works with times in seconds, offsets in nanoseconds, and
+ * rates in nanoseconds per second. One ppm is 1000 nanoseconds per second. */
+#define NANOSECONDS_PER_SECOND 1e9
+#define RATE_UNITS_PER_PPM 1e3
+
+/* Standard deviation of the rate before the first measurement. The
+ * first two measurements effectively determine the initial rate. */
+#define INITIAL_RATE_STDDEV_PPM 1e4
+
+
+typedef struct
+{
+	int valid;
+	uint64_t last_timestamp;
+
+	/* State: offset, rate. */
+	double offset;
+	double rate;
+
+	/* State covariance. p01 and p10 are equal, so only p01 is stored. */
+	double p00, p01, p11;
+}
+ChannelState;
+
+
+struct _DriftMeasureDriftTracker
+{
+	unsigned int num_channels;
+	double measurement_variance;
+	double rate_variance_per_second;
+	ChannelState *channels;
+};
+
+
+DriftMeasureDriftTracker * drift_measure_drift_tracker_new(unsigned int num_channels, double measurement_noise, double rate_noise_ppm)
+{
+	DriftMeasureDriftTracker *tracker;
+
+	if ((num_channels == 0) || !(measurement_noise > 0.0) || !(rate_noise_ppm >= 0.0))
+		return NULL;
+
+	tracker = calloc(1, sizeof(DriftMeasureDriftTracker));
+	if (tracker == NULL)
+		return NULL;
+
+	tracker->num_channels = num_channels;
+	tracker->measurement_variance = measurement_noise * measurement_noise;
+	tracker->rate_variance_per_second = (rate_noise_ppm * RATE_UNITS_PER_PPM) * (rate_noise_ppm * RATE_UNITS_PER_PPM);
+
+	tracker->channels = calloc(num_channels, sizeof(ChannelState));
+	if (tracker->channels == NULL)
+	{
+		free(tracker);
+		return NULL;
+	}
+
+	return tracker;
+}
+
+
+void drift_measure_drift_tracker_free(DriftMeasureDriftTracker *tracker)
+{
+	if (tracker == NULL)
+		return;
+
+	free(tracker->channels);
+	free(tracker);
+}
+
+
+void drift_measure_drift_tracker_reset(DriftMeasureDriftTracker *tracker)
+{
+	unsigned int channel;
+
+	for (channel = 0; channel < tracker->num_channels; ++channel)
+		tracker->channels[channel].valid = 0;
+}
+
+
+void drift_measure_drift_tracker_update(DriftMeasureDriftTracker *tracker, uint64_t timestamp, int64_t const *drifts)
+{
+	unsigned int channel;
+
+	for (channel = 0; channel < tracker->num_channels; ++channel)
+	{
+		ChannelState *state = &(tracker->channels[channel]);
+		double measurement, dt, q, p00, p01, p11, innovation, innovation_variance, gain0, gain1;
+
+		if (drifts[channel] == DRIFT_MEASURE_DRIFT_TRACKER_NO_VALUE)
+			continue;
+
+		measurement = (double)(drifts[channel]);
+
+		if (!state->valid)
+		{
+			state->valid = 1;
+			state->last_timestamp = timestamp;
+			state->offset = measurement;
+			state->rate = 0.0;
+			state->p00 = tracker->measurement_variance;
+			state->p01 = 0.0;
+			state->p11 = (INITIAL_RATE_STDDEV_PPM * RATE_UNITS_PER_PPM) * (INITIAL_RATE_STDDEV_PPM * RATE_UNITS_PER_PPM);
+			continue;
+		}
+
+		dt = (timestamp > state->last_timestamp) ? ((timestamp - state->last_timestamp) / NANOSECONDS_PER_SECOND) : 0.0;
+		state->last_timestamp = timestamp;
+
+		/* Predict. With F = [1 dt; 0 1], and the process noise
+		 * of a rate random walk, integrated over dt:
+		 * Q = q * [dt^3/3 dt^2/2; dt^2/2 dt] */
+		q = tracker->rate_variance_per_second;
+		state->offset += state->rate * dt;
+		p00 = state->p00 + dt * (2.0 * state->p01 + dt * state->p11) + q * dt * dt * dt / 3.0;
+		p01 = state->p01 + dt * state->p11 + q * dt * dt / 2.0;
+		p11 = state->p11 + q * dt;
+
+		/* Update with the measured offset (H = [1 0]). */
+		innovation = measurement - state->offset;
+		innovation_variance = p00 + tracker->measurement_variance;
+		gain0 = p00 / innovation_variance;
+		gain1 = p01 / innovation_variance;
+
+		state->offset += gain0 * innovation;
+		state->rate += gain1 * innovation;
+
+		state->p00 = p00 - gain0 * p00;
+		state->p01 = p01 - gain0 * p01;
+		state->p11 = p11 - gain1 * p01;
+	}
+}
+
+
+void drift_measure_drift_tracker_get(DriftMeasureDriftTracker const *tracker, unsigned int channel, DriftMeasureDriftEstimate *estimate)
+{
+	ChannelState const *state = &(tracker->channels[channel]);
+
+	estimate->valid = state->valid;
+	estimate->offset = state->offset;
+	estimate->offset_stddev = sqrt(fmax(state->p00, 0.0));
+	estimate->rate_ppm = state->rate / RATE_UNITS_PER_PPM;
+	estimate->rate_stddev_ppm = sqrt(fmax(state->p11, 0.0)) / RATE_UNITS_PER_PPM;
+}
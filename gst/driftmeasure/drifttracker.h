@@ -0,0 +1,78 @@
+#ifndef DRIFTTRACKER_H
+#define DRIFTTRACKER_H
+
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Tracking of the clock offset and clock rate error of several channels.
+ *
+ * Each channel has a small Kalman filter whose state consists of the
+ * offset (the drift, in nanoseconds) and the rate at which it changes,
+ * which is the clock rate error of the channel relative to the reference
+ * channel. The rate is modeled as a random walk, so the filter follows
+ * slow changes of the rate, for example due to temperature, while the
+ * jitter of individual measurements is smoothed out. Each measurement
+ * costs a constant amount of work.
+ *
+ * Measurements are added as a timestamp and one drift per channel (all in
+ * nanoseconds). Missing drifts are passed as DRIFT_MEASURE_DRIFT_TRACKER_NO_VALUE
+ * and ignored.
+ *
+ * This tracker does not depend on GStreamer or GLib. */
+
+
+#define DRIFT_MEASURE_DRIFT_TRACKER_NO_VALUE INT64_MIN
+
+
+typedef struct _DriftMeasureDriftTracker DriftMeasureDriftTracker;
+
+
+typedef struct
+{
+	/* Nonzero once the channel had at least one drift. The other
+	 * fields are only valid if this is nonzero. */
+	int valid;
+
+	/* Estimated offset at the time of the last drift, in nanoseconds,
+	 * and its standard deviation. */
+	double offset;
+	double offset_stddev;
+
+	/* Estimated clock rate error in ppm, and its standard deviation,
+	 * which is a measure for how much the estimate can be trusted. */
+	double rate_ppm;
+	double rate_stddev_ppm;
+}
+DriftMeasureDriftEstimate;
+
+
+/* Creates a tracker for num_channels channels. measurement_noise is the
+ * standard deviation of the measured drifts in nanoseconds (the jitter).
+ * rate_noise_ppm is how much the rate is expected to change, as the
+ * standard deviation of the change over one second, in ppm. Returns NULL
+ * if the arguments are invalid or memory is exhausted. */
+DriftMeasureDriftTracker * drift_measure_drift_tracker_new(unsigned int num_channels, double measurement_noise, double rate_noise_ppm);
+
+void drift_measure_drift_tracker_free(DriftMeasureDriftTracker *tracker);
+
+/* Discards all measurements. */
+void drift_measure_drift_tracker_reset(DriftMeasureDriftTracker *tracker);
+
+/* Adds a measurement. drifts contains one value per channel. Timestamps
+ * must not decrease. */
+void drift_measure_drift_tracker_update(DriftMeasureDriftTracker *tracker, uint64_t timestamp, int64_t const *drifts);
+
+void drift_measure_drift_tracker_get(DriftMeasureDriftTracker const *tracker, unsigned int channel, DriftMeasureDriftEstimate *estimate);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DRIFTTRACKER_H */
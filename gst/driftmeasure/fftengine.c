@@ -0,0 +1,201 @@
+#include <math.h>
+#include <stdlib.h>
+#include "fftengine.h"
+
+
+/* M_PI is not part of C99. */
+#define PI 3.14159265358979323846
+
+
+struct _DriftMeasureFftPlan
+{
+	size_t length;
+	/* exp(-2*pi*i*k/length) for k = 0 .. length/2-1. */
+	DriftMeasureComplex *twiddles;
+	/* Bit reversed index of each index. */
+	size_t *permutation;
+};
+
+
+size_t drift_measure_fft_get_length(size_t min_length)
+{
+	size_t length = 1;
+
+	while (length < min_length)
+		length <<= 1;
+
+	return length;
+}
+
+
+DriftMeasureFftPlan * drift_measure_fft_plan_new(size_t length)
+{
+	DriftMeasureFftPlan *plan;
+	size_t i, num_bits = 0;
+
+	if ((length < 2) || ((length & (length - 1)) != 0))
+		return NULL;
+
+	while (((size_t)1 << num_bits) < length)
+		++num_bits;
+
+	plan = malloc(sizeof(DriftMeasureFftPlan));
+	if (plan == NULL)
+		return NULL;
+
+	plan->length = length;
+	plan->twiddles = malloc(sizeof(DriftMeasureComplex) * (length / 2));
+	plan->permutation = malloc(sizeof(size_t) * length);
+
+	if ((plan->twiddles == NULL) || (plan->permutation == NULL))
+	{
+		drift_measure_fft_plan_free(plan);
+		return NULL;
+	}
+
+	for (i = 0; i < (length / 2); ++i)
+	{
+		double angle = -2.0 * PI * (double)i / (double)length;
+		plan->twiddles[i].re = cos(angle);
+		plan->twiddles[i].im = sin(angle);
+	}
+
+	for (i = 0; i < length; ++i)
+	{
+		size_t reversed = 0, bit;
+
+		for (bit = 0; bit < num_bits; ++bit)
+		{
+			if (i & ((size_t)1 << bit))
+				reversed |= (size_t)1 << (num_bits - 1 - bit);
+		}
+
+		plan->permutation[i] = reversed;
+	}
+
+	return plan;
+}
+
+
+void drift_measure_fft_plan_free(DriftMeasureFftPlan *plan)
+{
+	if (plan == NULL)
+		return;
+
+	free(plan->twiddles);
+	free(plan->permutation);
+	free(plan);
+}
+
+
+size_t drift_measure_fft_plan_get_length(DriftMeasureFftPlan const *plan)
+{
+	return plan->length;
+}
+
+
+/* Iterative radix-2 decimation in time transform. The inverse transform
+ * uses the complex conjugates of the twiddle factors. */
+static void transform(DriftMeasureFftPlan const *plan, DriftMeasureComplex *values, int inverse)
+{
+	size_t length = plan->length;
+	size_t i, half_size;
+
+	for (i = 0; i < length; ++i)
+	{
+		size_t j = plan->permutation[i];
+
+		if (i < j)
+		{
+			DriftMeasureComplex temp = values[i];
+			values[i] = values[j];
+			values[j] = temp;
+		}
+	}
+
+	for (half_size = 1; half_size < length; half_size <<= 1)
+	{
+		size_t twiddle_stride = length / (half_size * 2);
+		size_t start, k;
+
+		for (start = 0; start < length; start += half_size * 2)
+		{
+			DriftMeasureComplex *even = values + start;
+			DriftMeasureComplex *odd = values + start + half_size;
+
+			for (k = 0; k < half_size; ++k)
+			{
+				DriftMeasureComplex twiddle = plan->twiddles[k * twiddle_stride];
+				DriftMeasureComplex product;
+
+				if (inverse)
+					twiddle.im = -twiddle.im;
+
+				product.re = odd[k].re * twiddle.re - odd[k].im * twiddle.im;
+				product.im = odd[k].re * twiddle.im + odd[k].im * twiddle.re;
+
+				odd[k].re = even[k].re - product.re;
+				odd[k].im = even[k].im - product.im;
+				even[k].re += product.re;
+				even[k].im += product.im;
+			}
+		}
+	}
+}
+
+
+void drift_measure_fft_forward(DriftMeasureFftPlan const *plan, DriftMeasureComplex *values)
+{
+	transform(plan, values, 0);
+}
+
+
+void drift_measure_fft_inverse(DriftMeasureFftPlan const *plan, DriftMeasureComplex *values)
+{
+	transform(plan, values, 1);
+}
+
+
+void drift_measure_fft_multiply_real_pair(DriftMeasureFftPlan const *plan, DriftMeasureComplex *values, DriftMeasureComplex const *spectrum, int conjugate)
+{
+	size_t length = plan->length;
+	size_t k;
+
+	/* Separate the transforms A and B of the two signals from the transform
+	 * Z of the packed signal, using the conjugate symmetry of real signals:
+	 *
+	 *   A[k] = (Z[k] + conj(Z[N-k])) / 2
+	 *   B[k] = (Z[k] - conj(Z[N-k])) / 2i
+	 *
+	 * Then multiply them with the spectrum S, and pack the products back:
+	 *
+	 *   W[k] = A[k] * S[k] + i * B[k] * S[k]
+	 *
+	 * Since A, B and S are conjugate symmetric, W[N-k] can be computed from
+	 * the same products as W[k], so each pair of bins is handled in one go. */
+	for (k = 0; k <= (length / 2); ++k)
+	{
+		size_t j = (length - k) & (length - 1);
+		DriftMeasureComplex zk = values[k], zj = values[j];
+		DriftMeasureComplex s = spectrum[k];
+		DriftMeasureComplex a, b, sa, sb;
+
+		if (conjugate)
+			s.im = -s.im;
+
+		a.re = (zk.re + zj.re) * 0.5;
+		a.im = (zk.im - zj.im) * 0.5;
+		b.re = (zk.im + zj.im) * 0.5;
+		b.im = (zj.re - zk.re) * 0.5;
+
+		sa.re = a.re * s.re - a.im * s.im;
+		sa.im = a.re * s.im + a.im * s.re;
+		sb.re = b.re * s.re - b.im * s.im;
+		sb.im = b.re * s.im + b.im * s.re;
+
+		values[k].re = sa.re - sb.im;
+		values[k].im = sa.im + sb.re;
+		values[j].re = sa.re + sb.im;
+		values[j].im = sb.re - sa.im;
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef FFTENGINE_H
+#define FFTENGINE_H
+
+#include <stddef.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Minimal complex FFT engine.
+ *
+ * Transforms are planned once for a given length. The plan contains the
+ * twiddle factors and the bit reversal permutation, so that repeated
+ * transforms of the same length do not have to compute them again.
+ * Only power-of-two lengths are supported.
+ *
+ * This engine does not depend on GStreamer or GLib. */
+
+
+typedef struct
+{
+	double re, im;
+}
+DriftMeasureComplex;
+
+
+typedef struct _DriftMeasureFftPlan DriftMeasureFftPlan;
+
+
+/* Returns the smallest power of two that is at or above min_length. */
+size_t drift_measure_fft_get_length(size_t min_length);
+
+/* Creates a plan for transforms of the given length, which must be a power
+ * of two. Returns NULL if the length is invalid or memory is exhausted. */
+DriftMeasureFftPlan * drift_measure_fft_plan_new(size_t length);
+
+void drift_measure_fft_plan_free(DriftMeasureFftPlan *plan);
+
+size_t drift_measure_fft_plan_get_length(DriftMeasureFftPlan const *plan);
+
+/* In-place forward transform of plan length values. */
+void drift_measure_fft_forward(DriftMeasureFftPlan const *plan, DriftMeasureComplex *values);
+
+/* In-place inverse transform of plan length values. The result is not
+ * normalized, that is, forward followed by inverse transforms scale the
+ * values by the plan length. */
+void drift_measure_fft_inverse(DriftMeasureFftPlan const *plan, DriftMeasureComplex *values);
+
+/* values must contain the forward transform of two real signals, packed
+ * into the real and imaginary parts of one complex signal. Multiplies the
+ * transforms of both signals with spectrum (or its complex conjugate, if
+ * conjugate is nonzero), which must be the transform of a real signal,
+ * and packs the products back, so that the inverse transform of values
+ * contains both filtered signals in its real and imaginary parts. */
+void drift_measure_fft_multiply_real_pair(DriftMeasureFftPlan const *plan, DriftMeasureComplex *values, DriftMeasureComplex const *spectrum, int conjugate);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* FFTENGINE_H */
@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <string.h>
+#include "framering.h"
+
+
+/* Planes start at multiples of this many bytes, so that
+ * no cache line is shared by two planes. */
+#define CACHE_LINE_SIZE 64
+
+
+struct _DriftMeasureFrameRing
+{
+	size_t capacity;
+	unsigned int num_channels;
+	size_t bytes_per_sample;
+	int interleaved;
+
+	/* The allocated block, and the cache line aligned storage in it. */
+	uint8_t *allocation;
+	size_t allocation_size;
+	uint8_t *storage;
+
+	size_t frame_stride;
+	/* Distance between the starts of two channels, in bytes. This is the
+	 * sample size with interleaved samples, and the (padded) plane size
+	 * with non-interleaved ones. */
+	size_t channel_stride;
+
+	/* Position of the oldest frame, and number of frames. */
+	size_t head;
+	size_t num_frames;
+};
+
+
+DriftMeasureFrameRing * drift_measure_frame_ring_new(size_t capacity, unsigned int num_channels, size_t bytes_per_sample, int interleaved)
+{
+	DriftMeasureFrameRing *ring;
+	size_t storage_size;
+
+	if ((capacity == 0) || (num_channels == 0) || (bytes_per_sample == 0))
+		return NULL;
+
+	ring = calloc(1, sizeof(DriftMeasureFrameRing));
+	if (ring == NULL)
+		return NULL;
+
+	ring->capacity = capacity;
+	ring->num_channels = num_channels;
+	ring->bytes_per_sample = bytes_per_sample;
+	ring->interleaved = interleaved;
+
+	if (interleaved)
+	{
+		ring->frame_stride = bytes_per_sample * num_channels;
+		ring->channel_stride = bytes_per_sample;
+		storage_size = capacity * ring->frame_stride;
+	}
+	else
+	{
+		ring->frame_stride = bytes_per_sample;
+		ring->channel_stride = (capacity * bytes_per_sample + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+		storage_size = ring->channel_stride * num_channels;
+	}
+
+	ring->allocation_size = storage_size + CACHE_LINE_SIZE - 1;
+	ring->allocation = malloc(ring->allocation_size);
+	if (ring->allocation == NULL)
+	{
+		free(ring);
+		return NULL;
+	}
+
+	ring->storage = ring->allocation + ((CACHE_LINE_SIZE - ((uintptr_t)(ring->allocation) % CACHE_LINE_SIZE)) % CACHE_LINE_SIZE);
+
+	return ring;
+}
+
+
+void drift_measure_frame_ring_free(DriftMeasureFrameRing *ring)
+{
+	if (ring == NULL)
+		return;
+
+	free(ring->allocation);
+	free(ring);
+}
+
+
+int drift_measure_frame_ring_has_layout(DriftMeasureFrameRing const *ring, size_t capacity, unsigned int num_channels, size_t bytes_per_sample, int interleaved)
+{
+	return (ring->capacity == capacity) && (ring->num_channels == num_channels) && (ring->bytes_per_sample == bytes_per_sample) && (!(ring->interleaved) == !interleaved);
+}
+
+
+size_t drift_measure_frame_ring_get_capacity(DriftMeasureFrameRing const *ring)
+{
+	return ring->capacity;
+}
+
+
+size_t drift_measure_frame_ring_get_num_frames(DriftMeasureFrameRing const *ring)
+{
+	return ring->num_frames;
+}
+
+
+size_t drift_measure_frame_ring_get_num_free_frames(DriftMeasureFrameRing const *ring)
+{
+	return ring->capacity - ring->num_frames;
+}
+
+
+size_t drift_measure_frame_ring_get_memory_size(DriftMeasureFrameRing const *ring)
+{
+	return sizeof(DriftMeasureFrameRing) + ring->allocation_size;
+}
+
+
+size_t drift_measure_frame_ring_get_frame_stride(DriftMeasureFrameRing const *ring)
+{
+	return ring->frame_stride;
+}
+
+
+void drift_measure_frame_ring_clear(DriftMeasureFrameRing *ring)
+{
+	ring->head = 0;
+	ring->num_frames = 0;
+}
+
+
+void drift_measure_frame_ring_discard(DriftMeasureFrameRing *ring, size_t num_frames)
+{
+	if (num_frames >= ring->num_frames)
+	{
+		drift_measure_frame_ring_clear(ring);
+		return;
+	}
+
+	ring->head = (ring->head + num_frames) % ring->capacity;
+	ring->num_frames -= num_frames;
+}
+
+
+static void copy_samples(uint8_t *dest, size_t dest_stride, uint8_t const *src, size_t src_stride, size_t num_samples, size_t bytes_per_sample)
+{
+	size_t i;
+
+	if ((dest_stride == bytes_per_sample) && (src_stride == bytes_per_sample))
+	{
+		memcpy(dest, src, num_samples * bytes_per_sample);
+		return;
+	}
+
+	for (i = 0; i < num_samples; ++i)
+		memcpy(dest + i * dest_stride, src + i * src_stride, bytes_per_sample);
+}
+
+
+/* Copies num_frames frames to the ring storage starting at the given
+ * position. The frames must fit without wrapping around. */
+static void copy_run(DriftMeasureFrameRing *ring, size_t position, uint8_t const *data, size_t frame_stride, size_t const *channel_offsets, size_t num_frames)
+{
+	unsigned int channel;
+	int contiguous_frames = ring->interleaved && (frame_stride == ring->frame_stride);
+
+	/* Interleaved frames with the same layout are copied in one go. */
+	for (channel = 0; contiguous_frames && (channel < ring->num_channels); ++channel)
+		contiguous_frames = (channel_offsets[channel] == (channel_offsets[0] + channel * ring->bytes_per_sample));
+
+	if (contiguous_frames)
+	{
+		memcpy(ring->storage + position * ring->frame_stride, data + channel_offsets[0], num_frames * ring->frame_stride);
+		return;
+	}
+
+	for (channel = 0; channel < ring->num_channels; ++channel)
+	{
+		copy_samples(
+			ring->storage + channel * ring->channel_stride + position * ring->frame_stride,
+			ring->frame_stride,
+			data + channel_offsets[channel],
+			frame_stride,
+			num_frames,
+			ring->bytes_per_sample
+		);
+	}
+}
+
+
+size_t drift_measure_frame_ring_write(DriftMeasureFrameRing *ring, void const *data, size_t frame_stride, size_t const *channel_offsets, size_t num_frames)
+{
+	uint8_t const *bytes = data;
+	size_t num_copied_frames = 0;
+
+	if (num_frames > drift_measure_frame_ring_get_num_free_frames(ring))
+		num_frames = drift_measure_frame_ring_get_num_free_frames(ring);
+
+	/* At most two runs are needed: one up to the end
+	 * of the storage, and one from its beginning. */
+	while (num_copied_frames < num_frames)
+	{
+		size_t position = (ring->head + ring->num_frames) % ring->capacity;
+		size_t num_run_frames = ring->capacity - position;
+
+		if (num_run_frames > (num_frames - num_copied_frames))
+			num_run_frames = num_frames - num_copied_frames;
+
+		copy_run(ring, position, bytes + num_copied_frames * frame_stride, frame_stride, channel_offsets, num_run_frames);
+
+		ring->num_frames += num_run_frames;
+		num_copied_frames += num_run_frames;
+	}
+
+	return num_copied_frames;
+}
+
+
+size_t drift_measure_frame_ring_append(DriftMeasureFrameRing *ring, DriftMeasureFrameRing const *source, size_t first_frame, size_t num_frames)
+{
+	size_t num_copied_frames = 0;
+
+	if (num_frames > drift_measure_frame_ring_get_num_free_frames(ring))
+		num_frames = drift_measure_frame_ring_get_num_free_frames(ring);
+
+	while (num_copied_frames < num_frames)
+	{
+		size_t source_position, num_run_frames;
+		size_t position = (ring->head + ring->num_frames) % ring->capacity;
+		unsigned int channel;
+
+		/* Runs end where either ring wraps around. */
+		num_run_frames = drift_measure_frame_ring_get_run(source, first_frame + num_copied_frames, num_frames - num_copied_frames, &source_position);
+		if (num_run_frames > (ring->capacity - position))
+			num_run_frames = ring->capacity - position;
+
+		if (ring->interleaved && source->interleaved)
+		{
+			memcpy(ring->storage + position * ring->frame_stride, source->storage + source_position * source->frame_stride, num_run_frames * ring->frame_stride);
+		}
+		else
+		{
+			for (channel = 0; channel < ring->num_channels; ++channel)
+			{
+				copy_samples(
+					ring->storage + channel * ring->channel_stride + position * ring->frame_stride,
+					ring->frame_stride,
+					source->storage + channel * source->channel_stride + source_position * source->frame_stride,
+					source->frame_stride,
+					num_run_frames,
+					ring->bytes_per_sample
+				);
+			}
+		}
+
+		ring->num_frames += num_run_frames;
+		num_copied_frames += num_run_frames;
+	}
+
+	return num_copied_frames;
+}
+
+
+size_t drift_measure_frame_ring_get_run(DriftMeasureFrameRing const *ring, size_t first_frame, size_t num_frames, size_t *position)
+{
+	size_t num_run_frames;
+
+	*position = (ring->head + first_frame) % ring->capacity;
+	num_run_frames = ring->capacity - *position;
+
+	return (num_run_frames < num_frames) ? num_run_frames : num_frames;
+}
+
+
+uint8_t const * drift_measure_frame_ring_get_samples(DriftMeasureFrameRing const *ring, unsigned int channel, size_t position)
+{
+	return ring->storage + channel * ring->channel_stride + position * ring->frame_stride;
+}
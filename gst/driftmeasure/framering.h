@@ -0,0 +1,95 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Fixed capacity ring buffer for audio frames.
+ *
+ * The ring is allocated once with room for a given number of frames, and
+ * new frames are copied into it. Frames are discarded from the front. No
+ * memory is allocated after creation, so the memory footprint is known in
+ * advance.
+ *
+ * Samples are stored in their original format, either interleaved (all
+ * channels of a frame next to each other), or non-interleaved, with one
+ * plane per channel. Each plane starts at a cache line boundary. Frames
+ * are addressed in two ways: by their index, which counts from the oldest
+ * frame in the ring, and by their position in the storage. Consecutive
+ * frames have consecutive positions, except where the ring wraps around.
+ * The sample of channel C at position P is located at:
+ *
+ *   drift_measure_frame_ring_get_samples(ring, C, 0) + P * frame_stride
+ *
+ * where frame_stride is drift_measure_frame_ring_get_frame_stride(ring).
+ *
+ * This ring buffer does not depend on GStreamer or GLib. */
+
+
+typedef struct _DriftMeasureFrameRing DriftMeasureFrameRing;
+
+
+/* Creates a ring for the given number of frames with the given number of
+ * channels and bytes per sample. Returns NULL if capacity, num_channels or
+ * bytes_per_sample is zero, or if memory is exhausted. */
+DriftMeasureFrameRing * drift_measure_frame_ring_new(size_t capacity, unsigned int num_channels, size_t bytes_per_sample, int interleaved);
+
+void drift_measure_frame_ring_free(DriftMeasureFrameRing *ring);
+
+/* Returns nonzero if the ring was created with the given parameters. */
+int drift_measure_frame_ring_has_layout(DriftMeasureFrameRing const *ring, size_t capacity, unsigned int num_channels, size_t bytes_per_sample, int interleaved);
+
+size_t drift_measure_frame_ring_get_capacity(DriftMeasureFrameRing const *ring);
+size_t drift_measure_frame_ring_get_num_frames(DriftMeasureFrameRing const *ring);
+size_t drift_measure_frame_ring_get_num_free_frames(DriftMeasureFrameRing const *ring);
+
+/* Returns the number of bytes that were allocated for the ring. */
+size_t drift_measure_frame_ring_get_memory_size(DriftMeasureFrameRing const *ring);
+
+/* Returns the distance between two consecutive samples of the same channel,
+ * in bytes. This is the frame size with interleaved samples, and the sample
+ * size with non-interleaved ones. */
+size_t drift_measure_frame_ring_get_frame_stride(DriftMeasureFrameRing const *ring);
+
+/* Discards all frames. */
+void drift_measure_frame_ring_clear(DriftMeasureFrameRing *ring);
+
+/* Discards the given number of frames (or all, if there are fewer) from the front. */
+void drift_measure_frame_ring_discard(DriftMeasureFrameRing *ring, size_t num_frames);
+
+/* Copies frames into the ring, up to the number of free frames. The
+ * sample of channel C in frame F is read from:
+ *
+ *   data + channel_offsets[C] + F * frame_stride
+ *
+ * This covers both interleaved and non-interleaved source layouts, which
+ * need not match the layout of the ring. Returns the number of copied frames. */
+size_t drift_measure_frame_ring_write(DriftMeasureFrameRing *ring, void const *data, size_t frame_stride, size_t const *channel_offsets, size_t num_frames);
+
+/* Copies num_frames frames, starting at frame first_frame, from another
+ * ring with the same number of channels and bytes per sample, up to the
+ * number of free frames. Returns the number of copied frames. */
+size_t drift_measure_frame_ring_append(DriftMeasureFrameRing *ring, DriftMeasureFrameRing const *source, size_t first_frame, size_t num_frames);
+
+/* Returns the number of frames starting at frame first_frame that are
+ * contiguous in the storage, at most num_frames, and stores the position
+ * of first_frame in position. first_frame must be less than the number of
+ * frames in the ring. */
+size_t drift_measure_frame_ring_get_run(DriftMeasureFrameRing const *ring, size_t first_frame, size_t num_frames, size_t *position);
+
+/* Returns a pointer to the sample of the given channel at the given position. */
+uint8_t const * drift_measure_frame_ring_get_samples(DriftMeasureFrameRing const *ring, unsigned int channel, size_t position);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* FRAMERING_H */
@@ -1,8 +1,18 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <gst/gst.h>
-#include <gst/base/gstadapter.h>
 #include <gst/audio/audio.h>
 #include <gst/audio/gstaudiofilter.h>
+#include <gst/base/gstadapter.h>
 #include "gstdriftmeasure.h"
+#include "driftdetector.h"
+#include "matchedfilter.h"
+#include "spscqueue.h"
+#include "intformat.h"
+#include "gstdriftmeasuremeta.h"
+#include "driftstats.h"
+#include "drifttracker.h"
 
 
 GST_DEBUG_CATEGORY_STATIC(drift_measure_debug);
@@ -18,7 +28,36 @@ enum
 	PROP_REFERENCE_CHANNEL,
 	PROP_UNDETECTED_PEAK_HANDLING,
 	PROP_UNDETECTED_PEAK_FILL_VALUE,
-	PROP_OMIT_OUTPUT_IF_NO_PEAKS
+	PROP_OMIT_OUTPUT_IF_NO_PEAKS,
+	PROP_PEAK_INTERPOLATION,
+	PROP_DETECTION_METHOD,
+	PROP_PULSE_FREQUENCY,
+	PROP_PULSE_TEMPLATE_LOCATION,
+	PROP_N_THREADS,
+	PROP_ANALYSIS_QUEUE_SIZE,
+	PROP_ANALYSIS_QUEUE_POLICY,
+	PROP_ANALYSIS_QUEUE_DEPTH,
+	PROP_NUM_DROPPED_WINDOWS,
+	PROP_HISTORY_MEMORY_SIZE,
+	PROP_OUTPUT_BATCH_ROWS,
+	PROP_OUTPUT_BATCH_SIZE,
+	PROP_OUTPUT_BATCH_LATENCY,
+	PROP_POST_MESSAGES,
+	PROP_ATTACH_META,
+	PROP_OUTPUT_MODE,
+	PROP_STATISTICS_PULSES,
+	PROP_STATISTICS_INTERVAL,
+	PROP_STATISTICS_WINDOW,
+	PROP_STATISTICS_EWMA_WEIGHT,
+	PROP_OUTPUT_TRACKING,
+	PROP_TRACKING_MEASUREMENT_NOISE,
+	PROP_TRACKING_RATE_NOISE,
+	PROP_TRACKING_ESTIMATES,
+	PROP_MAX_INPUT_QUEUE_TIME,
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	PROP_STATS,
+	PROP_STATS_INTERVAL
+#endif
 };
 
 
@@ -29,21 +68,86 @@ enum
 #define DEFAULT_UNDETECTED_PEAK_HANDLING GST_DRIFT_MEASURE_UNDETECTED_PEAK_HANDLING_NO_VALUE
 #define DEFAULT_UNDETECTED_PEAK_FILL_VALUE 0
 #define DEFAULT_OMIT_OUTPUT_IF_NO_PEAKS FALSE
+#define DEFAULT_PEAK_INTERPOLATION DRIFT_MEASURE_PEAK_INTERPOLATION_NONE
+#define DEFAULT_DETECTION_METHOD DRIFT_MEASURE_DETECTION_METHOD_PEAK
+#define DEFAULT_PULSE_FREQUENCY 1000.0
+#define DEFAULT_PULSE_TEMPLATE_LOCATION NULL
+#define DEFAULT_N_THREADS 1
+#define DEFAULT_ANALYSIS_QUEUE_SIZE 0
+#define DEFAULT_ANALYSIS_QUEUE_POLICY GST_DRIFT_MEASURE_QUEUE_POLICY_BLOCK
+#define DEFAULT_OUTPUT_BATCH_ROWS 1
+#define DEFAULT_OUTPUT_BATCH_SIZE 0
+#define DEFAULT_OUTPUT_BATCH_LATENCY GST_CLOCK_TIME_NONE
+#define DEFAULT_POST_MESSAGES FALSE
+#define DEFAULT_ATTACH_META FALSE
+#define DEFAULT_OUTPUT_MODE GST_DRIFT_MEASURE_OUTPUT_MODE_MEASUREMENTS
+#define DEFAULT_STATISTICS_PULSES 100
+#define DEFAULT_STATISTICS_INTERVAL 0
+#define DEFAULT_STATISTICS_WINDOW 32
+#define DEFAULT_STATISTICS_EWMA_WEIGHT 0.1
+#define DEFAULT_OUTPUT_TRACKING FALSE
+#define DEFAULT_TRACKING_MEASUREMENT_NOISE 20000.0
+#define DEFAULT_TRACKING_RATE_NOISE 0.01
+#define DEFAULT_MAX_INPUT_QUEUE_TIME GST_SECOND
+#define DEFAULT_STATS_INTERVAL 0
 #define DEFAULT_CSV_CLOCK_TIME_TIMESTAMPS FALSE
 
 
 #define CSV_CAPS "text/x-csv"
+#define BINARY_CAPS "application/x-driftmeasure"
+
+
+/* The binary output format starts with a header, followed by records.
+ * All values are little endian. The header is:
+ *
+ *   offset  0: magic bytes "DRIFTMSR"
+ *   offset  8: format version (32 bit unsigned)
+ *   offset 12: number of input channels (32 bit unsigned)
+ *   offset 16: reference channel (32 bit unsigned)
+ *   offset 20: sample rate (32 bit unsigned)
+ *
+ * Each record consists of num_channels 64-bit values: the timestamp
+ * (unsigned), then the drifts of the non-reference channels (signed),
+ * in channel order. Drifts that have no value (the empty CSV columns)
+ * are set to BINARY_NONE_VALUE. The header size is a multiple of 8, so
+ * all values are naturally aligned in a file that is mapped into memory.
+ * A new header is written whenever the input caps change. */
+#define BINARY_MAGIC "DRIFTMSR"
+#define BINARY_VERSION 1
+#define BINARY_HEADER_SIZE 24
+#define BINARY_NONE_VALUE G_MININT64
+
+
+/* Columns per non-reference channel in statistics rows: count, mean,
+ * standard deviation, minimum, maximum, moving average, and slope. */
+#define NUM_STATISTICS_COLUMNS 7
+
+
+/* Maximum number of frames that are taken from the
+ * sink_%u request pads at once and combined. */
+#define MAX_COMBINED_FRAMES 4096
 
 
 #define SINK_CAPS \
 	"audio/x-raw, " \
-	"format = (string) F32LE, " \
+	"format = (string) { F32LE, S16LE, S24LE, S32LE }, " \
 	"rate = [ 1, MAX ], " \
 	"channels = [ 2, MAX ], " \
-	"layout = (string) { interleaved }; "
+	"layout = (string) { interleaved, non-interleaved }; "
+
+/* Request pads accept any number of channels, since the channels of all
+ * request pads are combined. Their data is queued in adapters, which
+ * concatenate the buffers, so only interleaved data is accepted. */
+#define REQUEST_SINK_CAPS \
+	"audio/x-raw, " \
+	"format = (string) { F32LE, S16LE, S24LE, S32LE }, " \
+	"rate = [ 1, MAX ], " \
+	"channels = [ 1, MAX ], " \
+	"layout = (string) interleaved; "
 
 #define SRC_CAPS \
-	CSV_CAPS
+	CSV_CAPS "; " \
+	BINARY_CAPS
 
 
 static GstStaticPadTemplate static_sink_template = GST_STATIC_PAD_TEMPLATE(
@@ -54,6 +158,14 @@ static GstStaticPadTemplate static_sink_template = GST_STATIC_PAD_TEMPLATE(
 );
 
 
+static GstStaticPadTemplate static_request_sink_template = GST_STATIC_PAD_TEMPLATE(
+	"sink_%u",
+	GST_PAD_SINK,
+	GST_PAD_REQUEST,
+	GST_STATIC_CAPS(REQUEST_SINK_CAPS)
+);
+
+
 static GstStaticPadTemplate static_src_template = GST_STATIC_PAD_TEMPLATE(
 	"src",
 	GST_PAD_SRC,
@@ -73,13 +185,26 @@ GstDriftMeasureUndetectedPeakHandling;
 
 typedef enum
 {
-	DRIFT_MEASUREMENT_MODE_PEAK_SEARCH,
-	DRIFT_MEASUREMENT_MODE_PEAK_ANALYSIS
+	GST_DRIFT_MEASURE_QUEUE_POLICY_BLOCK,
+	GST_DRIFT_MEASURE_QUEUE_POLICY_DROP
+}
+GstDriftMeasureQueuePolicy;
+
+
+typedef enum
+{
+	GST_DRIFT_MEASURE_OUTPUT_MODE_MEASUREMENTS,
+	GST_DRIFT_MEASURE_OUTPUT_MODE_STATISTICS
 }
-DriftMeasurementMode;
+GstDriftMeasureOutputMode;
 
 
-#define UNDEFINED_INDEX ((guint64)(-1))
+typedef enum
+{
+	GST_DRIFT_MEASURE_OUTPUT_FORMAT_CSV,
+	GST_DRIFT_MEASURE_OUTPUT_FORMAT_BINARY
+}
+GstDriftMeasureOutputFormat;
 
 
 typedef struct
@@ -90,11 +215,26 @@ typedef struct
 GstDriftMeasureDataset;
 
 
-struct _GstDriftMeasure
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+/* The stats of all detectors the element had so far, plus the times
+ * the element itself spent producing output; see the stats property. */
+typedef struct
 {
-	GstElement parent;
+	DriftMeasureDetectorStats detector_stats;
+	guint64 format_time;
+	guint64 push_time;
+}
+GstDriftMeasureStats;
+#endif
+
 
-	/* GObject properties */
+/* The property values that processing depends on. set_property changes
+ * the property_params of the element, and publishes a copy of them; the
+ * streaming thread swaps that copy in at the next buffer boundary. Once
+ * published, a copy is never modified, so its fields can be read without
+ * any lock. See gst_drift_measure_update_params(). */
+typedef struct
+{
 	GstClockTime window_size;
 	GstClockTime pulse_length;
 	gfloat peak_threshold;
@@ -102,6 +242,108 @@ struct _GstDriftMeasure
 	GstDriftMeasureUndetectedPeakHandling undetected_peak_handling;
 	GstClockTimeDiff undetected_peak_fill_value;
 	gboolean omit_output_if_no_peaks;
+	DriftMeasurePeakInterpolation peak_interpolation;
+	DriftMeasureDetectionMethod detection_method;
+	gdouble pulse_frequency;
+	guint n_threads;
+	guint analysis_queue_size;
+	GstDriftMeasureQueuePolicy analysis_queue_policy;
+	guint output_batch_rows;
+	guint output_batch_size;
+	GstClockTime output_batch_latency;
+	gboolean post_messages;
+	gboolean attach_meta;
+	GstDriftMeasureOutputMode output_mode;
+	guint statistics_pulses;
+	GstClockTime statistics_interval;
+	guint statistics_window;
+	gdouble statistics_ewma_weight;
+	gboolean output_tracking;
+	gdouble tracking_measurement_noise;
+	gdouble tracking_rate_noise;
+	GstClockTime max_input_queue_time;
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	GstClockTime stats_interval;
+#endif
+
+	/* The pulse template loaded from pulse-template-location, as gfloat
+	 * values, used by the matched filter if it is set. Otherwise, the
+	 * detector generates a sine template from pulse_length and
+	 * pulse_frequency. The bytes are shared between the copies. */
+	GBytes *pulse_template;
+	guint pulse_template_rate;
+}
+GstDriftMeasureParams;
+
+
+/* The frames around one reference peak, queued for the analysis thread.
+ * The detector window has its own copy of these frames, so the detector
+ * can move on while the snapshot is waiting in the queue. */
+typedef struct
+{
+	DriftMeasureDetectorWindow *window;
+	/* Added to the timestamp of the dataset. */
+	GstClockTime base;
+	/* The history_generation the snapshot was taken in. */
+	guint generation;
+}
+GstDriftMeasureWindowSnapshot;
+
+
+/* State of one sink_%u request pad. Its buffers are queued in the
+ * adapter until all request pads have frames for the same running
+ * time; these frames are then combined and analyzed. All fields are
+ * protected by the input_mutex of the element. */
+typedef struct
+{
+	GstPad *pad;
+	GstAudioInfo audio_info;
+	gboolean audio_info_valid;
+	GstSegment segment;
+	GstAdapter *adapter;
+	/* Running time of the first queued frame, or GST_CLOCK_TIME_NONE
+	 * if no buffer was queued since the inputs were last reset. */
+	GstClockTime start_time;
+	/* Number of frames to drop to get to the running time where
+	 * the inputs are aligned. Set when the inputs get aligned. */
+	guint64 num_frames_to_skip;
+	gboolean eos;
+	gboolean flushing;
+}
+GstDriftMeasureInput;
+
+
+struct _GstDriftMeasure
+{
+	GstElement parent;
+
+	/* GObject properties, protected by the object lock. Processing does
+	 * not use these directly; it uses params instead. */
+	GstDriftMeasureParams property_params;
+	gchar *pulse_template_location;
+
+	/* The copy of property_params that set_property published last, if the
+	 * streaming thread did not take it yet, and NULL otherwise. Only
+	 * accessed atomically. */
+	gpointer pending_params;
+	/* The parameters that are currently used for processing. Protected by
+	 * process_mutex. */
+	GstDriftMeasureParams *params;
+
+	/* Held by the streaming threads and the analysis thread while they
+	 * process data, that is, while they access params and the processing
+	 * state below. Property accesses only take the object lock, so they
+	 * never wait for the processing to finish. process_mutex is taken
+	 * before the object lock. */
+	GMutex process_mutex;
+
+	/* Copies of processing state that is reported by read-only properties.
+	 * They are updated by the processing, and protected by the object
+	 * lock. published_estimates has num_published_estimates values; it is
+	 * empty if there is no tracker. */
+	guint64 published_history_memory_size;
+	DriftMeasureDriftEstimate *published_estimates;
+	guint num_published_estimates;
 
 	GstPad *sinkpad, *srcpad;
 
@@ -110,45 +352,198 @@ struct _GstDriftMeasure
 	/* If true, then the output segment was started by pushing
 	 * the caps and segment downstream already. */
 	gboolean output_segment_started;
-	/* The CSV caps. We need these for buffer pool creation and for pushing
-	 * a caps event downstream, so we keep a prepared copy around. */
+	/* The output caps. We need these for buffer pool creation and for
+	 * pushing a caps event downstream, so we keep a prepared copy around.
+	 * The output format is negotiated with downstream when the input caps
+	 * are set; CSV is preferred. If output_caps_pending is TRUE, the caps
+	 * (and in binary format, the header) still have to be pushed. */
 	GstCaps *src_caps;
+	GstDriftMeasureOutputFormat output_format;
+	/* The output-mode property value at the time the output format was
+	 * negotiated. The format and the size of the output buffers depend on
+	 * it, so the output code uses this copy instead of the params, and a
+	 * new output mode takes effect with the next caps event. */
+	GstDriftMeasureOutputMode output_mode;
+	/* The output-tracking property value at the time the input caps were
+	 * set. Like output_mode, it determines the size of the output rows. */
+	gboolean output_tracking;
+	gboolean output_caps_pending;
 
 	/* Audio info converted from sink caps. */
 	GstAudioInfo input_audio_info;
 	/* FALSE if the input_audio_info was not set yet, TRUE otherwise. */
 	gboolean input_audio_info_valid;
-
-	/* Adapter holding the frames that we keep around for analysis. The first
-	 * bytes in the adapter are from the oldest frames we currently hold in
-	 * there, while the last bytes are from the newest frames. As soon as
-	 * we are done with the oldest frames, we flush them out. */
-	GstAdapter *frame_history;
-	/* The current measurement mode. */
-	DriftMeasurementMode mode;
-	/* window_size translated from nanoseconds to frames. */
-	gsize window_size_in_frames;
-	/* Index of the frame where the peak in the reference channel was found.
-	 * Once this index is found, other indices are looked for in other channels.
-	 * This peak is searched in the DRIFT_MEASUREMENT_MODE_PEAK_SEARCH mode,
-	 * while the peaks in other channels are look for when the mode is
-	 * DRIFT_MEASUREMENT_MODE_PEAK_ANALYSIS. */
-	guint64 peak_frame_index;
-	/* Total number of input frames we have seen so far. We need this for
-	 * generating the timestamps that we put in the CSV output. */
-	guint64 total_num_input_frames_seen;
-	/* pulse_length translated from nanoseconds to frames. */
-	gsize pulse_length_in_frames;
-
-	/* The dataset we produced in the previous analysis mode. We need this
+	/* Sample format of the input data. Set when input caps are set. */
+	DriftMeasureSampleFormat input_sample_format;
+
+	/* The pulse detector. It contains the frame history and does the
+	 * actual measurements; see driftdetector.h. It is created when input
+	 * caps are set, and recreated when a property it depends on changes. */
+	DriftMeasureDetector *detector;
+	/* Incremented whenever the detector is flushed or recreated. Window
+	 * snapshots taken before that are discarded by the analysis thread. */
+	guint history_generation;
+	/* Incremented whenever the detector is recreated. */
+	guint detector_generation;
+
+	/* The dataset we wrote last, with the drifts of channels without a
+	 * pulse filled in according to undetected_peak_handling. We need this
 	 * for handling GST_DRIFT_MEASURE_UNDETECTED_PEAK_HANDLING_LAST_VALUE. */
 	GstDriftMeasureDataset last_dataset;
-	/* The dataset we currently want to fill by analysing peaks. */
+	/* The dataset we currently want to fill by analysing peaks. It has the
+	 * drifts as measured, with GST_CLOCK_STIME_NONE for channels without
+	 * a pulse. */
 	GstDriftMeasureDataset current_dataset;
 
-	/* Buffer pool for output CSV data. Created once the sink
+	/* Per-channel analysis threads. The detector splits the non-reference
+	 * channels of a window into num_analysis_threads shares, and hands them
+	 * to gst_drift_measure_run_analysis_tasks(), which runs the first share
+	 * in the calling thread, and the others in analysis_thread_pool, with
+	 * analysis_task_func. The pool is created for n_threads, and only
+	 * recreated when that number changes. Its threads are exclusive, so
+	 * they are kept around between windows. */
+	GThreadPool *analysis_thread_pool;
+	guint num_analysis_threads;
+	DriftMeasureDetectorTaskFunc analysis_task_func;
+	/* Number of shares that the pool threads did not finish yet.
+	 * Protected by analysis_mutex; analysis_cond is signaled
+	 * when it reaches zero. */
+	guint num_pending_analysis_tasks;
+	GMutex analysis_mutex;
+	GCond analysis_cond;
+
+	/* Asynchronous analysis state, used if analysis_queue_size is nonzero.
+	 * The streaming thread then only searches for reference peaks, and
+	 * puts the windows around them into analysis_queue. The analysis
+	 * thread takes them out, analyzes them, and pushes the datasets
+	 * downstream, so a slow downstream does not block the streaming
+	 * thread. The queue and thread exist between the
+	 * READY->PAUSED and PAUSED->READY state changes.
+	 *
+	 * The analysis thread has its own detector, analysis_detector, which
+	 * is created with the same settings as detector, and is only used for
+	 * analyzing windows. Only the analysis thread accesses it, so the
+	 * analysis runs without process_mutex; the analysis thread only takes
+	 * process_mutex to pick up the current settings before the analysis,
+	 * and to hand off the finished dataset after it. analysis_detector is
+	 * recreated once analysis_detector_generation no longer matches
+	 * detector_generation. The per-channel analysis threads then work
+	 * for analysis_detector; the streaming thread does not use them while
+	 * the analysis thread exists.
+	 *
+	 * The queue itself is lock-free; queue_mutex and queue_cond are only
+	 * used for waiting until there are snapshots to analyze (analysis
+	 * thread), until there is space in the queue (streaming thread, with
+	 * the block policy), and until the queue is drained (at EOS).
+	 * The streaming thread also uses them to ask the analysis thread
+	 * to push out an output batch whose latency has passed, by setting
+	 * output_batch_push_requested (protected by queue_mutex); while the
+	 * analysis thread exists, only it pushes batches during streaming.
+	 * num_queued_windows counts the snapshots that are in the queue or
+	 * being analyzed; it and num_dropped_windows are accessed atomically.
+	 * analysis_flow_ret is the last flow return of the analysis thread
+	 * (protected by process_mutex); errors are passed on to upstream
+	 * with the next input buffer. */
+	DriftMeasureSpscQueue *analysis_queue;
+	GThread *analysis_thread;
+	GMutex queue_mutex;
+	GCond queue_cond;
+	gboolean analysis_thread_stopping;
+	gboolean analysis_flushing;
+	gboolean output_batch_push_requested;
+	volatile gint num_queued_windows;
+	volatile gint num_dropped_windows;
+	GstFlowReturn analysis_flow_ret;
+	DriftMeasureDetector *analysis_detector;
+	guint analysis_detector_generation;
+
+	/* Buffer pool for output data. Created once the sink
 	 * pad gets a caps event. */
 	GstBufferPool *output_buffer_pool;
+	/* Maximum size of one output row (a CSV line including its
+	 * newline character, or a binary record). */
+	gsize max_output_row_size;
+
+	/* The batch of output rows that were not pushed downstream yet. This is
+	 * a buffer from the output buffer pool, which stays mapped while rows
+	 * are appended to it. output_batch is NULL if no rows are pending.
+	 * output_batch_start_time is the monotonic time (in microseconds)
+	 * at which the first row of the batch was written. max_output_batch_rows
+	 * is the output_batch_rows value at that time; the meta of the batch
+	 * has room for that many rows, so the batch is pushed once it has that
+	 * many, even if output_batch_rows was changed meanwhile.
+	 * output_batch_pushing is TRUE while a detached batch is being pushed
+	 * without process_mutex; other pushes wait on output_batch_push_cond
+	 * until it is done, so batches reach downstream in order. */
+	GstBuffer *output_batch;
+	GstMapInfo output_batch_map_info;
+	gsize output_batch_fill_size;
+	guint num_output_batch_rows;
+	guint max_output_batch_rows;
+	gint64 output_batch_start_time;
+	gboolean output_batch_pushing;
+	GCond output_batch_push_cond;
+
+	/* Running statistics over the datasets, with one channel per
+	 * non-reference channel. Created when input caps are set. */
+	DriftMeasureDriftStats *statistics;
+
+	/* Offset and clock rate tracking, with one channel per non-reference
+	 * channel. Created when input caps are set. */
+	DriftMeasureDriftTracker *tracker;
+
+	/* Multi-stream input. Instead of one interleaved stream on the sink
+	 * pad, separate streams can be fed into sink_%u request pads. Each
+	 * GstDriftMeasureInput in inputs queues the buffers of one request
+	 * pad. Once all request pads have caps, their channels are combined,
+	 * in the order the pads were requested, and the resulting caps are
+	 * set as the input caps. The streams are aligned by running time:
+	 * once all pads queued a buffer, frames before the latest start
+	 * time are dropped. From then on, frames of all pads are taken out
+	 * of the adapters in lockstep, copied into combined_frames (with one
+	 * plane per channel), and processed just like an input buffer. A
+	 * pad blocks while it has max_input_queue_time worth of frames
+	 * queued, so that no pad can run arbitrarily far ahead of the others.
+	 *
+	 * input_mutex protects the inputs and the fields below it, and
+	 * input_cond is signaled when frames are taken out of the adapters or
+	 * when the inputs are flushed or reach EOS. combine_mutex serializes
+	 * the streaming threads of the request pads while they combine and
+	 * process frames. It is taken before input_mutex, which in turn is
+	 * taken before process_mutex. */
+	GPtrArray *inputs;
+	guint next_input_index;
+	GMutex input_mutex;
+	GCond input_cond;
+	GMutex combine_mutex;
+	gboolean inputs_configured;
+	gboolean inputs_aligned;
+	gboolean inputs_eos;
+	gboolean stream_start_forwarded;
+	guint8 *combined_frames;
+	gsize combined_frames_size;
+
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	/* Instrumentation, only built if the instrumentation build option is
+	 * enabled. Each detector gathers its own stats, so the stats of those
+	 * that were replaced since the element was created are accumulated in
+	 * retired_detector_stats. format_time and push_time are the times spent
+	 * writing output rows (including acquiring output buffers) and pushing
+	 * output batches downstream, in nanoseconds; output_row_start_time is
+	 * the time at which the current row was begun. num_stats_frames counts
+	 * the input frames since the last stats message. analysis_detector_stats
+	 * are the stats of the analysis detector, copied by the analysis thread
+	 * after each window. These are protected by process_mutex.
+	 * published_stats is the copy of the stats that the
+	 * stats property reports, protected by the object lock. */
+	DriftMeasureDetectorStats retired_detector_stats;
+	DriftMeasureDetectorStats analysis_detector_stats;
+	guint64 format_time;
+	guint64 push_time;
+	GstClockTime output_row_start_time;
+	guint64 num_stats_frames;
+	GstDriftMeasureStats published_stats;
+#endif
 };
 
 
@@ -162,29 +557,87 @@ G_DEFINE_TYPE(GstDriftMeasure, gst_drift_measure, GST_TYPE_ELEMENT)
 
 
 static void gst_drift_measure_dispose(GObject *object);
+static void gst_drift_measure_finalize(GObject *object);
 static void gst_drift_measure_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec);
 static void gst_drift_measure_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
 
 static GstStateChangeReturn gst_drift_measure_change_state(GstElement *element, GstStateChange transition);
 
+static GstPad * gst_drift_measure_request_new_pad(GstElement *element, GstPadTemplate *templ, gchar const *name, GstCaps const *caps);
+static void gst_drift_measure_release_pad(GstElement *element, GstPad *pad);
+
 static gboolean gst_drift_measure_sink_event(GstPad *pad, GstObject *parent, GstEvent *event);
 static GstFlowReturn gst_drift_measure_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer);
+static gboolean gst_drift_measure_input_event(GstPad *pad, GstObject *parent, GstEvent *event);
+static GstFlowReturn gst_drift_measure_input_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer);
+
+static gboolean gst_drift_measure_flush_stop(GstDriftMeasure *drift_measure, GstEvent *event);
+static void gst_drift_measure_finish_stream(GstDriftMeasure *drift_measure);
+static gboolean gst_drift_measure_apply_input_caps(GstDriftMeasure *drift_measure, GstCaps const *input_caps);
+static GstFlowReturn gst_drift_measure_start_output(GstDriftMeasure *drift_measure);
+static GstFlowReturn gst_drift_measure_process_buffer(GstDriftMeasure *drift_measure, GstBuffer *buffer);
+
+static void gst_drift_measure_free_input(GstDriftMeasureInput *input);
+static void gst_drift_measure_reset_inputs(GstDriftMeasure *drift_measure);
+static gboolean gst_drift_measure_inputs_flushing(GstDriftMeasure *drift_measure);
+static GstCaps * gst_drift_measure_get_combined_caps(GstDriftMeasure *drift_measure, guint *num_channels);
+static gboolean gst_drift_measure_align_inputs(GstDriftMeasure *drift_measure);
+static gsize gst_drift_measure_take_input_frames(GstDriftMeasure *drift_measure);
+static GstFlowReturn gst_drift_measure_combine_inputs(GstDriftMeasure *drift_measure);
 
 static void gst_drift_measure_allocate_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset *dataset);
 static void gst_drift_measure_reset_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset *dataset);
 static void gst_drift_measure_free_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset *dataset);
-static void gst_drift_measure_copy_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset const *from, GstDriftMeasureDataset *to);
+static GstFlowReturn gst_drift_measure_output_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset const *measured_dataset, GstDriftMeasureDataset const *written_dataset);
+static GstFlowReturn gst_drift_measure_output_statistics(GstDriftMeasure *drift_measure);
+static gchar * gst_drift_measure_begin_output_row(GstDriftMeasure *drift_measure, GstFlowReturn *flow_ret);
+static void gst_drift_measure_end_output_row(GstDriftMeasure *drift_measure, gchar *write_pointer);
 static GstFlowReturn gst_drift_measure_push_out_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset const *dataset);
+static void gst_drift_measure_post_dataset_message(GstDriftMeasure *drift_measure, GstDriftMeasureDataset const *dataset);
+static void gst_drift_measure_publish_tracking_estimates(GstDriftMeasure *drift_measure);
+static void gst_drift_measure_add_tracking_fields(GstStructure *structure, DriftMeasureDriftEstimate const *estimates, guint num_estimates);
+static gboolean gst_drift_measure_output_batch_is_due(GstDriftMeasure *drift_measure);
+static gboolean gst_drift_measure_negotiate_output_format(GstDriftMeasure *drift_measure, GstDriftMeasureOutputMode output_mode, GstDriftMeasureOutputFormat *output_format);
+static GstFlowReturn gst_drift_measure_push_binary_header(GstDriftMeasure *drift_measure);
+static GstFlowReturn gst_drift_measure_push_output_batch(GstDriftMeasure *drift_measure);
+static void gst_drift_measure_discard_output_batch(GstDriftMeasure *drift_measure);
 
 static gboolean gst_drift_measure_validate_reference_channel(GstDriftMeasure *drift_measure);
 static gboolean gst_drift_measure_set_input_caps(GstDriftMeasure *drift_measure, GstCaps const *caps);
-static void gst_drift_measure_find_largest_frame(GstDriftMeasure *drift_measure, gfloat const *samples, guint channel, gsize num_frames, guint64 *largest_frame_index, gfloat *largest_sample);
-static guint64 gst_drift_measure_scan_for_peak(GstDriftMeasure *drift_measure, gsize num_available_frames);
-static GstFlowReturn gst_drift_measure_analyze_peaks(GstDriftMeasure *drift_measure, gsize num_available_frames);
-static void gst_drift_measure_recalculate_num_window_frames(GstDriftMeasure *drift_measure);
-static void gst_drift_measure_reset_to_search_mode(GstDriftMeasure *drift_measure);
+static DriftMeasureDetector * gst_drift_measure_create_detector(GstDriftMeasure *drift_measure);
+static gboolean gst_drift_measure_setup_detector(GstDriftMeasure *drift_measure);
+static gboolean gst_drift_measure_load_pulse_template(GstDriftMeasure *drift_measure, gchar const *location, gfloat **template_values, gsize *template_length, guint *template_rate);
+static gsize gst_drift_measure_get_buffer_layout(GstDriftMeasure *drift_measure, GstBuffer *buffer, gsize size, gboolean interleaved, guint bytes_per_sample, gsize *frame_stride, gsize *channel_offsets);
+static gboolean gst_drift_measure_setup_analysis_threads(GstDriftMeasure *drift_measure, DriftMeasureDetector *detector);
+static void gst_drift_measure_free_analysis_threads(GstDriftMeasure *drift_measure);
+static void gst_drift_measure_run_analysis_tasks(DriftMeasureDetectorTaskFunc func, void * const *tasks, unsigned int num_tasks, void *user_data);
+static void gst_drift_measure_analysis_thread_func(gpointer data, gpointer user_data);
+static GstFlowReturn gst_drift_measure_handle_dataset(GstDriftMeasure *drift_measure);
+static gboolean gst_drift_measure_start_analysis_thread(GstDriftMeasure *drift_measure);
+static void gst_drift_measure_stop_analysis_thread(GstDriftMeasure *drift_measure);
+static void gst_drift_measure_set_analysis_flushing(GstDriftMeasure *drift_measure, gboolean flushing);
+static void gst_drift_measure_drain_analysis_queue(GstDriftMeasure *drift_measure);
+static void gst_drift_measure_request_output_batch_push(GstDriftMeasure *drift_measure);
+static void gst_drift_measure_free_window_snapshot(GstDriftMeasureWindowSnapshot *snapshot);
+static GstFlowReturn gst_drift_measure_queue_window(GstDriftMeasure *drift_measure, DriftMeasureDetectorWindow *window, GstClockTime base);
+static gboolean gst_drift_measure_prepare_window_analysis(GstDriftMeasure *drift_measure, GstDriftMeasureWindowSnapshot const *snapshot);
+static void gst_drift_measure_hand_off_window_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureWindowSnapshot const *snapshot, guint64 timestamp, GstClockTimeDiff const *drifts);
+static gpointer gst_drift_measure_analysis_thread_main(gpointer data);
 static void gst_drift_measure_flush(GstDriftMeasure *drift_measure);
+static GstDriftMeasureParams * gst_drift_measure_copy_params(GstDriftMeasureParams const *params);
+static void gst_drift_measure_free_params(GstDriftMeasureParams *params);
+static GstDriftMeasureParams * gst_drift_measure_exchange_pending_params(GstDriftMeasure *drift_measure, GstDriftMeasureParams *params);
+static void gst_drift_measure_publish_params(GstDriftMeasure *drift_measure);
+static void gst_drift_measure_update_params(GstDriftMeasure *drift_measure);
 static GstFlowReturn gst_drift_measure_process_input_buffer(GstDriftMeasure *drift_measure, GstBuffer *input_buffer);
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+static void gst_drift_measure_add_detector_stats(DriftMeasureDetectorStats *sum, DriftMeasureDetectorStats const *stats);
+static void gst_drift_measure_retire_detector_stats(GstDriftMeasure *drift_measure, DriftMeasureDetectorStats const *stats);
+static void gst_drift_measure_get_stats(GstDriftMeasure *drift_measure, GstDriftMeasureStats *stats);
+static void gst_drift_measure_publish_stats(GstDriftMeasure *drift_measure);
+static GstStructure * gst_drift_measure_create_stats_structure(GstDriftMeasureStats const *stats);
+static void gst_drift_measure_post_stats_message(GstDriftMeasure *drift_measure);
+#endif
 
 
 
@@ -213,6 +666,100 @@ GType gst_undetected_peak_handling_get_type(void)
 }
 
 
+GType gst_peak_interpolation_get_type(void)
+{
+	static GType gst_peak_interpolation_type = 0;
+
+	if (!gst_peak_interpolation_type)
+	{
+		static GEnumValue peak_interpolation_values[] =
+		{
+			{ DRIFT_MEASURE_PEAK_INTERPOLATION_NONE, "No interpolation; drift values are multiples of the frame duration", "none" },
+			{ DRIFT_MEASURE_PEAK_INTERPOLATION_PARABOLIC, "Parabolic fit through the peak and its direct neighbours", "parabolic" },
+			{ DRIFT_MEASURE_PEAK_INTERPOLATION_SINC, "Windowed sinc reconstruction of the signal around the peak", "sinc" },
+			{ 0, NULL, NULL },
+		};
+
+		gst_peak_interpolation_type = g_enum_register_static(
+			"GstDriftMeasurePeakInterpolation",
+			peak_interpolation_values
+		);
+	}
+
+	return gst_peak_interpolation_type;
+}
+
+
+GType gst_queue_policy_get_type(void)
+{
+	static GType gst_queue_policy_type = 0;
+
+	if (!gst_queue_policy_type)
+	{
+		static GEnumValue queue_policy_values[] =
+		{
+			{ GST_DRIFT_MEASURE_QUEUE_POLICY_BLOCK, "Block the streaming thread until there is room in the queue", "block" },
+			{ GST_DRIFT_MEASURE_QUEUE_POLICY_DROP, "Drop the window; no dataset is produced for it", "drop" },
+			{ 0, NULL, NULL },
+		};
+
+		gst_queue_policy_type = g_enum_register_static(
+			"GstDriftMeasureQueuePolicy",
+			queue_policy_values
+		);
+	}
+
+	return gst_queue_policy_type;
+}
+
+
+GType gst_output_mode_get_type(void)
+{
+	static GType gst_output_mode_type = 0;
+
+	if (!gst_output_mode_type)
+	{
+		static GEnumValue output_mode_values[] =
+		{
+			{ GST_DRIFT_MEASURE_OUTPUT_MODE_MEASUREMENTS, "Output one row per measurement", "measurements" },
+			{ GST_DRIFT_MEASURE_OUTPUT_MODE_STATISTICS, "Output one row with per-channel statistics per statistics interval", "statistics" },
+			{ 0, NULL, NULL },
+		};
+
+		gst_output_mode_type = g_enum_register_static(
+			"GstDriftMeasureOutputMode",
+			output_mode_values
+		);
+	}
+
+	return gst_output_mode_type;
+}
+
+
+GType gst_detection_method_get_type(void)
+{
+	static GType gst_detection_method_type = 0;
+
+	if (!gst_detection_method_type)
+	{
+		static GEnumValue detection_method_values[] =
+		{
+			{ DRIFT_MEASURE_DETECTION_METHOD_PEAK, "Position of the largest sample in each channel", "peak" },
+			{ DRIFT_MEASURE_DETECTION_METHOD_CROSS_CORRELATION, "Cross-correlation of each channel with the reference channel", "cross-correlation" },
+			{ DRIFT_MEASURE_DETECTION_METHOD_MATCHED_FILTER, "Position of the largest output value of a filter matched to the pulse shape", "matched-filter" },
+			{ 0, NULL, NULL },
+		};
+
+		gst_detection_method_type = g_enum_register_static(
+			"GstDriftMeasureDetectionMethod",
+			detection_method_values
+		);
+	}
+
+	return gst_detection_method_type;
+}
+
+
 
 
 static void gst_drift_measure_class_init(GstDriftMeasureClass *klass)
@@ -226,13 +773,17 @@ static void gst_drift_measure_class_init(GstDriftMeasureClass *klass)
 	element_class = GST_ELEMENT_CLASS(klass);
 
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&static_sink_template));
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&static_request_sink_template));
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&static_src_template));
 
 	object_class->dispose      = GST_DEBUG_FUNCPTR(gst_drift_measure_dispose);
+	object_class->finalize     = GST_DEBUG_FUNCPTR(gst_drift_measure_finalize);
 	object_class->set_property = GST_DEBUG_FUNCPTR(gst_drift_measure_set_property);
 	object_class->get_property = GST_DEBUG_FUNCPTR(gst_drift_measure_get_property);
 
-	element_class->change_state = GST_DEBUG_FUNCPTR(gst_drift_measure_change_state);
+	element_class->change_state    = GST_DEBUG_FUNCPTR(gst_drift_measure_change_state);
+	element_class->request_new_pad = GST_DEBUG_FUNCPTR(gst_drift_measure_request_new_pad);
+	element_class->release_pad     = GST_DEBUG_FUNCPTR(gst_drift_measure_release_pad);
 
 	gst_element_class_set_static_metadata(
 		element_class,
@@ -331,119 +882,608 @@ static void gst_drift_measure_class_init(GstDriftMeasureClass *klass)
 			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
 		)
 	);
-}
-
 
-static void gst_drift_measure_init(GstDriftMeasure *drift_measure)
-{
-	drift_measure->window_size = DEFAULT_WINDOW_SIZE;
-	drift_measure->pulse_length = DEFAULT_PULSE_LENGTH;
-	drift_measure->peak_threshold = DEFAULT_PEAK_THRESHOLD;
-	drift_measure->reference_channel = DEFAULT_REFERENCE_CHANNEL;
-	drift_measure->undetected_peak_handling = DEFAULT_UNDETECTED_PEAK_HANDLING;
-	drift_measure->undetected_peak_fill_value = DEFAULT_UNDETECTED_PEAK_FILL_VALUE;
-	drift_measure->omit_output_if_no_peaks = DEFAULT_OMIT_OUTPUT_IF_NO_PEAKS;
+	g_object_class_install_property(
+		object_class,
+		PROP_PEAK_INTERPOLATION,
+		g_param_spec_enum(
+			"peak-interpolation",
+			"Peak interpolation",
+			"How to estimate the position of peaks between frames, for drift values with sub-frame precision",
+			gst_peak_interpolation_get_type(),
+			DEFAULT_PEAK_INTERPOLATION,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-	drift_measure->output_segment_started = FALSE;
-	drift_measure->src_caps = gst_caps_new_empty_simple(CSV_CAPS);
+	g_object_class_install_property(
+		object_class,
+		PROP_DETECTION_METHOD,
+		g_param_spec_enum(
+			"detection-method",
+			"Detection method",
+			"How to determine the position of the pulse in the non-reference channels",
+			gst_detection_method_get_type(),
+			DEFAULT_DETECTION_METHOD,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-	gst_audio_info_init(&(drift_measure->input_audio_info));
-	drift_measure->input_audio_info_valid = FALSE;
+	g_object_class_install_property(
+		object_class,
+		PROP_PULSE_FREQUENCY,
+		g_param_spec_double(
+			"pulse-frequency",
+			"Pulse frequency",
+			"Frequency of the sine wave the pulses consist of, in Hz (used by the matched-filter detection method if no pulse template is set)",
+			1.0, G_MAXDOUBLE,
+			DEFAULT_PULSE_FREQUENCY,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-	drift_measure->frame_history = gst_adapter_new();
-	drift_measure->mode = DRIFT_MEASUREMENT_MODE_PEAK_SEARCH;
-	drift_measure->window_size_in_frames = 0;
-	drift_measure->peak_frame_index = 0;
-	drift_measure->total_num_input_frames_seen = 0;
+	g_object_class_install_property(
+		object_class,
+		PROP_PULSE_TEMPLATE_LOCATION,
+		g_param_spec_string(
+			"pulse-template-location",
+			"Pulse template location",
+			"Path to a WAV file containing one pulse (used by the matched-filter detection method); if not set, a sine pulse is generated out of pulse-length and pulse-frequency",
+			DEFAULT_PULSE_TEMPLATE_LOCATION,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-	memset(&(drift_measure->last_dataset), 0, sizeof(GstDriftMeasureDataset));
-	memset(&(drift_measure->current_dataset), 0, sizeof(GstDriftMeasureDataset));
+	g_object_class_install_property(
+		object_class,
+		PROP_N_THREADS,
+		g_param_spec_uint(
+			"n-threads",
+			"Number of threads",
+			"Number of threads that analyze the channels of a window (0 = one per CPU core; 1 = analyze in the streaming thread only)",
+			0, G_MAXINT,
+			DEFAULT_N_THREADS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-	drift_measure->output_buffer_pool = NULL;
+	g_object_class_install_property(
+		object_class,
+		PROP_ANALYSIS_QUEUE_SIZE,
+		g_param_spec_uint(
+			"analysis-queue-size",
+			"Analysis queue size",
+			"Maximum number of windows waiting for analysis in a separate thread (0 = analyze in the streaming thread)",
+			0, G_MAXINT / 2,
+			DEFAULT_ANALYSIS_QUEUE_SIZE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY
+		)
+	);
 
-	drift_measure->sinkpad = gst_pad_new_from_static_template(&static_sink_template, "sink");
-	gst_pad_set_event_function(drift_measure->sinkpad, GST_DEBUG_FUNCPTR(gst_drift_measure_sink_event));
-	gst_pad_set_chain_function(drift_measure->sinkpad, GST_DEBUG_FUNCPTR(gst_drift_measure_chain));
-	gst_element_add_pad(GST_ELEMENT(drift_measure), drift_measure->sinkpad);
+	g_object_class_install_property(
+		object_class,
+		PROP_ANALYSIS_QUEUE_POLICY,
+		g_param_spec_enum(
+			"analysis-queue-policy",
+			"Analysis queue policy",
+			"What to do with a window if the analysis queue is full",
+			gst_queue_policy_get_type(),
+			DEFAULT_ANALYSIS_QUEUE_POLICY,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-	drift_measure->srcpad = gst_pad_new_from_static_template(&static_src_template, "src");
-	gst_element_add_pad(GST_ELEMENT(drift_measure), drift_measure->srcpad);
-}
+	g_object_class_install_property(
+		object_class,
+		PROP_ANALYSIS_QUEUE_DEPTH,
+		g_param_spec_uint(
+			"analysis-queue-depth",
+			"Analysis queue depth",
+			"Number of windows that are waiting for or undergoing analysis in the analysis thread",
+			0, G_MAXUINT,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
+	g_object_class_install_property(
+		object_class,
+		PROP_NUM_DROPPED_WINDOWS,
+		g_param_spec_uint(
+			"num-dropped-windows",
+			"Number of dropped windows",
+			"Number of windows that were dropped because the analysis queue was full",
+			0, G_MAXUINT,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-static void gst_drift_measure_dispose(GObject *object)
-{
-	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(object);
+	g_object_class_install_property(
+		object_class,
+		PROP_HISTORY_MEMORY_SIZE,
+		g_param_spec_uint64(
+			"history-memory-size",
+			"History memory size",
+			"Number of bytes allocated for the frame history (0 if no input caps are set yet)",
+			0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-	if (drift_measure->src_caps != NULL)
-	{
-		gst_caps_unref(drift_measure->src_caps);
-		drift_measure->src_caps = NULL;
-	}
+	g_object_class_install_property(
+		object_class,
+		PROP_OUTPUT_BATCH_ROWS,
+		g_param_spec_uint(
+			"output-batch-rows",
+			"Output batch rows",
+			"Maximum number of CSV rows to collect before pushing them downstream in one buffer",
+			1, 65536,
+			DEFAULT_OUTPUT_BATCH_ROWS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY
+		)
+	);
 
-	G_OBJECT_CLASS(gst_drift_measure_parent_class)->dispose(object);
-}
+	g_object_class_install_property(
+		object_class,
+		PROP_OUTPUT_BATCH_SIZE,
+		g_param_spec_uint(
+			"output-batch-size",
+			"Output batch size",
+			"Number of bytes of collected CSV rows at which they are pushed downstream (0 = no limit)",
+			0, G_MAXINT,
+			DEFAULT_OUTPUT_BATCH_SIZE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY
+		)
+	);
 
+	g_object_class_install_property(
+		object_class,
+		PROP_OUTPUT_BATCH_LATENCY,
+		g_param_spec_uint64(
+			"output-batch-latency",
+			"Output batch latency",
+			"Maximum time in nanoseconds collected CSV rows may wait before they are pushed downstream (-1 = no limit)",
+			0, G_MAXUINT64,
+			DEFAULT_OUTPUT_BATCH_LATENCY,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-static void gst_drift_measure_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec)
-{
-	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(object);
+	g_object_class_install_property(
+		object_class,
+		PROP_POST_MESSAGES,
+		g_param_spec_boolean(
+			"post-messages",
+			"Post messages",
+			"Post a drift-measurement element message on the bus for each measurement",
+			DEFAULT_POST_MESSAGES,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-	switch (prop_id)
-	{
-		case PROP_WINDOW_SIZE:
-		{
-			GST_OBJECT_LOCK(object);
-			drift_measure->window_size = g_value_get_uint64(value);
-			if (drift_measure->input_audio_info_valid)
-				gst_drift_measure_recalculate_num_window_frames(drift_measure);
-			gst_drift_measure_flush(drift_measure);
-			GST_OBJECT_UNLOCK(object);
-			break;
-		}
+	g_object_class_install_property(
+		object_class,
+		PROP_ATTACH_META,
+		g_param_spec_boolean(
+			"attach-meta",
+			"Attach meta",
+			"Attach a GstDriftMeasureMeta with the measurements to output buffers",
+			DEFAULT_ATTACH_META,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-		case PROP_PULSE_LENGTH:
-		{
-			GST_OBJECT_LOCK(object);
-			drift_measure->pulse_length = g_value_get_uint64(value);
-			gst_drift_measure_flush(drift_measure);
-			GST_OBJECT_UNLOCK(object);
-			break;
-		}
+	g_object_class_install_property(
+		object_class,
+		PROP_OUTPUT_MODE,
+		g_param_spec_enum(
+			"output-mode",
+			"Output mode",
+			"Whether to output the individual measurements or statistics over them (statistics are always CSV)",
+			gst_output_mode_get_type(),
+			DEFAULT_OUTPUT_MODE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY
+		)
+	);
 
-		case PROP_PEAK_THRESHOLD:
-		{
-			GST_OBJECT_LOCK(object);
-			drift_measure->peak_threshold = g_value_get_float(value);
-			gst_drift_measure_flush(drift_measure);
-			GST_OBJECT_UNLOCK(object);
-			break;
-		}
+	g_object_class_install_property(
+		object_class,
+		PROP_STATISTICS_PULSES,
+		g_param_spec_uint(
+			"statistics-pulses",
+			"Statistics pulses",
+			"Number of measurements after which statistics are produced (0 = not based on the number of measurements)",
+			0, G_MAXUINT,
+			DEFAULT_STATISTICS_PULSES,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-		case PROP_REFERENCE_CHANNEL:
-		{
-			guint reference_channel;
+	g_object_class_install_property(
+		object_class,
+		PROP_STATISTICS_INTERVAL,
+		g_param_spec_uint64(
+			"statistics-interval",
+			"Statistics interval",
+			"Time span of measurements in nanoseconds after which statistics are produced (0 = not based on time)",
+			0, G_MAXUINT64,
+			DEFAULT_STATISTICS_INTERVAL,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
 
-			GST_OBJECT_LOCK(object);
+	g_object_class_install_property(
+		object_class,
+		PROP_STATISTICS_WINDOW,
+		g_param_spec_uint(
+			"statistics-window",
+			"Statistics window",
+			"Number of most recent measurements the drift slope is computed over",
+			2, 65536,
+			DEFAULT_STATISTICS_WINDOW,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY
+		)
+	);
+
+	g_object_class_install_property(
+		object_class,
+		PROP_STATISTICS_EWMA_WEIGHT,
+		g_param_spec_double(
+			"statistics-ewma-weight",
+			"Statistics EWMA weight",
+			"Weight of a new measurement in the exponentially weighted moving average of the drift",
+			0.0, 1.0,
+			DEFAULT_STATISTICS_EWMA_WEIGHT,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY
+		)
+	);
 
-			reference_channel = g_value_get_uint(value);
+	g_object_class_install_property(
+		object_class,
+		PROP_OUTPUT_TRACKING,
+		g_param_spec_boolean(
+			"output-tracking",
+			"Output tracking",
+			"Add columns with the tracked offset, clock rate error, and its uncertainty to CSV measurement rows",
+			DEFAULT_OUTPUT_TRACKING,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY
+		)
+	);
 
-			if (!gst_drift_measure_validate_reference_channel(drift_measure))
-				break;
+	g_object_class_install_property(
+		object_class,
+		PROP_TRACKING_MEASUREMENT_NOISE,
+		g_param_spec_double(
+			"tracking-measurement-noise",
+			"Tracking measurement noise",
+			"Expected standard deviation of measured drifts in nanoseconds, used for tracking",
+			1.0, G_MAXDOUBLE,
+			DEFAULT_TRACKING_MEASUREMENT_NOISE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY
+		)
+	);
 
-			drift_measure->reference_channel = reference_channel;
-			gst_drift_measure_flush(drift_measure);
+	g_object_class_install_property(
+		object_class,
+		PROP_TRACKING_RATE_NOISE,
+		g_param_spec_double(
+			"tracking-rate-noise",
+			"Tracking rate noise",
+			"Expected standard deviation of clock rate error changes over one second in ppm, used for tracking",
+			0.0, G_MAXDOUBLE,
+			DEFAULT_TRACKING_RATE_NOISE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY
+		)
+	);
+
+	g_object_class_install_property(
+		object_class,
+		PROP_TRACKING_ESTIMATES,
+		g_param_spec_boxed(
+			"tracking-estimates",
+			"Tracking estimates",
+			"Tracked offsets, clock rate errors, and their uncertainties of the non-reference channels (NULL if no input caps are set yet)",
+			GST_TYPE_STRUCTURE,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+
+	g_object_class_install_property(
+		object_class,
+		PROP_MAX_INPUT_QUEUE_TIME,
+		g_param_spec_uint64(
+			"max-input-queue-time",
+			"Maximum input queue time",
+			"Amount of audio a sink_%u request pad can queue while waiting for the other request pads, in nanoseconds (0 = queue one buffer at a time)",
+			0, G_MAXUINT64,
+			DEFAULT_MAX_INPUT_QUEUE_TIME,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING
+		)
+	);
+
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	g_object_class_install_property(
+		object_class,
+		PROP_STATS,
+		g_param_spec_boxed(
+			"stats",
+			"Stats",
+			"Frame and peak search counters, and processing times per stage in nanoseconds, gathered since the element was created",
+			GST_TYPE_STRUCTURE,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+
+	g_object_class_install_property(
+		object_class,
+		PROP_STATS_INTERVAL,
+		g_param_spec_uint64(
+			"stats-interval",
+			"Stats interval",
+			"Amount of input after which the stats are posted as an element message, in nanoseconds (0 = never)",
+			0, G_MAXUINT64,
+			DEFAULT_STATS_INTERVAL,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING
+		)
+	);
+#endif
+}
+
+
+static void gst_drift_measure_init(GstDriftMeasure *drift_measure)
+{
+	drift_measure->property_params.window_size = DEFAULT_WINDOW_SIZE;
+	drift_measure->property_params.pulse_length = DEFAULT_PULSE_LENGTH;
+	drift_measure->property_params.peak_threshold = DEFAULT_PEAK_THRESHOLD;
+	drift_measure->property_params.reference_channel = DEFAULT_REFERENCE_CHANNEL;
+	drift_measure->property_params.undetected_peak_handling = DEFAULT_UNDETECTED_PEAK_HANDLING;
+	drift_measure->property_params.undetected_peak_fill_value = DEFAULT_UNDETECTED_PEAK_FILL_VALUE;
+	drift_measure->property_params.omit_output_if_no_peaks = DEFAULT_OMIT_OUTPUT_IF_NO_PEAKS;
+	drift_measure->property_params.peak_interpolation = DEFAULT_PEAK_INTERPOLATION;
+	drift_measure->property_params.detection_method = DEFAULT_DETECTION_METHOD;
+	drift_measure->property_params.pulse_frequency = DEFAULT_PULSE_FREQUENCY;
+	drift_measure->pulse_template_location = g_strdup(DEFAULT_PULSE_TEMPLATE_LOCATION);
+	drift_measure->property_params.n_threads = DEFAULT_N_THREADS;
+	drift_measure->property_params.analysis_queue_size = DEFAULT_ANALYSIS_QUEUE_SIZE;
+	drift_measure->property_params.analysis_queue_policy = DEFAULT_ANALYSIS_QUEUE_POLICY;
+	drift_measure->property_params.output_batch_rows = DEFAULT_OUTPUT_BATCH_ROWS;
+	drift_measure->property_params.output_batch_size = DEFAULT_OUTPUT_BATCH_SIZE;
+	drift_measure->property_params.output_batch_latency = DEFAULT_OUTPUT_BATCH_LATENCY;
+	drift_measure->property_params.post_messages = DEFAULT_POST_MESSAGES;
+	drift_measure->property_params.attach_meta = DEFAULT_ATTACH_META;
+	drift_measure->property_params.output_mode = DEFAULT_OUTPUT_MODE;
+	drift_measure->property_params.statistics_pulses = DEFAULT_STATISTICS_PULSES;
+	drift_measure->property_params.statistics_interval = DEFAULT_STATISTICS_INTERVAL;
+	drift_measure->property_params.statistics_window = DEFAULT_STATISTICS_WINDOW;
+	drift_measure->property_params.statistics_ewma_weight = DEFAULT_STATISTICS_EWMA_WEIGHT;
+	drift_measure->property_params.output_tracking = DEFAULT_OUTPUT_TRACKING;
+	drift_measure->property_params.tracking_measurement_noise = DEFAULT_TRACKING_MEASUREMENT_NOISE;
+	drift_measure->property_params.tracking_rate_noise = DEFAULT_TRACKING_RATE_NOISE;
+	drift_measure->property_params.max_input_queue_time = DEFAULT_MAX_INPUT_QUEUE_TIME;
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	drift_measure->property_params.stats_interval = DEFAULT_STATS_INTERVAL;
+#endif
+	drift_measure->property_params.pulse_template = NULL;
+	drift_measure->property_params.pulse_template_rate = 0;
+
+	drift_measure->pending_params = NULL;
+	drift_measure->params = gst_drift_measure_copy_params(&(drift_measure->property_params));
+	g_mutex_init(&(drift_measure->process_mutex));
+
+	drift_measure->published_history_memory_size = 0;
+	drift_measure->published_estimates = NULL;
+	drift_measure->num_published_estimates = 0;
+
+	drift_measure->output_segment_started = FALSE;
+	drift_measure->src_caps = gst_caps_new_empty_simple(CSV_CAPS);
+	drift_measure->output_format = GST_DRIFT_MEASURE_OUTPUT_FORMAT_CSV;
+	drift_measure->output_mode = DEFAULT_OUTPUT_MODE;
+	drift_measure->output_tracking = DEFAULT_OUTPUT_TRACKING;
+	drift_measure->output_caps_pending = TRUE;
+
+	gst_audio_info_init(&(drift_measure->input_audio_info));
+	drift_measure->input_audio_info_valid = FALSE;
+	drift_measure->input_sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_F32;
+
+	drift_measure->detector = NULL;
+	drift_measure->history_generation = 0;
+	drift_measure->detector_generation = 0;
+
+	memset(&(drift_measure->last_dataset), 0, sizeof(GstDriftMeasureDataset));
+	memset(&(drift_measure->current_dataset), 0, sizeof(GstDriftMeasureDataset));
+
+	drift_measure->analysis_thread_pool = NULL;
+	drift_measure->num_analysis_threads = 0;
+	drift_measure->analysis_task_func = NULL;
+	drift_measure->num_pending_analysis_tasks = 0;
+	g_mutex_init(&(drift_measure->analysis_mutex));
+	g_cond_init(&(drift_measure->analysis_cond));
+
+	drift_measure->analysis_queue = NULL;
+	drift_measure->analysis_thread = NULL;
+	g_mutex_init(&(drift_measure->queue_mutex));
+	g_cond_init(&(drift_measure->queue_cond));
+	drift_measure->analysis_thread_stopping = FALSE;
+	drift_measure->analysis_flushing = FALSE;
+	drift_measure->output_batch_push_requested = FALSE;
+	drift_measure->num_queued_windows = 0;
+	drift_measure->num_dropped_windows = 0;
+	drift_measure->analysis_flow_ret = GST_FLOW_OK;
+	drift_measure->analysis_detector = NULL;
+	drift_measure->analysis_detector_generation = 0;
+
+	drift_measure->output_buffer_pool = NULL;
+	drift_measure->max_output_row_size = 0;
+
+	drift_measure->output_batch = NULL;
+	drift_measure->output_batch_fill_size = 0;
+	drift_measure->num_output_batch_rows = 0;
+	drift_measure->max_output_batch_rows = 0;
+	drift_measure->output_batch_start_time = 0;
+	drift_measure->output_batch_pushing = FALSE;
+	g_cond_init(&(drift_measure->output_batch_push_cond));
+
+	drift_measure->statistics = NULL;
+	drift_measure->tracker = NULL;
+
+	drift_measure->inputs = g_ptr_array_new();
+	drift_measure->next_input_index = 0;
+	g_mutex_init(&(drift_measure->input_mutex));
+	g_cond_init(&(drift_measure->input_cond));
+	g_mutex_init(&(drift_measure->combine_mutex));
+	drift_measure->inputs_configured = FALSE;
+	drift_measure->inputs_aligned = FALSE;
+	drift_measure->inputs_eos = FALSE;
+	drift_measure->stream_start_forwarded = FALSE;
+	drift_measure->combined_frames = NULL;
+	drift_measure->combined_frames_size = 0;
+
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	memset(&(drift_measure->retired_detector_stats), 0, sizeof(DriftMeasureDetectorStats));
+	memset(&(drift_measure->analysis_detector_stats), 0, sizeof(DriftMeasureDetectorStats));
+	drift_measure->format_time = 0;
+	drift_measure->push_time = 0;
+	drift_measure->output_row_start_time = 0;
+	drift_measure->num_stats_frames = 0;
+	memset(&(drift_measure->published_stats), 0, sizeof(GstDriftMeasureStats));
+#endif
+
+	drift_measure->sinkpad = gst_pad_new_from_static_template(&static_sink_template, "sink");
+	gst_pad_set_event_function(drift_measure->sinkpad, GST_DEBUG_FUNCPTR(gst_drift_measure_sink_event));
+	gst_pad_set_chain_function(drift_measure->sinkpad, GST_DEBUG_FUNCPTR(gst_drift_measure_chain));
+	gst_element_add_pad(GST_ELEMENT(drift_measure), drift_measure->sinkpad);
+
+	drift_measure->srcpad = gst_pad_new_from_static_template(&static_src_template, "src");
+	gst_element_add_pad(GST_ELEMENT(drift_measure), drift_measure->srcpad);
+}
+
+
+static void gst_drift_measure_dispose(GObject *object)
+{
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(object);
+
+	/* Normally, the thread is already stopped by the PAUSED->READY state
+	 * change. This stops it if that state change never happened. */
+	gst_drift_measure_stop_analysis_thread(drift_measure);
+
+	if (drift_measure->src_caps != NULL)
+	{
+		gst_caps_unref(drift_measure->src_caps);
+		drift_measure->src_caps = NULL;
+	}
+
+	drift_measure_detector_free(drift_measure->detector);
+	drift_measure->detector = NULL;
+
+	gst_drift_measure_free_analysis_threads(drift_measure);
+
+	drift_measure_drift_stats_free(drift_measure->statistics);
+	drift_measure->statistics = NULL;
+	drift_measure_drift_tracker_free(drift_measure->tracker);
+	drift_measure->tracker = NULL;
+
+	/* The request pads themselves are released by GstElement. */
+	if (drift_measure->inputs != NULL)
+	{
+		guint i;
+		for (i = 0; i < drift_measure->inputs->len; ++i)
+			gst_drift_measure_free_input(g_ptr_array_index(drift_measure->inputs, i));
+		g_ptr_array_free(drift_measure->inputs, TRUE);
+		drift_measure->inputs = NULL;
+	}
+	g_free(drift_measure->combined_frames);
+	drift_measure->combined_frames = NULL;
+	drift_measure->combined_frames_size = 0;
+
+	gst_drift_measure_free_params(gst_drift_measure_exchange_pending_params(drift_measure, NULL));
+	gst_drift_measure_free_params(drift_measure->params);
+	drift_measure->params = NULL;
+	if (drift_measure->property_params.pulse_template != NULL)
+	{
+		g_bytes_unref(drift_measure->property_params.pulse_template);
+		drift_measure->property_params.pulse_template = NULL;
+	}
+	g_free(drift_measure->pulse_template_location);
+	drift_measure->pulse_template_location = NULL;
+
+	g_free(drift_measure->published_estimates);
+	drift_measure->published_estimates = NULL;
+	drift_measure->num_published_estimates = 0;
+
+	G_OBJECT_CLASS(gst_drift_measure_parent_class)->dispose(object);
+}
+
+
+static void gst_drift_measure_finalize(GObject *object)
+{
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(object);
+
+	g_mutex_clear(&(drift_measure->analysis_mutex));
+	g_cond_clear(&(drift_measure->analysis_cond));
+	g_mutex_clear(&(drift_measure->queue_mutex));
+	g_cond_clear(&(drift_measure->queue_cond));
+	g_cond_clear(&(drift_measure->output_batch_push_cond));
+	g_mutex_clear(&(drift_measure->input_mutex));
+	g_cond_clear(&(drift_measure->input_cond));
+	g_mutex_clear(&(drift_measure->combine_mutex));
+	g_mutex_clear(&(drift_measure->process_mutex));
+
+	G_OBJECT_CLASS(gst_drift_measure_parent_class)->finalize(object);
+}
+
+
+static void gst_drift_measure_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec)
+{
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(object);
+
+	/* The new values are only stored here, and then published. The
+	 * streaming thread applies them at the next buffer boundary, so a
+	 * setter never waits for processing, and each buffer is processed
+	 * with one consistent set of values. Changes that require a new
+	 * detector or a flush are dealt with there as well; see
+	 * gst_drift_measure_update_params(). */
+
+	switch (prop_id)
+	{
+		case PROP_WINDOW_SIZE:
+		{
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.window_size = g_value_get_uint64(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
+
+		case PROP_PULSE_LENGTH:
+		{
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.pulse_length = g_value_get_uint64(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
 
+		case PROP_PEAK_THRESHOLD:
+		{
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.peak_threshold = g_value_get_float(value);
 			GST_OBJECT_UNLOCK(object);
+			break;
+		}
 
+		case PROP_REFERENCE_CHANNEL:
+		{
+			/* Validated against the input caps once it is used. */
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.reference_channel = g_value_get_uint(value);
+			GST_OBJECT_UNLOCK(object);
 			break;
 		}
 
 		case PROP_UNDETECTED_PEAK_HANDLING:
 		{
 			GST_OBJECT_LOCK(object);
-			drift_measure->undetected_peak_handling = g_value_get_enum(value);
-			gst_drift_measure_flush(drift_measure);
+			drift_measure->property_params.undetected_peak_handling = g_value_get_enum(value);
 			GST_OBJECT_UNLOCK(object);
 			break;
 		}
@@ -451,7 +1491,7 @@ static void gst_drift_measure_set_property(GObject *object, guint prop_id, GValu
 		case PROP_UNDETECTED_PEAK_FILL_VALUE:
 		{
 			GST_OBJECT_LOCK(object);
-			drift_measure->undetected_peak_fill_value = g_value_get_int64(value);
+			drift_measure->property_params.undetected_peak_fill_value = g_value_get_int64(value);
 			GST_OBJECT_UNLOCK(object);
 			break;
 		}
@@ -459,881 +1499,3467 @@ static void gst_drift_measure_set_property(GObject *object, guint prop_id, GValu
 		case PROP_OMIT_OUTPUT_IF_NO_PEAKS:
 		{
 			GST_OBJECT_LOCK(object);
-			drift_measure->omit_output_if_no_peaks = g_value_get_boolean(value);
+			drift_measure->property_params.omit_output_if_no_peaks = g_value_get_boolean(value);
 			GST_OBJECT_UNLOCK(object);
 			break;
 		}
 
-		default:
-			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		case PROP_PEAK_INTERPOLATION:
+		{
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.peak_interpolation = g_value_get_enum(value);
+			GST_OBJECT_UNLOCK(object);
 			break;
-	}
-}
+		}
 
+		case PROP_DETECTION_METHOD:
+		{
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.detection_method = g_value_get_enum(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
 
-static void gst_drift_measure_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
-{
-	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(object);
+		case PROP_PULSE_FREQUENCY:
+		{
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.pulse_frequency = g_value_get_double(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
+
+		case PROP_PULSE_TEMPLATE_LOCATION:
+		{
+			gchar *location = g_value_dup_string(value);
+			gfloat *template_values = NULL;
+			gsize template_length = 0;
+			guint template_rate = 0;
+			GBytes *pulse_template = NULL;
+
+			/* Load the template before taking the lock, since reading
+			 * the file may take a while. If it cannot be loaded, the
+			 * generated template is used instead. */
+			if ((location != NULL) && gst_drift_measure_load_pulse_template(drift_measure, location, &template_values, &template_length, &template_rate))
+				pulse_template = g_bytes_new_with_free_func(template_values, template_length * sizeof(gfloat), free, template_values);
 
-	switch (prop_id)
-	{
-		case PROP_WINDOW_SIZE:
 			GST_OBJECT_LOCK(object);
-			g_value_set_uint64(value, drift_measure->window_size);
+			g_free(drift_measure->pulse_template_location);
+			drift_measure->pulse_template_location = location;
+			if (drift_measure->property_params.pulse_template != NULL)
+				g_bytes_unref(drift_measure->property_params.pulse_template);
+			drift_measure->property_params.pulse_template = pulse_template;
+			drift_measure->property_params.pulse_template_rate = template_rate;
 			GST_OBJECT_UNLOCK(object);
 			break;
+		}
 
-		case PROP_PULSE_LENGTH:
+		case PROP_N_THREADS:
+		{
+			/* The thread pool is set up again before the next analysis. */
 			GST_OBJECT_LOCK(object);
-			g_value_set_uint64(value, drift_measure->pulse_length);
+			drift_measure->property_params.n_threads = g_value_get_uint(value);
 			GST_OBJECT_UNLOCK(object);
 			break;
+		}
 
-		case PROP_PEAK_THRESHOLD:
+		case PROP_ANALYSIS_QUEUE_SIZE:
+		{
+			/* Takes effect with the next READY->PAUSED state change. */
 			GST_OBJECT_LOCK(object);
-			g_value_set_float(value, drift_measure->peak_threshold);
+			drift_measure->property_params.analysis_queue_size = g_value_get_uint(value);
 			GST_OBJECT_UNLOCK(object);
 			break;
+		}
 
-		case PROP_REFERENCE_CHANNEL:
+		case PROP_ANALYSIS_QUEUE_POLICY:
+		{
 			GST_OBJECT_LOCK(object);
-			g_value_set_uint(value, drift_measure->reference_channel);
+			drift_measure->property_params.analysis_queue_policy = g_value_get_enum(value);
 			GST_OBJECT_UNLOCK(object);
 			break;
+		}
 
-		case PROP_UNDETECTED_PEAK_HANDLING:
+		case PROP_OUTPUT_BATCH_ROWS:
+		{
+			/* Takes effect with the next caps event, since
+			 * the output buffer pool is sized for the batches. */
 			GST_OBJECT_LOCK(object);
-			g_value_set_enum(value, drift_measure->undetected_peak_handling);
+			drift_measure->property_params.output_batch_rows = g_value_get_uint(value);
 			GST_OBJECT_UNLOCK(object);
 			break;
+		}
 
-		case PROP_UNDETECTED_PEAK_FILL_VALUE:
+		case PROP_OUTPUT_BATCH_SIZE:
+		{
 			GST_OBJECT_LOCK(object);
-			g_value_set_int64(value, drift_measure->undetected_peak_fill_value);
+			drift_measure->property_params.output_batch_size = g_value_get_uint(value);
 			GST_OBJECT_UNLOCK(object);
 			break;
+		}
 
-		case PROP_OMIT_OUTPUT_IF_NO_PEAKS:
+		case PROP_OUTPUT_BATCH_LATENCY:
+		{
 			GST_OBJECT_LOCK(object);
-			g_value_set_boolean(value, drift_measure->omit_output_if_no_peaks);
+			drift_measure->property_params.output_batch_latency = g_value_get_uint64(value);
 			GST_OBJECT_UNLOCK(object);
 			break;
+		}
 
-		default:
-			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		case PROP_POST_MESSAGES:
+		{
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.post_messages = g_value_get_boolean(value);
+			GST_OBJECT_UNLOCK(object);
 			break;
-	}
-}
+		}
 
+		case PROP_ATTACH_META:
+		{
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.attach_meta = g_value_get_boolean(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
 
-static GstStateChangeReturn gst_drift_measure_change_state(GstElement *element, GstStateChange transition)
-{
-	GstStateChangeReturn ret;
-	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(element);
+		case PROP_OUTPUT_MODE:
+		{
+			/* Takes effect with the next caps event, since
+			 * it affects output format negotiation. */
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.output_mode = g_value_get_enum(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
 
-	ret = GST_ELEMENT_CLASS(gst_drift_measure_parent_class)->change_state(element, transition);
-	if (ret == GST_STATE_CHANGE_FAILURE)
-		return ret;
+		case PROP_STATISTICS_PULSES:
+		{
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.statistics_pulses = g_value_get_uint(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
 
-	switch (transition)
-	{
-		case GST_STATE_CHANGE_PAUSED_TO_READY:
+		case PROP_STATISTICS_INTERVAL:
+		{
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.statistics_interval = g_value_get_uint64(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
+
+		case PROP_STATISTICS_WINDOW:
 		{
-			GST_OBJECT_LOCK(drift_measure);
+			/* Takes effect with the next caps event. */
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.statistics_window = g_value_get_uint(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
 
-			gst_drift_measure_flush(drift_measure);
+		case PROP_STATISTICS_EWMA_WEIGHT:
+		{
+			/* Takes effect with the next caps event. */
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.statistics_ewma_weight = g_value_get_double(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
 
-			gst_drift_measure_free_dataset(drift_measure, &(drift_measure->last_dataset));
-			gst_drift_measure_free_dataset(drift_measure, &(drift_measure->current_dataset));
+		case PROP_OUTPUT_TRACKING:
+		{
+			/* Takes effect with the next caps event. */
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.output_tracking = g_value_get_boolean(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
+
+		case PROP_TRACKING_MEASUREMENT_NOISE:
+		{
+			/* Takes effect with the next caps event. */
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.tracking_measurement_noise = g_value_get_double(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
+
+		case PROP_TRACKING_RATE_NOISE:
+		{
+			/* Takes effect with the next caps event. */
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.tracking_rate_noise = g_value_get_double(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+		}
+
+		case PROP_MAX_INPUT_QUEUE_TIME:
+		{
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.max_input_queue_time = g_value_get_uint64(value);
+			GST_OBJECT_UNLOCK(object);
+
+			/* Let blocked request pads check against the new limit. */
+			g_mutex_lock(&(drift_measure->input_mutex));
+			g_cond_broadcast(&(drift_measure->input_cond));
+			g_mutex_unlock(&(drift_measure->input_mutex));
+			break;
+		}
+
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+		case PROP_STATS_INTERVAL:
+			GST_OBJECT_LOCK(object);
+			drift_measure->property_params.stats_interval = g_value_get_uint64(value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+#endif
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			return;
+	}
+
+	gst_drift_measure_publish_params(drift_measure);
+}
+
+
+static void gst_drift_measure_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(object);
+
+	switch (prop_id)
+	{
+		case PROP_WINDOW_SIZE:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint64(value, drift_measure->property_params.window_size);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_PULSE_LENGTH:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint64(value, drift_measure->property_params.pulse_length);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_PEAK_THRESHOLD:
+			GST_OBJECT_LOCK(object);
+			g_value_set_float(value, drift_measure->property_params.peak_threshold);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_REFERENCE_CHANNEL:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint(value, drift_measure->property_params.reference_channel);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_UNDETECTED_PEAK_HANDLING:
+			GST_OBJECT_LOCK(object);
+			g_value_set_enum(value, drift_measure->property_params.undetected_peak_handling);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_UNDETECTED_PEAK_FILL_VALUE:
+			GST_OBJECT_LOCK(object);
+			g_value_set_int64(value, drift_measure->property_params.undetected_peak_fill_value);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_OMIT_OUTPUT_IF_NO_PEAKS:
+			GST_OBJECT_LOCK(object);
+			g_value_set_boolean(value, drift_measure->property_params.omit_output_if_no_peaks);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_PEAK_INTERPOLATION:
+			GST_OBJECT_LOCK(object);
+			g_value_set_enum(value, drift_measure->property_params.peak_interpolation);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_DETECTION_METHOD:
+			GST_OBJECT_LOCK(object);
+			g_value_set_enum(value, drift_measure->property_params.detection_method);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_PULSE_FREQUENCY:
+			GST_OBJECT_LOCK(object);
+			g_value_set_double(value, drift_measure->property_params.pulse_frequency);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_PULSE_TEMPLATE_LOCATION:
+			GST_OBJECT_LOCK(object);
+			g_value_set_string(value, drift_measure->pulse_template_location);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_N_THREADS:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint(value, drift_measure->property_params.n_threads);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_ANALYSIS_QUEUE_SIZE:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint(value, drift_measure->property_params.analysis_queue_size);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_ANALYSIS_QUEUE_POLICY:
+			GST_OBJECT_LOCK(object);
+			g_value_set_enum(value, drift_measure->property_params.analysis_queue_policy);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_ANALYSIS_QUEUE_DEPTH:
+			g_value_set_uint(value, (guint)g_atomic_int_get(&(drift_measure->num_queued_windows)));
+			break;
+
+		case PROP_NUM_DROPPED_WINDOWS:
+			g_value_set_uint(value, (guint)g_atomic_int_get(&(drift_measure->num_dropped_windows)));
+			break;
+
+		case PROP_HISTORY_MEMORY_SIZE:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint64(value, drift_measure->published_history_memory_size);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_OUTPUT_BATCH_ROWS:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint(value, drift_measure->property_params.output_batch_rows);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_OUTPUT_BATCH_SIZE:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint(value, drift_measure->property_params.output_batch_size);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_OUTPUT_BATCH_LATENCY:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint64(value, drift_measure->property_params.output_batch_latency);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_POST_MESSAGES:
+			GST_OBJECT_LOCK(object);
+			g_value_set_boolean(value, drift_measure->property_params.post_messages);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_ATTACH_META:
+			GST_OBJECT_LOCK(object);
+			g_value_set_boolean(value, drift_measure->property_params.attach_meta);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_OUTPUT_MODE:
+			GST_OBJECT_LOCK(object);
+			g_value_set_enum(value, drift_measure->property_params.output_mode);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_STATISTICS_PULSES:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint(value, drift_measure->property_params.statistics_pulses);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_STATISTICS_INTERVAL:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint64(value, drift_measure->property_params.statistics_interval);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_STATISTICS_WINDOW:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint(value, drift_measure->property_params.statistics_window);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_STATISTICS_EWMA_WEIGHT:
+			GST_OBJECT_LOCK(object);
+			g_value_set_double(value, drift_measure->property_params.statistics_ewma_weight);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_OUTPUT_TRACKING:
+			GST_OBJECT_LOCK(object);
+			g_value_set_boolean(value, drift_measure->property_params.output_tracking);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_TRACKING_MEASUREMENT_NOISE:
+			GST_OBJECT_LOCK(object);
+			g_value_set_double(value, drift_measure->property_params.tracking_measurement_noise);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_TRACKING_RATE_NOISE:
+			GST_OBJECT_LOCK(object);
+			g_value_set_double(value, drift_measure->property_params.tracking_rate_noise);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_MAX_INPUT_QUEUE_TIME:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint64(value, drift_measure->property_params.max_input_queue_time);
+			GST_OBJECT_UNLOCK(object);
+			break;
+
+		case PROP_TRACKING_ESTIMATES:
+		{
+			GstStructure *structure = NULL;
+
+			GST_OBJECT_LOCK(object);
+			if (drift_measure->num_published_estimates > 0)
+			{
+				structure = gst_structure_new_empty("drift-tracking");
+				gst_drift_measure_add_tracking_fields(structure, drift_measure->published_estimates, drift_measure->num_published_estimates);
+			}
+			GST_OBJECT_UNLOCK(object);
+
+			g_value_take_boxed(value, structure);
+			break;
+		}
+
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+		case PROP_STATS:
+		{
+			GstDriftMeasureStats stats;
+
+			GST_OBJECT_LOCK(object);
+			stats = drift_measure->published_stats;
+			GST_OBJECT_UNLOCK(object);
+
+			g_value_take_boxed(value, gst_drift_measure_create_stats_structure(&stats));
+			break;
+		}
+
+		case PROP_STATS_INTERVAL:
+			GST_OBJECT_LOCK(object);
+			g_value_set_uint64(value, drift_measure->property_params.stats_interval);
+			GST_OBJECT_UNLOCK(object);
+			break;
+#endif
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+
+static GstStateChangeReturn gst_drift_measure_change_state(GstElement *element, GstStateChange transition)
+{
+	GstStateChangeReturn ret;
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(element);
+
+	switch (transition)
+	{
+		case GST_STATE_CHANGE_READY_TO_PAUSED:
+		{
+			if (!gst_drift_measure_start_analysis_thread(drift_measure))
+				return GST_STATE_CHANGE_FAILURE;
+
+			g_mutex_lock(&(drift_measure->input_mutex));
+			gst_drift_measure_reset_inputs(drift_measure);
+			g_mutex_unlock(&(drift_measure->input_mutex));
+			break;
+		}
+
+		case GST_STATE_CHANGE_PAUSED_TO_READY:
+		{
+			guint i;
+
+			/* Make sure the streaming threads do not wait for the analysis
+			 * queue or for the other request pads while the pads are
+			 * deactivated. */
+			gst_drift_measure_set_analysis_flushing(drift_measure, TRUE);
+
+			g_mutex_lock(&(drift_measure->input_mutex));
+			for (i = 0; i < drift_measure->inputs->len; ++i)
+				((GstDriftMeasureInput *)g_ptr_array_index(drift_measure->inputs, i))->flushing = TRUE;
+			g_cond_broadcast(&(drift_measure->input_cond));
+			g_mutex_unlock(&(drift_measure->input_mutex));
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	ret = GST_ELEMENT_CLASS(gst_drift_measure_parent_class)->change_state(element, transition);
+	if (ret == GST_STATE_CHANGE_FAILURE)
+	{
+		if (transition == GST_STATE_CHANGE_READY_TO_PAUSED)
+			gst_drift_measure_stop_analysis_thread(drift_measure);
+		return ret;
+	}
+
+	switch (transition)
+	{
+		case GST_STATE_CHANGE_PAUSED_TO_READY:
+		{
+			gst_drift_measure_stop_analysis_thread(drift_measure);
+
+			g_mutex_lock(&(drift_measure->process_mutex));
+
+			gst_drift_measure_flush(drift_measure);
+
+			gst_drift_measure_free_dataset(drift_measure, &(drift_measure->last_dataset));
+			gst_drift_measure_free_dataset(drift_measure, &(drift_measure->current_dataset));
+
+			if (drift_measure->statistics != NULL)
+				drift_measure_drift_stats_reset(drift_measure->statistics);
+			if (drift_measure->tracker != NULL)
+				drift_measure_drift_tracker_reset(drift_measure->tracker);
+			gst_drift_measure_publish_tracking_estimates(drift_measure);
+
+			/* Rows that are still pending cannot be pushed
+			 * anymore, since the pads are deactivated. */
+			gst_drift_measure_discard_output_batch(drift_measure);
+
+			drift_measure->output_segment_started = FALSE;
+			drift_measure->output_caps_pending = TRUE;
+
+			g_mutex_unlock(&(drift_measure->process_mutex));
+
+			g_mutex_lock(&(drift_measure->input_mutex));
+			gst_drift_measure_reset_inputs(drift_measure);
+			g_mutex_unlock(&(drift_measure->input_mutex));
+
+			break;
+		}
+
+		case GST_STATE_CHANGE_READY_TO_NULL:
+		{
+			if (drift_measure->output_buffer_pool != NULL)
+			{
+				gst_object_unref(GST_OBJECT(drift_measure->output_buffer_pool));
+				drift_measure->output_buffer_pool = NULL;
+			}
+
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	return ret;
+}
+
+
+static gboolean gst_drift_measure_sink_event(GstPad *pad, GstObject *parent, GstEvent *event)
+{
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(parent);
+
+	switch(GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_FLUSH_START:
+		{
+			/* Unblock the streaming thread if it waits for the analysis queue. */
+			gst_drift_measure_set_analysis_flushing(drift_measure, TRUE);
+			return gst_pad_event_default(pad, parent, event);
+		}
+
+		case GST_EVENT_FLUSH_STOP:
+			return gst_drift_measure_flush_stop(drift_measure, event);
+
+		case GST_EVENT_EOS:
+		{
+			gst_drift_measure_finish_stream(drift_measure);
+
+			/* Forward the event */
+			return gst_pad_push_event(drift_measure->srcpad, event);
+		}
+
+		case GST_EVENT_CAPS:
+		{
+			/* We need to parse the input caps to be able to
+			 * properly search the incoming PCM data for peaks. */
+
+			GstCaps *input_caps;
+			gboolean retval;
+
+			gst_event_parse_caps(event, &input_caps);
+			g_assert(input_caps != NULL);
+
+			GST_DEBUG_OBJECT(drift_measure, "got caps event with caps %" GST_PTR_FORMAT, (gpointer)input_caps);
+
+			retval = gst_drift_measure_apply_input_caps(drift_measure, input_caps);
+
+			/* Unref the event. Do not forward it, since we do not forward
+			 * the input PCM data. Instead, we output CSV or binary data. */
+			gst_event_unref(event);
+
+			return retval;
+		}
+
+		case GST_EVENT_SEGMENT:
+		{
+			GstSegment const *segment;
+
+			gst_event_parse_segment(event, &segment);
+
+			GST_DEBUG_OBJECT(drift_measure, "got segment event: %" GST_SEGMENT_FORMAT, (gpointer)segment);
+
+			/* We use the base field of the input segments for producing
+			 * timestamps in the CSV output (not to be confused with the
+			 * PTS and DTS of outgoing buffers, which we do _not_ set). */
+			g_mutex_lock(&(drift_measure->process_mutex));
+			drift_measure->input_segment = *segment;
+			gst_drift_measure_flush(drift_measure);
+			g_mutex_unlock(&(drift_measure->process_mutex));
+
+			/* Input segment events are never forwarded, since input and output
+			 * segments never are the same. */
+			gst_event_unref(event);
+
+			return TRUE;
+		}
+
+		default:
+			return gst_pad_event_default(pad, parent, event);
+	}
+}
+
+
+static GstFlowReturn gst_drift_measure_chain(G_GNUC_UNUSED GstPad *pad, GstObject *parent, GstBuffer *buffer)
+{
+	GstFlowReturn flow_ret;
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(parent);
+	gboolean has_inputs;
+
+	/* The channels of the request pads are the input channels
+	 * once there are request pads, so the sink pad is unused. */
+	g_mutex_lock(&(drift_measure->input_mutex));
+	has_inputs = (drift_measure->inputs->len > 0);
+	g_mutex_unlock(&(drift_measure->input_mutex));
+	if (G_UNLIKELY(has_inputs))
+	{
+		GST_ELEMENT_ERROR(drift_measure, STREAM, FAILED, ("the sink pad cannot be used together with request pads"), (NULL));
+		gst_buffer_unref(buffer);
+		return GST_FLOW_ERROR;
+	}
+
+	flow_ret = gst_drift_measure_start_output(drift_measure);
+	if (flow_ret == GST_FLOW_OK)
+		flow_ret = gst_drift_measure_process_buffer(drift_measure, buffer);
+
+	/* We are done with this buffer. */
+	gst_buffer_unref(buffer);
+
+	return flow_ret;
+}
+
+
+static GstPad * gst_drift_measure_request_new_pad(GstElement *element, GstPadTemplate *templ, gchar const *name, G_GNUC_UNUSED GstCaps const *caps)
+{
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(element);
+	GstDriftMeasureInput *input;
+	GstState state;
+	GstPad *pad;
+	gchar *pad_name;
+	guint index;
+
+	/* The request pads define the input channels, so
+	 * they cannot change once streaming started. */
+	GST_OBJECT_LOCK(element);
+	state = GST_STATE(element);
+	GST_OBJECT_UNLOCK(element);
+	if (state > GST_STATE_READY)
+	{
+		GST_WARNING_OBJECT(drift_measure, "request pads can only be added in the NULL and READY states");
+		return NULL;
+	}
+
+	if (gst_pad_is_linked(drift_measure->sinkpad))
+	{
+		GST_WARNING_OBJECT(drift_measure, "request pads cannot be added while the sink pad is linked");
+		return NULL;
+	}
+
+	g_mutex_lock(&(drift_measure->input_mutex));
+
+	if ((name != NULL) && (sscanf(name, "sink_%u", &index) == 1))
+	{
+		pad_name = g_strdup(name);
+		drift_measure->next_input_index = MAX(drift_measure->next_input_index, index + 1);
+	}
+	else
+		pad_name = g_strdup_printf("sink_%u", drift_measure->next_input_index++);
+
+	pad = gst_pad_new_from_template(templ, pad_name);
+	g_free(pad_name);
+
+	gst_pad_set_event_function(pad, GST_DEBUG_FUNCPTR(gst_drift_measure_input_event));
+	gst_pad_set_chain_function(pad, GST_DEBUG_FUNCPTR(gst_drift_measure_input_chain));
+
+	input = g_new0(GstDriftMeasureInput, 1);
+	input->pad = pad;
+	gst_audio_info_init(&(input->audio_info));
+	input->audio_info_valid = FALSE;
+	gst_segment_init(&(input->segment), GST_FORMAT_TIME);
+	input->adapter = gst_adapter_new();
+	input->start_time = GST_CLOCK_TIME_NONE;
+	input->num_frames_to_skip = 0;
+	input->eos = FALSE;
+	input->flushing = FALSE;
+	gst_pad_set_element_private(pad, input);
+
+	g_ptr_array_add(drift_measure->inputs, input);
+	drift_measure->inputs_configured = FALSE;
+
+	g_mutex_unlock(&(drift_measure->input_mutex));
+
+	if (!gst_element_add_pad(element, pad))
+	{
+		GST_WARNING_OBJECT(drift_measure, "could not add request pad");
+
+		g_mutex_lock(&(drift_measure->input_mutex));
+		g_ptr_array_remove(drift_measure->inputs, input);
+		g_mutex_unlock(&(drift_measure->input_mutex));
+		gst_drift_measure_free_input(input);
+
+		return NULL;
+	}
+
+	GST_DEBUG_OBJECT(drift_measure, "added request pad %s:%s", GST_DEBUG_PAD_NAME(pad));
+
+	return pad;
+}
+
+
+static void gst_drift_measure_release_pad(GstElement *element, GstPad *pad)
+{
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(element);
+	GstDriftMeasureInput *input = gst_pad_get_element_private(pad);
+
+	GST_DEBUG_OBJECT(drift_measure, "releasing request pad %s:%s", GST_DEBUG_PAD_NAME(pad));
+
+	g_mutex_lock(&(drift_measure->input_mutex));
+	g_ptr_array_remove(drift_measure->inputs, input);
+	drift_measure->inputs_configured = FALSE;
+	g_cond_broadcast(&(drift_measure->input_cond));
+	g_mutex_unlock(&(drift_measure->input_mutex));
+
+	gst_element_remove_pad(element, pad);
+	gst_drift_measure_free_input(input);
+}
+
+
+static gboolean gst_drift_measure_input_event(GstPad *pad, GstObject *parent, GstEvent *event)
+{
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(parent);
+	GstDriftMeasureInput *input = gst_pad_get_element_private(pad);
+
+	switch(GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_STREAM_START:
+		{
+			/* Downstream gets one output stream, so only
+			 * the first stream-start event is forwarded. */
+			gboolean forward;
+
+			g_mutex_lock(&(drift_measure->input_mutex));
+			forward = !drift_measure->stream_start_forwarded;
+			drift_measure->stream_start_forwarded = TRUE;
+			g_mutex_unlock(&(drift_measure->input_mutex));
+
+			if (forward)
+				return gst_pad_push_event(drift_measure->srcpad, event);
+
+			gst_event_unref(event);
+			return TRUE;
+		}
+
+		case GST_EVENT_FLUSH_START:
+		{
+			gboolean forward;
+
+			/* Downstream gets one output stream, so it is flushed when
+			 * the first request pad starts flushing, and only then. */
+			g_mutex_lock(&(drift_measure->input_mutex));
+			forward = !gst_drift_measure_inputs_flushing(drift_measure);
+			input->flushing = TRUE;
+			g_cond_broadcast(&(drift_measure->input_cond));
+			g_mutex_unlock(&(drift_measure->input_mutex));
+
+			if (!forward)
+			{
+				gst_event_unref(event);
+				return TRUE;
+			}
+
+			/* If another streaming thread is blocked downstream
+			 * while combining frames, this unblocks it. */
+			gst_drift_measure_set_analysis_flushing(drift_measure, TRUE);
+			return gst_pad_push_event(drift_measure->srcpad, event);
+		}
+
+		case GST_EVENT_FLUSH_STOP:
+		{
+			gboolean retval = TRUE;
+			gboolean forward;
+
+			/* The frames queued by the other request pads are kept; they
+			 * are aligned again with the frames that come after the flush.
+			 * Downstream stops flushing once all request pads did. */
+			g_mutex_lock(&(drift_measure->combine_mutex));
+
+			g_mutex_lock(&(drift_measure->input_mutex));
+			gst_adapter_clear(input->adapter);
+			input->start_time = GST_CLOCK_TIME_NONE;
+			input->num_frames_to_skip = 0;
+			input->eos = FALSE;
+			input->flushing = FALSE;
+			drift_measure->inputs_aligned = FALSE;
+			drift_measure->inputs_eos = FALSE;
+			forward = !gst_drift_measure_inputs_flushing(drift_measure);
+			g_mutex_unlock(&(drift_measure->input_mutex));
+
+			if (forward)
+				retval = gst_drift_measure_flush_stop(drift_measure, event);
+			else
+				gst_event_unref(event);
+
+			g_mutex_unlock(&(drift_measure->combine_mutex));
+
+			return retval;
+		}
+
+		case GST_EVENT_EOS:
+		{
+			/* The combined stream ends as soon as one of the request pads
+			 * runs out of frames; gst_drift_measure_combine_inputs() pushes
+			 * the EOS event downstream then. */
+			g_mutex_lock(&(drift_measure->input_mutex));
+			input->eos = TRUE;
+			g_cond_broadcast(&(drift_measure->input_cond));
+			g_mutex_unlock(&(drift_measure->input_mutex));
+
+			g_mutex_lock(&(drift_measure->combine_mutex));
+			gst_drift_measure_combine_inputs(drift_measure);
+			g_mutex_unlock(&(drift_measure->combine_mutex));
+
+			gst_event_unref(event);
+			return TRUE;
+		}
+
+		case GST_EVENT_CAPS:
+		{
+			GstCaps *input_caps, *combined_caps;
+			GstAudioInfo audio_info;
+			guint num_channels = 0;
+			gboolean retval = TRUE;
+			guint i;
+
+			gst_event_parse_caps(event, &input_caps);
+			g_assert(input_caps != NULL);
+
+			GST_DEBUG_OBJECT(pad, "got caps event with caps %" GST_PTR_FORMAT, (gpointer)input_caps);
+
+			if (!gst_audio_info_from_caps(&audio_info, input_caps))
+			{
+				GST_ELEMENT_ERROR(drift_measure, STREAM, FORMAT, ("could not use input caps"), ("caps: %" GST_PTR_FORMAT, (gpointer)input_caps));
+				gst_event_unref(event);
+				return FALSE;
+			}
+
+			g_mutex_lock(&(drift_measure->combine_mutex));
+			g_mutex_lock(&(drift_measure->input_mutex));
+
+			/* Channels of different request pads end up in the same
+			 * frames, so they must have the same format and rate. */
+			for (i = 0; i < drift_measure->inputs->len; ++i)
+			{
+				GstDriftMeasureInput *other_input = g_ptr_array_index(drift_measure->inputs, i);
+
+				if ((other_input == input) || !other_input->audio_info_valid)
+					continue;
+
+				if ((GST_AUDIO_INFO_FORMAT(&(other_input->audio_info)) != GST_AUDIO_INFO_FORMAT(&audio_info)) || (GST_AUDIO_INFO_RATE(&(other_input->audio_info)) != GST_AUDIO_INFO_RATE(&audio_info)))
+				{
+					g_mutex_unlock(&(drift_measure->input_mutex));
+					g_mutex_unlock(&(drift_measure->combine_mutex));
+					GST_ELEMENT_ERROR(drift_measure, STREAM, FORMAT, ("request pads have different sample formats or rates"), ("caps: %" GST_PTR_FORMAT, (gpointer)input_caps));
+					gst_event_unref(event);
+					return FALSE;
+				}
+			}
+
+			input->audio_info = audio_info;
+			input->audio_info_valid = TRUE;
+
+			/* The layout of the combined frames changes, so the
+			 * frames that are already queued do not fit anymore. */
+			if (drift_measure->inputs_configured)
+			{
+				for (i = 0; i < drift_measure->inputs->len; ++i)
+				{
+					GstDriftMeasureInput *other_input = g_ptr_array_index(drift_measure->inputs, i);
+					gst_adapter_clear(other_input->adapter);
+					other_input->start_time = GST_CLOCK_TIME_NONE;
+				}
+
+				drift_measure->inputs_configured = FALSE;
+				drift_measure->inputs_aligned = FALSE;
+			}
+
+			combined_caps = gst_drift_measure_get_combined_caps(drift_measure, &num_channels);
+
+			g_mutex_unlock(&(drift_measure->input_mutex));
+
+			/* The input caps are set once all request pads have caps. */
+			if (combined_caps != NULL)
+			{
+				GST_DEBUG_OBJECT(drift_measure, "all request pads have caps; combined caps: %" GST_PTR_FORMAT, (gpointer)combined_caps);
+
+				if (num_channels < 2)
+				{
+					GST_ELEMENT_ERROR(drift_measure, STREAM, FORMAT, ("request pads need to provide at least 2 channels in total"), ("got %u channel(s)", num_channels));
+					retval = FALSE;
+				}
+				else
+					retval = gst_drift_measure_apply_input_caps(drift_measure, combined_caps);
+
+				gst_caps_unref(combined_caps);
+
+				g_mutex_lock(&(drift_measure->input_mutex));
+				drift_measure->inputs_configured = retval;
+				g_mutex_unlock(&(drift_measure->input_mutex));
+			}
+
+			g_mutex_unlock(&(drift_measure->combine_mutex));
+
+			gst_event_unref(event);
+
+			/* Frames that other request pads queued while
+			 * waiting for these caps can be combined now. */
+			if (retval)
+			{
+				g_mutex_lock(&(drift_measure->combine_mutex));
+				gst_drift_measure_combine_inputs(drift_measure);
+				g_mutex_unlock(&(drift_measure->combine_mutex));
+			}
+
+			return retval;
+		}
+
+		case GST_EVENT_SEGMENT:
+		{
+			GstSegment const *segment;
+
+			gst_event_parse_segment(event, &segment);
+
+			GST_DEBUG_OBJECT(pad, "got segment event: %" GST_SEGMENT_FORMAT, (gpointer)segment);
+
+			/* Streams are aligned by running time, which
+			 * requires segments in the time format. */
+			if (segment->format != GST_FORMAT_TIME)
+			{
+				GST_ELEMENT_ERROR(drift_measure, STREAM, FORMAT, ("request pads require time segments"), ("got segment: %" GST_SEGMENT_FORMAT, (gpointer)segment));
+				gst_event_unref(event);
+				return FALSE;
+			}
+
+			g_mutex_lock(&(drift_measure->input_mutex));
+			input->segment = *segment;
+			g_mutex_unlock(&(drift_measure->input_mutex));
+
+			/* Just like with the sink pad, input segment events are not
+			 * forwarded. The output segment is started by the element. */
+			gst_event_unref(event);
+
+			return TRUE;
+		}
+
+		default:
+			return gst_pad_event_default(pad, parent, event);
+	}
+}
+
+
+static GstFlowReturn gst_drift_measure_input_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer)
+{
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(parent);
+	GstDriftMeasureInput *input = gst_pad_get_element_private(pad);
+	GstFlowReturn flow_ret = GST_FLOW_OK;
+
+	g_mutex_lock(&(drift_measure->input_mutex));
+
+	if (G_UNLIKELY(!input->audio_info_valid))
+	{
+		g_mutex_unlock(&(drift_measure->input_mutex));
+		GST_ERROR_OBJECT(pad, "got buffer before caps");
+		gst_buffer_unref(buffer);
+		return GST_FLOW_NOT_NEGOTIATED;
+	}
+
+	/* Wait until there is room in the queue. A buffer is always accepted
+	 * if the queue is empty, so the queue holds at most one buffer more
+	 * than max_input_queue_time. Since frames are taken from all queues
+	 * at once, a request pad can only wait if another one has no queued
+	 * frames, and that one does not wait. */
+	while (TRUE)
+	{
+		guint64 max_num_queued_frames;
+		gsize num_queued_frames;
+
+		if (input->flushing)
+		{
+			flow_ret = GST_FLOW_FLUSHING;
+			break;
+		}
+
+		if (input->eos || drift_measure->inputs_eos)
+		{
+			flow_ret = GST_FLOW_EOS;
+			break;
+		}
+
+		num_queued_frames = gst_adapter_available(input->adapter) / GST_AUDIO_INFO_BPF(&(input->audio_info));
+
+		GST_OBJECT_LOCK(drift_measure);
+		max_num_queued_frames = gst_util_uint64_scale_int(drift_measure->property_params.max_input_queue_time, GST_AUDIO_INFO_RATE(&(input->audio_info)), GST_SECOND);
+		GST_OBJECT_UNLOCK(drift_measure);
+
+		if ((num_queued_frames == 0) || (num_queued_frames < max_num_queued_frames))
+			break;
+
+		GST_LOG_OBJECT(pad, "%" G_GSIZE_FORMAT " frames queued; waiting for the other request pads", num_queued_frames);
+		g_cond_wait(&(drift_measure->input_cond), &(drift_measure->input_mutex));
+	}
+
+	if (flow_ret != GST_FLOW_OK)
+	{
+		g_mutex_unlock(&(drift_measure->input_mutex));
+		gst_buffer_unref(buffer);
+		return flow_ret;
+	}
+
+	/* The running time of the first queued frame is
+	 * what the request pads are aligned by. */
+	if (!GST_CLOCK_TIME_IS_VALID(input->start_time))
+	{
+		GstClockTime timestamp = GST_BUFFER_PTS_IS_VALID(buffer) ? GST_BUFFER_PTS(buffer) : input->segment.start;
+		GstClockTime running_time = gst_segment_to_running_time(&(input->segment), GST_FORMAT_TIME, timestamp);
+
+		if (!GST_CLOCK_TIME_IS_VALID(running_time))
+		{
+			g_mutex_unlock(&(drift_measure->input_mutex));
+			GST_DEBUG_OBJECT(pad, "dropping buffer outside of the segment");
+			gst_buffer_unref(buffer);
+			return GST_FLOW_OK;
+		}
+
+		input->start_time = running_time;
+		GST_DEBUG_OBJECT(pad, "first queued frame has running time %" GST_TIME_FORMAT, GST_TIME_ARGS(running_time));
+	}
+
+	gst_adapter_push(input->adapter, buffer);
+
+	g_mutex_unlock(&(drift_measure->input_mutex));
+
+	g_mutex_lock(&(drift_measure->combine_mutex));
+	flow_ret = gst_drift_measure_combine_inputs(drift_measure);
+	g_mutex_unlock(&(drift_measure->combine_mutex));
+
+	return flow_ret;
+}
+
+
+static gboolean gst_drift_measure_flush_stop(GstDriftMeasure *drift_measure, GstEvent *event)
+{
+	/* Flush our history */
+	GST_DEBUG_OBJECT(drift_measure, "got flush_stop event; flushing history");
+	g_mutex_lock(&(drift_measure->process_mutex));
+	gst_drift_measure_flush(drift_measure);
+	drift_measure->analysis_flow_ret = GST_FLOW_OK;
+	/* Measurements after the flush are unrelated to the earlier ones. */
+	if (drift_measure->statistics != NULL)
+		drift_measure_drift_stats_reset(drift_measure->statistics);
+	if (drift_measure->tracker != NULL)
+		drift_measure_drift_tracker_reset(drift_measure->tracker);
+	gst_drift_measure_publish_tracking_estimates(drift_measure);
+	/* The rows that were collected before the flush are flushed as
+	 * well; downstream must not get them after the FLUSH_STOP event. */
+	gst_drift_measure_discard_output_batch(drift_measure);
+	g_mutex_unlock(&(drift_measure->process_mutex));
+	gst_drift_measure_set_analysis_flushing(drift_measure, FALSE);
+
+	/* Forward the event */
+	return gst_pad_push_event(drift_measure->srcpad, event);
+}
+
+
+static void gst_drift_measure_finish_stream(GstDriftMeasure *drift_measure)
+{
+	/* Let the analysis thread finish the queued windows
+	 * first, so their datasets are pushed before EOS. */
+	gst_drift_measure_drain_analysis_queue(drift_measure);
+
+	/* Flush our history */
+	GST_DEBUG_OBJECT(drift_measure, "got eos event; flushing history");
+	g_mutex_lock(&(drift_measure->process_mutex));
+	gst_drift_measure_flush(drift_measure);
+	/* Produce statistics for the last, incomplete interval,
+	 * then push out any pending rows; EOS must come after them. */
+	gst_drift_measure_output_statistics(drift_measure);
+	gst_drift_measure_push_output_batch(drift_measure);
+	g_mutex_unlock(&(drift_measure->process_mutex));
+}
+
+
+static gboolean gst_drift_measure_apply_input_caps(GstDriftMeasure *drift_measure, GstCaps const *input_caps)
+{
+	GstDriftMeasureOutputFormat output_format;
+	GstDriftMeasureOutputMode output_mode;
+	gboolean retval;
+
+	/* Let the analysis thread finish the queued windows first. Their
+	 * datasets belong to the old caps, so they have to be pushed before
+	 * the output is set up for the new ones. */
+	gst_drift_measure_drain_analysis_queue(drift_measure);
+
+	/* A caps event is a buffer boundary as well. This is done before the
+	 * negotiation, since that depends on the output mode. */
+	g_mutex_lock(&(drift_measure->process_mutex));
+	gst_drift_measure_update_params(drift_measure);
+	output_mode = drift_measure->params->output_mode;
+	g_mutex_unlock(&(drift_measure->process_mutex));
+
+	/* Pick the output format. This queries downstream,
+	 * so it must not be done with the process mutex held. */
+	if (!gst_drift_measure_negotiate_output_format(drift_measure, output_mode, &output_format))
+		return FALSE;
+
+	g_mutex_lock(&(drift_measure->process_mutex));
+	/* Pending rows belong to the old caps (their number of
+	 * columns can differ), and their buffer to the old pool. */
+	gst_drift_measure_push_output_batch(drift_measure);
+	drift_measure->output_format = output_format;
+	drift_measure->output_mode = output_mode;
+	gst_caps_unref(drift_measure->src_caps);
+	drift_measure->src_caps = gst_caps_new_empty_simple((output_format == GST_DRIFT_MEASURE_OUTPUT_FORMAT_BINARY) ? BINARY_CAPS : CSV_CAPS);
+	retval = gst_drift_measure_set_input_caps(drift_measure, input_caps);
+	drift_measure->output_caps_pending = TRUE;
+	g_mutex_unlock(&(drift_measure->process_mutex));
+
+	return retval;
+}
+
+
+static GstFlowReturn gst_drift_measure_start_output(GstDriftMeasure *drift_measure)
+{
+	GstFlowReturn flow_ret = GST_FLOW_OK;
+
+	if (drift_measure->output_caps_pending)
+	{
+		/* If we did not push the current output caps yet, do so now.
+		 * If we did not start the output segment yet either, push
+		 * a segment event after the caps. (stream-start will have been
+		 * forwarded already by GstElement at this point.) */
+
+		GstSegment segment;
+
+		if (!gst_pad_push_event(drift_measure->srcpad, gst_event_new_caps(drift_measure->src_caps)))
+		{
+			GST_ERROR_OBJECT(drift_measure, "could not push caps event downstream");
+			return GST_FLOW_ERROR;
+		}
+
+		if (!drift_measure->output_segment_started)
+		{
+			gst_segment_init(&segment, GST_FORMAT_BYTES);
+
+			if (!gst_pad_push_event(drift_measure->srcpad, gst_event_new_segment(&segment)))
+			{
+				GST_ERROR_OBJECT(drift_measure, "could not push segment event downstream");
+				return GST_FLOW_ERROR;
+			}
+
+			drift_measure->output_segment_started = TRUE;
+		}
+
+		drift_measure->output_caps_pending = FALSE;
+
+		/* Binary output needs a header that describes the records. */
+		if (drift_measure->output_format == GST_DRIFT_MEASURE_OUTPUT_FORMAT_BINARY)
+			flow_ret = gst_drift_measure_push_binary_header(drift_measure);
+	}
+
+	return flow_ret;
+}
+
+
+static GstFlowReturn gst_drift_measure_process_buffer(GstDriftMeasure *drift_measure, GstBuffer *buffer)
+{
+	GstFlowReturn flow_ret;
+
+	/* Perform the main processing. Property changes are picked up here,
+	 * before the buffer is processed, so the entire buffer is processed
+	 * with the same parameters. */
+	g_mutex_lock(&(drift_measure->process_mutex));
+	gst_drift_measure_update_params(drift_measure);
+	flow_ret = gst_drift_measure_process_input_buffer(drift_measure, buffer);
+	/* Rows are otherwise only pushed when new ones are added, so this
+	 * is where the latency limit is enforced while no peaks are found.
+	 * The analysis thread adds rows concurrently if it exists, so it
+	 * is asked to push the batch instead; otherwise, a push from here
+	 * could overtake the batches that the analysis thread pushes. */
+	if ((flow_ret == GST_FLOW_OK) && gst_drift_measure_output_batch_is_due(drift_measure))
+	{
+		if (drift_measure->analysis_queue != NULL)
+			gst_drift_measure_request_output_batch_push(drift_measure);
+		else
+			flow_ret = gst_drift_measure_push_output_batch(drift_measure);
+	}
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	gst_drift_measure_publish_stats(drift_measure);
+#endif
+	g_mutex_unlock(&(drift_measure->process_mutex));
+
+	return flow_ret;
+}
+
+
+static void gst_drift_measure_free_input(GstDriftMeasureInput *input)
+{
+	if (input == NULL)
+		return;
+
+	g_object_unref(G_OBJECT(input->adapter));
+	g_free(input);
+}
+
+
+static void gst_drift_measure_reset_inputs(GstDriftMeasure *drift_measure)
+{
+	/* must be called with input mutex held */
+
+	guint i;
+
+	for (i = 0; i < drift_measure->inputs->len; ++i)
+	{
+		GstDriftMeasureInput *input = g_ptr_array_index(drift_measure->inputs, i);
+
+		gst_adapter_clear(input->adapter);
+		input->audio_info_valid = FALSE;
+		gst_segment_init(&(input->segment), GST_FORMAT_TIME);
+		input->start_time = GST_CLOCK_TIME_NONE;
+		input->num_frames_to_skip = 0;
+		input->eos = FALSE;
+		input->flushing = FALSE;
+	}
+
+	drift_measure->inputs_configured = FALSE;
+	drift_measure->inputs_aligned = FALSE;
+	drift_measure->inputs_eos = FALSE;
+	drift_measure->stream_start_forwarded = FALSE;
+}
+
+
+static gboolean gst_drift_measure_inputs_flushing(GstDriftMeasure *drift_measure)
+{
+	/* must be called with input mutex held */
+
+	/* Returns TRUE if any request pad is flushing. */
+
+	guint i;
+
+	for (i = 0; i < drift_measure->inputs->len; ++i)
+	{
+		if (((GstDriftMeasureInput *)g_ptr_array_index(drift_measure->inputs, i))->flushing)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+static GstCaps * gst_drift_measure_get_combined_caps(GstDriftMeasure *drift_measure, guint *num_channels)
+{
+	/* must be called with input mutex held */
+
+	/* Returns caps for the frames that combine the channels of all
+	 * request pads, or NULL if not all request pads have caps yet. The
+	 * combined frames are non-interleaved, since each request pad's
+	 * channels are copied into their own planes. */
+
+	GstDriftMeasureInput *first_input;
+	GstAudioInfo audio_info;
+	guint i;
+
+	*num_channels = 0;
+
+	if (drift_measure->inputs->len == 0)
+		return NULL;
+
+	for (i = 0; i < drift_measure->inputs->len; ++i)
+	{
+		GstDriftMeasureInput *input = g_ptr_array_index(drift_measure->inputs, i);
+
+		if (!input->audio_info_valid)
+			return NULL;
+
+		*num_channels += GST_AUDIO_INFO_CHANNELS(&(input->audio_info));
+	}
+
+	first_input = g_ptr_array_index(drift_measure->inputs, 0);
+
+	gst_audio_info_init(&audio_info);
+	gst_audio_info_set_format(
+		&audio_info,
+		GST_AUDIO_INFO_FORMAT(&(first_input->audio_info)),
+		GST_AUDIO_INFO_RATE(&(first_input->audio_info)),
+		*num_channels,
+		NULL
+	);
+	audio_info.layout = GST_AUDIO_LAYOUT_NON_INTERLEAVED;
+
+	return gst_audio_info_to_caps(&audio_info);
+}
+
+
+static gboolean gst_drift_measure_align_inputs(GstDriftMeasure *drift_measure)
+{
+	/* must be called with input mutex held */
+
+	/* Aligns the request pads once all of them queued frames. The
+	 * latest running time of their first queued frames becomes the
+	 * start of the combined stream; earlier frames are skipped. Returns
+	 * TRUE if the request pads are aligned. */
+
+	GstClockTime start_time = 0;
+	guint i;
+
+	if (drift_measure->inputs_aligned)
+		return TRUE;
+
+	if (!drift_measure->inputs_configured)
+		return FALSE;
+
+	for (i = 0; i < drift_measure->inputs->len; ++i)
+	{
+		GstDriftMeasureInput *input = g_ptr_array_index(drift_measure->inputs, i);
+
+		if (!GST_CLOCK_TIME_IS_VALID(input->start_time))
+			return FALSE;
+
+		start_time = MAX(start_time, input->start_time);
+	}
+
+	for (i = 0; i < drift_measure->inputs->len; ++i)
+	{
+		GstDriftMeasureInput *input = g_ptr_array_index(drift_measure->inputs, i);
+
+		input->num_frames_to_skip = gst_util_uint64_scale_int_round(start_time - input->start_time, GST_AUDIO_INFO_RATE(&(input->audio_info)), GST_SECOND);
+		GST_DEBUG_OBJECT(input->pad, "skipping %" G_GUINT64_FORMAT " frame(s) for alignment", input->num_frames_to_skip);
+	}
+
+	GST_DEBUG_OBJECT(drift_measure, "aligned %u request pads at running time %" GST_TIME_FORMAT, drift_measure->inputs->len, GST_TIME_ARGS(start_time));
+
+	/* The combined stream starts at this running time, so
+	 * the output timestamps are running times as well. */
+	g_mutex_lock(&(drift_measure->process_mutex));
+	gst_segment_init(&(drift_measure->input_segment), GST_FORMAT_TIME);
+	drift_measure->input_segment.base = start_time;
+	gst_drift_measure_flush(drift_measure);
+	g_mutex_unlock(&(drift_measure->process_mutex));
+
+	drift_measure->inputs_aligned = TRUE;
+
+	return TRUE;
+}
+
+
+static gsize gst_drift_measure_take_input_frames(GstDriftMeasure *drift_measure)
+{
+	/* must be called with input mutex held */
+
+	/* Takes the frames that all request pads have queued (up to
+	 * MAX_COMBINED_FRAMES) out of their adapters, and copies them into
+	 * combined_frames, one plane per channel. Returns the number of
+	 * bytes in combined_frames, or 0 if a request pad has no frames. */
+
+	gsize num_frames = MAX_COMBINED_FRAMES;
+	guint num_channels = 0, bytes_per_sample, channel;
+	gsize size;
+	guint i;
+
+	for (i = 0; i < drift_measure->inputs->len; ++i)
+	{
+		GstDriftMeasureInput *input = g_ptr_array_index(drift_measure->inputs, i);
+		guint bytes_per_frame = GST_AUDIO_INFO_BPF(&(input->audio_info));
+		guint rate = GST_AUDIO_INFO_RATE(&(input->audio_info));
+		gsize num_queued_frames = gst_adapter_available(input->adapter) / bytes_per_frame;
+
+		if (input->num_frames_to_skip > 0)
+		{
+			gsize num_skipped_frames = MIN(input->num_frames_to_skip, num_queued_frames);
+
+			gst_adapter_flush(input->adapter, num_skipped_frames * bytes_per_frame);
+			input->num_frames_to_skip -= num_skipped_frames;
+			input->start_time += gst_util_uint64_scale_int(num_skipped_frames, GST_SECOND, rate);
+			num_queued_frames -= num_skipped_frames;
+		}
+
+		if (input->num_frames_to_skip > 0)
+			num_queued_frames = 0;
+
+		num_frames = MIN(num_frames, num_queued_frames);
+		num_channels += GST_AUDIO_INFO_CHANNELS(&(input->audio_info));
+	}
+
+	if (num_frames == 0)
+		return 0;
+
+	/* All request pads have the same sample format. */
+	bytes_per_sample = GST_AUDIO_INFO_BPS(&(((GstDriftMeasureInput *)g_ptr_array_index(drift_measure->inputs, 0))->audio_info));
+	size = num_frames * num_channels * bytes_per_sample;
+
+	if (drift_measure->combined_frames_size < size)
+	{
+		g_free(drift_measure->combined_frames);
+		drift_measure->combined_frames_size = MAX_COMBINED_FRAMES * num_channels * bytes_per_sample;
+		drift_measure->combined_frames = g_malloc(drift_measure->combined_frames_size);
+	}
+
+	channel = 0;
+
+	for (i = 0; i < drift_measure->inputs->len; ++i)
+	{
+		GstDriftMeasureInput *input = g_ptr_array_index(drift_measure->inputs, i);
+		guint input_num_channels = GST_AUDIO_INFO_CHANNELS(&(input->audio_info));
+		guint bytes_per_frame = GST_AUDIO_INFO_BPF(&(input->audio_info));
+		guint8 const *data = gst_adapter_map(input->adapter, num_frames * bytes_per_frame);
+		guint input_channel;
+		gsize frame;
+
+		/* Deinterleave the channels into their planes. */
+		for (input_channel = 0; input_channel < input_num_channels; ++input_channel, ++channel)
+		{
+			guint8 *plane = drift_measure->combined_frames + channel * num_frames * bytes_per_sample;
+			guint8 const *samples = data + input_channel * bytes_per_sample;
+
+			for (frame = 0; frame < num_frames; ++frame)
+				memcpy(plane + frame * bytes_per_sample, samples + frame * bytes_per_frame, bytes_per_sample);
+		}
+
+		gst_adapter_unmap(input->adapter);
+		gst_adapter_flush(input->adapter, num_frames * bytes_per_frame);
+		input->start_time += gst_util_uint64_scale_int(num_frames, GST_SECOND, GST_AUDIO_INFO_RATE(&(input->audio_info)));
+	}
+
+	return size;
+}
+
+
+static GstFlowReturn gst_drift_measure_combine_inputs(GstDriftMeasure *drift_measure)
+{
+	/* must be called with combine mutex held */
+
+	/* Combines and processes the frames that all request pads have queued.
+	 * If a request pad reached EOS and has no frames left, the combined
+	 * stream is finished and EOS is pushed downstream. */
+
+	GstFlowReturn flow_ret = GST_FLOW_OK;
+
+	while (TRUE)
+	{
+		GstBuffer *combined_buffer;
+		gboolean finished = FALSE;
+		gsize size = 0;
+		guint i;
+
+		g_mutex_lock(&(drift_measure->input_mutex));
+
+		if (drift_measure->inputs_eos)
+		{
+			g_mutex_unlock(&(drift_measure->input_mutex));
+			return GST_FLOW_EOS;
+		}
+
+		if (gst_drift_measure_align_inputs(drift_measure))
+			size = gst_drift_measure_take_input_frames(drift_measure);
+
+		if (size == 0)
+		{
+			for (i = 0; i < drift_measure->inputs->len; ++i)
+			{
+				GstDriftMeasureInput *input = g_ptr_array_index(drift_measure->inputs, i);
+
+				if (input->eos && (!input->audio_info_valid || (gst_adapter_available(input->adapter) < (gsize)GST_AUDIO_INFO_BPF(&(input->audio_info)))))
+					finished = TRUE;
+			}
+
+			if (finished)
+			{
+				drift_measure->inputs_eos = TRUE;
+				g_cond_broadcast(&(drift_measure->input_cond));
+			}
+
+			g_mutex_unlock(&(drift_measure->input_mutex));
+
+			if (finished)
+			{
+				GST_DEBUG_OBJECT(drift_measure, "a request pad ran out of frames at EOS; finishing the combined stream");
+				gst_drift_measure_finish_stream(drift_measure);
+				gst_pad_push_event(drift_measure->srcpad, gst_event_new_eos());
+				flow_ret = GST_FLOW_EOS;
+			}
+
+			break;
+		}
+
+		/* Frames were taken out of the adapters, so there
+		 * may be room for blocked request pads now. */
+		g_cond_broadcast(&(drift_measure->input_cond));
+		g_mutex_unlock(&(drift_measure->input_mutex));
+
+		flow_ret = gst_drift_measure_start_output(drift_measure);
+		if (flow_ret != GST_FLOW_OK)
+			break;
+
+		/* combined_frames is only accessed with the combine mutex
+		 * held, so it can be wrapped instead of being copied. */
+		combined_buffer = gst_buffer_new_wrapped_full(0, drift_measure->combined_frames, drift_measure->combined_frames_size, 0, size, NULL, NULL);
+		flow_ret = gst_drift_measure_process_buffer(drift_measure, combined_buffer);
+		gst_buffer_unref(combined_buffer);
+
+		if (flow_ret != GST_FLOW_OK)
+			break;
+	}
+
+	return flow_ret;
+}
+
+
+static void gst_drift_measure_allocate_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset *dataset)
+{
+	guint num_channels;
+
+	num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+	g_assert(num_channels >= 2);
+
+	dataset->drifts = g_slice_alloc(sizeof(GstClockTimeDiff) * (num_channels - 1));
+
+	gst_drift_measure_reset_dataset(drift_measure, dataset);
+}
+
+
+static void gst_drift_measure_reset_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset *dataset)
+{
+	dataset->timestamp = GST_CLOCK_TIME_NONE;
+
+	if (drift_measure->input_audio_info_valid)
+	{
+		guint num_channels, channel;
+
+		num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+		g_assert(num_channels >= 2);
+
+		if (dataset->drifts != NULL)
+		{
+			for (channel = 0; channel < (num_channels - 1); ++channel)
+				dataset->drifts[channel] = GST_CLOCK_STIME_NONE;
+		}
+	}
+}
+
+
+static void gst_drift_measure_free_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset *dataset)
+{
+	if (drift_measure->input_audio_info_valid)
+	{
+		guint num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+		g_assert(num_channels >= 2);
+
+		g_slice_free1(sizeof(GstClockTimeDiff) * (num_channels - 1), dataset->drifts);
+	}
+
+	dataset->timestamp = GST_CLOCK_TIME_NONE;
+	dataset->drifts = NULL;
+}
+
+
+static GstFlowReturn gst_drift_measure_output_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset const *measured_dataset, GstDriftMeasureDataset const *written_dataset)
+{
+	/* must be called with process mutex held */
+
+	/* measured_dataset has the drifts as the detector measured them.
+	 * written_dataset has the same timestamp, but the drifts of channels
+	 * without a pulse are filled in according to the undetected-peak-handling
+	 * property. Only the written output uses these substitutes.
+	 *
+	 * Missing drifts are GST_CLOCK_STIME_NONE in measured_dataset, which is
+	 * the same as DRIFT_MEASURE_DRIFT_STATS_NO_VALUE and
+	 * DRIFT_MEASURE_DRIFT_TRACKER_NO_VALUE, so the statistics and the
+	 * tracker skip these channels instead of using made-up values. */
+
+	GstFlowReturn flow_ret = GST_FLOW_OK;
+	gboolean statistics_due = FALSE;
+
+	if (drift_measure->tracker != NULL)
+	{
+		drift_measure_drift_tracker_update(drift_measure->tracker, measured_dataset->timestamp, measured_dataset->drifts);
+		gst_drift_measure_publish_tracking_estimates(drift_measure);
+	}
+
+	if (drift_measure->statistics != NULL)
+	{
+		guint64 num_measurements;
+		GstClockTime interval_duration;
+
+		drift_measure_drift_stats_add(drift_measure->statistics, measured_dataset->timestamp, measured_dataset->drifts);
+
+		num_measurements = drift_measure_drift_stats_get_num_interval_measurements(drift_measure->statistics);
+		interval_duration = drift_measure_drift_stats_get_interval_end(drift_measure->statistics) - drift_measure_drift_stats_get_interval_start(drift_measure->statistics);
+
+		statistics_due = ((drift_measure->params->statistics_pulses > 0) && (num_measurements >= drift_measure->params->statistics_pulses))
+		              || ((drift_measure->params->statistics_interval > 0) && (interval_duration >= drift_measure->params->statistics_interval));
+	}
+
+	if (drift_measure->output_mode == GST_DRIFT_MEASURE_OUTPUT_MODE_MEASUREMENTS)
+	{
+		flow_ret = gst_drift_measure_push_out_dataset(drift_measure, written_dataset);
+		if (flow_ret != GST_FLOW_OK)
+			return flow_ret;
+	}
+
+	if (statistics_due)
+		flow_ret = gst_drift_measure_output_statistics(drift_measure);
+
+	return flow_ret;
+}
+
+
+/* Writes the value with 3 decimals. Values beyond +-1e12 are clamped,
+ * so at most 18 characters are written (sign, 13 digits, decimal point,
+ * 3 decimals). Unlike printf, this does not depend on the locale. */
+static gsize fixed3_to_string(gchar *destination, gdouble value)
+{
+	gint64 thousandths;
+	guint64 magnitude;
+	gchar *write_pointer = destination;
+
+	thousandths = (gint64)(round(CLAMP(value, -1e12, 1e12) * 1000.0));
+	magnitude = (thousandths < 0) ? (guint64)(-thousandths) : (guint64)thousandths;
+
+	if (thousandths < 0)
+		*write_pointer++ = '-';
+
+	write_pointer += drift_measure_format_uint64(write_pointer, magnitude / 1000);
+	*write_pointer++ = '.';
+	*write_pointer++ = '0' + (magnitude / 100) % 10;
+	*write_pointer++ = '0' + (magnitude / 10) % 10;
+	*write_pointer++ = '0' + magnitude % 10;
+
+	return write_pointer - destination;
+}
+
+
+static GstFlowReturn gst_drift_measure_output_statistics(GstDriftMeasure *drift_measure)
+{
+	/* must be called with process mutex held */
+
+	GstFlowReturn flow_ret = GST_FLOW_OK;
+	DriftMeasureChannelStats channel_stats;
+	guint num_drifts, channel;
+	GstStructure *structure = NULL;
+	GstClockTime timestamp;
+
+	if ((drift_measure->statistics == NULL) || (drift_measure_drift_stats_get_num_interval_measurements(drift_measure->statistics) == 0))
+		return GST_FLOW_OK;
+
+	num_drifts = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info)) - 1;
+	timestamp = drift_measure_drift_stats_get_interval_end(drift_measure->statistics);
+
+	GST_LOG_OBJECT(drift_measure, "producing statistics over %" G_GUINT64_FORMAT " measurement(s)", drift_measure_drift_stats_get_num_interval_measurements(drift_measure->statistics));
+
+	if (drift_measure->output_mode == GST_DRIFT_MEASURE_OUTPUT_MODE_STATISTICS)
+	{
+		/* Statistics rows look like this, with the 7 columns
+		 * repeated for each non-reference channel:
+		 *
+		 * <timestamp>,<count>,<mean>,<stddev>,<min>,<max>,<moving average>,<slope in ppm>,...
+		 *
+		 * All values except for the count and the slope are in nanoseconds.
+		 * Columns without a value (because there were no drifts in the
+		 * interval, or not enough for a slope) are left empty. */
+
+		gchar *write_pointer = gst_drift_measure_begin_output_row(drift_measure, &flow_ret);
+		if (write_pointer == NULL)
+			return flow_ret;
+
+		write_pointer += drift_measure_format_uint64(write_pointer, timestamp);
+
+		for (channel = 0; channel < num_drifts; ++channel)
+		{
+			drift_measure_drift_stats_get(drift_measure->statistics, channel, &channel_stats);
+
+			*write_pointer++ = ',';
+			write_pointer += drift_measure_format_uint64(write_pointer, channel_stats.count);
+
+			*write_pointer++ = ',';
+			if (channel_stats.count > 0)
+				write_pointer += drift_measure_format_int64(write_pointer, (gint64)round(channel_stats.mean));
+			*write_pointer++ = ',';
+			if (channel_stats.count > 0)
+				write_pointer += drift_measure_format_int64(write_pointer, (gint64)round(channel_stats.stddev));
+			*write_pointer++ = ',';
+			if (channel_stats.count > 0)
+				write_pointer += drift_measure_format_int64(write_pointer, channel_stats.min);
+			*write_pointer++ = ',';
+			if (channel_stats.count > 0)
+				write_pointer += drift_measure_format_int64(write_pointer, channel_stats.max);
+			*write_pointer++ = ',';
+			if (channel_stats.has_ewma)
+				write_pointer += drift_measure_format_int64(write_pointer, (gint64)round(channel_stats.ewma));
+			*write_pointer++ = ',';
+			if (channel_stats.has_slope)
+				write_pointer += fixed3_to_string(write_pointer, channel_stats.slope_ppm);
+		}
+
+		*write_pointer++ = '\n';
+
+		gst_drift_measure_end_output_row(drift_measure, write_pointer);
+	}
+
+	if (drift_measure->params->post_messages)
+	{
+		/* Values that are not available are NaN (or GST_CLOCK_STIME_NONE
+		 * for the minimum and maximum), so all arrays have one entry per
+		 * non-reference channel. */
+
+		GValue counts = G_VALUE_INIT, means = G_VALUE_INIT, stddevs = G_VALUE_INIT, mins = G_VALUE_INIT, maxs = G_VALUE_INIT, ewmas = G_VALUE_INIT, slopes = G_VALUE_INIT;
+
+		g_value_init(&counts, GST_TYPE_ARRAY);
+		g_value_init(&means, GST_TYPE_ARRAY);
+		g_value_init(&stddevs, GST_TYPE_ARRAY);
+		g_value_init(&mins, GST_TYPE_ARRAY);
+		g_value_init(&maxs, GST_TYPE_ARRAY);
+		g_value_init(&ewmas, GST_TYPE_ARRAY);
+		g_value_init(&slopes, GST_TYPE_ARRAY);
+
+		for (channel = 0; channel < num_drifts; ++channel)
+		{
+			GValue value = G_VALUE_INIT;
+			gboolean has_values;
+
+			drift_measure_drift_stats_get(drift_measure->statistics, channel, &channel_stats);
+			has_values = (channel_stats.count > 0);
+
+			g_value_init(&value, G_TYPE_UINT64);
+			g_value_set_uint64(&value, channel_stats.count);
+			gst_value_array_append_and_take_value(&counts, &value);
+
+			g_value_init(&value, G_TYPE_DOUBLE);
+			g_value_set_double(&value, has_values ? channel_stats.mean : NAN);
+			gst_value_array_append_and_take_value(&means, &value);
+
+			g_value_init(&value, G_TYPE_DOUBLE);
+			g_value_set_double(&value, has_values ? channel_stats.stddev : NAN);
+			gst_value_array_append_and_take_value(&stddevs, &value);
+
+			g_value_init(&value, G_TYPE_INT64);
+			g_value_set_int64(&value, has_values ? channel_stats.min : GST_CLOCK_STIME_NONE);
+			gst_value_array_append_and_take_value(&mins, &value);
+
+			g_value_init(&value, G_TYPE_INT64);
+			g_value_set_int64(&value, has_values ? channel_stats.max : GST_CLOCK_STIME_NONE);
+			gst_value_array_append_and_take_value(&maxs, &value);
+
+			g_value_init(&value, G_TYPE_DOUBLE);
+			g_value_set_double(&value, channel_stats.has_ewma ? channel_stats.ewma : NAN);
+			gst_value_array_append_and_take_value(&ewmas, &value);
+
+			g_value_init(&value, G_TYPE_DOUBLE);
+			g_value_set_double(&value, channel_stats.has_slope ? channel_stats.slope_ppm : NAN);
+			gst_value_array_append_and_take_value(&slopes, &value);
+		}
+
+		structure = gst_structure_new(
+			"drift-statistics",
+			"timestamp", G_TYPE_UINT64, (guint64)timestamp,
+			"interval-start", G_TYPE_UINT64, (guint64)drift_measure_drift_stats_get_interval_start(drift_measure->statistics),
+			"num-measurements", G_TYPE_UINT64, (guint64)drift_measure_drift_stats_get_num_interval_measurements(drift_measure->statistics),
+			"reference-channel", G_TYPE_UINT, drift_measure->params->reference_channel,
+			NULL
+		);
+		gst_structure_take_value(structure, "counts", &counts);
+		gst_structure_take_value(structure, "means", &means);
+		gst_structure_take_value(structure, "stddevs", &stddevs);
+		gst_structure_take_value(structure, "mins", &mins);
+		gst_structure_take_value(structure, "maxs", &maxs);
+		gst_structure_take_value(structure, "ewmas", &ewmas);
+		gst_structure_take_value(structure, "slopes-ppm", &slopes);
+	}
+
+	/* Start the next interval before the lock is released below. */
+	drift_measure_drift_stats_start_interval(drift_measure->statistics);
+
+	if (structure != NULL)
+	{
+		/* Bus sync handlers run in this thread, and may call back into
+		 * the element, for example to change its state. */
+		g_mutex_unlock(&(drift_measure->process_mutex));
+		gst_element_post_message(GST_ELEMENT(drift_measure), gst_message_new_element(GST_OBJECT(drift_measure), structure));
+		g_mutex_lock(&(drift_measure->process_mutex));
+	}
+
+	if (gst_drift_measure_output_batch_is_due(drift_measure))
+		flow_ret = gst_drift_measure_push_output_batch(drift_measure);
+
+	return flow_ret;
+}
+
+
+static gchar * gst_drift_measure_begin_output_row(GstDriftMeasure *drift_measure, GstFlowReturn *flow_ret)
+{
+	/* must be called with process mutex held */
+
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	drift_measure->output_row_start_time = gst_util_get_timestamp();
+#endif
+
+	/* Start a new batch if necessary. Full batches are always pushed
+	 * right away, so an existing one has room for this row. */
+	if (drift_measure->output_batch == NULL)
+	{
+		*flow_ret = gst_buffer_pool_acquire_buffer(drift_measure->output_buffer_pool, &(drift_measure->output_batch), NULL);
+		if (*flow_ret != GST_FLOW_OK)
+		{
+			GST_ERROR_OBJECT(drift_measure, "could not acquire output buffer: %s", gst_flow_get_name(*flow_ret));
+			drift_measure->output_batch = NULL;
+			return NULL;
+		}
+
+		gst_buffer_map(drift_measure->output_batch, &(drift_measure->output_batch_map_info), GST_MAP_WRITE);
+
+		drift_measure->output_batch_fill_size = 0;
+		drift_measure->num_output_batch_rows = 0;
+		drift_measure->max_output_batch_rows = drift_measure->params->output_batch_rows;
+		drift_measure->output_batch_start_time = g_get_monotonic_time();
+
+		/* A batch never has more than max_output_batch_rows rows. The meta
+		 * describes measurements, so statistics rows do not get one. */
+		if (drift_measure->params->attach_meta && (drift_measure->output_mode == GST_DRIFT_MEASURE_OUTPUT_MODE_MEASUREMENTS))
+			gst_buffer_add_drift_measure_meta(drift_measure->output_batch, drift_measure->max_output_batch_rows, GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info)) - 1);
+	}
+
+	*flow_ret = GST_FLOW_OK;
+	return (gchar *)(drift_measure->output_batch_map_info.data) + drift_measure->output_batch_fill_size;
+}
+
+
+static void gst_drift_measure_end_output_row(GstDriftMeasure *drift_measure, gchar *write_pointer)
+{
+	/* must be called with process mutex held */
+
+	/* Note down how much data the batch actually contains. */
+	drift_measure->output_batch_fill_size = (write_pointer - (gchar *)(drift_measure->output_batch_map_info.data));
+	drift_measure->num_output_batch_rows++;
+
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	drift_measure->format_time += gst_util_get_timestamp() - drift_measure->output_row_start_time;
+#endif
+}
+
+
+static GstFlowReturn gst_drift_measure_push_out_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset const *dataset)
+{
+	/* must be called with process mutex held */
+
+	gchar *write_pointer;
+	gsize num_written;
+	guint num_channels, channel;
+	GstFlowReturn flow_ret;
+	GstDriftMeasureMeta *meta;
+
+	num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+	g_assert(num_channels >= 2);
+
+	write_pointer = gst_drift_measure_begin_output_row(drift_measure, &flow_ret);
+	if (write_pointer == NULL)
+		return flow_ret;
+
+	/* The meta is only added when a batch is started, so rows
+	 * are only recorded in it if attach-meta was enabled then. */
+	meta = gst_buffer_get_drift_measure_meta(drift_measure->output_batch);
+	if ((meta != NULL) && !gst_drift_measure_meta_add_dataset(meta, dataset->timestamp, dataset->drifts))
+		GST_WARNING_OBJECT(drift_measure, "drift measure meta is full; dataset with timestamp %" GST_TIME_FORMAT " is only in the output data", GST_TIME_ARGS(dataset->timestamp));
+
+	if (drift_measure->output_format == GST_DRIFT_MEASURE_OUTPUT_FORMAT_BINARY)
+	{
+		/* Write the record. Its layout is described at the
+		 * definition of the BINARY_* constants. */
+		GST_WRITE_UINT64_LE(write_pointer, dataset->timestamp);
+		write_pointer += 8;
+
+		for (channel = 0; channel < (num_channels - 1); ++channel)
+		{
+			GstClockTimeDiff drift = dataset->drifts[channel];
+			GST_WRITE_UINT64_LE(write_pointer, (guint64)((drift != GST_CLOCK_STIME_NONE) ? drift : BINARY_NONE_VALUE));
+			write_pointer += 8;
+		}
+
+		goto row_written;
+	}
+
+	/* Write the timestamp. */
+	num_written = drift_measure_format_uint64(write_pointer, dataset->timestamp);
+	write_pointer += num_written;
+
+	/* Write the drift values including their preceding comma delimiters. */
+	for (channel = 0; channel < (num_channels - 1); ++channel)
+	{
+		GstClockTimeDiff drift = dataset->drifts[channel];
+
+		*write_pointer++ = ',';
+
+		if (drift != GST_CLOCK_STIME_NONE)
+		{
+			num_written = drift_measure_format_int64(write_pointer, drift);
+			write_pointer += num_written;
+		}
+	}
+
+	/* Write the tracking columns: the offset in nanoseconds, and the
+	 * clock rate error and its standard deviation in ppm. */
+	if (drift_measure->output_tracking)
+	{
+		for (channel = 0; channel < (num_channels - 1); ++channel)
+		{
+			DriftMeasureDriftEstimate estimate;
+
+			drift_measure_drift_tracker_get(drift_measure->tracker, channel, &estimate);
+
+			*write_pointer++ = ',';
+			if (estimate.valid)
+				write_pointer += drift_measure_format_int64(write_pointer, (gint64)round(estimate.offset));
+			*write_pointer++ = ',';
+			if (estimate.valid)
+				write_pointer += fixed3_to_string(write_pointer, estimate.rate_ppm);
+			*write_pointer++ = ',';
+			if (estimate.valid)
+				write_pointer += fixed3_to_string(write_pointer, estimate.rate_stddev_ppm);
+		}
+	}
+
+	/* Finish the CSV row with a newline character. */
+	*write_pointer++ = '\n';
+
+row_written:
+	gst_drift_measure_end_output_row(drift_measure, write_pointer);
+
+	if (drift_measure->params->post_messages)
+		gst_drift_measure_post_dataset_message(drift_measure, dataset);
+
+	if (gst_drift_measure_output_batch_is_due(drift_measure))
+		return gst_drift_measure_push_output_batch(drift_measure);
+	else
+		return GST_FLOW_OK;
+}
+
+
+static void gst_drift_measure_post_dataset_message(GstDriftMeasure *drift_measure, GstDriftMeasureDataset const *dataset)
+{
+	/* must be called with process mutex held */
+
+	GstStructure *structure;
+	GValue drifts = G_VALUE_INIT;
+	guint num_channels, channel;
+
+	num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+
+	/* Drifts without a value are GST_CLOCK_STIME_NONE, as in the meta. */
+	g_value_init(&drifts, GST_TYPE_ARRAY);
+	for (channel = 0; channel < (num_channels - 1); ++channel)
+	{
+		GValue drift = G_VALUE_INIT;
+		g_value_init(&drift, G_TYPE_INT64);
+		g_value_set_int64(&drift, dataset->drifts[channel]);
+		gst_value_array_append_and_take_value(&drifts, &drift);
+	}
+
+	structure = gst_structure_new(
+		"drift-measurement",
+		"timestamp", G_TYPE_UINT64, (guint64)(dataset->timestamp),
+		"reference-channel", G_TYPE_UINT, drift_measure->params->reference_channel,
+		NULL
+	);
+	gst_structure_take_value(structure, "drifts", &drifts);
+
+	/* The published estimates are the current ones, since they
+	 * are published whenever the tracker is updated. */
+	if (drift_measure->params->output_tracking)
+	{
+		GST_OBJECT_LOCK(drift_measure);
+		gst_drift_measure_add_tracking_fields(structure, drift_measure->published_estimates, drift_measure->num_published_estimates);
+		GST_OBJECT_UNLOCK(drift_measure);
+	}
+
+	/* Bus sync handlers run in this thread, and may call back into
+	 * the element, for example to change its state. */
+	g_mutex_unlock(&(drift_measure->process_mutex));
+	gst_element_post_message(GST_ELEMENT(drift_measure), gst_message_new_element(GST_OBJECT(drift_measure), structure));
+	g_mutex_lock(&(drift_measure->process_mutex));
+}
+
+
+static void gst_drift_measure_publish_tracking_estimates(GstDriftMeasure *drift_measure)
+{
+	/* must be called with process mutex held */
+
+	guint num_estimates = 0, channel;
+
+	if (drift_measure->tracker != NULL)
+		num_estimates = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info)) - 1;
+
+	GST_OBJECT_LOCK(drift_measure);
+
+	/* Only reallocated when the number of channels changes. */
+	if (num_estimates != drift_measure->num_published_estimates)
+	{
+		drift_measure->published_estimates = g_renew(DriftMeasureDriftEstimate, drift_measure->published_estimates, num_estimates);
+		drift_measure->num_published_estimates = num_estimates;
+	}
+
+	for (channel = 0; channel < num_estimates; ++channel)
+		drift_measure_drift_tracker_get(drift_measure->tracker, channel, &(drift_measure->published_estimates[channel]));
+
+	GST_OBJECT_UNLOCK(drift_measure);
+}
+
+
+static void gst_drift_measure_add_tracking_fields(GstStructure *structure, DriftMeasureDriftEstimate const *estimates, guint num_estimates)
+{
+	GValue offsets = G_VALUE_INIT, offset_stddevs = G_VALUE_INIT, rates = G_VALUE_INIT, rate_stddevs = G_VALUE_INIT;
+	guint channel;
+
+	g_value_init(&offsets, GST_TYPE_ARRAY);
+	g_value_init(&offset_stddevs, GST_TYPE_ARRAY);
+	g_value_init(&rates, GST_TYPE_ARRAY);
+	g_value_init(&rate_stddevs, GST_TYPE_ARRAY);
+
+	/* Channels without any drift so far have NaN estimates. */
+	for (channel = 0; channel < num_estimates; ++channel)
+	{
+		DriftMeasureDriftEstimate const *estimate = &(estimates[channel]);
+		GValue value = G_VALUE_INIT;
+
+		g_value_init(&value, G_TYPE_DOUBLE);
+		g_value_set_double(&value, estimate->valid ? estimate->offset : NAN);
+		gst_value_array_append_and_take_value(&offsets, &value);
+
+		g_value_init(&value, G_TYPE_DOUBLE);
+		g_value_set_double(&value, estimate->valid ? estimate->offset_stddev : NAN);
+		gst_value_array_append_and_take_value(&offset_stddevs, &value);
+
+		g_value_init(&value, G_TYPE_DOUBLE);
+		g_value_set_double(&value, estimate->valid ? estimate->rate_ppm : NAN);
+		gst_value_array_append_and_take_value(&rates, &value);
+
+		g_value_init(&value, G_TYPE_DOUBLE);
+		g_value_set_double(&value, estimate->valid ? estimate->rate_stddev_ppm : NAN);
+		gst_value_array_append_and_take_value(&rate_stddevs, &value);
+	}
+
+	gst_structure_take_value(structure, "offsets", &offsets);
+	gst_structure_take_value(structure, "offset-stddevs", &offset_stddevs);
+	gst_structure_take_value(structure, "rates-ppm", &rates);
+	gst_structure_take_value(structure, "rate-stddevs-ppm", &rate_stddevs);
+}
+
+
+static gboolean gst_drift_measure_negotiate_output_format(GstDriftMeasure *drift_measure, GstDriftMeasureOutputMode output_mode, GstDriftMeasureOutputFormat *output_format)
+{
+	GstCaps *template_caps, *peer_caps;
+	GstStructure const *structure;
+
+	/* The result is in the order of downstream's preference, and if
+	 * downstream has no preference (like filesink, which accepts any
+	 * caps), in the order of our template, where CSV comes first. */
+	template_caps = gst_pad_get_pad_template_caps(drift_measure->srcpad);
+
+	/* Statistics rows only exist in CSV format. */
+	if (output_mode == GST_DRIFT_MEASURE_OUTPUT_MODE_STATISTICS)
+	{
+		gst_caps_unref(template_caps);
+		template_caps = gst_caps_new_empty_simple(CSV_CAPS);
+	}
+
+	peer_caps = gst_pad_peer_query_caps(drift_measure->srcpad, template_caps);
+	gst_caps_unref(template_caps);
+
+	if (gst_caps_is_empty(peer_caps))
+	{
+		gst_caps_unref(peer_caps);
+		GST_ELEMENT_ERROR(drift_measure, CORE, NEGOTIATION, ("could not negotiate output format"), ("downstream accepts neither CSV nor binary output"));
+		return FALSE;
+	}
+
+	structure = gst_caps_get_structure(peer_caps, 0);
+	*output_format = gst_structure_has_name(structure, BINARY_CAPS) ? GST_DRIFT_MEASURE_OUTPUT_FORMAT_BINARY : GST_DRIFT_MEASURE_OUTPUT_FORMAT_CSV;
+
+	GST_DEBUG_OBJECT(drift_measure, "downstream caps: %" GST_PTR_FORMAT "; using %s output", (gpointer)peer_caps, (*output_format == GST_DRIFT_MEASURE_OUTPUT_FORMAT_BINARY) ? "binary" : "CSV");
+
+	gst_caps_unref(peer_caps);
+
+	return TRUE;
+}
+
+
+static GstFlowReturn gst_drift_measure_push_binary_header(GstDriftMeasure *drift_measure)
+{
+	GstBuffer *header_buffer;
+	GstMapInfo map_info;
+
+	header_buffer = gst_buffer_new_allocate(NULL, BINARY_HEADER_SIZE, NULL);
+	gst_buffer_map(header_buffer, &map_info, GST_MAP_WRITE);
+
+	g_mutex_lock(&(drift_measure->process_mutex));
+	memcpy(map_info.data, BINARY_MAGIC, 8);
+	GST_WRITE_UINT32_LE(map_info.data + 8, BINARY_VERSION);
+	GST_WRITE_UINT32_LE(map_info.data + 12, GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info)));
+	GST_WRITE_UINT32_LE(map_info.data + 16, drift_measure->params->reference_channel);
+	GST_WRITE_UINT32_LE(map_info.data + 20, GST_AUDIO_INFO_RATE(&(drift_measure->input_audio_info)));
+	g_mutex_unlock(&(drift_measure->process_mutex));
+
+	gst_buffer_unmap(header_buffer, &map_info);
+
+	return gst_pad_push(drift_measure->srcpad, header_buffer);
+}
+
+
+static gboolean gst_drift_measure_output_batch_is_due(GstDriftMeasure *drift_measure)
+{
+	/* must be called with process mutex held */
+
+	if (drift_measure->output_batch == NULL)
+		return FALSE;
+
+	if (drift_measure->num_output_batch_rows >= drift_measure->max_output_batch_rows)
+		return TRUE;
+
+	if ((drift_measure->params->output_batch_size > 0) && (drift_measure->output_batch_fill_size >= drift_measure->params->output_batch_size))
+		return TRUE;
+
+	/* Not enough room for another row. */
+	if ((drift_measure->output_batch_fill_size + drift_measure->max_output_row_size) > drift_measure->output_batch_map_info.size)
+		return TRUE;
+
+	if (GST_CLOCK_TIME_IS_VALID(drift_measure->params->output_batch_latency))
+	{
+		GstClockTime age = (g_get_monotonic_time() - drift_measure->output_batch_start_time) * GST_USECOND;
+		if (age >= drift_measure->params->output_batch_latency)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+static GstFlowReturn gst_drift_measure_push_output_batch(GstDriftMeasure *drift_measure)
+{
+	/* must be called with process mutex held */
+
+	GstBuffer *output_buffer;
+	GstFlowReturn flow_ret;
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	GstClockTime push_start_time;
+#endif
+
+	/* Another thread may still be pushing the previous batch. */
+	while (drift_measure->output_batch_pushing)
+		g_cond_wait(&(drift_measure->output_batch_push_cond), &(drift_measure->process_mutex));
+
+	if (drift_measure->output_batch == NULL)
+		return GST_FLOW_OK;
+
+	output_buffer = drift_measure->output_batch;
+	gst_buffer_unmap(output_buffer, &(drift_measure->output_batch_map_info));
+
+	/* Now resize the buffer to the actual data size, which _at most_ is
+	 * the maximum batch size we computed when creating the buffer pool.
+	 * Since most of the time, the actual size is less than the maximum size,
+	 * we have to resize the buffer, otherwise downstream will think that
+	 * the bytes beyond the first output_batch_fill_size ones are also valid data. */
+	gst_buffer_set_size(output_buffer, drift_measure->output_batch_fill_size);
+
+	GST_LOG_OBJECT(drift_measure, "pushing output batch with %u row(s) and %" G_GSIZE_FORMAT " byte(s)", drift_measure->num_output_batch_rows, drift_measure->output_batch_fill_size);
+
+	/* Detach the batch before unlocking, so that new rows go into a new batch. */
+	drift_measure->output_batch = NULL;
+	drift_measure->output_batch_fill_size = 0;
+	drift_measure->num_output_batch_rows = 0;
+	drift_measure->output_batch_pushing = TRUE;
+
+	g_mutex_unlock(&(drift_measure->process_mutex));
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	push_start_time = gst_util_get_timestamp();
+#endif
+	flow_ret = gst_pad_push(drift_measure->srcpad, output_buffer);
+	g_mutex_lock(&(drift_measure->process_mutex));
+
+	drift_measure->output_batch_pushing = FALSE;
+	g_cond_broadcast(&(drift_measure->output_batch_push_cond));
+
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	drift_measure->push_time += gst_util_get_timestamp() - push_start_time;
+#endif
+
+	return flow_ret;
+}
+
+
+static void gst_drift_measure_discard_output_batch(GstDriftMeasure *drift_measure)
+{
+	/* must be called with process mutex held */
+
+	if (drift_measure->output_batch == NULL)
+		return;
+
+	gst_buffer_unmap(drift_measure->output_batch, &(drift_measure->output_batch_map_info));
+	gst_buffer_unref(drift_measure->output_batch);
+
+	drift_measure->output_batch = NULL;
+	drift_measure->output_batch_fill_size = 0;
+	drift_measure->num_output_batch_rows = 0;
+}
+
+
+static gboolean gst_drift_measure_validate_reference_channel(GstDriftMeasure *drift_measure)
+{
+	/* must be called with process mutex held */
+
+	gboolean ret = TRUE;
+	guint num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+
+	if (G_UNLIKELY(drift_measure->input_audio_info_valid && (drift_measure->params->reference_channel >= num_channels)))
+	{
+		g_mutex_unlock(&(drift_measure->process_mutex));
+		GST_ELEMENT_ERROR(drift_measure, STREAM, FAILED, ("invalid reference channel"), ("reference channel %u out of bounds (valid range is 0-%u)", drift_measure->params->reference_channel, num_channels - 1));
+		g_mutex_lock(&(drift_measure->process_mutex));
+		ret = FALSE;
+	}
+
+	return ret;
+}
+
+
+static gboolean gst_drift_measure_set_input_caps(GstDriftMeasure *drift_measure, GstCaps const *caps)
+{
+	/* must be called with process mutex held */
+
+	guint num_channels;
+	GstStructure *pool_config;
+	gsize max_output_buffer_size;
+	gboolean ret = TRUE;
+
+
+	/* Flush present states and frame histories, since they are no longer valid. */
+	gst_drift_measure_flush(drift_measure);
+
+
+	/* Parse input caps */
+	drift_measure->input_audio_info_valid = gst_audio_info_from_caps(&(drift_measure->input_audio_info), caps);
+	if (!drift_measure->input_audio_info_valid)
+	{
+		g_mutex_unlock(&(drift_measure->process_mutex));
+		GST_ELEMENT_ERROR(drift_measure, STREAM, FORMAT, ("could not use input caps"), ("caps: %" GST_PTR_FORMAT, (gpointer)caps));
+		g_mutex_lock(&(drift_measure->process_mutex));
+		goto error;
+	}
+
+
+	/* The caps only allow for the formats that are handled here. */
+	switch (GST_AUDIO_INFO_FORMAT(&(drift_measure->input_audio_info)))
+	{
+		case GST_AUDIO_FORMAT_F32LE: drift_measure->input_sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_F32; break;
+		case GST_AUDIO_FORMAT_S16LE: drift_measure->input_sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_S16; break;
+		case GST_AUDIO_FORMAT_S24LE: drift_measure->input_sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_S24; break;
+		case GST_AUDIO_FORMAT_S32LE: drift_measure->input_sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_S32; break;
+		default:
+			GST_ERROR_OBJECT(drift_measure, "unsupported sample format %s", GST_AUDIO_INFO_NAME(&(drift_measure->input_audio_info)));
+			drift_measure->input_audio_info_valid = FALSE;
+			goto error;
+	}
+
+
+	/* Check if the reference channel is still valid (= it is < num_channels). */
+	if (!gst_drift_measure_validate_reference_channel(drift_measure))
+		goto error;
+
+
+	/* Set up datasets according to our new audio info. */
+
+	gst_drift_measure_free_dataset(drift_measure, &(drift_measure->last_dataset));
+	gst_drift_measure_free_dataset(drift_measure, &(drift_measure->current_dataset));
+	gst_drift_measure_allocate_dataset(drift_measure, &(drift_measure->last_dataset));
+	gst_drift_measure_allocate_dataset(drift_measure, &(drift_measure->current_dataset));
+
+	/* Create the detector for the new sample format and layout. */
+	if (!gst_drift_measure_setup_detector(drift_measure))
+		goto error;
+
+	drift_measure_drift_stats_free(drift_measure->statistics);
+	drift_measure->statistics = drift_measure_drift_stats_new(GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info)) - 1, drift_measure->params->statistics_window, drift_measure->params->statistics_ewma_weight);
+	if (drift_measure->statistics == NULL)
+	{
+		GST_ERROR_OBJECT(drift_measure, "could not allocate statistics");
+		goto error;
+	}
+
+	drift_measure_drift_tracker_free(drift_measure->tracker);
+	drift_measure->tracker = drift_measure_drift_tracker_new(GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info)) - 1, drift_measure->params->tracking_measurement_noise, drift_measure->params->tracking_rate_noise);
+	if (drift_measure->tracker == NULL)
+	{
+		GST_ERROR_OBJECT(drift_measure, "could not allocate tracker");
+		goto error;
+	}
+
+
+	/* Set up the output buffer pool. */
+
+	num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+
+	/* The size of the output rows depends on whether they have tracking
+	 * columns, so the rows are written with this value until the next
+	 * caps, even if output-tracking is changed meanwhile. */
+	drift_measure->output_tracking = drift_measure->params->output_tracking;
+
+	/* Get rid of any already existing buffer pool. The caller
+	 * pushed out any pending rows of the old pool already. */
+	g_assert(drift_measure->output_batch == NULL);
+	if (drift_measure->output_buffer_pool != NULL)
+		gst_object_unref(GST_OBJECT(drift_measure->output_buffer_pool));
+
+	/* Binary records consist of one 64-bit value per channel: the
+	 * timestamp, and the drifts of the non-reference channels.
+	 *
+	 * Outgoing CSV lines have the following structure:
+	 *
+	 * <timestamp>,<channel 1 drift>,<channel 2 drift>,<channel 3 drift>...
+	 *
+	 * The timestamp and drift values are 64-bit integers. Timestamps are
+	 * unsigned, drift values are signed. This means that the string
+	 * representation of timestamps is at most 20 characters long, and that
+	 * of drift values at most 21 characters (20 digits + 1 sign).
+	 *
+	 * We also have 1 column for the timestamps and (num_channel-1) columns
+	 * for the drift values (since we skip the reference channel).
+	 *
+	 * Therefore, if we factor in the comma delimiters and newline, we get:
+	 *
+	 * Maximum CSV line length: 20 [the timestamp] + (num_channels - 1) [the number of drift values] * (1 [the comma delimiter] + 21 [the drift value digits and a sign character]) + 1 [the newline]
+	 */
+	if (drift_measure->output_format == GST_DRIFT_MEASURE_OUTPUT_FORMAT_BINARY)
+		drift_measure->max_output_row_size = num_channels * 8;
+	else
+		drift_measure->max_output_row_size = 20 + (num_channels - 1) * (1 + 21) + 1;
+
+	/* Statistics rows have NUM_STATISTICS_COLUMNS columns per non-reference
+	 * channel instead of one. None of them is longer than a drift value,
+	 * except for the slope, which has a decimal point and 3 decimals. */
+	if (drift_measure->output_mode == GST_DRIFT_MEASURE_OUTPUT_MODE_STATISTICS)
+		drift_measure->max_output_row_size = 20 + (num_channels - 1) * NUM_STATISTICS_COLUMNS * (1 + 21 + 4) + 1;
+	/* Tracking adds an offset and two values with 3 decimals
+	 * (at most 18 characters) per non-reference channel. */
+	else if (drift_measure->output_tracking && (drift_measure->output_format == GST_DRIFT_MEASURE_OUTPUT_FORMAT_CSV))
+		drift_measure->max_output_row_size += (num_channels - 1) * ((1 + 21) + 2 * (1 + 18));
+
+	/* Output buffers hold a batch of rows. A batch is pushed once it has
+	 * output_batch_rows rows, or once it has at least output_batch_size
+	 * bytes. In the latter case, the last row may have started just below
+	 * that size, so there must be room for one more row after it. */
+	max_output_buffer_size = drift_measure->max_output_row_size * drift_measure->params->output_batch_rows;
+	if (drift_measure->params->output_batch_size > 0)
+		max_output_buffer_size = MIN(max_output_buffer_size, drift_measure->params->output_batch_size - 1 + drift_measure->max_output_row_size);
 
-			drift_measure->output_segment_started = FALSE;
+	drift_measure->output_buffer_pool = gst_buffer_pool_new();
+	pool_config = gst_buffer_pool_get_config(drift_measure->output_buffer_pool);
+	gst_buffer_pool_config_set_params(pool_config, drift_measure->src_caps, max_output_buffer_size, 0, 0);
+	if (!gst_buffer_pool_set_config(drift_measure->output_buffer_pool, pool_config))
+	{
+		GST_ERROR_OBJECT(drift_measure, "could not set modified buffer pool configuration");
+		goto error;
+	}
 
-			GST_OBJECT_UNLOCK(drift_measure);
+	if (!gst_buffer_pool_set_active(drift_measure->output_buffer_pool, TRUE))
+	{
+		GST_ERROR_OBJECT(drift_measure, "could not activate buffer pool");
+		goto error;
+	}
 
-			break;
-		}
 
-		case GST_STATE_CHANGE_READY_TO_NULL:
-		{
-			if (drift_measure->output_buffer_pool != NULL)
-			{
-				gst_object_unref(GST_OBJECT(drift_measure->output_buffer_pool));
-				drift_measure->output_buffer_pool = NULL;
-			}
+done:
+	gst_drift_measure_publish_tracking_estimates(drift_measure);
+	return ret;
 
-			g_object_unref(G_OBJECT(drift_measure->frame_history));
-			drift_measure->frame_history = NULL;
+error:
+	ret = FALSE;
+	goto done;
+}
 
-			break;
-		}
 
-		default:
-			break;
+static DriftMeasureDetector * gst_drift_measure_create_detector(GstDriftMeasure *drift_measure)
+{
+	/* must be called with process mutex held */
+
+	/* Creates a detector for the current input audio info and detection
+	 * properties. Returns NULL if the detector cannot be created. */
+
+	GstAudioInfo const *info = &(drift_measure->input_audio_info);
+	DriftMeasureDetectorSettings settings;
+
+	drift_measure_detector_settings_init(&settings);
+	settings.sample_format = drift_measure->input_sample_format;
+	settings.num_channels = GST_AUDIO_INFO_CHANNELS(info);
+	settings.sample_rate = GST_AUDIO_INFO_RATE(info);
+	settings.interleaved = (GST_AUDIO_INFO_LAYOUT(info) == GST_AUDIO_LAYOUT_INTERLEAVED);
+	settings.window_size = drift_measure->params->window_size;
+	settings.pulse_length = drift_measure->params->pulse_length;
+	settings.peak_threshold = drift_measure->params->peak_threshold;
+	settings.reference_channel = drift_measure->params->reference_channel;
+	settings.detection_method = drift_measure->params->detection_method;
+	settings.peak_interpolation = drift_measure->params->peak_interpolation;
+	settings.pulse_frequency = drift_measure->params->pulse_frequency;
+
+	if (drift_measure->params->pulse_template != NULL)
+	{
+		gsize template_size;
+		settings.pulse_template = g_bytes_get_data(drift_measure->params->pulse_template, &template_size);
+		settings.pulse_template_length = template_size / sizeof(gfloat);
 	}
 
-	return ret;
+	return drift_measure_detector_new(&settings);
 }
 
 
-static gboolean gst_drift_measure_sink_event(GstPad *pad, GstObject *parent, GstEvent *event)
+static gboolean gst_drift_measure_setup_detector(GstDriftMeasure *drift_measure)
 {
-	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(parent);
-
-	switch(GST_EVENT_TYPE(event))
-	{
-		case GST_EVENT_FLUSH_STOP:
-		{
-			/* Flush our history */
-			GST_DEBUG_OBJECT(drift_measure, "got flush_stop event; flushing history");
-			GST_OBJECT_LOCK(drift_measure);
-			gst_drift_measure_flush(drift_measure);
-			GST_OBJECT_UNLOCK(drift_measure);
-
-			/* Forward the event */
-			return gst_pad_push_event(drift_measure->srcpad, event);
-		}
+	/* must be called with process mutex held */
 
-		case GST_EVENT_EOS:
-		{
-			/* Flush our history */
-			GST_DEBUG_OBJECT(drift_measure, "got eos event; flushing history");
-			gst_drift_measure_flush(drift_measure);
+	/* (Re)creates the detector for the current input audio info and
+	 * detection properties. A new detector has no frames, so this
+	 * also flushes. */
 
-			/* Forward the event */
-			return gst_pad_push_event(drift_measure->srcpad, event);
-		}
+	GstAudioInfo const *info = &(drift_measure->input_audio_info);
+	guint sample_rate = GST_AUDIO_INFO_RATE(info);
+	gboolean ret = TRUE;
 
-		case GST_EVENT_CAPS:
-		{
-			/* We need to parse the input caps to be able to
-			 * properly search the incoming PCM data for peaks. */
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	if (drift_measure->detector != NULL)
+	{
+		DriftMeasureDetectorStats stats;
+		drift_measure_detector_get_stats(drift_measure->detector, &stats);
+		gst_drift_measure_retire_detector_stats(drift_measure, &stats);
+	}
+#endif
+	drift_measure_detector_free(drift_measure->detector);
+	drift_measure->detector = NULL;
+	/* The analysis thread recreates its detector as well. */
+	++drift_measure->detector_generation;
 
-			GstCaps *input_caps;
-			gboolean retval = TRUE;
+	if ((drift_measure->params->pulse_template != NULL) && (drift_measure->params->detection_method == DRIFT_MEASURE_DETECTION_METHOD_MATCHED_FILTER) && (drift_measure->params->pulse_template_rate != sample_rate))
+		GST_WARNING_OBJECT(drift_measure, "pulse template sample rate %u Hz does not match input sample rate %u Hz; detection will be less sensitive", drift_measure->params->pulse_template_rate, sample_rate);
 
-			gst_event_parse_caps(event, &input_caps);
-			g_assert(input_caps != NULL);
+	drift_measure->detector = gst_drift_measure_create_detector(drift_measure);
+	if (drift_measure->detector == NULL)
+	{
+		GST_ERROR_OBJECT(drift_measure, "could not create detector");
+		ret = FALSE;
+		goto done;
+	}
 
-			GST_DEBUG_OBJECT(drift_measure, "got caps event with caps %" GST_PTR_FORMAT, (gpointer)input_caps);
+	if (drift_measure_detector_uses_matched_filter(drift_measure->detector))
+	{
+		GST_DEBUG_OBJECT(drift_measure, "created matched filter with a delay of %" G_GSIZE_FORMAT " frames", drift_measure_detector_get_matched_filter_delay(drift_measure->detector));
+	}
+	else if (drift_measure->params->detection_method == DRIFT_MEASURE_DETECTION_METHOD_MATCHED_FILTER)
+	{
+		/* This happens if the template is silent, for example because
+		 * the pulse frequency is a multiple of the sample rate. */
+		GST_ERROR_OBJECT(drift_measure, "could not create matched filter; using the input frames directly");
+		ret = FALSE;
+	}
 
-			GST_OBJECT_LOCK(drift_measure);
-			retval = gst_drift_measure_set_input_caps(drift_measure, input_caps);
-			GST_OBJECT_UNLOCK(drift_measure);
+	GST_DEBUG_OBJECT(
+		drift_measure,
+		"using %s peak search kernels for %s samples; allocated %" G_GSIZE_FORMAT " bytes for the history",
+		drift_measure_detector_get_peak_kernels_name(drift_measure->detector),
+		drift_measure_detector_uses_matched_filter(drift_measure->detector) ? "matched filter output" : GST_AUDIO_INFO_NAME(info),
+		drift_measure_detector_get_history_memory_size(drift_measure->detector)
+	);
 
-			/* Unref the event. Do not forward it, since we do not forward
-			 * the input PCM data. Instead, we output CSV data. */
-			gst_event_unref(event);
+done:
+	GST_OBJECT_LOCK(drift_measure);
+	drift_measure->published_history_memory_size = (drift_measure->detector != NULL) ? drift_measure_detector_get_history_memory_size(drift_measure->detector) : 0;
+	GST_OBJECT_UNLOCK(drift_measure);
 
-			return retval;
-		}
+	/* Window snapshots of the old detector are no longer valid. */
+	gst_drift_measure_flush(drift_measure);
 
-		case GST_EVENT_SEGMENT:
-		{
-			GstSegment const *segment;
+	return ret;
+}
 
-			gst_event_parse_segment(event, &segment);
 
-			GST_DEBUG_OBJECT(drift_measure, "got segment event: %" GST_SEGMENT_FORMAT, (gpointer)segment);
+static gboolean gst_drift_measure_load_pulse_template(GstDriftMeasure *drift_measure, gchar const *location, gfloat **template_values, gsize *template_length, guint *template_rate)
+{
+	gchar *contents;
+	gsize size;
+	GError *error = NULL;
+	gboolean ret;
 
-			/* We use the base field of the input segments for producing
-			 * timestamps in the CSV output (not to be confused with the
-			 * PTS and DTS of outgoing buffers, which we do _not_ set). */
-			drift_measure->input_segment = *segment;
-			gst_drift_measure_flush(drift_measure);
+	if (!g_file_get_contents(location, &contents, &size, &error))
+	{
+		GST_ELEMENT_WARNING(drift_measure, RESOURCE, READ, ("could not read pulse template"), ("%s", error->message));
+		g_error_free(error);
+		return FALSE;
+	}
 
-			/* Input segment events are never forwarded, since input and output
-			 * segments never are the same. */
-			gst_event_unref(event);
+	ret = drift_measure_matched_filter_parse_wav_template(contents, size, template_values, template_length, template_rate);
+	g_free(contents);
 
-			return TRUE;
-		}
+	if (ret)
+		GST_DEBUG_OBJECT(drift_measure, "loaded pulse template with %" G_GSIZE_FORMAT " frames at %u Hz from %s", *template_length, *template_rate, location);
+	else
+		GST_ELEMENT_WARNING(drift_measure, RESOURCE, READ, ("could not read pulse template"), ("%s is not a supported WAV file", location));
 
-		default:
-			return gst_pad_event_default(pad, parent, event);
-	}
+	return ret;
 }
 
 
-static GstFlowReturn gst_drift_measure_chain(G_GNUC_UNUSED GstPad *pad, GstObject *parent, GstBuffer *buffer)
+static gsize gst_drift_measure_get_buffer_layout(GstDriftMeasure *drift_measure, GstBuffer *buffer, gsize size, gboolean interleaved, guint bytes_per_sample, gsize *frame_stride, gsize *channel_offsets)
 {
-	GstFlowReturn flow_ret;
-	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(parent);
+	/* must be called with process mutex held */
+
+	/* Determines where the samples of each channel are located in a
+	 * buffer of the given size, and returns the number of frames in it. */
+
+	guint num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+	gsize bytes_per_frame = num_channels * bytes_per_sample;
+	gsize num_frames;
+	guint channel;
 
-	if (!drift_measure->output_segment_started)
+	if (interleaved)
 	{
-		/* If we did not start the output segment yet, do so now.
-		 * To that end, push a caps event with the CSV caps inside,
-		 * then push a segment event. (stream-start will have been
-		 * forwarded already by GstElement at this point.) */
+		num_frames = size / bytes_per_frame;
+		*frame_stride = bytes_per_frame;
+		for (channel = 0; channel < num_channels; ++channel)
+			channel_offsets[channel] = channel * bytes_per_sample;
 
-		GstSegment segment;
+		if (G_UNLIKELY((size % bytes_per_frame) != 0))
+			GST_WARNING_OBJECT(drift_measure, "input buffer size %" G_GSIZE_FORMAT " is not a multiple of the frame size; ignoring the trailing partial frame", size);
+	}
+	else
+	{
+#if GST_CHECK_VERSION(1, 16, 0)
+		GstAudioMeta *audio_meta = gst_buffer_get_audio_meta(buffer);
+#else
+		(void)buffer;
+#endif
 
-		if (!gst_pad_push_event(drift_measure->srcpad, gst_event_new_caps(drift_measure->src_caps)))
+		*frame_stride = bytes_per_sample;
+
+#if GST_CHECK_VERSION(1, 16, 0)
+		if (audio_meta != NULL)
 		{
-			GST_ERROR_OBJECT(drift_measure, "could not push caps event downstream");
-			return GST_FLOW_ERROR;
+			/* The planes can be anywhere in the buffer. */
+			num_frames = audio_meta->samples;
+			for (channel = 0; channel < num_channels; ++channel)
+				channel_offsets[channel] = audio_meta->offsets[channel];
 		}
-
-		gst_segment_init(&segment, GST_FORMAT_BYTES);
-
-		if (!gst_pad_push_event(drift_measure->srcpad, gst_event_new_segment(&segment)))
+		else
+#endif
 		{
-			GST_ERROR_OBJECT(drift_measure, "could not push segment event downstream");
-			return GST_FLOW_ERROR;
+			/* Without an audio meta, the planes are placed
+			 * back to back and all have the same size. */
+			gsize plane_size = size / num_channels;
+			num_frames = plane_size / bytes_per_sample;
+			for (channel = 0; channel < num_channels; ++channel)
+				channel_offsets[channel] = channel * plane_size;
 		}
-
-		drift_measure->output_segment_started = TRUE;
 	}
 
-	/* Perform the main processing. We hold the object lock to avoid
-	 * race conditions that could otherwise happen when the user sets
-	 * new property values while we are processing. */
-	GST_OBJECT_LOCK(drift_measure);
-	flow_ret = gst_drift_measure_process_input_buffer(drift_measure, buffer);
-	GST_OBJECT_UNLOCK(drift_measure);
-
-	/* We are done with this buffer. */
-	gst_buffer_unref(buffer);
-
-	return flow_ret;
+	return num_frames;
 }
 
 
-static void gst_drift_measure_allocate_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset *dataset)
+static gboolean gst_drift_measure_setup_analysis_threads(GstDriftMeasure *drift_measure, DriftMeasureDetector *detector)
 {
-	guint num_channels;
-
-	num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
-	g_assert(num_channels >= 2);
-
-	dataset->drifts = g_slice_alloc(sizeof(GstClockTimeDiff) * (num_channels - 1));
+	/* must be called with process mutex held */
 
-	gst_drift_measure_reset_dataset(drift_measure, dataset);
-}
+	/* Sets up the thread pool for n_threads, and makes the given detector
+	 * split the analysis of each window into as many shares. Only the
+	 * thread that analyzes the windows may call this, since the pool
+	 * must not be replaced while it runs shares. */
 
+	guint num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+	guint num_threads = (drift_measure->params->n_threads == 0) ? g_get_num_processors() : drift_measure->params->n_threads;
 
-static void gst_drift_measure_reset_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset *dataset)
-{
-	dataset->timestamp = GST_CLOCK_TIME_NONE;
+	/* There is no point in having more shares than non-reference channels. */
+	num_threads = CLAMP(num_threads, 1, num_channels - 1);
 
-	if (drift_measure->input_audio_info_valid)
+	if (num_threads != drift_measure->num_analysis_threads)
 	{
-		guint num_channels, channel;
-
-		num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
-		g_assert(num_channels >= 2);
+		gst_drift_measure_free_analysis_threads(drift_measure);
 
-		if (dataset->drifts != NULL)
+		if (num_threads > 1)
 		{
-			for (channel = 0; channel < (num_channels - 1); ++channel)
-				dataset->drifts[channel] = GST_CLOCK_STIME_NONE;
+			GError *error = NULL;
+
+			/* The calling thread analyzes one share itself,
+			 * so the pool needs one thread less. */
+			drift_measure->analysis_thread_pool = g_thread_pool_new(gst_drift_measure_analysis_thread_func, drift_measure, (gint)(num_threads - 1), TRUE, &error);
+			if (drift_measure->analysis_thread_pool == NULL)
+			{
+				GST_ERROR_OBJECT(drift_measure, "could not create analysis thread pool: %s", error->message);
+				g_error_free(error);
+				return FALSE;
+			}
 		}
+
+		drift_measure->num_analysis_threads = num_threads;
+
+		GST_DEBUG_OBJECT(drift_measure, "analyzing channels with %u thread(s)", num_threads);
+	}
+
+	if (!drift_measure_detector_set_task_runner(detector, num_threads, (num_threads > 1) ? gst_drift_measure_run_analysis_tasks : NULL, drift_measure))
+	{
+		GST_ERROR_OBJECT(drift_measure, "could not allocate analysis tasks");
+		return FALSE;
 	}
+
+	return TRUE;
 }
 
 
-static void gst_drift_measure_free_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset *dataset)
+static void gst_drift_measure_free_analysis_threads(GstDriftMeasure *drift_measure)
 {
-	if (drift_measure->input_audio_info_valid)
+	if (drift_measure->analysis_thread_pool != NULL)
 	{
-		guint num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
-		g_assert(num_channels >= 2);
-
-		g_slice_free1(sizeof(GstClockTimeDiff) * (num_channels - 1), dataset->drifts);
+		g_thread_pool_free(drift_measure->analysis_thread_pool, FALSE, TRUE);
+		drift_measure->analysis_thread_pool = NULL;
 	}
 
-	dataset->timestamp = GST_CLOCK_TIME_NONE;
-	dataset->drifts = NULL;
+	drift_measure->num_analysis_threads = 0;
 }
 
 
-static void gst_drift_measure_copy_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset const *from, GstDriftMeasureDataset *to)
+static void gst_drift_measure_run_analysis_tasks(DriftMeasureDetectorTaskFunc func, void * const *tasks, unsigned int num_tasks, void *user_data)
 {
-	guint num_channels, channel;
-
-	num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
-	g_assert(num_channels >= 2);
+	/* Runs the analysis tasks of one window. The calling thread runs the
+	 * first one, the threads in the pool the others. The calling thread
+	 * does not use the detector for anything else until this returns, and
+	 * the detector does not modify its history until all tasks are
+	 * finished, so the pool threads can read it without any lock. */
 
-	to->timestamp = from->timestamp;
-	for (channel = 0; channel < (num_channels - 1); ++channel)
-		to->drifts[channel] = from->drifts[channel];
-}
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(user_data);
+	guint i;
 
+	GST_LOG_OBJECT(drift_measure, "analyzing channels in %u share(s)", num_tasks);
 
-/* The lengths 20 and 21 refer to the length of a string representation
- * of a 64-bit integer: at most 20 digits, plus one sign character */
+	drift_measure->analysis_task_func = func;
+	drift_measure->num_pending_analysis_tasks = num_tasks - 1;
+	for (i = 1; i < num_tasks; ++i)
+		g_thread_pool_push(drift_measure->analysis_thread_pool, tasks[i], NULL);
 
-static gint int64_to_string(gchar *destination, gint64 integer)
-{
-	int num_if_buffer_big_enough = g_snprintf(destination, 21, "%" G_GINT64_FORMAT, integer);
-	return MIN(num_if_buffer_big_enough, 21);
-}
+	func(tasks[0]);
 
-static gint uint64_to_string(gchar *destination, guint64 integer)
-{
-	int num_if_buffer_big_enough = g_snprintf(destination, 20, "%" G_GUINT64_FORMAT, integer);
-	return MIN(num_if_buffer_big_enough, 20);
+	g_mutex_lock(&(drift_measure->analysis_mutex));
+	while (drift_measure->num_pending_analysis_tasks > 0)
+		g_cond_wait(&(drift_measure->analysis_cond), &(drift_measure->analysis_mutex));
+	g_mutex_unlock(&(drift_measure->analysis_mutex));
 }
 
 
-static GstFlowReturn gst_drift_measure_push_out_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureDataset const *dataset)
+static void gst_drift_measure_analysis_thread_func(gpointer data, gpointer user_data)
 {
-	/* must be called with object lock held */
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(user_data);
 
-	GstBuffer *output_buffer;
-	GstMapInfo map_info;
-	gchar *write_pointer;
-	gint num_written;
-	guint num_channels, channel;
-	GstFlowReturn flow_ret;
-	gsize actual_size;
+	drift_measure->analysis_task_func(data);
 
-	num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
-	g_assert(num_channels >= 2);
+	g_mutex_lock(&(drift_measure->analysis_mutex));
+	if (--drift_measure->num_pending_analysis_tasks == 0)
+		g_cond_signal(&(drift_measure->analysis_cond));
+	g_mutex_unlock(&(drift_measure->analysis_mutex));
+}
 
-	flow_ret = gst_buffer_pool_acquire_buffer(drift_measure->output_buffer_pool, &output_buffer, NULL);
-	if (flow_ret != GST_FLOW_OK)
-	{
-		GST_ERROR_OBJECT(drift_measure, "could not acquire output buffer: %s", gst_flow_get_name(flow_ret));
-		return flow_ret;
-	}
 
-	gst_buffer_map(output_buffer, &map_info, GST_MAP_WRITE);
+static GstFlowReturn gst_drift_measure_handle_dataset(GstDriftMeasure *drift_measure)
+{
+	/* must be called with process mutex held */
 
-	write_pointer = (gchar *)(map_info.data);
+	/* Writes the drifts of current_dataset into last_dataset, filling in
+	 * the drifts of the channels in which the detector found no pulse,
+	 * and pushes out the dataset. current_dataset is left unchanged. */
 
-	/* Write the timestamp. */
-	num_written = uint64_to_string(write_pointer, dataset->timestamp);
-	write_pointer += num_written;
+	GstDriftMeasureDataset const *measured = &(drift_measure->current_dataset);
+	GstDriftMeasureDataset *written = &(drift_measure->last_dataset);
+	guint num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+	guint channel;
+	guint non_ref_channel;
+	gboolean found_no_peaks = TRUE;
 
-	/* Write the drift values including their preceding comma delimiters. */
-	for (channel = 0; channel < (num_channels - 1); ++channel)
+	for (channel = 0, non_ref_channel = 0; channel < num_channels; ++channel)
 	{
-		GstClockTimeDiff drift = dataset->drifts[channel];
-
-		*write_pointer++ = ',';
+		/* The dataset has no drift for the reference channel. */
+		if (channel == drift_measure->params->reference_channel)
+			continue;
 
-		if (drift != GST_CLOCK_STIME_NONE)
+		if (measured->drifts[non_ref_channel] != DRIFT_MEASURE_DETECTOR_NO_DRIFT)
 		{
-			num_written = int64_to_string(write_pointer, drift);
-			write_pointer += num_written;
+			GST_DEBUG_OBJECT(drift_measure, "channel #%u drift: %" G_GINT64_FORMAT " nanoseconds", channel, measured->drifts[non_ref_channel]);
+			written->drifts[non_ref_channel] = measured->drifts[non_ref_channel];
+			found_no_peaks = FALSE;
 		}
-	}
+		else
+		{
+			switch (drift_measure->params->undetected_peak_handling)
+			{
+				case GST_DRIFT_MEASURE_UNDETECTED_PEAK_HANDLING_LAST_VALUE:
+				{
+					GstClockTimeDiff last_value = written->drifts[non_ref_channel];
+					GST_DEBUG_OBJECT(drift_measure, "channel #%u pulse not found; writing last value %" G_GINT64_FORMAT " to CSV", channel, last_value);
+					written->drifts[non_ref_channel] = (last_value == GST_CLOCK_STIME_NONE) ? drift_measure->params->undetected_peak_fill_value : last_value;
+					break;
+				}
 
-	/* Finish the CSV row with a newline character. */
-	*write_pointer++ = '\n';
+				case GST_DRIFT_MEASURE_UNDETECTED_PEAK_HANDLING_FILL_VALUE:
+					GST_DEBUG_OBJECT(drift_measure, "channel #%u pulse not found; writing fill value %" G_GINT64_FORMAT " to CSV", channel, drift_measure->params->undetected_peak_fill_value);
+					written->drifts[non_ref_channel] = drift_measure->params->undetected_peak_fill_value;
+					break;
 
-	/* Note down how large the CSV data actually is
-	 * (= how long the CSV line is, including its newline character). */
-	actual_size = (write_pointer - (gchar *)(map_info.data));
+				case GST_DRIFT_MEASURE_UNDETECTED_PEAK_HANDLING_NO_VALUE:
+					GST_DEBUG_OBJECT(drift_measure, "channel #%u pulse not found; not writing any value to CSV (= leaving column empty)", channel);
+					written->drifts[non_ref_channel] = GST_CLOCK_STIME_NONE;
+					break;
 
-	gst_buffer_unmap(output_buffer, &map_info);
+				default:
+					g_assert_not_reached();
+			}
+		}
 
-	/* Now resize the buffer to the actual data size, which _at most_ is
-	 * the maximum CSV size we computed when creating the buffer pool.
-	 * Since most of the time, the actual size is less than the maximum size,
-	 * we have to resize the buffer, otherwise downstream will think that
-	 * the bytes beyond the first actual_size ones are also valid data. */
-	gst_buffer_set_size(output_buffer, actual_size);
+		++non_ref_channel;
+	}
 
-	GST_OBJECT_UNLOCK(drift_measure);
-	flow_ret = gst_pad_push(drift_measure->srcpad, output_buffer);
-	GST_OBJECT_LOCK(drift_measure);
+	written->timestamp = measured->timestamp;
 
-	return flow_ret;
+	/* Now output the completed dataset. */
+	if (G_UNLIKELY(found_no_peaks && drift_measure->params->omit_output_if_no_peaks))
+		return GST_FLOW_OK;
+	else
+		return gst_drift_measure_output_dataset(drift_measure, measured, written);
 }
 
 
-static gboolean gst_drift_measure_validate_reference_channel(GstDriftMeasure *drift_measure)
-{
-	/* must be called with object lock held */
+static gboolean gst_drift_measure_start_analysis_thread(GstDriftMeasure *drift_measure)
+{
+	GError *error = NULL;
+	guint queue_size;
+
+	g_mutex_lock(&(drift_measure->process_mutex));
+	gst_drift_measure_update_params(drift_measure);
+	queue_size = drift_measure->params->analysis_queue_size;
+	g_mutex_unlock(&(drift_measure->process_mutex));
+
+	if (queue_size == 0)
+		return TRUE;
 
-	gboolean ret = TRUE;
-	guint num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+	GST_DEBUG_OBJECT(drift_measure, "starting analysis thread with a queue for %u windows", queue_size);
 
-	if (G_UNLIKELY(drift_measure->input_audio_info_valid && (drift_measure->reference_channel >= num_channels)))
+	drift_measure->analysis_queue = drift_measure_spsc_queue_new(queue_size);
+	drift_measure->analysis_thread_stopping = FALSE;
+	drift_measure->analysis_flushing = FALSE;
+	drift_measure->output_batch_push_requested = FALSE;
+	g_atomic_int_set(&(drift_measure->num_queued_windows), 0);
+	g_atomic_int_set(&(drift_measure->num_dropped_windows), 0);
+	drift_measure->analysis_flow_ret = GST_FLOW_OK;
+
+	drift_measure->analysis_thread = g_thread_try_new("driftmeasure-analysis", gst_drift_measure_analysis_thread_main, drift_measure, &error);
+	if (drift_measure->analysis_thread == NULL)
 	{
-		GST_OBJECT_UNLOCK(drift_measure);
-		GST_ELEMENT_ERROR(drift_measure, STREAM, FAILED, ("invalid reference channel"), ("reference channel %u out of bounds (valid range is 0-%u)", drift_measure->reference_channel, num_channels - 1));
-		GST_OBJECT_LOCK(drift_measure);
-		ret = FALSE;
+		GST_ERROR_OBJECT(drift_measure, "could not start analysis thread: %s", error->message);
+		g_error_free(error);
+		drift_measure_spsc_queue_free(drift_measure->analysis_queue);
+		drift_measure->analysis_queue = NULL;
+		return FALSE;
 	}
 
-	return ret;
+	return TRUE;
 }
 
 
-static gboolean gst_drift_measure_set_input_caps(GstDriftMeasure *drift_measure, GstCaps const *caps)
+static void gst_drift_measure_stop_analysis_thread(GstDriftMeasure *drift_measure)
 {
-	/* must be called with object lock held */
+	GstDriftMeasureWindowSnapshot *snapshot;
 
-	guint num_channels;
-	GstStructure *pool_config;
-	gsize max_csv_buffer_size;
-	gboolean ret = TRUE;
+	if (drift_measure->analysis_thread == NULL)
+		return;
 
+	GST_DEBUG_OBJECT(drift_measure, "stopping analysis thread");
 
-	/* Flush present states and frame histories, since they are no longer valid. */
-	gst_drift_measure_flush(drift_measure);
+	g_mutex_lock(&(drift_measure->queue_mutex));
+	drift_measure->analysis_thread_stopping = TRUE;
+	g_cond_broadcast(&(drift_measure->queue_cond));
+	g_mutex_unlock(&(drift_measure->queue_mutex));
 
+	g_thread_join(drift_measure->analysis_thread);
+	drift_measure->analysis_thread = NULL;
 
-	/* Parse input caps */
-	drift_measure->input_audio_info_valid = gst_audio_info_from_caps(&(drift_measure->input_audio_info), caps);
-	if (!drift_measure->input_audio_info_valid)
-	{
-		GST_OBJECT_UNLOCK(drift_measure);
-		GST_ELEMENT_ERROR(drift_measure, STREAM, FORMAT, ("could not use input caps"), ("caps: %" GST_PTR_FORMAT, (gpointer)caps));
-		GST_OBJECT_LOCK(drift_measure);
-		goto error;
-	}
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	g_mutex_lock(&(drift_measure->process_mutex));
+	gst_drift_measure_retire_detector_stats(drift_measure, &(drift_measure->analysis_detector_stats));
+	memset(&(drift_measure->analysis_detector_stats), 0, sizeof(DriftMeasureDetectorStats));
+	g_mutex_unlock(&(drift_measure->process_mutex));
+#endif
+	drift_measure_detector_free(drift_measure->analysis_detector);
+	drift_measure->analysis_detector = NULL;
 
+	/* Snapshots that were not analyzed yet are discarded. */
+	while ((snapshot = drift_measure_spsc_queue_pop(drift_measure->analysis_queue)) != NULL)
+		gst_drift_measure_free_window_snapshot(snapshot);
 
-	/* Check if the reference channel is still valid (= it is < num_channels). */
-	if (!gst_drift_measure_validate_reference_channel(drift_measure))
-		goto error;
+	drift_measure_spsc_queue_free(drift_measure->analysis_queue);
+	drift_measure->analysis_queue = NULL;
+	g_atomic_int_set(&(drift_measure->num_queued_windows), 0);
+}
 
 
-	/* Set up sizes and datasets according to our new audio info. */
+static void gst_drift_measure_set_analysis_flushing(GstDriftMeasure *drift_measure, gboolean flushing)
+{
+	/* While flushing, the streaming thread does not wait for the
+	 * analysis queue, so that it can quickly return from the chain
+	 * function. Snapshots that are still in the queue are discarded
+	 * by the analysis thread, since the flush changes the history
+	 * generation. */
+
+	g_mutex_lock(&(drift_measure->queue_mutex));
+	drift_measure->analysis_flushing = flushing;
+	g_cond_broadcast(&(drift_measure->queue_cond));
+	g_mutex_unlock(&(drift_measure->queue_mutex));
+}
 
-	gst_drift_measure_recalculate_num_window_frames(drift_measure);
 
-	gst_drift_measure_free_dataset(drift_measure, &(drift_measure->last_dataset));
-	gst_drift_measure_free_dataset(drift_measure, &(drift_measure->current_dataset));
-	gst_drift_measure_allocate_dataset(drift_measure, &(drift_measure->last_dataset));
-	gst_drift_measure_allocate_dataset(drift_measure, &(drift_measure->current_dataset));
+static void gst_drift_measure_drain_analysis_queue(GstDriftMeasure *drift_measure)
+{
+	/* Waits until all queued windows are analyzed. */
 
-	drift_measure->pulse_length_in_frames = gst_util_uint64_scale_int_ceil(drift_measure->pulse_length, GST_AUDIO_INFO_RATE(&(drift_measure->input_audio_info)), GST_SECOND);
+	if (drift_measure->analysis_queue == NULL)
+		return;
 
+	GST_DEBUG_OBJECT(drift_measure, "waiting for %d queued window(s) to be analyzed", g_atomic_int_get(&(drift_measure->num_queued_windows)));
 
-	/* Set up the output buffer pool. */
+	g_mutex_lock(&(drift_measure->queue_mutex));
+	while ((g_atomic_int_get(&(drift_measure->num_queued_windows)) > 0) && !drift_measure->analysis_flushing && !drift_measure->analysis_thread_stopping)
+		g_cond_wait(&(drift_measure->queue_cond), &(drift_measure->queue_mutex));
+	g_mutex_unlock(&(drift_measure->queue_mutex));
+}
 
-	num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
 
-	/* Get rid of any already existing buffer pool. */
-	if (drift_measure->output_buffer_pool != NULL)
-		gst_object_unref(GST_OBJECT(drift_measure->output_buffer_pool));
+static void gst_drift_measure_request_output_batch_push(GstDriftMeasure *drift_measure)
+{
+	/* Asks the analysis thread to push out the current output batch
+	 * if it is still due by the time the analysis thread gets to it. */
 
-	/* Outgoing CSV lines have the following structure:
-	 *
-	 * <timestamp>,<channel 1 drift>,<channel 2 drift>,<channel 3 drift>...
-	 *
-	 * The timestamp and drift values are 64-bit integers. Timestamps are
-	 * unsigned, drift values are signed. This means that the string
-	 * representation of timestamps is at most 20 characters long, and that
-	 * of drift values at most 21 characters (20 digits + 1 sign).
-	 *
-	 * We also have 1 column for the timestamps and (num_channel-1) columns
-	 * for the drift values (since we skip the reference channel).
-	 *
-	 * Therefore, if we factor in the comma delimiters and newline, we get:
-	 *
-	 * Maximum CSV line length: 20 [the timestamp] + (num_channels - 1) [the number of drift values] * (1 [the comma delimiter] + 21 [the drift value digits and a sign character]) + 1 [the newline]
-	 */
-	max_csv_buffer_size = 20 + (num_channels - 1) * (1 + 21) + 1;
+	g_mutex_lock(&(drift_measure->queue_mutex));
+	drift_measure->output_batch_push_requested = TRUE;
+	g_cond_broadcast(&(drift_measure->queue_cond));
+	g_mutex_unlock(&(drift_measure->queue_mutex));
+}
 
-	drift_measure->output_buffer_pool = gst_buffer_pool_new();
-	pool_config = gst_buffer_pool_get_config(drift_measure->output_buffer_pool);
-	gst_buffer_pool_config_set_params(pool_config, drift_measure->src_caps, max_csv_buffer_size, 0, 0);
-	if (!gst_buffer_pool_set_config(drift_measure->output_buffer_pool, pool_config))
-	{
-		GST_ERROR_OBJECT(drift_measure, "could not set modified buffer pool configuration");
-		goto error;
-	}
 
-	if (!gst_buffer_pool_set_active(drift_measure->output_buffer_pool, TRUE))
-	{
-		GST_ERROR_OBJECT(drift_measure, "could not activate buffer pool");
-		goto error;
-	}
+static void gst_drift_measure_free_window_snapshot(GstDriftMeasureWindowSnapshot *snapshot)
+{
+	drift_measure_detector_window_free(snapshot->window);
+	g_free(snapshot);
+}
 
 
-done:
-	return ret;
+static GstFlowReturn gst_drift_measure_queue_window(GstDriftMeasure *drift_measure, DriftMeasureDetectorWindow *window, GstClockTime base)
+{
+	/* must be called with process mutex held */
 
-error:
-	ret = FALSE;
-	goto done;
-}
+	/* Puts a window that was pulled out of the detector into the analysis
+	 * queue. The snapshot takes ownership of the window. base is added to
+	 * the timestamp of the dataset once the window is analyzed. */
 
+	GstDriftMeasureWindowSnapshot *snapshot;
 
-static void gst_drift_measure_find_largest_frame(GstDriftMeasure *drift_measure, gfloat const *samples, guint channel, gsize num_frames, guint64 *largest_frame_index, gfloat *largest_sample)
-{
-	guint sample_index;
-	guint64 largest_sample_index = UNDEFINED_INDEX;
-	guint num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+	if (drift_measure->analysis_flow_ret < GST_FLOW_OK)
+	{
+		GST_DEBUG_OBJECT(drift_measure, "analysis thread reported flow return %s", gst_flow_get_name(drift_measure->analysis_flow_ret));
+		drift_measure_detector_window_free(window);
+		return drift_measure->analysis_flow_ret;
+	}
 
-	*largest_frame_index = UNDEFINED_INDEX;
+	snapshot = g_new0(GstDriftMeasureWindowSnapshot, 1);
+	snapshot->window = window;
+	snapshot->base = base;
+	snapshot->generation = drift_measure->history_generation;
 
-	/* Search for the positive peak in the input signal. */
-	/* TODO: Implement a better peak detection method. This one
-	 * is susceptible to signal noise. */
-	for (sample_index = channel; sample_index < (num_frames * num_channels); sample_index += num_channels)
+	g_atomic_int_inc(&(drift_measure->num_queued_windows));
+
+	while (!drift_measure_spsc_queue_push(drift_measure->analysis_queue, snapshot))
 	{
-		gfloat sample = samples[sample_index];
+		gboolean flushing;
 
-		if (sample < drift_measure->peak_threshold)
-			continue;
+		if (drift_measure->params->analysis_queue_policy == GST_DRIFT_MEASURE_QUEUE_POLICY_DROP)
+		{
+			GST_DEBUG_OBJECT(drift_measure, "analysis queue is full; dropping window");
+			g_atomic_int_add(&(drift_measure->num_queued_windows), -1);
+			g_atomic_int_inc(&(drift_measure->num_dropped_windows));
+			gst_drift_measure_free_window_snapshot(snapshot);
+			return GST_FLOW_OK;
+		}
 
-		if ((largest_sample_index == UNDEFINED_INDEX) || (sample > *largest_sample))
+		/* Wait for the analysis thread to make room. The process mutex is
+		 * released meanwhile, since the analysis thread needs it. */
+		GST_LOG_OBJECT(drift_measure, "analysis queue is full; waiting");
+		g_mutex_unlock(&(drift_measure->process_mutex));
+		g_mutex_lock(&(drift_measure->queue_mutex));
+		while ((drift_measure_spsc_queue_get_length(drift_measure->analysis_queue) >= drift_measure_spsc_queue_get_capacity(drift_measure->analysis_queue)) && !drift_measure->analysis_flushing)
+			g_cond_wait(&(drift_measure->queue_cond), &(drift_measure->queue_mutex));
+		flushing = drift_measure->analysis_flushing;
+		g_mutex_unlock(&(drift_measure->queue_mutex));
+		g_mutex_lock(&(drift_measure->process_mutex));
+
+		if (flushing)
 		{
-			largest_sample_index = sample_index;
-			*largest_sample = sample;
+			g_atomic_int_add(&(drift_measure->num_queued_windows), -1);
+			gst_drift_measure_free_window_snapshot(snapshot);
+			return GST_FLOW_FLUSHING;
 		}
 	}
 
-	if (largest_sample_index != UNDEFINED_INDEX)
-		*largest_frame_index = largest_sample_index / num_channels;
+	g_mutex_lock(&(drift_measure->queue_mutex));
+	g_cond_broadcast(&(drift_measure->queue_cond));
+	g_mutex_unlock(&(drift_measure->queue_mutex));
+
+	return GST_FLOW_OK;
 }
 
 
-static guint64 gst_drift_measure_scan_for_peak(GstDriftMeasure *drift_measure, gsize num_available_frames)
+static gboolean gst_drift_measure_prepare_window_analysis(GstDriftMeasure *drift_measure, GstDriftMeasureWindowSnapshot const *snapshot)
 {
-	/* must be called with object lock held */
+	/* must be called with process mutex held */
 
-	guint bytes_per_frame = GST_AUDIO_INFO_BPF(&(drift_measure->input_audio_info));
-	gconstpointer mapped_ptr;
-	gfloat const *samples;
-	gfloat largest_sample = -G_MAXFLOAT;
-	guint64 largest_frame_index = UNDEFINED_INDEX;
+	/* Brings the analysis detector in line with the current settings.
+	 * Returns FALSE if the snapshot shall not be analyzed. */
 
-	g_assert(num_available_frames > 0);
+	/* Snapshots taken before a flush are stale. */
+	if ((snapshot->generation != drift_measure->history_generation) || (drift_measure->detector == NULL))
+	{
+		GST_DEBUG_OBJECT(drift_measure, "discarding window snapshot from before a flush");
+		return FALSE;
+	}
 
-	mapped_ptr = gst_adapter_map(drift_measure->frame_history, num_available_frames * bytes_per_frame);
-	samples = (gfloat const *)mapped_ptr;
+	if ((drift_measure->analysis_detector == NULL) || (drift_measure->analysis_detector_generation != drift_measure->detector_generation))
+	{
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+		gst_drift_measure_retire_detector_stats(drift_measure, &(drift_measure->analysis_detector_stats));
+		memset(&(drift_measure->analysis_detector_stats), 0, sizeof(DriftMeasureDetectorStats));
+#endif
+		drift_measure_detector_free(drift_measure->analysis_detector);
+
+		drift_measure->analysis_detector = gst_drift_measure_create_detector(drift_measure);
+		if (drift_measure->analysis_detector == NULL)
+		{
+			GST_ERROR_OBJECT(drift_measure, "could not create analysis detector");
+			drift_measure->analysis_flow_ret = GST_FLOW_ERROR;
+			return FALSE;
+		}
 
-	gst_drift_measure_find_largest_frame(drift_measure, samples, drift_measure->reference_channel, num_available_frames, &largest_frame_index, &largest_sample);
+		drift_measure->analysis_detector_generation = drift_measure->detector_generation;
+	}
 
-	gst_adapter_unmap(drift_measure->frame_history);
+	/* This does not require a new detector, so it is not
+	 * covered by the detector generation. */
+	drift_measure_detector_set_peak_interpolation(drift_measure->analysis_detector, drift_measure->params->peak_interpolation);
 
-	if (largest_frame_index != UNDEFINED_INDEX)
-		GST_DEBUG_OBJECT(drift_measure, "peak detected at frame #%" G_GUINT64_FORMAT " (#%" G_GUINT64_FORMAT " in the history) with value %f", largest_frame_index + drift_measure->total_num_input_frames_seen, largest_frame_index, largest_sample);
+	if (!gst_drift_measure_setup_analysis_threads(drift_measure, drift_measure->analysis_detector))
+	{
+		drift_measure->analysis_flow_ret = GST_FLOW_ERROR;
+		return FALSE;
+	}
 
-	return largest_frame_index;
+	return TRUE;
 }
 
 
-static GstFlowReturn gst_drift_measure_analyze_peaks(GstDriftMeasure *drift_measure, gsize num_available_frames)
+static void gst_drift_measure_hand_off_window_dataset(GstDriftMeasure *drift_measure, GstDriftMeasureWindowSnapshot const *snapshot, guint64 timestamp, GstClockTimeDiff const *drifts)
 {
-	/* must be called with object lock held */
-
-	guint bytes_per_frame = GST_AUDIO_INFO_BPF(&(drift_measure->input_audio_info));
-	guint sample_rate = GST_AUDIO_INFO_RATE(&(drift_measure->input_audio_info));
-	guint num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
-	gconstpointer mapped_ptr;
-	GstClockTime peak_frame_timestamp;
-	gfloat const *samples;
-	guint channel;
-	guint non_ref_channel;
-	gboolean found_no_peaks = TRUE;
+	/* must be called with process mutex held */
 
-	g_assert(num_available_frames > 0);
+	/* Outputs the dataset that the analysis of the snapshot produced. */
 
-	/* Set the timestamp for the output dataset. */
-	peak_frame_timestamp = gst_util_uint64_scale_int(drift_measure->peak_frame_index + drift_measure->total_num_input_frames_seen, GST_SECOND, sample_rate);
-	if (drift_measure->input_segment.format == GST_FORMAT_TIME)
-		peak_frame_timestamp += drift_measure->input_segment.base;
-	drift_measure->current_dataset.timestamp = peak_frame_timestamp;
+	GstFlowReturn flow_ret;
 
-	/* Set the drift values for the output dataset. */
-	mapped_ptr = gst_adapter_map(drift_measure->frame_history, num_available_frames * bytes_per_frame);
-	samples = (gfloat const *)mapped_ptr;
-	for (channel = 0, non_ref_channel = 0; channel < num_channels; ++channel)
+	/* The element may have been flushed while the window was analyzed. */
+	if (snapshot->generation != drift_measure->history_generation)
 	{
-		gfloat largest_sample;
-		guint64 largest_frame_index;
+		GST_DEBUG_OBJECT(drift_measure, "discarding dataset of a window from before a flush");
+		return;
+	}
 
-		/* Comparing the reference channel's peak against the
-		 * reference channel itself makes no sense, so skip it. */
-		if (channel == drift_measure->reference_channel)
-			continue;
+	/* The channel count did not change since the snapshot was taken, since
+	 * new caps recreate the detector, which changes the history generation. */
+	memcpy(drift_measure->current_dataset.drifts, drifts, sizeof(GstClockTimeDiff) * (GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info)) - 1));
+	drift_measure->current_dataset.timestamp = timestamp + snapshot->base;
 
-		gst_drift_measure_find_largest_frame(drift_measure, samples, channel, num_available_frames, &largest_frame_index, &largest_sample);
+	flow_ret = gst_drift_measure_handle_dataset(drift_measure);
+	if (flow_ret < GST_FLOW_OK)
+	{
+		GST_DEBUG_OBJECT(drift_measure, "analysis finished with flow return %s", gst_flow_get_name(flow_ret));
+		drift_measure->analysis_flow_ret = flow_ret;
+	}
+}
 
-		if (largest_frame_index != UNDEFINED_INDEX)
-		{
-			/* Compute the distance from the peak we found in the current channel
-			 * to the peak we found in the reference channel when we were running
-			 * in the search mode earlier. This distance is the drift. */
-			gint64 drift_in_frames = (gint64)largest_frame_index - (gint64)(drift_measure->peak_frame_index);
-			/* Translate the drift from frames to nanoseconds.
-			 * We have to do some signed integer trickery here since the
-			 * gst_util_uint64_scale_int() function only accepts unsigned 64-bit
-			 * integers, so we cannot pass our drift to it directly. */ 
-			gint64 drift_in_nanoseconds = ((gint64)gst_util_uint64_scale_int(ABS(drift_in_frames), GST_SECOND, sample_rate)) * ((drift_in_frames < 0) ? -1 : 1);
 
-			/* We use non_ref_channel, not channel, because non_ref_channel is
-			 * incremented only after we iterated over non-reference channels,
-			 * while "channels" is iterated every time, and the drifts array
-			 * only contains entries for the non-reference channels. */
-			drift_measure->current_dataset.drifts[non_ref_channel] = drift_in_nanoseconds;
+static gpointer gst_drift_measure_analysis_thread_main(gpointer data)
+{
+	GstDriftMeasure *drift_measure = GST_DRIFT_MEASURE(data);
+	/* The drifts of the window that is being analyzed. The analysis runs
+	 * without process_mutex, so it cannot write into current_dataset. */
+	GstClockTimeDiff *drifts = NULL;
+	guint num_allocated_drifts = 0;
 
-			found_no_peaks = FALSE;
+	GST_DEBUG_OBJECT(drift_measure, "analysis thread started");
 
-			GST_DEBUG_OBJECT(drift_measure, "channel #%u drift: %" G_GINT64_FORMAT " nanoseconds (%" G_GINT64_FORMAT " frames)", channel, drift_in_nanoseconds, drift_in_frames);
+	while (TRUE)
+	{
+		GstDriftMeasureWindowSnapshot *snapshot = NULL;
+		guint64 timestamp;
+		guint num_drifts = 0;
+		gboolean analyzed = FALSE;
+		gboolean push_requested, stopping;
+
+		g_mutex_lock(&(drift_measure->queue_mutex));
+		while (!drift_measure->analysis_thread_stopping)
+		{
+			snapshot = drift_measure_spsc_queue_pop(drift_measure->analysis_queue);
+			if ((snapshot != NULL) || drift_measure->output_batch_push_requested)
+				break;
+			g_cond_wait(&(drift_measure->queue_cond), &(drift_measure->queue_mutex));
 		}
-		else
+		push_requested = drift_measure->output_batch_push_requested;
+		drift_measure->output_batch_push_requested = FALSE;
+		stopping = drift_measure->analysis_thread_stopping;
+		/* Wake up the streaming thread if it waits for room in the queue. */
+		g_cond_broadcast(&(drift_measure->queue_cond));
+		g_mutex_unlock(&(drift_measure->queue_mutex));
+
+		if (stopping)
+			break;
+
+		/* The streaming thread found that the output batch is due. Rows may
+		 * have been added or pushed since then, so check again. */
+		if (push_requested)
 		{
-			switch (drift_measure->undetected_peak_handling)
+			g_mutex_lock(&(drift_measure->process_mutex));
+			if (gst_drift_measure_output_batch_is_due(drift_measure))
 			{
-				case GST_DRIFT_MEASURE_UNDETECTED_PEAK_HANDLING_LAST_VALUE:
+				GstFlowReturn flow_ret = gst_drift_measure_push_output_batch(drift_measure);
+				if (flow_ret < GST_FLOW_OK)
 				{
-					GstClockTimeDiff last_value = drift_measure->last_dataset.drifts[non_ref_channel];
-					GST_DEBUG_OBJECT(drift_measure, "channel #%u pulse not found; writing last value %" G_GINT64_FORMAT " to CSV", channel, last_value);
-					drift_measure->current_dataset.drifts[non_ref_channel] = (last_value == GST_CLOCK_STIME_NONE) ? drift_measure->undetected_peak_fill_value : last_value;
-					break;
+					GST_DEBUG_OBJECT(drift_measure, "pushing output batch finished with flow return %s", gst_flow_get_name(flow_ret));
+					drift_measure->analysis_flow_ret = flow_ret;
 				}
+			}
+			g_mutex_unlock(&(drift_measure->process_mutex));
+		}
 
-				case GST_DRIFT_MEASURE_UNDETECTED_PEAK_HANDLING_FILL_VALUE:
-					GST_DEBUG_OBJECT(drift_measure, "channel #%u pulse not found; writing fill value %" G_GINT64_FORMAT " to CSV", channel, drift_measure->undetected_peak_fill_value);
-					drift_measure->current_dataset.drifts[non_ref_channel] = drift_measure->undetected_peak_fill_value;
-					break;
+		if (snapshot == NULL)
+			continue;
 
-				case GST_DRIFT_MEASURE_UNDETECTED_PEAK_HANDLING_NO_VALUE:
-					GST_DEBUG_OBJECT(drift_measure, "channel #%u pulse not found; not writing any value to CSV (= leaving column empty)", channel);
-					drift_measure->current_dataset.drifts[non_ref_channel] = GST_CLOCK_STIME_NONE;
-					break;
+		g_mutex_lock(&(drift_measure->process_mutex));
+		if (gst_drift_measure_prepare_window_analysis(drift_measure, snapshot))
+			num_drifts = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info)) - 1;
+		g_mutex_unlock(&(drift_measure->process_mutex));
 
-				default:
-					g_assert_not_reached();
+		if (num_drifts > 0)
+		{
+			if (num_drifts > num_allocated_drifts)
+			{
+				drifts = g_renew(GstClockTimeDiff, drifts, num_drifts);
+				num_allocated_drifts = num_drifts;
 			}
+
+			/* If the window size was changed after the snapshot was taken,
+			 * the snapshot may not contain the whole window; the detector
+			 * rejects it then. */
+			analyzed = drift_measure_detector_analyze_window(drift_measure->analysis_detector, snapshot->window, &timestamp, (int64_t *)drifts);
+			if (!analyzed)
+				GST_DEBUG_OBJECT(drift_measure, "window does not fit the detection settings; discarding window snapshot");
 		}
 
-		++non_ref_channel;
+		g_mutex_lock(&(drift_measure->process_mutex));
+		if (analyzed)
+			gst_drift_measure_hand_off_window_dataset(drift_measure, snapshot, timestamp, drifts);
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+		if (drift_measure->analysis_detector != NULL)
+			drift_measure_detector_get_stats(drift_measure->analysis_detector, &(drift_measure->analysis_detector_stats));
+		gst_drift_measure_publish_stats(drift_measure);
+#endif
+		g_mutex_unlock(&(drift_measure->process_mutex));
+
+		gst_drift_measure_free_window_snapshot(snapshot);
+
+		/* Wake up the streaming thread if it waits for the queue to drain. */
+		g_mutex_lock(&(drift_measure->queue_mutex));
+		g_atomic_int_add(&(drift_measure->num_queued_windows), -1);
+		g_cond_broadcast(&(drift_measure->queue_cond));
+		g_mutex_unlock(&(drift_measure->queue_mutex));
 	}
 
-	gst_adapter_unmap(drift_measure->frame_history);
+	g_free(drifts);
 
-	/* Copy the dataset we just completed. We need this if the undetected
-	 * peak handling is set to GST_DRIFT_MEASURE_UNDETECTED_PEAK_HANDLING_LAST_VALUE. */
-	gst_drift_measure_copy_dataset(drift_measure, &(drift_measure->current_dataset), &(drift_measure->last_dataset));
+	GST_DEBUG_OBJECT(drift_measure, "analysis thread stopped");
 
-	/* Now output the completed dataset. */
-	if (G_UNLIKELY(found_no_peaks && drift_measure->omit_output_if_no_peaks))
-		return GST_FLOW_OK;
-	else
-		return gst_drift_measure_push_out_dataset(drift_measure, &(drift_measure->current_dataset));
+	return NULL;
 }
 
 
-static void gst_drift_measure_recalculate_num_window_frames(GstDriftMeasure *drift_measure)
+static void gst_drift_measure_flush(GstDriftMeasure *drift_measure)
 {
-	/* must be called with object lock held */
+	/* must be called with process mutex held */
 
-	guint sample_rate = GST_AUDIO_INFO_RATE(&(drift_measure->input_audio_info));
-	drift_measure->window_size_in_frames = gst_util_uint64_scale_int_ceil(drift_measure->window_size, sample_rate, GST_SECOND);
+	/* The detector only exists once input caps are set. */
+	if (drift_measure->detector != NULL)
+		drift_measure_detector_reset(drift_measure->detector);
+	++drift_measure->history_generation;
 
-	GST_INFO_OBJECT(
-		drift_measure,
-		"window size %" GST_TIME_FORMAT " and %u Hz sample rate => %" G_GSIZE_FORMAT " window frames",
-		GST_TIME_ARGS(drift_measure->window_size),
-		sample_rate,
-		drift_measure->window_size_in_frames
-	);
+	gst_drift_measure_reset_dataset(drift_measure, &(drift_measure->last_dataset));
+	gst_drift_measure_reset_dataset(drift_measure, &(drift_measure->current_dataset));
 }
 
 
-static void gst_drift_measure_reset_to_search_mode(GstDriftMeasure *drift_measure)
+static GstDriftMeasureParams * gst_drift_measure_copy_params(GstDriftMeasureParams const *params)
 {
-	/* must be called with object lock held */
+	GstDriftMeasureParams *copy = g_slice_dup(GstDriftMeasureParams, params);
+	if (copy->pulse_template != NULL)
+		g_bytes_ref(copy->pulse_template);
+	return copy;
+}
 
-	guint bytes_per_frame = GST_AUDIO_INFO_BPF(&(drift_measure->input_audio_info));
-	gsize num_frames_to_flush;
 
-	if (drift_measure->mode == DRIFT_MEASUREMENT_MODE_PEAK_SEARCH)
+static void gst_drift_measure_free_params(GstDriftMeasureParams *params)
+{
+	if (params == NULL)
 		return;
 
-	/* Flush the data around the peak we last discovered. We get rid
-	 * of everything before the peak plus half the pulse size to
-	 * make sure this same peak is not accidentally rediscovered. */
-	num_frames_to_flush = drift_measure->peak_frame_index + drift_measure->pulse_length_in_frames / 2;
-	GST_DEBUG_OBJECT(drift_measure, "flushing %" G_GSIZE_FORMAT " leftover frame(s) from history", num_frames_to_flush);
+	if (params->pulse_template != NULL)
+		g_bytes_unref(params->pulse_template);
+	g_slice_free(GstDriftMeasureParams, params);
+}
+
+
+static GstDriftMeasureParams * gst_drift_measure_exchange_pending_params(GstDriftMeasure *drift_measure, GstDriftMeasureParams *params)
+{
+	/* Replaces pending_params with params, and returns the previous value.
+	 * (g_atomic_pointer_exchange() requires GLib 2.74.) */
+
+	gpointer old_params;
+
+	do
+		old_params = g_atomic_pointer_get(&(drift_measure->pending_params));
+	while (!g_atomic_pointer_compare_and_exchange(&(drift_measure->pending_params), old_params, params));
 
-	gst_adapter_flush(drift_measure->frame_history, num_frames_to_flush * bytes_per_frame);
-	drift_measure->total_num_input_frames_seen += num_frames_to_flush;
-	drift_measure->peak_frame_index = 0;
-	drift_measure->mode = DRIFT_MEASUREMENT_MODE_PEAK_SEARCH;
+	return old_params;
 }
 
 
-static void gst_drift_measure_flush(GstDriftMeasure *drift_measure)
+static void gst_drift_measure_publish_params(GstDriftMeasure *drift_measure)
 {
-	/* must be called with object lock held */
+	/* Makes the current property values available to the streaming
+	 * thread. If it did not take the previously published ones yet,
+	 * these are discarded, since they are outdated. */
 
-	gst_adapter_clear(drift_measure->frame_history);
+	GstDriftMeasureParams *params;
+
+	GST_OBJECT_LOCK(drift_measure);
+	params = gst_drift_measure_copy_params(&(drift_measure->property_params));
+	GST_OBJECT_UNLOCK(drift_measure);
+
+	gst_drift_measure_free_params(gst_drift_measure_exchange_pending_params(drift_measure, params));
+}
 
-	gst_drift_measure_reset_dataset(drift_measure, &(drift_measure->last_dataset));
-	gst_drift_measure_reset_dataset(drift_measure, &(drift_measure->current_dataset));
 
-	drift_measure->total_num_input_frames_seen = 0;
-	drift_measure->peak_frame_index = 0;
-	drift_measure->mode = DRIFT_MEASUREMENT_MODE_PEAK_SEARCH;
+static void gst_drift_measure_update_params(GstDriftMeasure *drift_measure)
+{
+	/* must be called with process mutex held */
+
+	/* Switches to the parameters that were published last, if there are
+	 * any, and brings the processing state in line with them. */
+
+	GstDriftMeasureParams *old_params, *new_params;
+	guint num_channels = GST_AUDIO_INFO_CHANNELS(&(drift_measure->input_audio_info));
+	gboolean detector_changed, flush_needed;
+
+	new_params = gst_drift_measure_exchange_pending_params(drift_measure, NULL);
+	if (G_LIKELY(new_params == NULL))
+		return;
+
+	old_params = drift_measure->params;
+	drift_measure->params = new_params;
+
+	GST_DEBUG_OBJECT(drift_measure, "applying new property values");
+
+	/* Frames that are already in the history were gathered for the old
+	 * window and pulse, so changing these also requires a flush. */
+	flush_needed = (new_params->window_size != old_params->window_size)
+	            || (new_params->pulse_length != old_params->pulse_length)
+	            || (new_params->peak_threshold != old_params->peak_threshold)
+	            || (new_params->reference_channel != old_params->reference_channel)
+	            || (new_params->undetected_peak_handling != old_params->undetected_peak_handling);
+
+	detector_changed = (new_params->window_size != old_params->window_size)
+	                || (new_params->pulse_length != old_params->pulse_length)
+	                || (new_params->peak_threshold != old_params->peak_threshold)
+	                || (new_params->reference_channel != old_params->reference_channel)
+	                || (new_params->detection_method != old_params->detection_method)
+	                || (new_params->pulse_frequency != old_params->pulse_frequency)
+	                || (new_params->pulse_template != old_params->pulse_template)
+	                || (new_params->pulse_template_rate != old_params->pulse_template_rate);
+
+	/* An invalid reference channel is reported by the next buffer. The
+	 * detector is also created later (when the caps are set) if there
+	 * is no valid input audio info yet. Setting up the detector flushes. */
+	if (detector_changed && drift_measure->input_audio_info_valid && (new_params->reference_channel < num_channels))
+	{
+		gst_drift_measure_setup_detector(drift_measure);
+		flush_needed = FALSE;
+	}
+	else if ((new_params->peak_interpolation != old_params->peak_interpolation) && (drift_measure->detector != NULL))
+		drift_measure_detector_set_peak_interpolation(drift_measure->detector, new_params->peak_interpolation);
+
+	if (flush_needed)
+		gst_drift_measure_flush(drift_measure);
+
+	gst_drift_measure_free_params(old_params);
 }
 
 
 static GstFlowReturn gst_drift_measure_process_input_buffer(GstDriftMeasure *drift_measure, GstBuffer *input_buffer)
 {
-	/* must be called with object lock held */
+	/* must be called with process mutex held */
 
 
 	GST_LOG_OBJECT(drift_measure, "processing input buffer %p", (gpointer)input_buffer);
 
 
-	guint bytes_per_frame = GST_AUDIO_INFO_BPF(&(drift_measure->input_audio_info));
-	gboolean loop = TRUE;
+	GstAudioInfo const *info = &(drift_measure->input_audio_info);
+	guint num_channels = GST_AUDIO_INFO_CHANNELS(info);
+	gsize *channel_offsets = g_alloca(num_channels * sizeof(gsize));
+	gsize frame_stride, num_frames;
+	GstMapInfo map_info;
+	GstClockTime base;
+	guint64 timestamp;
+	gboolean pushed;
 	GstFlowReturn flow_ret = GST_FLOW_OK;
 
 
-	if (G_UNLIKELY(!drift_measure->input_audio_info_valid))
+	if (G_UNLIKELY(!drift_measure->input_audio_info_valid || (drift_measure->detector == NULL)))
 	{
 		GST_ERROR_OBJECT(drift_measure, "cannot process input buffer since the input audio info is not valid");
 		return GST_FLOW_ERROR;
 	}
 
+	/* The reference-channel property may have been set to a channel
+	 * that the input does not have. */
+	if (!gst_drift_measure_validate_reference_channel(drift_measure))
+		return GST_FLOW_ERROR;
 
-	gst_adapter_push(drift_measure->frame_history, gst_buffer_ref(input_buffer));
-	GST_LOG_OBJECT(drift_measure, "added %" G_GUINT64_FORMAT " frames", (guint64)(gst_buffer_get_size(input_buffer) / bytes_per_frame));
+	/* With an analysis queue, the analysis thread sets up
+	 * the per-channel analysis threads for its detector. */
+	if ((drift_measure->analysis_queue == NULL) && !gst_drift_measure_setup_analysis_threads(drift_measure, drift_measure->detector))
+		return GST_FLOW_ERROR;
 
 
-	while (loop)
+	if (!gst_buffer_map(input_buffer, &map_info, GST_MAP_READ))
 	{
-		gsize num_available_frames = gst_adapter_available(drift_measure->frame_history) / bytes_per_frame;
-		GST_LOG_OBJECT(drift_measure, "%" G_GSIZE_FORMAT " frames are in the history", num_available_frames);
-		if (num_available_frames == 0)
-			break;
-
-		switch (drift_measure->mode)
-		{
-			case DRIFT_MEASUREMENT_MODE_PEAK_SEARCH:
-			{
-				guint64 peak_frame_index = gst_drift_measure_scan_for_peak(drift_measure, num_available_frames);
-
-				if (peak_frame_index == UNDEFINED_INDEX)
-				{
-					if (num_available_frames >= (drift_measure->window_size_in_frames / 2))
-					{
-						/* There are a lot of frames, and we did not find a
-						 * peak anywhere. To avoid unnecessary processing
-						 * and prevent the frame history from getting too
-						 * large, discard the frames that we looked at,
-						 * except for the newest ones (to retain enough
-						 * samples for the next search, since we need
-						 * enough samples to cover the window size).*/
-
-						gsize num_excess_frames = num_available_frames - (drift_measure->window_size_in_frames / 2);
-						GST_LOG_OBJECT(drift_measure, "no peak found - discarding the oldest %" G_GSIZE_FORMAT " frames", num_excess_frames);
-						gst_adapter_flush(drift_measure->frame_history, num_excess_frames * bytes_per_frame);
-						drift_measure->total_num_input_frames_seen += num_excess_frames;
-					}
-					else
-						GST_LOG_OBJECT(drift_measure, "no peak found");
-
-					loop = FALSE;
-				}
-				else if (peak_frame_index < (drift_measure->window_size_in_frames / 2))
-				{
-					gsize num_frames_to_discard;
-
-					/* If we detected the peak within the first half of the
-					 * window size, then we cannot use it, for two reasons:
-					 *
-					 * #1: The "peak" may actually just be a maximum of a
-					 * clipped pulse. For example, suppose that the pulse
-					 * started 500 us before we started recording. Then
-					 * we won't have the first 500 us of data, and therefore
-					 * cannot guarantee that any peak we detect may be
-					 * the "real" peak of the pulse.
-					 *
-					 * #2: Pulses in non-reference channels may be drifting
-					 * both backwards and forwards. In order to be able to
-					 * properly detect both, we must make sure that there's
-					 * enough data before and after the pulse we detected. */
-
-					num_frames_to_discard = peak_frame_index + drift_measure->pulse_length_in_frames / 2;
-					num_frames_to_discard = MIN(num_frames_to_discard, num_available_frames);
-
-					GST_DEBUG_OBJECT(drift_measure, "not enough samples in history for peak window -> ignoring peak and discarding the oldest %" G_GSIZE_FORMAT " frames", num_frames_to_discard);
-					gst_adapter_flush(drift_measure->frame_history, num_frames_to_discard * bytes_per_frame);
-					drift_measure->total_num_input_frames_seen += num_frames_to_discard;
-
-					loop = FALSE;
-				}
-				else if ((num_available_frames - peak_frame_index) < drift_measure->pulse_length_in_frames)
-				{
-					/* We found a peak, but it is too close to the end of
-					 * the number of available samples in the history.
-					 * This is a problem, since then, the peak we found may
-					 * not be the true peak - the true peak may come in the
-					 * next buffer. This happens when the source records one
-					 * buffer worth of data, and captures only a first part
-					 * of the pulse. The next buffer will then contain the
-					 * rest of the pulse. So, to make sure we do not wrongly
-					 * detect the maximum sample value in the first buffer
-					 * as the peak, we check how close the detected peak is
-					 * to the end of the history. If the distance is smaller
-					 * than the pulse length, then we cannot be sure that we
-					 * really got the actual peak, and just ignore it for now.
-					 * We do NOT discard any samples from the history. That
-					 * way, data from the next input buffer will be appended,
-					 * and we'll have a full pulse in the history that can
-					 * be properly analyzed. */
-
-					GST_DEBUG_OBJECT(drift_measure, "found a peak, but it is too close to the end of the history; ignoring it for now");
-					loop = FALSE;
-				}
-				else
-				{
-					/* We found a peak, and there is enough data before
-					 * the peak. Swith to analysis mode and gather data
-					 * until there is also enough data _after_ the peak. */
+		GST_ERROR_OBJECT(drift_measure, "could not map input buffer");
+		return GST_FLOW_ERROR;
+	}
 
-					GST_DEBUG_OBJECT(drift_measure, "there are samples in history for peak window -> switching to analysis mode");
-					drift_measure->peak_frame_index = peak_frame_index;
-					drift_measure->mode = DRIFT_MEASUREMENT_MODE_PEAK_ANALYSIS;
-				}
+	num_frames = gst_drift_measure_get_buffer_layout(
+		drift_measure,
+		input_buffer,
+		map_info.size,
+		(GST_AUDIO_INFO_LAYOUT(info) == GST_AUDIO_LAYOUT_INTERLEAVED),
+		GST_AUDIO_INFO_BPS(info),
+		&frame_stride,
+		channel_offsets
+	);
 
-				break;
-			}
+	/* With an analysis queue, the detector only searches for reference
+	 * peaks, and the windows around them are analyzed by the analysis
+	 * thread. Otherwise, the windows are analyzed right away. */
+	drift_measure_detector_set_deferred_analysis(drift_measure->detector, (drift_measure->analysis_queue != NULL));
+	pushed = drift_measure_detector_push_frames(drift_measure->detector, map_info.data, frame_stride, channel_offsets, num_frames);
 
-			case DRIFT_MEASUREMENT_MODE_PEAK_ANALYSIS:
-			{
-				/* If there is enough data after the peak, we can start
-				 * analyzing, because then, it is guaranteed that both
-				 * before and after the peak there are enough samples
-				 * for analysis to proceed. */
+	gst_buffer_unmap(input_buffer, &map_info);
 
-				if ((num_available_frames - drift_measure->peak_frame_index) >= (drift_measure->window_size_in_frames / 2))
-				{
-					GST_LOG_OBJECT(drift_measure, "there are now enough frames in the history for analysis");
+	if (G_UNLIKELY(!pushed))
+	{
+		GST_ERROR_OBJECT(drift_measure, "could not process input frames");
+		return GST_FLOW_ERROR;
+	}
 
-					flow_ret = gst_drift_measure_analyze_peaks(drift_measure, num_available_frames);
-					if (flow_ret < GST_FLOW_OK)
-					{
-						loop = FALSE;
-						break;
-					}
 
-					GST_DEBUG_OBJECT(drift_measure, "peak analysis finished - switching back to search mode");
-					gst_drift_measure_reset_to_search_mode(drift_measure);
-				}
-				else
-				{
-					GST_LOG_OBJECT(drift_measure, "not enough frames in the history yet for analysis");
-					/* Not enough frames left in the history for further
-					 * scans and analysis. Exit the loop so that we can
-					 * receive more data that we can process. */
-					loop = FALSE;
-				}
+	/* Datasets are timestamped relative to the first frame after the last
+	 * flush. Pushing out a dataset releases the process mutex, and so does
+	 * waiting for room in the analysis queue, so the element may have been
+	 * flushed or stopped meanwhile. That is why the detector is looked up
+	 * again for each dataset. */
+	base = (drift_measure->input_segment.format == GST_FORMAT_TIME) ? drift_measure->input_segment.base : 0;
 
-				break;
-			}
+	if (drift_measure->analysis_queue != NULL)
+	{
+		DriftMeasureDetectorWindow *window;
 
-			default:
-				g_assert_not_reached();
+		while ((flow_ret >= GST_FLOW_OK) && (drift_measure->detector != NULL) && ((window = drift_measure_detector_pull_window(drift_measure->detector)) != NULL))
+			flow_ret = gst_drift_measure_queue_window(drift_measure, window, base);
+	}
+	else
+	{
+		while ((flow_ret >= GST_FLOW_OK) && (drift_measure->detector != NULL) && drift_measure_detector_pull_dataset(drift_measure->detector, &timestamp, (int64_t *)(drift_measure->current_dataset.drifts)))
+		{
+			drift_measure->current_dataset.timestamp = timestamp + base;
+			flow_ret = gst_drift_measure_handle_dataset(drift_measure);
 		}
 	}
 
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+	/* Like statistics-interval, stats-interval is an amount of input,
+	 * so the messages come at the same stream positions in every run. */
+	drift_measure->num_stats_frames += num_frames;
+	if ((drift_measure->params->stats_interval > 0) && (gst_util_uint64_scale_int(drift_measure->num_stats_frames, GST_SECOND, GST_AUDIO_INFO_RATE(info)) >= drift_measure->params->stats_interval))
+	{
+		drift_measure->num_stats_frames = 0;
+		gst_drift_measure_post_stats_message(drift_measure);
+	}
+#endif
+
 
 	GST_LOG_OBJECT(drift_measure, "input buffer %p processed", (gpointer)input_buffer);
 
 	return flow_ret;
 }
+
+
+#ifdef DRIFT_MEASURE_INSTRUMENTATION
+
+static void gst_drift_measure_add_detector_stats(DriftMeasureDetectorStats *sum, DriftMeasureDetectorStats const *stats)
+{
+	sum->num_frames_pushed += stats->num_frames_pushed;
+	sum->num_frames_scanned += stats->num_frames_scanned;
+	sum->num_frames_discarded += stats->num_frames_discarded;
+	sum->num_peaks_too_early += stats->num_peaks_too_early;
+	sum->num_peaks_near_history_end += stats->num_peaks_near_history_end;
+	sum->num_searches_without_peak += stats->num_searches_without_peak;
+	sum->num_windows_analyzed += stats->num_windows_analyzed;
+	sum->filter_time += stats->filter_time;
+	sum->copy_time += stats->copy_time;
+	sum->scan_time += stats->scan_time;
+	sum->analysis_time += stats->analysis_time;
+}
+
+
+static void gst_drift_measure_retire_detector_stats(GstDriftMeasure *drift_measure, DriftMeasureDetectorStats const *stats)
+{
+	/* must be called with process mutex held */
+
+	/* Adds the stats of a detector to the accumulated
+	 * ones. This is done right before the detector is freed. */
+
+	gst_drift_measure_add_detector_stats(&(drift_measure->retired_detector_stats), stats);
+}
+
+
+static void gst_drift_measure_get_stats(GstDriftMeasure *drift_measure, GstDriftMeasureStats *stats)
+{
+	/* must be called with process mutex held */
+
+	DriftMeasureDetectorStats *detector_stats = &(stats->detector_stats);
+
+	if (drift_measure->detector != NULL)
+		drift_measure_detector_get_stats(drift_measure->detector, detector_stats);
+	else
+		memset(detector_stats, 0, sizeof(DriftMeasureDetectorStats));
+
+	/* The analysis detector is used by the analysis thread without
+	 * process_mutex, so its stats are taken from the copy. */
+	gst_drift_measure_add_detector_stats(detector_stats, &(drift_measure->analysis_detector_stats));
+	gst_drift_measure_add_detector_stats(detector_stats, &(drift_measure->retired_detector_stats));
+
+	stats->format_time = drift_measure->format_time;
+	stats->push_time = drift_measure->push_time;
+}
+
+
+static void gst_drift_measure_publish_stats(GstDriftMeasure *drift_measure)
+{
+	/* must be called with process mutex held */
+
+	GstDriftMeasureStats stats;
+
+	gst_drift_measure_get_stats(drift_measure, &stats);
+
+	GST_OBJECT_LOCK(drift_measure);
+	drift_measure->published_stats = stats;
+	GST_OBJECT_UNLOCK(drift_measure);
+}
+
+
+static GstStructure * gst_drift_measure_create_stats_structure(GstDriftMeasureStats const *stats)
+{
+	DriftMeasureDetectorStats const *detector_stats = &(stats->detector_stats);
+
+	/* The peak rejection fields are named after the reasons why the
+	 * reference peak search did not lead to an analysis. */
+	return gst_structure_new(
+		"drift-measure-stats",
+		"frames-pushed", G_TYPE_UINT64, (guint64)(detector_stats->num_frames_pushed),
+		"frames-scanned", G_TYPE_UINT64, (guint64)(detector_stats->num_frames_scanned),
+		"frames-discarded", G_TYPE_UINT64, (guint64)(detector_stats->num_frames_discarded),
+		"peaks-rejected-too-early", G_TYPE_UINT64, (guint64)(detector_stats->num_peaks_too_early),
+		"peaks-rejected-near-history-end", G_TYPE_UINT64, (guint64)(detector_stats->num_peaks_near_history_end),
+		"peaks-rejected-no-peak-in-window", G_TYPE_UINT64, (guint64)(detector_stats->num_searches_without_peak),
+		"windows-analyzed", G_TYPE_UINT64, (guint64)(detector_stats->num_windows_analyzed),
+		"filter-time", G_TYPE_UINT64, (guint64)(detector_stats->filter_time),
+		"copy-time", G_TYPE_UINT64, (guint64)(detector_stats->copy_time),
+		"scan-time", G_TYPE_UINT64, (guint64)(detector_stats->scan_time),
+		"analysis-time", G_TYPE_UINT64, (guint64)(detector_stats->analysis_time),
+		"format-time", G_TYPE_UINT64, stats->format_time,
+		"push-time", G_TYPE_UINT64, stats->push_time,
+		NULL
+	);
+}
+
+
+static void gst_drift_measure_post_stats_message(GstDriftMeasure *drift_measure)
+{
+	/* must be called with process mutex held */
+
+	GstDriftMeasureStats stats;
+
+	gst_drift_measure_get_stats(drift_measure, &stats);
+
+	/* Bus sync handlers run in this thread, and may call back into
+	 * the element, for example to change its state. */
+	g_mutex_unlock(&(drift_measure->process_mutex));
+	gst_element_post_message(GST_ELEMENT(drift_measure), gst_message_new_element(GST_OBJECT(drift_measure), gst_drift_measure_create_stats_structure(&stats)));
+	g_mutex_lock(&(drift_measure->process_mutex));
+}
+
+#endif
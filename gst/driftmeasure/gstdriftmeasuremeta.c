@@ -0,0 +1,124 @@
+#include <string.h>
+#include "gstdriftmeasuremeta.h"
+
+
+typedef struct
+{
+	guint max_num_datasets;
+	guint num_drifts;
+}
+GstDriftMeasureMetaParams;
+
+
+static gboolean gst_drift_measure_meta_init(GstMeta *meta, gpointer params, GstBuffer *buffer);
+static void gst_drift_measure_meta_free(GstMeta *meta, GstBuffer *buffer);
+static gboolean gst_drift_measure_meta_transform(GstBuffer *dest, GstMeta *meta, GstBuffer *buffer, GQuark type, gpointer data);
+
+
+GType gst_drift_measure_meta_api_get_type(void)
+{
+	static GType type;
+	static gchar const *tags[] = { NULL };
+
+	if (g_once_init_enter(&type))
+	{
+		GType _type = gst_meta_api_type_register("GstDriftMeasureMetaAPI", tags);
+		g_once_init_leave(&type, _type);
+	}
+
+	return type;
+}
+
+
+GstMetaInfo const * gst_drift_measure_meta_get_info(void)
+{
+	static GstMetaInfo const *meta_info = NULL;
+
+	if (g_once_init_enter(&meta_info))
+	{
+		GstMetaInfo const *mi = gst_meta_register(
+			GST_DRIFT_MEASURE_META_API_TYPE,
+			"GstDriftMeasureMeta",
+			sizeof(GstDriftMeasureMeta),
+			gst_drift_measure_meta_init,
+			gst_drift_measure_meta_free,
+			gst_drift_measure_meta_transform
+		);
+		g_once_init_leave(&meta_info, mi);
+	}
+
+	return meta_info;
+}
+
+
+GstDriftMeasureMeta * gst_buffer_add_drift_measure_meta(GstBuffer *buffer, guint max_num_datasets, guint num_drifts)
+{
+	GstDriftMeasureMetaParams params;
+
+	g_return_val_if_fail(buffer != NULL, NULL);
+	g_return_val_if_fail(max_num_datasets > 0, NULL);
+
+	params.max_num_datasets = max_num_datasets;
+	params.num_drifts = num_drifts;
+
+	return (GstDriftMeasureMeta *)gst_buffer_add_meta(buffer, GST_DRIFT_MEASURE_META_INFO, &params);
+}
+
+
+gboolean gst_drift_measure_meta_add_dataset(GstDriftMeasureMeta *meta, GstClockTime timestamp, GstClockTimeDiff const *drifts)
+{
+	if (meta->num_datasets >= meta->max_num_datasets)
+		return FALSE;
+
+	meta->timestamps[meta->num_datasets] = timestamp;
+	memcpy(meta->drifts + (gsize)(meta->num_datasets) * meta->num_drifts, drifts, sizeof(GstClockTimeDiff) * meta->num_drifts);
+	meta->num_datasets++;
+
+	return TRUE;
+}
+
+
+static gboolean gst_drift_measure_meta_init(GstMeta *meta, gpointer params, G_GNUC_UNUSED GstBuffer *buffer)
+{
+	GstDriftMeasureMeta *drift_measure_meta = (GstDriftMeasureMeta *)meta;
+	GstDriftMeasureMetaParams const *meta_params = params;
+
+	drift_measure_meta->num_datasets = 0;
+	drift_measure_meta->max_num_datasets = meta_params->max_num_datasets;
+	drift_measure_meta->num_drifts = meta_params->num_drifts;
+	drift_measure_meta->timestamps = g_new(GstClockTime, meta_params->max_num_datasets);
+	drift_measure_meta->drifts = g_new(GstClockTimeDiff, (gsize)(meta_params->max_num_datasets) * meta_params->num_drifts);
+
+	return TRUE;
+}
+
+
+static void gst_drift_measure_meta_free(GstMeta *meta, G_GNUC_UNUSED GstBuffer *buffer)
+{
+	GstDriftMeasureMeta *drift_measure_meta = (GstDriftMeasureMeta *)meta;
+
+	g_free(drift_measure_meta->timestamps);
+	g_free(drift_measure_meta->drifts);
+}
+
+
+static gboolean gst_drift_measure_meta_transform(GstBuffer *dest, GstMeta *meta, G_GNUC_UNUSED GstBuffer *buffer, GQuark type, gpointer data)
+{
+	GstDriftMeasureMeta *src_meta = (GstDriftMeasureMeta *)meta;
+	GstDriftMeasureMeta *dest_meta;
+	guint i;
+
+	/* Only full copies keep the meta. With partial copies, it
+	 * is unclear which of the rows the new buffer contains. */
+	if (!GST_META_TRANSFORM_IS_COPY(type) || ((GstMetaTransformCopy const *)data)->region)
+		return FALSE;
+
+	dest_meta = gst_buffer_add_drift_measure_meta(dest, MAX(src_meta->num_datasets, 1), src_meta->num_drifts);
+	if (dest_meta == NULL)
+		return FALSE;
+
+	for (i = 0; i < src_meta->num_datasets; ++i)
+		gst_drift_measure_meta_add_dataset(dest_meta, src_meta->timestamps[i], src_meta->drifts + (gsize)i * src_meta->num_drifts);
+
+	return TRUE;
+}
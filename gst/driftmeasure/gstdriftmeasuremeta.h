@@ -0,0 +1,62 @@
+#ifndef GSTDRIFTMEASUREMETA_H
+#define GSTDRIFTMEASUREMETA_H
+
+#include <gst/gst.h>
+
+
+G_BEGIN_DECLS
+
+
+/* Meta that carries the measurements contained in a driftmeasure output
+ * buffer as numbers, so that in-process consumers do not have to parse
+ * the CSV or binary data. An output buffer can contain several rows (see
+ * the output-batch-* properties), so the meta holds one dataset per row,
+ * in the same order.
+ *
+ * Dataset D has the timestamp timestamps[D] and the drifts
+ * drifts[D * num_drifts] to drifts[D * num_drifts + num_drifts - 1], one
+ * for each non-reference channel, in channel order. Drifts without a value
+ * are set to GST_CLOCK_STIME_NONE.
+ *
+ * Since the meta is defined by the plugin, applications that do not link
+ * against it can look up the API type by name, with
+ * g_type_from_name("GstDriftMeasureMetaAPI"), and use this structure layout. */
+
+
+#define GST_DRIFT_MEASURE_META_API_TYPE (gst_drift_measure_meta_api_get_type())
+#define GST_DRIFT_MEASURE_META_INFO (gst_drift_measure_meta_get_info())
+
+
+typedef struct _GstDriftMeasureMeta GstDriftMeasureMeta;
+
+
+struct _GstDriftMeasureMeta
+{
+	GstMeta meta;
+
+	guint num_datasets;
+	guint max_num_datasets;
+	guint num_drifts;
+	GstClockTime *timestamps;
+	GstClockTimeDiff *drifts;
+};
+
+
+GType gst_drift_measure_meta_api_get_type(void);
+GstMetaInfo const * gst_drift_measure_meta_get_info(void);
+
+/* Adds a meta with room for max_num_datasets datasets with
+ * num_drifts drift values each. The meta has no datasets yet. */
+GstDriftMeasureMeta * gst_buffer_add_drift_measure_meta(GstBuffer *buffer, guint max_num_datasets, guint num_drifts);
+
+#define gst_buffer_get_drift_measure_meta(buffer) \
+	((GstDriftMeasureMeta *)gst_buffer_get_meta((buffer), GST_DRIFT_MEASURE_META_API_TYPE))
+
+/* Appends a dataset. Returns FALSE if the meta has no room for it. */
+gboolean gst_drift_measure_meta_add_dataset(GstDriftMeasureMeta *meta, GstClockTime timestamp, GstClockTimeDiff const *drifts);
+
+
+G_END_DECLS
+
+
+#endif /* GSTDRIFTMEASUREMETA_H */
@@ -0,0 +1,74 @@
+#include "intformat.h"
+
+
+static char const digit_pairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+
+static unsigned int count_digits(uint64_t value)
+{
+	unsigned int num_digits = 1;
+
+	/* Four digits per step keeps the number of
+	 * divisions low for large values. */
+	for (;;)
+	{
+		if (value < 10) return num_digits;
+		if (value < 100) return num_digits + 1;
+		if (value < 1000) return num_digits + 2;
+		if (value < 10000) return num_digits + 3;
+		value /= 10000;
+		num_digits += 4;
+	}
+}
+
+
+size_t drift_measure_format_uint64(char *destination, uint64_t value)
+{
+	unsigned int num_digits = count_digits(value);
+	char *write_pointer = destination + num_digits;
+
+	/* Write the digits from the end, two at a time. */
+	while (value >= 100)
+	{
+		unsigned int pair = (unsigned int)(value % 100) * 2;
+		value /= 100;
+		write_pointer -= 2;
+		write_pointer[0] = digit_pairs[pair];
+		write_pointer[1] = digit_pairs[pair + 1];
+	}
+
+	if (value >= 10)
+	{
+		unsigned int pair = (unsigned int)value * 2;
+		write_pointer -= 2;
+		write_pointer[0] = digit_pairs[pair];
+		write_pointer[1] = digit_pairs[pair + 1];
+	}
+	else
+		*--write_pointer = (char)('0' + value);
+
+	return num_digits;
+}
+
+
+size_t drift_measure_format_int64(char *destination, int64_t value)
+{
+	if (value < 0)
+	{
+		/* Negate as unsigned, since -INT64_MIN does not fit in an int64_t. */
+		*destination = '-';
+		return 1 + drift_measure_format_uint64(destination + 1, (uint64_t)0 - (uint64_t)value);
+	}
+	else
+		return drift_measure_format_uint64(destination, (uint64_t)value);
+}
@@ -0,0 +1,46 @@
+#ifndef INTFORMAT_H
+#define INTFORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Decimal formatting of 64-bit integers for the CSV output.
+ *
+ * printf style functions parse a format string and go through locale
+ * aware code for every call, which is a considerable part of the cost of
+ * producing a CSV row. These functions only write the decimal digits (and
+ * a minus sign if needed), two digits at a time, taken from a table of all
+ * 100 two-digit pairs. No terminating null character is written.
+ *
+ * These functions do not depend on GStreamer or GLib. */
+
+
+/* Maximum number of characters written by the functions below.
+ * UINT64_MAX has 20 digits; INT64_MIN has 19 digits and a sign. */
+#define DRIFT_MEASURE_MAX_FORMATTED_UINT64_LENGTH 20
+#define DRIFT_MEASURE_MAX_FORMATTED_INT64_LENGTH 20
+
+
+/* Writes the decimal representation of the value to destination, which
+ * must have room for DRIFT_MEASURE_MAX_FORMATTED_UINT64_LENGTH characters.
+ * Returns the number of written characters. */
+size_t drift_measure_format_uint64(char *destination, uint64_t value);
+
+/* Writes the decimal representation of the value to destination, which
+ * must have room for DRIFT_MEASURE_MAX_FORMATTED_INT64_LENGTH characters.
+ * Returns the number of written characters. */
+size_t drift_measure_format_int64(char *destination, int64_t value);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* INTFORMAT_H */
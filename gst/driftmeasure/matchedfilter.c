@@ -0,0 +1,313 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matchedfilter.h"
+#include "fftengine.h"
+#include "peakkernels.h"
+
+
+/* M_PI is not part of C99. */
+#define PI 3.14159265358979323846
+
+/* Lower limit for the transform length. The larger the transform is
+ * compared to the template, the more output frames each block yields,
+ * at the cost of a longer delay until a block is complete. */
+#define MIN_BLOCK_LENGTH 1024
+
+
+struct _DriftMeasureMatchedFilter
+{
+	size_t template_length;
+	unsigned int num_channels;
+
+	DriftMeasureFftPlan *plan;
+	/* Transform length. */
+	size_t block_length;
+	/* Number of output frames per block. The first template_length-1
+	 * frames of each block are the tail of the previous block. */
+	size_t num_block_output_frames;
+
+	/* Transform of the zero padded, time reversed and normalized template. */
+	DriftMeasureComplex *filter_spectrum;
+	DriftMeasureComplex *work;
+
+	/* Collected input frames, one block_length sized plane per channel.
+	 * num_block_frames is the number of frames in each plane. */
+	float *block;
+	size_t num_block_frames;
+};
+
+
+DriftMeasureMatchedFilter * drift_measure_matched_filter_new(float const *template_values, size_t template_length, unsigned int num_channels)
+{
+	DriftMeasureMatchedFilter *filter;
+	double energy = 0.0;
+	size_t i, block_length;
+
+	for (i = 0; i < template_length; ++i)
+		energy += (double)(template_values[i]) * template_values[i];
+
+	if ((template_length == 0) || (num_channels == 0) || !(energy > 0.0))
+		return NULL;
+
+	block_length = drift_measure_fft_get_length(template_length * 4);
+	if (block_length < MIN_BLOCK_LENGTH)
+		block_length = MIN_BLOCK_LENGTH;
+
+	filter = calloc(1, sizeof(DriftMeasureMatchedFilter));
+	if (filter == NULL)
+		return NULL;
+
+	filter->template_length = template_length;
+	filter->num_channels = num_channels;
+	filter->block_length = block_length;
+	filter->num_block_output_frames = block_length - (template_length - 1);
+	filter->plan = drift_measure_fft_plan_new(block_length);
+	filter->filter_spectrum = malloc(sizeof(DriftMeasureComplex) * block_length);
+	filter->work = malloc(sizeof(DriftMeasureComplex) * block_length);
+	filter->block = malloc(sizeof(float) * block_length * num_channels);
+
+	if ((filter->plan == NULL) || (filter->filter_spectrum == NULL) || (filter->work == NULL) || (filter->block == NULL))
+	{
+		drift_measure_matched_filter_free(filter);
+		return NULL;
+	}
+
+	/* Correlating with the template is the same as convolving with the
+	 * time reversed template. Dividing by the template energy makes the
+	 * output peak as large as the amplitude of a matching pulse. The
+	 * division by the transform length compensates for the unnormalized
+	 * inverse transform. */
+	for (i = 0; i < block_length; ++i)
+	{
+		filter->filter_spectrum[i].re = (i < template_length) ? (template_values[template_length - 1 - i] / energy / block_length) : 0.0;
+		filter->filter_spectrum[i].im = 0.0;
+	}
+
+	drift_measure_fft_forward(filter->plan, filter->filter_spectrum);
+
+	drift_measure_matched_filter_reset(filter);
+
+	return filter;
+}
+
+
+void drift_measure_matched_filter_free(DriftMeasureMatchedFilter *filter)
+{
+	if (filter == NULL)
+		return;
+
+	drift_measure_fft_plan_free(filter->plan);
+	free(filter->filter_spectrum);
+	free(filter->work);
+	free(filter->block);
+	free(filter);
+}
+
+
+size_t drift_measure_matched_filter_get_delay(DriftMeasureMatchedFilter const *filter)
+{
+	return filter->template_length - 1;
+}
+
+
+void drift_measure_matched_filter_reset(DriftMeasureMatchedFilter *filter)
+{
+	/* The frames before the first input frame are treated as silence. */
+	memset(filter->block, 0, sizeof(float) * filter->block_length * filter->num_channels);
+	filter->num_block_frames = filter->template_length - 1;
+}
+
+
+size_t drift_measure_matched_filter_get_num_output_frames(DriftMeasureMatchedFilter const *filter, size_t num_input_frames)
+{
+	size_t num_pending_frames = filter->num_block_frames - (filter->template_length - 1) + num_input_frames;
+	return (num_pending_frames / filter->num_block_output_frames) * filter->num_block_output_frames;
+}
+
+
+static void filter_block(DriftMeasureMatchedFilter *filter, float *output, size_t output_stride)
+{
+	size_t block_length = filter->block_length;
+	size_t overlap = filter->template_length - 1;
+	DriftMeasureComplex *work = filter->work;
+	unsigned int channel;
+	size_t i;
+
+	/* Filter two channels at a time by packing them
+	 * into one complex signal. */
+	for (channel = 0; channel < filter->num_channels; channel += 2)
+	{
+		float const *first = filter->block + channel * block_length;
+		float const *second = ((channel + 1) < filter->num_channels) ? (first + block_length) : NULL;
+
+		for (i = 0; i < block_length; ++i)
+		{
+			work[i].re = first[i];
+			work[i].im = (second != NULL) ? second[i] : 0.0f;
+		}
+
+		drift_measure_fft_forward(filter->plan, work);
+		drift_measure_fft_multiply_real_pair(filter->plan, work, filter->filter_spectrum, 0);
+		drift_measure_fft_inverse(filter->plan, work);
+
+		/* The first frames are affected by the circular wraparound;
+		 * the rest is the linear convolution. */
+		for (i = 0; i < filter->num_block_output_frames; ++i)
+			output[channel * output_stride + i] = (float)(work[overlap + i].re);
+
+		if (second != NULL)
+		{
+			for (i = 0; i < filter->num_block_output_frames; ++i)
+				output[(channel + 1) * output_stride + i] = (float)(work[overlap + i].im);
+		}
+	}
+
+	/* Keep the last frames for the overlap with the next block. */
+	for (channel = 0; channel < filter->num_channels; ++channel)
+	{
+		float *plane = filter->block + channel * block_length;
+		memmove(plane, plane + block_length - overlap, sizeof(float) * overlap);
+	}
+
+	filter->num_block_frames = overlap;
+}
+
+
+size_t drift_measure_matched_filter_process(DriftMeasureMatchedFilter *filter, float const *input, size_t input_stride, size_t num_input_frames, float *output, size_t output_stride)
+{
+	size_t num_output_frames = 0;
+	size_t input_frame = 0;
+
+	while (input_frame < num_input_frames)
+	{
+		size_t num_frames = filter->block_length - filter->num_block_frames;
+		unsigned int channel;
+
+		if (num_frames > (num_input_frames - input_frame))
+			num_frames = num_input_frames - input_frame;
+
+		for (channel = 0; channel < filter->num_channels; ++channel)
+		{
+			memcpy(
+				filter->block + channel * filter->block_length + filter->num_block_frames,
+				input + channel * input_stride + input_frame,
+				sizeof(float) * num_frames
+			);
+		}
+
+		filter->num_block_frames += num_frames;
+		input_frame += num_frames;
+
+		if (filter->num_block_frames == filter->block_length)
+		{
+			filter_block(filter, output + num_output_frames, output_stride);
+			num_output_frames += filter->num_block_output_frames;
+		}
+	}
+
+	return num_output_frames;
+}
+
+
+void drift_measure_matched_filter_generate_sine_template(float *template_values, size_t template_length, double frequency, double sample_rate)
+{
+	size_t i;
+
+	for (i = 0; i < template_length; ++i)
+		template_values[i] = (float)sin(2.0 * PI * frequency * (double)i / sample_rate);
+}
+
+
+static inline uint16_t read_u16(uint8_t const *bytes)
+{
+	return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+
+static inline uint32_t read_u32(uint8_t const *bytes)
+{
+	return (uint32_t)(bytes[0]) | ((uint32_t)(bytes[1]) << 8) | ((uint32_t)(bytes[2]) << 16) | ((uint32_t)(bytes[3]) << 24);
+}
+
+
+int drift_measure_matched_filter_parse_wav_template(void const *data, size_t size, float **template_values, size_t *template_length, unsigned int *sample_rate)
+{
+	uint8_t const *bytes = data;
+	uint8_t const *fmt_chunk = NULL, *data_chunk = NULL;
+	size_t fmt_chunk_size = 0, data_chunk_size = 0;
+	size_t offset = 12;
+	unsigned int format, num_channels, bits_per_sample, block_align;
+	DriftMeasureSampleFormat sample_format;
+	size_t num_frames;
+	float *values;
+
+	if ((size < 12) || (memcmp(bytes, "RIFF", 4) != 0) || (memcmp(bytes + 8, "WAVE", 4) != 0))
+		return 0;
+
+	/* Look for the fmt and data chunks. Chunks are padded to even sizes. */
+	while ((offset + 8) <= size)
+	{
+		size_t chunk_size = read_u32(bytes + offset + 4);
+		uint8_t const *chunk = bytes + offset + 8;
+
+		if (chunk_size > (size - offset - 8))
+			chunk_size = size - offset - 8;
+
+		if (memcmp(bytes + offset, "fmt ", 4) == 0)
+		{
+			fmt_chunk = chunk;
+			fmt_chunk_size = chunk_size;
+		}
+		else if (memcmp(bytes + offset, "data", 4) == 0)
+		{
+			data_chunk = chunk;
+			data_chunk_size = chunk_size;
+		}
+
+		offset += 8 + chunk_size + (chunk_size & 1);
+	}
+
+	if ((fmt_chunk == NULL) || (fmt_chunk_size < 16) || (data_chunk == NULL))
+		return 0;
+
+	format = read_u16(fmt_chunk);
+	num_channels = read_u16(fmt_chunk + 2);
+	*sample_rate = read_u32(fmt_chunk + 4);
+	block_align = read_u16(fmt_chunk + 12);
+	bits_per_sample = read_u16(fmt_chunk + 14);
+
+	/* WAVE_FORMAT_EXTENSIBLE stores the actual format in the subformat GUID. */
+	if ((format == 0xFFFE) && (fmt_chunk_size >= 26))
+		format = read_u16(fmt_chunk + 24);
+
+	if ((format == 1) && (bits_per_sample == 16))
+		sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_S16;
+	else if ((format == 1) && (bits_per_sample == 24))
+		sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_S24;
+	else if ((format == 1) && (bits_per_sample == 32))
+		sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_S32;
+	else if ((format == 3) && (bits_per_sample == 32))
+		sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_F32;
+	else
+		return 0;
+
+	if ((num_channels == 0) || (block_align != (num_channels * bits_per_sample / 8)))
+		return 0;
+
+	num_frames = data_chunk_size / block_align;
+	if (num_frames == 0)
+		return 0;
+
+	values = malloc(sizeof(float) * num_frames);
+	if (values == NULL)
+		return 0;
+
+	drift_measure_peak_kernels_normalize_samples(sample_format, data_chunk, num_channels, num_frames, values);
+
+	*template_values = values;
+	*template_length = num_frames;
+
+	return 1;
+}
@@ -0,0 +1,78 @@
+#ifndef MATCHEDFILTER_H
+#define MATCHEDFILTER_H
+
+#include <stddef.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Streaming matched filter for pulse detection.
+ *
+ * The filter correlates each channel with a pulse template. Its output is
+ * largest where the input matches the template best, and is scaled such
+ * that a pulse that has the exact shape of the template, with amplitude A,
+ * produces an output peak of A. Noise that does not resemble the template
+ * is suppressed, so pulses can be detected even if they are barely above
+ * the noise floor.
+ *
+ * The correlation is done with overlap-save FFT convolution. Input frames
+ * are collected until a whole block is available, so output frames are
+ * produced in block sized runs. Output frame N corresponds to input frame
+ * N, but the filter output for a pulse peaks at the end of the pulse, that
+ * is, the output is delayed by (template_length - 1) frames.
+ *
+ * Samples are passed in non-interleaved (planar) form, normalized to the
+ * -1.0 .. 1.0 range.
+ *
+ * This filter does not depend on GStreamer or GLib. */
+
+
+typedef struct _DriftMeasureMatchedFilter DriftMeasureMatchedFilter;
+
+
+/* Creates a filter for the given template and number of channels. Returns
+ * NULL if the template is empty or silent, or if memory is exhausted. */
+DriftMeasureMatchedFilter * drift_measure_matched_filter_new(float const *template_values, size_t template_length, unsigned int num_channels);
+
+void drift_measure_matched_filter_free(DriftMeasureMatchedFilter *filter);
+
+/* Returns the delay of the filter output, in frames. */
+size_t drift_measure_matched_filter_get_delay(DriftMeasureMatchedFilter const *filter);
+
+/* Discards all collected input frames, as if the filter had just been created. */
+void drift_measure_matched_filter_reset(DriftMeasureMatchedFilter *filter);
+
+/* Returns the number of output frames that drift_measure_matched_filter_process()
+ * produces if it is called with num_input_frames input frames next. */
+size_t drift_measure_matched_filter_get_num_output_frames(DriftMeasureMatchedFilter const *filter, size_t num_input_frames);
+
+/* Filters num_input_frames input frames. input contains one plane per
+ * channel, with input_stride values between the starts of two planes.
+ * The output frames are written to output the same way, with output_stride
+ * values between the planes; output must have room for as many frames as
+ * drift_measure_matched_filter_get_num_output_frames() returns. Returns
+ * the number of output frames. */
+size_t drift_measure_matched_filter_process(DriftMeasureMatchedFilter *filter, float const *input, size_t input_stride, size_t num_input_frames, float *output, size_t output_stride);
+
+/* Generates a pulse template: a sine wave with the given frequency, of the
+ * given length, like the ticks produced by GStreamer's audiotestsrc. */
+void drift_measure_matched_filter_generate_sine_template(float *template_values, size_t template_length, double frequency, double sample_rate);
+
+/* Reads a pulse template from the contents of a WAV file. 16-, 24- and 32-bit
+ * integer and 32-bit floating point PCM are supported. With multichannel
+ * files, the first channel is used. On success, a newly allocated array
+ * with the template values is stored in template_values (to be freed with
+ * free()), and its length and sample rate in template_length and
+ * sample_rate, and nonzero is returned. */
+int drift_measure_matched_filter_parse_wav_template(void const *data, size_t size, float **template_values, size_t *template_length, unsigned int *sample_rate);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* MATCHEDFILTER_H */
@@ -0,0 +1,114 @@
+#include <math.h>
+#include "peakinterpolation.h"
+
+
+#define HALF_LENGTH DRIFT_MEASURE_PEAK_INTERPOLATION_HALF_LENGTH
+
+/* M_PI is not part of C99. */
+#define PI 3.14159265358979323846
+
+/* The sinc interpolation evaluates the reconstructed signal at this many
+ * positions per frame between the peak's neighbours, and refines the
+ * position of the largest one with a parabolic fit. */
+#define SINC_STEPS_PER_FRAME 32
+
+
+/* Returns the offset of the vertex of the parabola through (-1, a), (0, b)
+ * and (1, c), relative to 0. If the parabola has no maximum (because the
+ * three values are equal, or b is not larger than its neighbours), 0 is
+ * returned. */
+static double get_parabola_vertex_offset(double a, double b, double c)
+{
+	double denominator = a - 2.0 * b + c;
+	double offset;
+
+	if (!(denominator < 0.0))
+		return 0.0;
+
+	offset = 0.5 * (a - c) / denominator;
+
+	/* The vertex is only between the neighbours if b is the largest of the
+	 * three values. Otherwise, the fit says little about the maximum. */
+	if (offset < -1.0)
+		return -1.0;
+	else if (offset > 1.0)
+		return 1.0;
+	else
+		return offset;
+}
+
+
+/* Evaluates the band limited signal described by the neighbourhood
+ * at the given position relative to the peak frame. */
+static double evaluate_windowed_sinc(double const *neighbourhood, double position)
+{
+	double sum = 0.0;
+	int i;
+
+	for (i = -HALF_LENGTH; i <= HALF_LENGTH; ++i)
+	{
+		double value = neighbourhood[HALF_LENGTH + i];
+		double x = position - i;
+		double sinc, window;
+
+		if (isnan(value))
+			continue;
+
+		if (fabs(x) >= (HALF_LENGTH + 1))
+			continue;
+
+		sinc = (x == 0.0) ? 1.0 : (sin(PI * x) / (PI * x));
+		/* Hann window, wide enough to keep all taps nonzero. */
+		window = 0.5 * (1.0 + cos(PI * x / (HALF_LENGTH + 1)));
+
+		sum += value * sinc * window;
+	}
+
+	return sum;
+}
+
+
+static double get_sinc_offset(double const *neighbourhood)
+{
+	double const step = 1.0 / SINC_STEPS_PER_FRAME;
+	double values[SINC_STEPS_PER_FRAME * 2 + 1];
+	int num_values = SINC_STEPS_PER_FRAME * 2 + 1;
+	int i, largest = 0;
+
+	/* Search the range between the two direct neighbours. The largest
+	 * sample is in the middle, so the maximum of the reconstructed
+	 * signal cannot be further away than that. */
+	for (i = 0; i < num_values; ++i)
+	{
+		values[i] = evaluate_windowed_sinc(neighbourhood, (i - SINC_STEPS_PER_FRAME) * step);
+		if ((i > 0) && (values[i] > values[largest]))
+			largest = i;
+	}
+
+	if ((largest == 0) || (largest == (num_values - 1)))
+		return (largest - SINC_STEPS_PER_FRAME) * step;
+
+	return (largest - SINC_STEPS_PER_FRAME + get_parabola_vertex_offset(values[largest - 1], values[largest], values[largest + 1])) * step;
+}
+
+
+double drift_measure_peak_interpolation_get_offset(DriftMeasurePeakInterpolation method, double const *neighbourhood)
+{
+	double previous = neighbourhood[HALF_LENGTH - 1];
+	double peak = neighbourhood[HALF_LENGTH];
+	double next = neighbourhood[HALF_LENGTH + 1];
+
+	switch (method)
+	{
+		case DRIFT_MEASURE_PEAK_INTERPOLATION_PARABOLIC:
+			if (isnan(previous) || isnan(next))
+				return 0.0;
+			return get_parabola_vertex_offset(previous, peak, next);
+
+		case DRIFT_MEASURE_PEAK_INTERPOLATION_SINC:
+			return get_sinc_offset(neighbourhood);
+
+		default:
+			return 0.0;
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef PEAKINTERPOLATION_H
+#define PEAKINTERPOLATION_H
+
+#include <stddef.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Sub-sample peak position estimation.
+ *
+ * The peak search kernels only find the frame that contains the largest
+ * sample. The actual maximum of the signal is usually located somewhere
+ * between that frame and one of its neighbours. These functions estimate
+ * the fractional offset of that maximum relative to the frame, from the
+ * samples in its neighbourhood.
+ *
+ * These functions do not depend on GStreamer or GLib. */
+
+
+typedef enum
+{
+	/* No interpolation; the offset is always 0. */
+	DRIFT_MEASURE_PEAK_INTERPOLATION_NONE,
+	/* Fits a parabola through the peak sample and its two direct neighbours.
+	 * Cheap, and accurate for pulses that are wide compared to a frame. */
+	DRIFT_MEASURE_PEAK_INTERPOLATION_PARABOLIC,
+	/* Reconstructs the band limited signal around the peak with a windowed
+	 * sinc and searches for its maximum. More expensive, but accurate even
+	 * for short pulses with lots of high frequency content. */
+	DRIFT_MEASURE_PEAK_INTERPOLATION_SINC
+}
+DriftMeasurePeakInterpolation;
+
+
+/* Number of neighbours on each side of the peak that the windowed sinc
+ * interpolation uses. The parabolic one only uses the direct ones. */
+#define DRIFT_MEASURE_PEAK_INTERPOLATION_HALF_LENGTH 16
+
+/* Number of values in the neighbourhood passed to
+ * drift_measure_peak_interpolation_get_offset(). */
+#define DRIFT_MEASURE_PEAK_INTERPOLATION_NEIGHBOURHOOD_SIZE (DRIFT_MEASURE_PEAK_INTERPOLATION_HALF_LENGTH * 2 + 1)
+
+
+/* Returns the offset of the interpolated maximum relative to the peak frame,
+ * in frames. The offset is within the -1.0 .. 1.0 range.
+ *
+ * neighbourhood must contain DRIFT_MEASURE_PEAK_INTERPOLATION_NEIGHBOURHOOD_SIZE
+ * sample values, with the peak sample in the middle. Neighbours that are not
+ * available (because they are outside of the frame history, for example)
+ * must be set to NAN. The parabolic interpolation then returns 0, while the
+ * sinc interpolation leaves them out. */
+double drift_measure_peak_interpolation_get_offset(DriftMeasurePeakInterpolation method, double const *neighbourhood);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* PEAKINTERPOLATION_H */
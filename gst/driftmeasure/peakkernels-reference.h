@@ -0,0 +1,79 @@
+/* Scalar peak search kernels. This file is included by peakkernels.c
+ * once for each supported sample format, with these macros defined:
+ *
+ *   REF_NAME(x)              : name of the function x for this sample format
+ *   REF_VALUE_TYPE           : type of the sample values (float or int32_t)
+ *   REF_VALUE_FIELD          : DriftMeasureSampleValue field for the values
+ *   REF_LOAD(samples, index) : value of the sample with the given index
+ *
+ * The macros are undefined at the end of this file. */
+
+
+static inline void REF_NAME(update_channel_peak)(DriftMeasureChannelPeak *channel_peak, REF_VALUE_TYPE value, uint64_t frame_index, REF_VALUE_TYPE threshold)
+{
+	if (!(value >= threshold))
+		return;
+
+	if ((channel_peak->largest_frame_index == DRIFT_MEASURE_UNDEFINED_INDEX)
+	 || (value > channel_peak->largest_sample.REF_VALUE_FIELD)
+	 || ((value == channel_peak->largest_sample.REF_VALUE_FIELD) && (frame_index < channel_peak->largest_frame_index)))
+	{
+		channel_peak->largest_frame_index = frame_index;
+		channel_peak->largest_sample.REF_VALUE_FIELD = value;
+	}
+}
+
+
+static void REF_NAME(find_largest_frames)(void const *samples, unsigned int num_channels, uint64_t first_frame, size_t num_frames, DriftMeasureSampleValue threshold, DriftMeasureChannelPeak *channel_peaks)
+{
+	REF_VALUE_TYPE native_threshold = threshold.REF_VALUE_FIELD;
+	size_t frame, sample_index = 0;
+	unsigned int channel;
+
+	for (frame = 0; frame < num_frames; ++frame)
+	{
+		for (channel = 0; channel < num_channels; ++channel, ++sample_index)
+		{
+			REF_VALUE_TYPE sample = REF_LOAD(samples, sample_index);
+			DriftMeasureChannelPeak *channel_peak = &(channel_peaks[channel]);
+
+			if (!(sample >= native_threshold))
+				continue;
+
+			if ((channel_peak->largest_frame_index == DRIFT_MEASURE_UNDEFINED_INDEX) || (sample > channel_peak->largest_sample.REF_VALUE_FIELD))
+			{
+				channel_peak->largest_frame_index = first_frame + frame;
+				channel_peak->largest_sample.REF_VALUE_FIELD = sample;
+			}
+		}
+	}
+}
+
+
+static size_t REF_NAME(find_first_frame_above_threshold)(void const *samples, unsigned int num_channels, unsigned int channel, size_t num_frames, DriftMeasureSampleValue threshold)
+{
+	REF_VALUE_TYPE native_threshold = threshold.REF_VALUE_FIELD;
+	size_t frame, sample_index = channel;
+
+	for (frame = 0; frame < num_frames; ++frame, sample_index += num_channels)
+	{
+		if (REF_LOAD(samples, sample_index) >= native_threshold)
+			break;
+	}
+
+	return frame;
+}
+
+
+static DriftMeasurePeakKernels const REF_NAME(kernels) =
+{
+	"reference",
+	REF_NAME(find_largest_frames),
+	REF_NAME(find_first_frame_above_threshold)
+};
+
+
+#undef REF_NAME
+#undef REF_VALUE_TYPE
+#undef REF_VALUE_FIELD
+#undef REF_LOAD
@@ -0,0 +1,181 @@
+/* Vectorized peak search kernels. This file is included by peakkernels.c
+ * once for each supported combination of instruction set and sample format,
+ * with these macros defined:
+ *
+ *   SIMD_NAME(x)          : name of the function x for this combination
+ *   SIMD_NAME_STRING      : name of the instruction set
+ *   SIMD_ATTR             : function attributes (like the target ISA)
+ *   SIMD_WIDTH            : number of 32-bit lanes per vector
+ *   SIMD_SAMPLE_TYPE      : type of the samples in memory
+ *   SIMD_REFERENCE(x)     : name of the reference function x for this format
+ *   SIMD_LOAD_V(p)        : loads SIMD_WIDTH samples into a value vector
+ *   SIMD_VALUE_TYPE       : type of the values in the lanes (float or int32_t)
+ *   SIMD_VALUE_FIELD      : DriftMeasureSampleValue field for the values
+ *   SIMD_VALUE_MIN        : smallest possible value
+ *   SIMD_VVEC             : value vector type
+ *   SIMD_IVEC             : 32-bit unsigned integer vector type
+ *   SIMD_MVEC             : comparison mask type
+ *   SIMD_LOAD_M(p)        : unaligned load of a mask from uint32_t lanes
+ *   SIMD_SET1_V(x)        : value vector with all lanes set to x
+ *   SIMD_SET1_I(x)        : integer vector with all lanes set to x
+ *   SIMD_CMPGT(a, b)      : mask of lanes where a > b
+ *   SIMD_CMPGE(a, b)      : mask of lanes where a >= b
+ *   SIMD_BLEND_V(m, a, b) : lanes of a where m is set, lanes of b otherwise
+ *   SIMD_BLEND_I(m, a, b) : same as SIMD_BLEND_V, for integer vectors
+ *   SIMD_AND_M(a, b)      : bitwise AND of two masks
+ *   SIMD_OR_M(a, b)       : bitwise OR of two masks
+ *   SIMD_ZERO_M()         : mask with no lanes set
+ *   SIMD_ANY_M(m)         : nonzero if any lane in m is set
+ *   SIMD_STORE_V(p, v)    : unaligned value vector store
+ *   SIMD_STORE_I(p, v)    : unaligned integer vector store
+ *
+ * SIMD_NAME, SIMD_SAMPLE_TYPE, SIMD_REFERENCE and SIMD_LOAD_V are
+ * undefined at the end of this file.
+ *
+ * The interleaved samples are processed in blocks of frames_per_block frames.
+ * The block size is the smallest number of frames that fills a whole number
+ * of vectors, so a given vector lane always refers to the same channel and
+ * the same frame within each block. The vectorized argmax then only needs
+ * to keep track of the largest value per lane along with the index of the
+ * block it was found in. Since the lanes are only updated if a value is
+ * strictly larger, the earliest block wins among equal values, and when
+ * the lanes are reduced to one result per channel, the earliest frame
+ * wins as well. This way, the results match the reference implementation
+ * exactly. */
+
+
+SIMD_ATTR static void SIMD_NAME(find_largest_frames)(void const *samples, unsigned int num_channels, uint64_t first_frame, size_t num_frames, DriftMeasureSampleValue threshold, DriftMeasureChannelPeak *channel_peaks)
+{
+	SIMD_SAMPLE_TYPE const *typed_samples = samples;
+	unsigned int divisor = gcd(num_channels, SIMD_WIDTH);
+	unsigned int frames_per_block = SIMD_WIDTH / divisor;
+	unsigned int vectors_per_block = num_channels / divisor;
+	SIMD_VVEC largest_values[MAX_VECTORS_PER_BLOCK];
+	SIMD_IVEC largest_blocks[MAX_VECTORS_PER_BLOCK];
+	SIMD_VALUE_TYPE lane_values[SIMD_WIDTH];
+	uint32_t lane_blocks[SIMD_WIDTH];
+
+	if (vectors_per_block > MAX_VECTORS_PER_BLOCK)
+	{
+		SIMD_REFERENCE(find_largest_frames)(typed_samples, num_channels, first_frame, num_frames, threshold, channel_peaks);
+		return;
+	}
+
+	while (num_frames >= frames_per_block)
+	{
+		size_t num_blocks = num_frames / frames_per_block;
+		size_t num_block_frames;
+		uint32_t block;
+		unsigned int vector, lane;
+
+		if (num_blocks > MAX_BLOCKS_PER_PASS)
+			num_blocks = MAX_BLOCKS_PER_PASS;
+		num_block_frames = num_blocks * frames_per_block;
+
+		for (vector = 0; vector < vectors_per_block; ++vector)
+		{
+			largest_values[vector] = SIMD_SET1_V(SIMD_VALUE_MIN);
+			largest_blocks[vector] = SIMD_SET1_I(0);
+		}
+
+		for (block = 0; block < num_blocks; ++block)
+		{
+			SIMD_SAMPLE_TYPE const *block_samples = typed_samples + (size_t)block * vectors_per_block * SIMD_WIDTH;
+			SIMD_IVEC block_index = SIMD_SET1_I(block);
+
+			for (vector = 0; vector < vectors_per_block; ++vector)
+			{
+				SIMD_VVEC values = SIMD_LOAD_V(block_samples + vector * SIMD_WIDTH);
+				SIMD_MVEC is_larger = SIMD_CMPGT(values, largest_values[vector]);
+				largest_values[vector] = SIMD_BLEND_V(is_larger, values, largest_values[vector]);
+				largest_blocks[vector] = SIMD_BLEND_I(is_larger, block_index, largest_blocks[vector]);
+			}
+		}
+
+		/* Reduce the lanes to per-channel results. A lane that was never
+		 * updated holds SIMD_VALUE_MIN and block 0; this is still correct,
+		 * since all of its values were SIMD_VALUE_MIN then. */
+		for (vector = 0; vector < vectors_per_block; ++vector)
+		{
+			SIMD_STORE_V(lane_values, largest_values[vector]);
+			SIMD_STORE_I(lane_blocks, largest_blocks[vector]);
+
+			for (lane = 0; lane < SIMD_WIDTH; ++lane)
+			{
+				unsigned int position = vector * SIMD_WIDTH + lane;
+				uint64_t frame_index = first_frame + (uint64_t)(lane_blocks[lane]) * frames_per_block + position / num_channels;
+				SIMD_REFERENCE(update_channel_peak)(&(channel_peaks[position % num_channels]), lane_values[lane], frame_index, threshold.SIMD_VALUE_FIELD);
+			}
+		}
+
+		typed_samples += num_block_frames * num_channels;
+		first_frame += num_block_frames;
+		num_frames -= num_block_frames;
+	}
+
+	/* The remaining frames do not fill a whole block. */
+	SIMD_REFERENCE(find_largest_frames)(typed_samples, num_channels, first_frame, num_frames, threshold, channel_peaks);
+}
+
+
+SIMD_ATTR static size_t SIMD_NAME(find_first_frame_above_threshold)(void const *samples, unsigned int num_channels, unsigned int channel, size_t num_frames, DriftMeasureSampleValue threshold)
+{
+	SIMD_SAMPLE_TYPE const *typed_samples = samples;
+	unsigned int divisor = gcd(num_channels, SIMD_WIDTH);
+	unsigned int frames_per_block = SIMD_WIDTH / divisor;
+	unsigned int vectors_per_block = num_channels / divisor;
+	SIMD_MVEC channel_masks[MAX_VECTORS_PER_BLOCK];
+	SIMD_VVEC threshold_vector = SIMD_SET1_V(threshold.SIMD_VALUE_FIELD);
+	uint32_t lane_bits[SIMD_WIDTH];
+	size_t num_blocks, block, frame;
+	unsigned int vector, lane;
+
+	/* All channels are compared at once, and the results for the other
+	 * channels are masked out. This only pays off if the vectors cover
+	 * more frames than there are vectors in a block; otherwise, the
+	 * strided scalar loop does less work. */
+	if (vectors_per_block >= frames_per_block)
+		return SIMD_REFERENCE(find_first_frame_above_threshold)(typed_samples, num_channels, channel, num_frames, threshold);
+
+	for (vector = 0; vector < vectors_per_block; ++vector)
+	{
+		for (lane = 0; lane < SIMD_WIDTH; ++lane)
+			lane_bits[lane] = (((vector * SIMD_WIDTH + lane) % num_channels) == channel) ? 0xFFFFFFFFu : 0;
+		channel_masks[vector] = SIMD_LOAD_M(lane_bits);
+	}
+
+	num_blocks = num_frames / frames_per_block;
+
+	for (block = 0; block < num_blocks; ++block)
+	{
+		SIMD_SAMPLE_TYPE const *block_samples = typed_samples + block * vectors_per_block * SIMD_WIDTH;
+		SIMD_MVEC found = SIMD_ZERO_M();
+
+		for (vector = 0; vector < vectors_per_block; ++vector)
+		{
+			SIMD_MVEC is_above = SIMD_CMPGE(SIMD_LOAD_V(block_samples + vector * SIMD_WIDTH), threshold_vector);
+			found = SIMD_OR_M(found, SIMD_AND_M(is_above, channel_masks[vector]));
+		}
+
+		/* Let the reference implementation pinpoint the frame in the block. */
+		if (SIMD_ANY_M(found))
+			return block * frames_per_block + SIMD_REFERENCE(find_first_frame_above_threshold)(block_samples, num_channels, channel, frames_per_block, threshold);
+	}
+
+	frame = num_blocks * frames_per_block;
+	return frame + SIMD_REFERENCE(find_first_frame_above_threshold)(typed_samples + frame * num_channels, num_channels, channel, num_frames - frame, threshold);
+}
+
+
+static DriftMeasurePeakKernels const SIMD_NAME(kernels) =
+{
+	SIMD_NAME_STRING,
+	SIMD_NAME(find_largest_frames),
+	SIMD_NAME(find_first_frame_above_threshold)
+};
+
+
+#undef SIMD_NAME
+#undef SIMD_SAMPLE_TYPE
+#undef SIMD_REFERENCE
+#undef SIMD_LOAD_V
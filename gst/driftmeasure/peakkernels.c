@@ -0,0 +1,543 @@
+#include <math.h>
+#include "peakkernels.h"
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+
+/* Upper limit for the number of vectors that make up one block of frames
+ * in the vectorized kernels (see peakkernels-simd.h). The kernels keep one
+ * accumulator per vector on the stack. With more channels than that (or
+ * with channel counts that require blocks larger than that), the
+ * reference implementation is used. */
+#define MAX_VECTORS_PER_BLOCK 128
+
+/* The vectorized kernels store block indices in 32-bit lanes, so they
+ * process at most this many blocks before reducing the lanes. */
+#define MAX_BLOCKS_PER_PASS ((size_t)1 << 30)
+
+
+static inline unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while (b != 0)
+	{
+		unsigned int t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+
+static inline int32_t load_s24(void const *samples, size_t index)
+{
+	uint8_t const *bytes = (uint8_t const *)samples + index * 3;
+	uint32_t value = (uint32_t)(bytes[0]) | ((uint32_t)(bytes[1]) << 8) | ((uint32_t)(bytes[2]) << 16);
+	/* Sign-extend the 24-bit value. */
+	return (int32_t)(value ^ 0x800000u) - 0x800000;
+}
+
+
+
+
+/* Reference implementations */
+
+#define REF_NAME(x) f32_##x
+#define REF_VALUE_TYPE float
+#define REF_VALUE_FIELD f32
+#define REF_LOAD(samples, index) (((float const *)(samples))[index])
+#include "peakkernels-reference.h"
+
+#define REF_NAME(x) s16_##x
+#define REF_VALUE_TYPE int32_t
+#define REF_VALUE_FIELD s32
+#define REF_LOAD(samples, index) ((int32_t)(((int16_t const *)(samples))[index]))
+#include "peakkernels-reference.h"
+
+#define REF_NAME(x) s24_##x
+#define REF_VALUE_TYPE int32_t
+#define REF_VALUE_FIELD s32
+#define REF_LOAD(samples, index) load_s24((samples), (index))
+#include "peakkernels-reference.h"
+
+#define REF_NAME(x) s32_##x
+#define REF_VALUE_TYPE int32_t
+#define REF_VALUE_FIELD s32
+#define REF_LOAD(samples, index) (((int32_t const *)(samples))[index])
+#include "peakkernels-reference.h"
+
+
+
+
+/* Vectorized implementations. Packed 24-bit samples are not vectorized,
+ * since the lanes would have to be assembled from 3-byte groups. */
+
+#ifdef HAVE_X86_KERNELS
+
+/* SSE2 */
+
+#define SIMD_NAME_STRING "sse2"
+#define SIMD_ATTR __attribute__((target("sse2")))
+#define SIMD_WIDTH 4
+#define SIMD_IVEC __m128i
+#define SIMD_SET1_I(x) _mm_set1_epi32((int)(x))
+#define SIMD_STORE_I(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+
+#define SIMD_VALUE_TYPE float
+#define SIMD_VALUE_FIELD f32
+#define SIMD_VALUE_MIN (-INFINITY)
+#define SIMD_VVEC __m128
+#define SIMD_MVEC __m128
+#define SIMD_LOAD_M(p) _mm_castsi128_ps(_mm_loadu_si128((__m128i const *)(p)))
+#define SIMD_SET1_V(x) _mm_set1_ps(x)
+#define SIMD_CMPGT(a, b) _mm_cmpgt_ps((a), (b))
+#define SIMD_CMPGE(a, b) _mm_cmpge_ps((a), (b))
+#define SIMD_BLEND_V(m, a, b) _mm_or_ps(_mm_and_ps((m), (a)), _mm_andnot_ps((m), (b)))
+#define SIMD_BLEND_I(m, a, b) _mm_or_si128(_mm_and_si128(_mm_castps_si128(m), (a)), _mm_andnot_si128(_mm_castps_si128(m), (b)))
+#define SIMD_AND_M(a, b) _mm_and_ps((a), (b))
+#define SIMD_OR_M(a, b) _mm_or_ps((a), (b))
+#define SIMD_ZERO_M() _mm_setzero_ps()
+#define SIMD_ANY_M(m) (_mm_movemask_ps(m) != 0)
+#define SIMD_STORE_V(p, v) _mm_storeu_ps((p), (v))
+
+#define SIMD_NAME(x) sse2_f32_##x
+#define SIMD_SAMPLE_TYPE float
+#define SIMD_REFERENCE(x) f32_##x
+#define SIMD_LOAD_V(p) _mm_loadu_ps(p)
+#include "peakkernels-simd.h"
+
+#undef SIMD_VALUE_TYPE
+#undef SIMD_VALUE_FIELD
+#undef SIMD_VALUE_MIN
+#undef SIMD_VVEC
+#undef SIMD_MVEC
+#undef SIMD_LOAD_M
+#undef SIMD_SET1_V
+#undef SIMD_CMPGT
+#undef SIMD_CMPGE
+#undef SIMD_BLEND_V
+#undef SIMD_BLEND_I
+#undef SIMD_AND_M
+#undef SIMD_OR_M
+#undef SIMD_ZERO_M
+#undef SIMD_ANY_M
+#undef SIMD_STORE_V
+
+#define SIMD_VALUE_TYPE int32_t
+#define SIMD_VALUE_FIELD s32
+#define SIMD_VALUE_MIN INT32_MIN
+#define SIMD_VVEC __m128i
+#define SIMD_MVEC __m128i
+#define SIMD_LOAD_M(p) _mm_loadu_si128((__m128i const *)(p))
+#define SIMD_SET1_V(x) _mm_set1_epi32(x)
+#define SIMD_CMPGT(a, b) _mm_cmpgt_epi32((a), (b))
+#define SIMD_CMPGE(a, b) _mm_xor_si128(_mm_cmplt_epi32((a), (b)), _mm_set1_epi32(-1))
+#define SIMD_BLEND_V(m, a, b) _mm_or_si128(_mm_and_si128((m), (a)), _mm_andnot_si128((m), (b)))
+#define SIMD_BLEND_I(m, a, b) SIMD_BLEND_V(m, a, b)
+#define SIMD_AND_M(a, b) _mm_and_si128((a), (b))
+#define SIMD_OR_M(a, b) _mm_or_si128((a), (b))
+#define SIMD_ZERO_M() _mm_setzero_si128()
+#define SIMD_ANY_M(m) (_mm_movemask_epi8(m) != 0)
+#define SIMD_STORE_V(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+
+/* Sign-extends 4 16-bit samples to 32 bits by moving them into
+ * the upper halves of the lanes and shifting them back down. */
+#define SIMD_NAME(x) sse2_s16_##x
+#define SIMD_SAMPLE_TYPE int16_t
+#define SIMD_REFERENCE(x) s16_##x
+#define SIMD_LOAD_V(p) _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), _mm_loadl_epi64((__m128i const *)(p))), 16)
+#include "peakkernels-simd.h"
+
+#define SIMD_NAME(x) sse2_s32_##x
+#define SIMD_SAMPLE_TYPE int32_t
+#define SIMD_REFERENCE(x) s32_##x
+#define SIMD_LOAD_V(p) _mm_loadu_si128((__m128i const *)(p))
+#include "peakkernels-simd.h"
+
+#undef SIMD_VALUE_TYPE
+#undef SIMD_VALUE_FIELD
+#undef SIMD_VALUE_MIN
+#undef SIMD_VVEC
+#undef SIMD_MVEC
+#undef SIMD_LOAD_M
+#undef SIMD_SET1_V
+#undef SIMD_CMPGT
+#undef SIMD_CMPGE
+#undef SIMD_BLEND_V
+#undef SIMD_BLEND_I
+#undef SIMD_AND_M
+#undef SIMD_OR_M
+#undef SIMD_ZERO_M
+#undef SIMD_ANY_M
+#undef SIMD_STORE_V
+
+#undef SIMD_NAME_STRING
+#undef SIMD_ATTR
+#undef SIMD_WIDTH
+#undef SIMD_IVEC
+#undef SIMD_SET1_I
+#undef SIMD_STORE_I
+
+
+/* AVX2 */
+
+#define SIMD_NAME_STRING "avx2"
+#define SIMD_ATTR __attribute__((target("avx2")))
+#define SIMD_WIDTH 8
+#define SIMD_IVEC __m256i
+#define SIMD_SET1_I(x) _mm256_set1_epi32((int)(x))
+#define SIMD_STORE_I(p, v) _mm256_storeu_si256((__m256i *)(p), (v))
+
+#define SIMD_VALUE_TYPE float
+#define SIMD_VALUE_FIELD f32
+#define SIMD_VALUE_MIN (-INFINITY)
+#define SIMD_VVEC __m256
+#define SIMD_MVEC __m256
+#define SIMD_LOAD_M(p) _mm256_castsi256_ps(_mm256_loadu_si256((__m256i const *)(p)))
+#define SIMD_SET1_V(x) _mm256_set1_ps(x)
+#define SIMD_CMPGT(a, b) _mm256_cmp_ps((a), (b), _CMP_GT_OQ)
+#define SIMD_CMPGE(a, b) _mm256_cmp_ps((a), (b), _CMP_GE_OQ)
+#define SIMD_BLEND_V(m, a, b) _mm256_blendv_ps((b), (a), (m))
+#define SIMD_BLEND_I(m, a, b) _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a), (m)))
+#define SIMD_AND_M(a, b) _mm256_and_ps((a), (b))
+#define SIMD_OR_M(a, b) _mm256_or_ps((a), (b))
+#define SIMD_ZERO_M() _mm256_setzero_ps()
+#define SIMD_ANY_M(m) (_mm256_movemask_ps(m) != 0)
+#define SIMD_STORE_V(p, v) _mm256_storeu_ps((p), (v))
+
+#define SIMD_NAME(x) avx2_f32_##x
+#define SIMD_SAMPLE_TYPE float
+#define SIMD_REFERENCE(x) f32_##x
+#define SIMD_LOAD_V(p) _mm256_loadu_ps(p)
+#include "peakkernels-simd.h"
+
+#undef SIMD_VALUE_TYPE
+#undef SIMD_VALUE_FIELD
+#undef SIMD_VALUE_MIN
+#undef SIMD_VVEC
+#undef SIMD_MVEC
+#undef SIMD_LOAD_M
+#undef SIMD_SET1_V
+#undef SIMD_CMPGT
+#undef SIMD_CMPGE
+#undef SIMD_BLEND_V
+#undef SIMD_BLEND_I
+#undef SIMD_AND_M
+#undef SIMD_OR_M
+#undef SIMD_ZERO_M
+#undef SIMD_ANY_M
+#undef SIMD_STORE_V
+
+#define SIMD_VALUE_TYPE int32_t
+#define SIMD_VALUE_FIELD s32
+#define SIMD_VALUE_MIN INT32_MIN
+#define SIMD_VVEC __m256i
+#define SIMD_MVEC __m256i
+#define SIMD_LOAD_M(p) _mm256_loadu_si256((__m256i const *)(p))
+#define SIMD_SET1_V(x) _mm256_set1_epi32(x)
+#define SIMD_CMPGT(a, b) _mm256_cmpgt_epi32((a), (b))
+#define SIMD_CMPGE(a, b) _mm256_xor_si256(_mm256_cmpgt_epi32((b), (a)), _mm256_set1_epi32(-1))
+#define SIMD_BLEND_V(m, a, b) _mm256_blendv_epi8((b), (a), (m))
+#define SIMD_BLEND_I(m, a, b) _mm256_blendv_epi8((b), (a), (m))
+#define SIMD_AND_M(a, b) _mm256_and_si256((a), (b))
+#define SIMD_OR_M(a, b) _mm256_or_si256((a), (b))
+#define SIMD_ZERO_M() _mm256_setzero_si256()
+#define SIMD_ANY_M(m) (_mm256_movemask_epi8(m) != 0)
+#define SIMD_STORE_V(p, v) _mm256_storeu_si256((__m256i *)(p), (v))
+
+#define SIMD_NAME(x) avx2_s16_##x
+#define SIMD_SAMPLE_TYPE int16_t
+#define SIMD_REFERENCE(x) s16_##x
+#define SIMD_LOAD_V(p) _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i const *)(p)))
+#include "peakkernels-simd.h"
+
+#define SIMD_NAME(x) avx2_s32_##x
+#define SIMD_SAMPLE_TYPE int32_t
+#define SIMD_REFERENCE(x) s32_##x
+#define SIMD_LOAD_V(p) _mm256_loadu_si256((__m256i const *)(p))
+#include "peakkernels-simd.h"
+
+#undef SIMD_VALUE_TYPE
+#undef SIMD_VALUE_FIELD
+#undef SIMD_VALUE_MIN
+#undef SIMD_VVEC
+#undef SIMD_MVEC
+#undef SIMD_LOAD_M
+#undef SIMD_SET1_V
+#undef SIMD_CMPGT
+#undef SIMD_CMPGE
+#undef SIMD_BLEND_V
+#undef SIMD_BLEND_I
+#undef SIMD_AND_M
+#undef SIMD_OR_M
+#undef SIMD_ZERO_M
+#undef SIMD_ANY_M
+#undef SIMD_STORE_V
+
+#undef SIMD_NAME_STRING
+#undef SIMD_ATTR
+#undef SIMD_WIDTH
+#undef SIMD_IVEC
+#undef SIMD_SET1_I
+#undef SIMD_STORE_I
+
+#endif /* HAVE_X86_KERNELS */
+
+
+
+
+#ifdef HAVE_NEON_KERNELS
+
+/* NEON (always available on AArch64) */
+
+#define SIMD_NAME_STRING "neon"
+#define SIMD_ATTR
+#define SIMD_WIDTH 4
+#define SIMD_IVEC uint32x4_t
+#define SIMD_MVEC uint32x4_t
+#define SIMD_LOAD_M(p) vld1q_u32(p)
+#define SIMD_SET1_I(x) vdupq_n_u32(x)
+#define SIMD_BLEND_I(m, a, b) vbslq_u32((m), (a), (b))
+#define SIMD_AND_M(a, b) vandq_u32((a), (b))
+#define SIMD_OR_M(a, b) vorrq_u32((a), (b))
+#define SIMD_ZERO_M() vdupq_n_u32(0)
+#define SIMD_ANY_M(m) (vmaxvq_u32(m) != 0)
+#define SIMD_STORE_I(p, v) vst1q_u32((p), (v))
+
+#define SIMD_VALUE_TYPE float
+#define SIMD_VALUE_FIELD f32
+#define SIMD_VALUE_MIN (-INFINITY)
+#define SIMD_VVEC float32x4_t
+#define SIMD_SET1_V(x) vdupq_n_f32(x)
+#define SIMD_CMPGT(a, b) vcgtq_f32((a), (b))
+#define SIMD_CMPGE(a, b) vcgeq_f32((a), (b))
+#define SIMD_BLEND_V(m, a, b) vbslq_f32((m), (a), (b))
+#define SIMD_STORE_V(p, v) vst1q_f32((p), (v))
+
+#define SIMD_NAME(x) neon_f32_##x
+#define SIMD_SAMPLE_TYPE float
+#define SIMD_REFERENCE(x) f32_##x
+#define SIMD_LOAD_V(p) vld1q_f32(p)
+#include "peakkernels-simd.h"
+
+#undef SIMD_VALUE_TYPE
+#undef SIMD_VALUE_FIELD
+#undef SIMD_VALUE_MIN
+#undef SIMD_VVEC
+#undef SIMD_SET1_V
+#undef SIMD_CMPGT
+#undef SIMD_CMPGE
+#undef SIMD_BLEND_V
+#undef SIMD_STORE_V
+
+#define SIMD_VALUE_TYPE int32_t
+#define SIMD_VALUE_FIELD s32
+#define SIMD_VALUE_MIN INT32_MIN
+#define SIMD_VVEC int32x4_t
+#define SIMD_SET1_V(x) vdupq_n_s32(x)
+#define SIMD_CMPGT(a, b) vcgtq_s32((a), (b))
+#define SIMD_CMPGE(a, b) vcgeq_s32((a), (b))
+#define SIMD_BLEND_V(m, a, b) vbslq_s32((m), (a), (b))
+#define SIMD_STORE_V(p, v) vst1q_s32((p), (v))
+
+#define SIMD_NAME(x) neon_s16_##x
+#define SIMD_SAMPLE_TYPE int16_t
+#define SIMD_REFERENCE(x) s16_##x
+#define SIMD_LOAD_V(p) vmovl_s16(vld1_s16(p))
+#include "peakkernels-simd.h"
+
+#define SIMD_NAME(x) neon_s32_##x
+#define SIMD_SAMPLE_TYPE int32_t
+#define SIMD_REFERENCE(x) s32_##x
+#define SIMD_LOAD_V(p) vld1q_s32(p)
+#include "peakkernels-simd.h"
+
+#endif /* HAVE_NEON_KERNELS */
+
+
+
+
+DriftMeasurePeakKernels const * drift_measure_peak_kernels_get_reference(DriftMeasureSampleFormat format)
+{
+	switch (format)
+	{
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S16: return &s16_kernels;
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S24: return &s24_kernels;
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S32: return &s32_kernels;
+		default: return &f32_kernels;
+	}
+}
+
+
+DriftMeasurePeakKernels const * drift_measure_peak_kernels_get_for_isa(DriftMeasurePeakKernelsIsa isa, DriftMeasureSampleFormat format)
+{
+	switch (isa)
+	{
+		case DRIFT_MEASURE_PEAK_KERNELS_ISA_REFERENCE:
+			return drift_measure_peak_kernels_get_reference(format);
+
+#if defined(HAVE_X86_KERNELS)
+		case DRIFT_MEASURE_PEAK_KERNELS_ISA_SSE2:
+			__builtin_cpu_init();
+			if (!__builtin_cpu_supports("sse2"))
+				return NULL;
+
+			switch (format)
+			{
+				case DRIFT_MEASURE_SAMPLE_FORMAT_F32: return &sse2_f32_kernels;
+				case DRIFT_MEASURE_SAMPLE_FORMAT_S16: return &sse2_s16_kernels;
+				case DRIFT_MEASURE_SAMPLE_FORMAT_S32: return &sse2_s32_kernels;
+				default: return NULL;
+			}
+
+		case DRIFT_MEASURE_PEAK_KERNELS_ISA_AVX2:
+			__builtin_cpu_init();
+			if (!__builtin_cpu_supports("avx2"))
+				return NULL;
+
+			switch (format)
+			{
+				case DRIFT_MEASURE_SAMPLE_FORMAT_F32: return &avx2_f32_kernels;
+				case DRIFT_MEASURE_SAMPLE_FORMAT_S16: return &avx2_s16_kernels;
+				case DRIFT_MEASURE_SAMPLE_FORMAT_S32: return &avx2_s32_kernels;
+				default: return NULL;
+			}
+#endif
+
+#if defined(HAVE_NEON_KERNELS)
+		case DRIFT_MEASURE_PEAK_KERNELS_ISA_NEON:
+			switch (format)
+			{
+				case DRIFT_MEASURE_SAMPLE_FORMAT_F32: return &neon_f32_kernels;
+				case DRIFT_MEASURE_SAMPLE_FORMAT_S16: return &neon_s16_kernels;
+				case DRIFT_MEASURE_SAMPLE_FORMAT_S32: return &neon_s32_kernels;
+				default: return NULL;
+			}
+#endif
+
+		default:
+			return NULL;
+	}
+}
+
+
+DriftMeasurePeakKernels const * drift_measure_peak_kernels_get_optimized(DriftMeasureSampleFormat format)
+{
+	/* In order of preference. */
+	static DriftMeasurePeakKernelsIsa const isas[] = { DRIFT_MEASURE_PEAK_KERNELS_ISA_AVX2, DRIFT_MEASURE_PEAK_KERNELS_ISA_SSE2, DRIFT_MEASURE_PEAK_KERNELS_ISA_NEON };
+	size_t i;
+
+	for (i = 0; i < sizeof(isas) / sizeof(isas[0]); ++i)
+	{
+		DriftMeasurePeakKernels const *kernels = drift_measure_peak_kernels_get_for_isa(isas[i], format);
+		if (kernels != NULL)
+			return kernels;
+	}
+
+	return drift_measure_peak_kernels_get_reference(format);
+}
+
+
+static double get_integer_scale(DriftMeasureSampleFormat format)
+{
+	switch (format)
+	{
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S16: return 32768.0;
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S24: return 8388608.0;
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S32: return 2147483648.0;
+		default: return 1.0;
+	}
+}
+
+
+DriftMeasureSampleValue drift_measure_peak_kernels_convert_threshold(DriftMeasureSampleFormat format, float threshold)
+{
+	DriftMeasureSampleValue value;
+	double scaled;
+
+	if (format == DRIFT_MEASURE_SAMPLE_FORMAT_F32)
+	{
+		value.f32 = threshold;
+		return value;
+	}
+
+	/* Round up, since samples below the exact scaled
+	 * threshold must not be considered. */
+	scaled = ceil((double)threshold * get_integer_scale(format));
+
+	/* A threshold of 1.0 cannot be represented as a 32-bit integer.
+	 * Clamping it means that the largest possible S32 sample passes
+	 * such a threshold, which is negligible. */
+	if (scaled > (double)INT32_MAX)
+		value.s32 = INT32_MAX;
+	else if (scaled < (double)INT32_MIN)
+		value.s32 = INT32_MIN;
+	else
+		value.s32 = (int32_t)scaled;
+
+	return value;
+}
+
+
+DriftMeasureSampleValue drift_measure_peak_kernels_read_sample(DriftMeasureSampleFormat format, void const *sample)
+{
+	DriftMeasureSampleValue value;
+
+	switch (format)
+	{
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S16: value.s32 = *((int16_t const *)sample); break;
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S24: value.s32 = load_s24(sample, 0); break;
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S32: value.s32 = *((int32_t const *)sample); break;
+		default: value.f32 = *((float const *)sample); break;
+	}
+
+	return value;
+}
+
+
+double drift_measure_peak_kernels_normalize_value(DriftMeasureSampleFormat format, DriftMeasureSampleValue value)
+{
+	if (format == DRIFT_MEASURE_SAMPLE_FORMAT_F32)
+		return value.f32;
+	else
+		return value.s32 / get_integer_scale(format);
+}
+
+
+void drift_measure_peak_kernels_normalize_samples(DriftMeasureSampleFormat format, void const *samples, size_t sample_stride, size_t num_samples, float *values)
+{
+	float scale = (float)(1.0 / get_integer_scale(format));
+	size_t i;
+
+	switch (format)
+	{
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S16:
+			for (i = 0; i < num_samples; ++i)
+				values[i] = ((int16_t const *)samples)[i * sample_stride] * scale;
+			break;
+
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S24:
+			for (i = 0; i < num_samples; ++i)
+				values[i] = load_s24(samples, i * sample_stride) * scale;
+			break;
+
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S32:
+			for (i = 0; i < num_samples; ++i)
+				values[i] = ((int32_t const *)samples)[i * sample_stride] * scale;
+			break;
+
+		default:
+			for (i = 0; i < num_samples; ++i)
+				values[i] = ((float const *)samples)[i * sample_stride];
+			break;
+	}
+}
@@ -0,0 +1,140 @@
+#ifndef PEAKKERNELS_H
+#define PEAKKERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Low level peak search kernels for little endian PCM samples.
+ *
+ * There is a scalar reference implementation for each sample format and
+ * vectorized ones (SSE2 and AVX2 on x86, NEON on ARM) for the formats that
+ * lend themselves to vectorization. The vectorized implementations produce
+ * exactly the same results as the reference ones, including the
+ * tie-breaking rule: if several samples share the largest value, the one
+ * in the earliest frame wins.
+ *
+ * Samples are always compared in their native domain, that is, integer
+ * samples are compared against an integer threshold. Use
+ * drift_measure_peak_kernels_convert_threshold() to get such a threshold.
+ *
+ * The kernels operate on interleaved samples. Non-interleaved (planar)
+ * data is handled by calling them for each plane with num_channels
+ * set to 1.
+ *
+ * These kernels do not depend on GStreamer or GLib. */
+
+
+#define DRIFT_MEASURE_UNDEFINED_INDEX ((uint64_t)(-1))
+
+
+typedef enum
+{
+	/* 32-bit float samples, nominal range -1.0 .. 1.0 */
+	DRIFT_MEASURE_SAMPLE_FORMAT_F32,
+	/* 16-bit signed integer samples */
+	DRIFT_MEASURE_SAMPLE_FORMAT_S16,
+	/* 24-bit signed integer samples, packed in 3 bytes */
+	DRIFT_MEASURE_SAMPLE_FORMAT_S24,
+	/* 32-bit signed integer samples */
+	DRIFT_MEASURE_SAMPLE_FORMAT_S32
+}
+DriftMeasureSampleFormat;
+
+
+/* A sample value in the native domain of a sample format. f32 is
+ * used by DRIFT_MEASURE_SAMPLE_FORMAT_F32, s32 by all other formats. */
+typedef union
+{
+	float f32;
+	int32_t s32;
+}
+DriftMeasureSampleValue;
+
+
+/* Peak search state for one channel. largest_frame_index is set to
+ * DRIFT_MEASURE_UNDEFINED_INDEX as long as no sample at or above
+ * the threshold was found. */
+typedef struct
+{
+	uint64_t largest_frame_index;
+	DriftMeasureSampleValue largest_sample;
+}
+DriftMeasureChannelPeak;
+
+
+typedef struct
+{
+	/* Name of the implementation, for logging purposes. */
+	char const *name;
+
+	/* Updates channel_peaks (which must have num_channels entries) with the
+	 * largest samples of each channel that are at or above the threshold.
+	 * The peak states are only replaced if a strictly larger sample is found,
+	 * so frames can be passed in several consecutive runs. first_frame is
+	 * the frame index of the first frame in samples. */
+	void (*find_largest_frames)(void const *samples, unsigned int num_channels, uint64_t first_frame, size_t num_frames, DriftMeasureSampleValue threshold, DriftMeasureChannelPeak *channel_peaks);
+
+	/* Returns the index of the first frame whose sample in the given channel
+	 * is at or above the threshold, or num_frames if there is no such frame. */
+	size_t (*find_first_frame_above_threshold)(void const *samples, unsigned int num_channels, unsigned int channel, size_t num_frames, DriftMeasureSampleValue threshold);
+}
+DriftMeasurePeakKernels;
+
+
+/* Instruction sets that kernels are implemented with. */
+typedef enum
+{
+	/* The scalar reference implementation, which is always available. */
+	DRIFT_MEASURE_PEAK_KERNELS_ISA_REFERENCE,
+	DRIFT_MEASURE_PEAK_KERNELS_ISA_SSE2,
+	DRIFT_MEASURE_PEAK_KERNELS_ISA_AVX2,
+	DRIFT_MEASURE_PEAK_KERNELS_ISA_NEON
+}
+DriftMeasurePeakKernelsIsa;
+
+
+/* Returns the scalar reference implementation for the given format. */
+DriftMeasurePeakKernels const * drift_measure_peak_kernels_get_reference(DriftMeasureSampleFormat format);
+
+/* Returns the implementation for the given format that uses the given
+ * instruction set, or NULL if there is none for this format, if it was
+ * not built for this architecture, or if the CPU does not support it. */
+DriftMeasurePeakKernels const * drift_measure_peak_kernels_get_for_isa(DriftMeasurePeakKernelsIsa isa, DriftMeasureSampleFormat format);
+
+/* Returns the fastest implementation for the given format
+ * that the CPU supports. */
+DriftMeasurePeakKernels const * drift_measure_peak_kernels_get_optimized(DriftMeasureSampleFormat format);
+
+/* Converts a threshold in the -1.0 .. 1.0 range to the native domain of
+ * the given format. An integer sample is at or above the returned threshold
+ * if and only if its value, normalized to the -1.0 .. 1.0 range, is at or
+ * above the given threshold. */
+DriftMeasureSampleValue drift_measure_peak_kernels_convert_threshold(DriftMeasureSampleFormat format, float threshold);
+
+/* Returns the value of the sample at the given address, in the
+ * native domain of the given format. */
+DriftMeasureSampleValue drift_measure_peak_kernels_read_sample(DriftMeasureSampleFormat format, void const *sample);
+
+/* Converts a sample value in the native domain of the given format
+ * to the -1.0 .. 1.0 range. */
+double drift_measure_peak_kernels_normalize_value(DriftMeasureSampleFormat format, DriftMeasureSampleValue value);
+
+/* Converts num_samples samples to the -1.0 .. 1.0 range and stores them
+ * in values. sample_stride is the distance between two consecutive input
+ * samples, in samples; pass the number of channels to extract one channel
+ * from interleaved data, or 1 for non-interleaved data. */
+void drift_measure_peak_kernels_normalize_samples(DriftMeasureSampleFormat format, void const *samples, size_t sample_stride, size_t num_samples, float *values);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* PEAKKERNELS_H */
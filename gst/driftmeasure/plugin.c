@@ -1,11 +1,15 @@
 #include <config.h>
 #include <gst/gst.h>
 #include "gstdriftmeasure.h"
+#include "gstdriftmeasuremeta.h"
 
 
 static gboolean plugin_init(GstPlugin *plugin)
 {
 	gboolean ret = TRUE;
+	/* Register the meta API type right away, so applications
+	 * can look it up by name before the first meta is added. */
+	gst_drift_measure_meta_api_get_type();
 	ret = ret && gst_element_register(plugin, "driftmeasure", GST_RANK_NONE, gst_drift_measure_get_type());
 	return ret;
 }
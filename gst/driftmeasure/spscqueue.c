@@ -0,0 +1,97 @@
+#include "spscqueue.h"
+
+
+struct _DriftMeasureSpscQueue
+{
+	gpointer *slots;
+	guint capacity;
+	/* Positions of the oldest item and of the slot for the next item. They
+	 * run from 0 to 2*capacity-1, so that a full queue (where they are
+	 * capacity apart) can be told apart from an empty one (where they are
+	 * equal). head is only written by the consumer, tail by the producer. */
+	volatile gint head;
+	volatile gint tail;
+};
+
+
+static inline guint get_distance(DriftMeasureSpscQueue const *queue, guint head, guint tail)
+{
+	return (tail >= head) ? (tail - head) : (tail + 2 * queue->capacity - head);
+}
+
+
+static inline guint advance(DriftMeasureSpscQueue const *queue, guint position)
+{
+	return ((position + 1) == (2 * queue->capacity)) ? 0 : (position + 1);
+}
+
+
+DriftMeasureSpscQueue * drift_measure_spsc_queue_new(guint capacity)
+{
+	DriftMeasureSpscQueue *queue;
+
+	g_assert((capacity > 0) && (capacity <= (G_MAXINT / 2)));
+
+	queue = g_new0(DriftMeasureSpscQueue, 1);
+	queue->slots = g_new0(gpointer, capacity);
+	queue->capacity = capacity;
+
+	return queue;
+}
+
+
+void drift_measure_spsc_queue_free(DriftMeasureSpscQueue *queue)
+{
+	if (queue == NULL)
+		return;
+
+	g_free(queue->slots);
+	g_free(queue);
+}
+
+
+guint drift_measure_spsc_queue_get_capacity(DriftMeasureSpscQueue const *queue)
+{
+	return queue->capacity;
+}
+
+
+guint drift_measure_spsc_queue_get_length(DriftMeasureSpscQueue *queue)
+{
+	guint head = (guint)g_atomic_int_get(&(queue->head));
+	guint tail = (guint)g_atomic_int_get(&(queue->tail));
+	return get_distance(queue, head, tail);
+}
+
+
+gboolean drift_measure_spsc_queue_push(DriftMeasureSpscQueue *queue, gpointer item)
+{
+	guint tail = (guint)(queue->tail);
+	guint head = (guint)g_atomic_int_get(&(queue->head));
+
+	if (get_distance(queue, head, tail) >= queue->capacity)
+		return FALSE;
+
+	queue->slots[tail % queue->capacity] = item;
+	/* Publishing the new tail also publishes the slot contents. */
+	g_atomic_int_set(&(queue->tail), (gint)advance(queue, tail));
+
+	return TRUE;
+}
+
+
+gpointer drift_measure_spsc_queue_pop(DriftMeasureSpscQueue *queue)
+{
+	guint head = (guint)(queue->head);
+	guint tail = (guint)g_atomic_int_get(&(queue->tail));
+	gpointer item;
+
+	if (head == tail)
+		return NULL;
+
+	item = queue->slots[head % queue->capacity];
+	/* Publishing the new head hands the slot back to the producer. */
+	g_atomic_int_set(&(queue->head), (gint)advance(queue, head));
+
+	return item;
+}
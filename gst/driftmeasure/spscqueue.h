@@ -0,0 +1,44 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <glib.h>
+
+
+G_BEGIN_DECLS
+
+
+/* Bounded lock-free single-producer single-consumer queue of pointers.
+ *
+ * One thread may push items while another one pops them, without any
+ * locking. The positions of both ends only ever increase, and are
+ * published with atomic operations, which also order the accesses to
+ * the item slots. The queue never blocks; it is up to the caller to
+ * wait if it is full or empty. */
+
+
+typedef struct _DriftMeasureSpscQueue DriftMeasureSpscQueue;
+
+
+DriftMeasureSpscQueue * drift_measure_spsc_queue_new(guint capacity);
+
+/* Frees the queue. Items that are still in the queue are not freed. */
+void drift_measure_spsc_queue_free(DriftMeasureSpscQueue *queue);
+
+guint drift_measure_spsc_queue_get_capacity(DriftMeasureSpscQueue const *queue);
+
+/* Returns the number of items in the queue. This can be called by any
+ * thread, but is only a snapshot if the other end is active. */
+guint drift_measure_spsc_queue_get_length(DriftMeasureSpscQueue *queue);
+
+/* Appends an item. Returns FALSE if the queue is full. Producer only. */
+gboolean drift_measure_spsc_queue_push(DriftMeasureSpscQueue *queue, gpointer item);
+
+/* Removes the oldest item and returns it. Returns NULL if the queue
+ * is empty. Consumer only. */
+gpointer drift_measure_spsc_queue_pop(DriftMeasureSpscQueue *queue);
+
+
+G_END_DECLS
+
+
+#endif /* SPSCQUEUE_H */
@@ -0,0 +1,928 @@
+/* Accuracy regression tests for the driftmeasure element.
+ *
+ * Synthetic pulse trains (see benchmarks/pulsegenerator.h) with exactly
+ * known fractional delays, jitter, clock rate errors, clipping and noise
+ * are pushed through the element, which is fed through pads without a
+ * pipeline (see tools/elementharness.h), and the drifts in its CSV output
+ * are compared with the true ones. The tolerances are a few times the largest errors that were
+ * observed when these tests were written, so that changes to the search
+ * and analysis code that make the measurements less accurate are caught.
+ *
+ * The remaining tests cover the edge cases of the search for pulses:
+ * pulses within the first half window, which cannot be measured, pulses
+ * whose peak is the last frame of a buffer, pulses that are too close to
+ * the end of the stream, and pulses that straddle buffer boundaries, which
+ * must produce the same output regardless of the buffer size.
+ *
+ * Finally, settings that must not change the measurements are checked
+ * against the default output: analyzing windows in a separate thread,
+ * analyzing the channels of a window in several threads, and collecting
+ * output rows in batches, and feeding the channels into separate request
+ * pads. The binary output must contain the same values as the CSV output.
+ *
+ * The statistics output mode and the tracking columns are checked against
+ * the true drifts of the measured pulses. */
+
+#include <math.h>
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include "elementharness.h"
+#include "gstdriftmeasure.h"
+#include "pulsegenerator.h"
+
+
+#define NUM_CHANNELS 5
+#define SAMPLE_RATE 48000
+#define DEFAULT_DURATION 10.5
+#define DEFAULT_BUFFER_NUM_FRAMES 1024
+/* Default window-size and pulse-length of the element, in seconds. */
+#define WINDOW_SIZE 0.5
+#define PULSE_LENGTH 0.002
+#define FRAME_PERIOD (1e9 / SAMPLE_RATE)
+
+
+/* Delays of the channels in nanoseconds; channel 0 is the reference.
+ * None of them is a multiple of the frame period. */
+static gdouble const channel_delays[NUM_CHANNELS] = { 0.0, 10300.0, -37770.0, 123456.0, 1234567.8 };
+/* Clock rate errors of the channels in ppm. */
+static gdouble const channel_skews[NUM_CHANNELS] = { 0.0, 100.0, -100.0, 250.0, -20.0 };
+
+
+typedef struct
+{
+	gchar const *name;
+	gchar const *detection_method;
+	gchar const *peak_interpolation;
+	GstAudioFormat format;
+	gdouble amplitude;
+	gdouble noise_level;
+	/* 1.0 means no clipping. */
+	gdouble clip_level;
+	/* Jitter in nanoseconds. */
+	gdouble jitter;
+	gboolean skewed;
+	/* Largest allowed difference between a measured and the true drift,
+	 * in nanoseconds. */
+	gdouble tolerance;
+}
+AccuracyTestCase;
+
+
+static AccuracyTestCase const accuracy_test_cases[] =
+{
+	/* name, detection method, peak interpolation, format, amplitude, noise, clip level, jitter, skewed, tolerance */
+	{ "fractional-delays/peak", "peak", "parabolic", GST_AUDIO_FORMAT_F32LE, 0.8, 0.0, 1.0, 0.0, FALSE, 100.0 },
+	{ "fractional-delays/cross-correlation", "cross-correlation", "parabolic", GST_AUDIO_FORMAT_F32LE, 0.8, 0.0, 1.0, 0.0, FALSE, 100.0 },
+	{ "fractional-delays/matched-filter", "matched-filter", "parabolic", GST_AUDIO_FORMAT_F32LE, 0.8, 0.0, 1.0, 0.0, FALSE, 250.0 },
+	{ "fractional-delays/peak-sinc", "peak", "sinc", GST_AUDIO_FORMAT_F32LE, 0.8, 0.0, 1.0, 0.0, FALSE, 500.0 },
+	/* Without interpolation, drifts are rounded to whole frames. */
+	{ "fractional-delays/peak-no-interpolation", "peak", "none", GST_AUDIO_FORMAT_F32LE, 0.8, 0.0, 1.0, 0.0, FALSE, FRAME_PERIOD / 2.0 + 1.0 },
+	{ "fractional-delays/peak-s16", "peak", "parabolic", GST_AUDIO_FORMAT_S16LE, 0.8, 0.0, 1.0, 0.0, FALSE, 100.0 },
+	{ "fractional-delays/cross-correlation-s16", "cross-correlation", "parabolic", GST_AUDIO_FORMAT_S16LE, 0.8, 0.0, 1.0, 0.0, FALSE, 100.0 },
+	{ "fractional-delays/matched-filter-s16", "matched-filter", "parabolic", GST_AUDIO_FORMAT_S16LE, 0.8, 0.0, 1.0, 0.0, FALSE, 250.0 },
+
+	{ "jitter/peak", "peak", "parabolic", GST_AUDIO_FORMAT_F32LE, 0.8, 0.0, 1.0, 50000.0, FALSE, 100.0 },
+	{ "jitter/cross-correlation", "cross-correlation", "parabolic", GST_AUDIO_FORMAT_F32LE, 0.8, 0.0, 1.0, 50000.0, FALSE, 100.0 },
+	{ "jitter/matched-filter", "matched-filter", "parabolic", GST_AUDIO_FORMAT_F32LE, 0.8, 0.0, 1.0, 50000.0, FALSE, 250.0 },
+
+	{ "skew/peak", "peak", "parabolic", GST_AUDIO_FORMAT_F32LE, 0.8, 0.0, 1.0, 0.0, TRUE, 100.0 },
+	{ "skew/cross-correlation", "cross-correlation", "parabolic", GST_AUDIO_FORMAT_F32LE, 0.8, 0.0, 1.0, 0.0, TRUE, 100.0 },
+	{ "skew/matched-filter", "matched-filter", "parabolic", GST_AUDIO_FORMAT_F32LE, 0.8, 0.0, 1.0, 0.0, TRUE, 250.0 },
+
+	/* A clipped pulse has a flat top, so the peak detection can only
+	 * find its first frame, and interpolation cannot help. */
+	{ "clipping/peak", "peak", "parabolic", GST_AUDIO_FORMAT_F32LE, 1.0, 0.0, 0.7, 0.0, FALSE, FRAME_PERIOD },
+	{ "clipping/cross-correlation", "cross-correlation", "parabolic", GST_AUDIO_FORMAT_F32LE, 1.0, 0.0, 0.7, 0.0, FALSE, 100.0 },
+	{ "clipping/matched-filter", "matched-filter", "parabolic", GST_AUDIO_FORMAT_F32LE, 1.0, 0.0, 0.7, 0.0, FALSE, 500.0 },
+
+	{ "noise/peak", "peak", "parabolic", GST_AUDIO_FORMAT_F32LE, 0.8, 0.01, 1.0, 0.0, FALSE, 3.0 * FRAME_PERIOD },
+	{ "noise/cross-correlation", "cross-correlation", "parabolic", GST_AUDIO_FORMAT_F32LE, 0.8, 0.01, 1.0, 0.0, FALSE, 15000.0 },
+	{ "noise/matched-filter", "matched-filter", "parabolic", GST_AUDIO_FORMAT_F32LE, 0.8, 0.01, 1.0, 0.0, FALSE, 3000.0 }
+};
+
+
+static AccuracyTestCase const * get_test_case(gchar const *name)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(accuracy_test_cases); ++i)
+	{
+		if (strcmp(accuracy_test_cases[i].name, name) == 0)
+			return &(accuracy_test_cases[i]);
+	}
+
+	g_assert_not_reached();
+	return NULL;
+}
+
+
+typedef struct
+{
+	AccuracyTestCase const *test_case;
+	gdouble duration;
+
+	DriftMeasurePulseGenerator *generator;
+	guint8 *frames;
+	gsize num_frames;
+	guint bytes_per_frame;
+}
+TestInput;
+
+
+static void test_input_init(TestInput *input, AccuracyTestCase const *test_case, gdouble duration, gdouble first_pulse_time)
+{
+	DriftMeasurePulseGeneratorSettings settings;
+
+	drift_measure_pulse_generator_settings_init(&settings);
+	settings.num_channels = NUM_CHANNELS;
+	settings.sample_rate = SAMPLE_RATE;
+	settings.first_pulse_time = first_pulse_time;
+	settings.pulse_length = PULSE_LENGTH;
+	settings.amplitude = test_case->amplitude;
+	/* The matched filter expects the sine bursts of its default template. */
+	settings.windowed = (strcmp(test_case->detection_method, "matched-filter") != 0);
+	settings.noise_level = test_case->noise_level;
+	settings.clip_level = test_case->clip_level;
+	settings.delays = channel_delays;
+	settings.skews = test_case->skewed ? channel_skews : NULL;
+	settings.jitter = test_case->jitter;
+	settings.seed = 1;
+
+	input->test_case = test_case;
+	input->duration = duration;
+	input->generator = drift_measure_pulse_generator_new(&settings);
+	input->num_frames = (gsize)(duration * SAMPLE_RATE);
+
+	if (test_case->format == GST_AUDIO_FORMAT_S16LE)
+	{
+		input->bytes_per_frame = NUM_CHANNELS * sizeof(gint16);
+		input->frames = g_malloc(input->num_frames * input->bytes_per_frame);
+		drift_measure_pulse_generator_generate_s16(input->generator, (gint16 *)(input->frames), input->num_frames);
+	}
+	else
+	{
+		input->bytes_per_frame = NUM_CHANNELS * sizeof(gfloat);
+		input->frames = g_malloc(input->num_frames * input->bytes_per_frame);
+		drift_measure_pulse_generator_generate_f32(input->generator, (gfloat *)(input->frames), input->num_frames);
+	}
+}
+
+
+static void test_input_clear(TestInput *input)
+{
+	drift_measure_pulse_generator_free(input->generator);
+	g_free(input->frames);
+}
+
+
+static void append_output(guint8 const *data, gsize size, gpointer user_data)
+{
+	GString *output = user_data;
+
+	g_string_append_len(output, (gchar const *)data, size);
+}
+
+
+/* Pushes the signal through a new element, in buffers of buffer_num_frames
+ * frames, and returns the CSV output. property_settings are "name=value"
+ * strings that are applied after the settings of the test case. If
+ * output_caps is not NULL, the output is negotiated with these caps instead
+ * of CSV. If element_out is not NULL, it is set to a reference to the
+ * element, which is back in the NULL state then, so its read-only
+ * properties can be checked. */
+static GString * run_element_with_properties(TestInput const *input, gsize buffer_num_frames, gchar **property_settings, GstCaps *output_caps, GstElement **element_out)
+{
+	AccuracyTestCase const *test_case = input->test_case;
+	GString *output = g_string_new(NULL);
+	GstElement *element;
+	DriftMeasureElementHarness *harness;
+	GstAudioInfo audio_info;
+	GError *error = NULL;
+
+	element = GST_ELEMENT(gst_object_ref_sink(g_object_new(GST_TYPE_DRIFT_MEASURE, NULL)));
+	gst_util_set_object_arg(G_OBJECT(element), "detection-method", test_case->detection_method);
+	gst_util_set_object_arg(G_OBJECT(element), "peak-interpolation", test_case->peak_interpolation);
+	drift_measure_element_harness_set_properties(element, property_settings, &error);
+	g_assert_no_error(error);
+
+	gst_audio_info_init(&audio_info);
+	gst_audio_info_set_format(&audio_info, test_case->format, SAMPLE_RATE, NUM_CHANNELS, NULL);
+	if (output_caps != NULL)
+		harness = drift_measure_element_harness_new_with_output_caps(element, "accuracy-test", &audio_info, 0, output_caps, append_output, output);
+	else
+		harness = drift_measure_element_harness_new(element, "accuracy-test", &audio_info, 0, append_output, output);
+
+	drift_measure_element_harness_push_frames(harness, input->frames, input->num_frames, buffer_num_frames);
+	g_assert_cmpint(drift_measure_element_harness_finish(harness), ==, GST_FLOW_OK);
+
+	drift_measure_element_harness_free(harness);
+
+	if (element_out != NULL)
+		*element_out = element;
+	else
+		gst_object_unref(GST_OBJECT(element));
+
+	return output;
+}
+
+
+static GString * run_element(TestInput const *input, gsize buffer_num_frames)
+{
+	return run_element_with_properties(input, buffer_num_frames, NULL, NULL, NULL);
+}
+
+
+/* Returns the index of the reference channel pulse that is closest to
+ * the given timestamp. */
+static guint64 get_pulse_index(TestInput const *input, gint64 timestamp)
+{
+	gdouble time = timestamp * 1e-9;
+	guint64 pulse_index = 0;
+
+	while (fabs(drift_measure_pulse_generator_get_pulse_time(input->generator, 0, pulse_index + 1) - time) < fabs(drift_measure_pulse_generator_get_pulse_time(input->generator, 0, pulse_index) - time))
+		++pulse_index;
+
+	return pulse_index;
+}
+
+
+/* Returns the true drift of a channel at a pulse, in nanoseconds. */
+static gdouble get_true_drift(TestInput const *input, guint channel, guint64 pulse_index)
+{
+	return (drift_measure_pulse_generator_get_pulse_time(input->generator, channel, pulse_index) - drift_measure_pulse_generator_get_pulse_time(input->generator, 0, pulse_index)) * 1e9;
+}
+
+
+/* Returns how fast the true drift of a channel changes, in ppm. Without
+ * jitter, the drift changes linearly with the clock rate error. */
+static gdouble get_true_drift_slope(TestInput const *input, guint channel)
+{
+	gdouble interval = drift_measure_pulse_generator_get_pulse_time(input->generator, 0, 1) - drift_measure_pulse_generator_get_pulse_time(input->generator, 0, 0);
+	return (get_true_drift(input, channel, 1) - get_true_drift(input, channel, 0)) / (interval * 1e9) * 1e6;
+}
+
+
+/* Checks that each CSV row has a drift for every channel, and that all
+ * of them are within the tolerance of the test case. Stores the index of
+ * the pulse of each row in pulse_indices. */
+static void check_rows(TestInput const *input, GString const *output, GArray *pulse_indices)
+{
+	gchar **rows = g_strsplit(output->str, "\n", -1);
+	gdouble max_error = 0.0;
+	guint row;
+
+	for (row = 0; rows[row] != NULL; ++row)
+	{
+		gchar **columns;
+		guint64 pulse_index;
+		guint channel;
+
+		if (rows[row][0] == '\0')
+			continue;
+
+		columns = g_strsplit(rows[row], ",", -1);
+		g_assert_cmpuint(g_strv_length(columns), ==, NUM_CHANNELS);
+
+		pulse_index = get_pulse_index(input, g_ascii_strtoll(columns[0], NULL, 10));
+		g_array_append_val(pulse_indices, pulse_index);
+
+		for (channel = 1; channel < NUM_CHANNELS; ++channel)
+		{
+			gdouble true_drift = get_true_drift(input, channel, pulse_index);
+			gdouble error;
+
+			/* An empty column means that no pulse was found. */
+			g_assert_cmpstr(columns[channel], !=, "");
+
+			error = fabs(g_ascii_strtoll(columns[channel], NULL, 10) - true_drift);
+			if (error > input->test_case->tolerance)
+				g_test_message("pulse %" G_GUINT64_FORMAT " channel %u: measured %s ns, true drift %.1f ns", pulse_index, channel, columns[channel], true_drift);
+			max_error = MAX(max_error, error);
+		}
+
+		g_strfreev(columns);
+	}
+
+	g_strfreev(rows);
+
+	g_assert_cmpfloat(max_error, <=, input->test_case->tolerance);
+}
+
+
+/* Checks the header of binary output, and converts its records into the
+ * CSV rows that contain the same values. */
+static GString * convert_binary_output(GString const *binary_output)
+{
+	/* Magic bytes, format version, number of channels,
+	 * reference channel, and sample rate. */
+	static gsize const header_size = 8 + 4 * 4;
+	static gsize const record_size = NUM_CHANNELS * 8;
+	guint8 const *data = (guint8 const *)(binary_output->str);
+	GString *csv_output = g_string_new(NULL);
+	gsize offset;
+
+	g_assert_cmpuint(binary_output->len, >=, header_size);
+	g_assert_cmpint(memcmp(data, "DRIFTMSR", 8), ==, 0);
+	g_assert_cmpuint(GST_READ_UINT32_LE(data + 8), ==, 1);
+	g_assert_cmpuint(GST_READ_UINT32_LE(data + 12), ==, NUM_CHANNELS);
+	g_assert_cmpuint(GST_READ_UINT32_LE(data + 16), ==, 0);
+	g_assert_cmpuint(GST_READ_UINT32_LE(data + 20), ==, SAMPLE_RATE);
+	g_assert_cmpuint((binary_output->len - header_size) % record_size, ==, 0);
+
+	for (offset = header_size; offset < binary_output->len; offset += record_size)
+	{
+		guint channel;
+
+		g_string_append_printf(csv_output, "%" G_GUINT64_FORMAT, (guint64)GST_READ_UINT64_LE(data + offset));
+
+		for (channel = 1; channel < NUM_CHANNELS; ++channel)
+		{
+			gint64 drift = (gint64)GST_READ_UINT64_LE(data + offset + channel * 8);
+
+			/* Drifts without a value are empty CSV columns. */
+			g_string_append_c(csv_output, ',');
+			if (drift != G_MININT64)
+				g_string_append_printf(csv_output, "%" G_GINT64_FORMAT, drift);
+		}
+
+		g_string_append_c(csv_output, '\n');
+	}
+
+	return csv_output;
+}
+
+
+/* Checks that the rows of output are rows of reference_output, in the same
+ * order, and returns how many rows of reference_output are missing. */
+static guint check_row_subsequence(GString const *output, GString const *reference_output)
+{
+	gchar **rows = g_strsplit(output->str, "\n", -1);
+	gchar **reference_rows = g_strsplit(reference_output->str, "\n", -1);
+	guint row, reference_row = 0, num_missing_rows = 0;
+
+	for (row = 0; rows[row] != NULL; ++row)
+	{
+		if (rows[row][0] == '\0')
+			continue;
+
+		while ((reference_rows[reference_row] != NULL) && (strcmp(reference_rows[reference_row], rows[row]) != 0))
+		{
+			++reference_row;
+			++num_missing_rows;
+		}
+
+		g_assert_nonnull(reference_rows[reference_row]);
+		++reference_row;
+	}
+
+	for (; reference_rows[reference_row] != NULL; ++reference_row)
+	{
+		if (reference_rows[reference_row][0] != '\0')
+			++num_missing_rows;
+	}
+
+	g_strfreev(reference_rows);
+	g_strfreev(rows);
+
+	return num_missing_rows;
+}
+
+
+/* Returns the number of pulses that have half a window before and after
+ * them in the reference channel, so that they must be measured. */
+static guint get_num_measurable_pulses(TestInput const *input)
+{
+	guint64 pulse_index;
+	guint num_pulses = 0;
+
+	for (pulse_index = 0; ; ++pulse_index)
+	{
+		gdouble time = drift_measure_pulse_generator_get_pulse_time(input->generator, 0, pulse_index);
+		if ((time + WINDOW_SIZE / 2.0) > input->duration)
+			break;
+		if (time >= WINDOW_SIZE / 2.0)
+			++num_pulses;
+	}
+
+	return num_pulses;
+}
+
+
+static void test_accuracy(gconstpointer data)
+{
+	TestInput input;
+	GString *output;
+	GArray *pulse_indices = g_array_new(FALSE, FALSE, sizeof(guint64));
+
+	test_input_init(&input, data, DEFAULT_DURATION, 1.0);
+	output = run_element(&input, DEFAULT_BUFFER_NUM_FRAMES);
+
+	check_rows(&input, output, pulse_indices);
+	g_assert_cmpuint(pulse_indices->len, ==, get_num_measurable_pulses(&input));
+
+	g_array_free(pulse_indices, TRUE);
+	g_string_free(output, TRUE);
+	test_input_clear(&input);
+}
+
+
+static void test_peak_within_first_half_window(void)
+{
+	TestInput input;
+	GString *output;
+	GArray *pulse_indices = g_array_new(FALSE, FALSE, sizeof(guint64));
+
+	/* The first pulse comes 100 ms after the first frame, which is less
+	 * than half a window, so it cannot be measured. All later ones can. */
+	test_input_init(&input, &(accuracy_test_cases[0]), 4.5, 0.1);
+	output = run_element(&input, DEFAULT_BUFFER_NUM_FRAMES);
+
+	check_rows(&input, output, pulse_indices);
+	g_assert_cmpuint(pulse_indices->len, ==, 4);
+	g_assert_cmpuint(g_array_index(pulse_indices, guint64, 0), ==, 1);
+
+	g_array_free(pulse_indices, TRUE);
+	g_string_free(output, TRUE);
+	test_input_clear(&input);
+}
+
+
+static void test_peak_at_end_of_buffer(gconstpointer data)
+{
+	TestInput input;
+	GString *output, *reference_output;
+	GArray *pulse_indices = g_array_new(FALSE, FALSE, sizeof(guint64));
+
+	/* Every reference pulse has its peak in the last frame of a one second
+	 * buffer, so the search sees a peak right at the end of the history,
+	 * and has to wait for the rest of the pulse. */
+	test_input_init(&input, data, DEFAULT_DURATION, (SAMPLE_RATE - 1.0) / SAMPLE_RATE - PULSE_LENGTH / 2.0);
+	output = run_element(&input, SAMPLE_RATE);
+	reference_output = run_element(&input, DEFAULT_BUFFER_NUM_FRAMES);
+
+	check_rows(&input, output, pulse_indices);
+	g_assert_cmpuint(pulse_indices->len, ==, get_num_measurable_pulses(&input));
+	g_assert_cmpstr(output->str, ==, reference_output->str);
+
+	g_array_free(pulse_indices, TRUE);
+	g_string_free(reference_output, TRUE);
+	g_string_free(output, TRUE);
+	test_input_clear(&input);
+}
+
+
+static void test_pulse_at_end_of_stream(void)
+{
+	TestInput input;
+	GString *output;
+	GArray *pulse_indices = g_array_new(FALSE, FALSE, sizeof(guint64));
+
+	/* The stream ends 200 ms after the last pulse, which is less than half
+	 * a window, so that pulse cannot be measured, even after EOS. */
+	test_input_init(&input, &(accuracy_test_cases[0]), 4.2, 1.0);
+	output = run_element(&input, DEFAULT_BUFFER_NUM_FRAMES);
+
+	check_rows(&input, output, pulse_indices);
+	g_assert_cmpuint(pulse_indices->len, ==, 3);
+
+	g_array_free(pulse_indices, TRUE);
+	g_string_free(output, TRUE);
+	test_input_clear(&input);
+}
+
+
+static void test_buffer_sizes(gconstpointer data)
+{
+	static gsize const buffer_sizes[] = { 1, 7, 333, 4801 };
+	TestInput input;
+	GString *reference_output;
+	GArray *pulse_indices = g_array_new(FALSE, FALSE, sizeof(guint64));
+	guint i;
+
+	/* Pulses straddle buffer boundaries in all sorts of ways. The output
+	 * must be the same as with buffers that contain whole pulses. */
+	test_input_init(&input, data, 3.5, 1.0);
+	reference_output = run_element(&input, 65536);
+
+	check_rows(&input, reference_output, pulse_indices);
+	g_assert_cmpuint(pulse_indices->len, ==, get_num_measurable_pulses(&input));
+
+	for (i = 0; i < G_N_ELEMENTS(buffer_sizes); ++i)
+	{
+		GString *output = run_element(&input, buffer_sizes[i]);
+		g_assert_cmpstr(output->str, ==, reference_output->str);
+		g_string_free(output, TRUE);
+	}
+
+	g_array_free(pulse_indices, TRUE);
+	g_string_free(reference_output, TRUE);
+	test_input_clear(&input);
+}
+
+
+static void test_analysis_queue(gconstpointer data)
+{
+	/* Windows are analyzed in a separate thread, and the rows are batched,
+	 * so rows are added to a batch while an earlier batch is pushed. */
+	static gchar *block_settings[] = { "analysis-queue-size=2", "analysis-queue-policy=block", "output-batch-rows=3", "output-batch-latency=1000000", NULL };
+	/* The queue is large enough for all windows, and the signal arrives
+	 * in one buffer, so windows are still queued at EOS. */
+	static gchar *eos_drain_settings[] = { "analysis-queue-size=64", "analysis-queue-policy=block", "output-batch-rows=3", NULL };
+	static gchar *drop_settings[] = { "analysis-queue-size=1", "analysis-queue-policy=drop", "output-batch-rows=3", NULL };
+	TestInput input;
+	GString *output, *reference_output;
+	GArray *pulse_indices = g_array_new(FALSE, FALSE, sizeof(guint64));
+	GstElement *element;
+	guint num_dropped_windows;
+
+	test_input_init(&input, data, DEFAULT_DURATION, 1.0);
+	reference_output = run_element(&input, DEFAULT_BUFFER_NUM_FRAMES);
+
+	check_rows(&input, reference_output, pulse_indices);
+	g_assert_cmpuint(pulse_indices->len, ==, get_num_measurable_pulses(&input));
+
+	output = run_element_with_properties(&input, DEFAULT_BUFFER_NUM_FRAMES, block_settings, NULL, NULL);
+	g_assert_cmpstr(output->str, ==, reference_output->str);
+	g_string_free(output, TRUE);
+
+	output = run_element_with_properties(&input, input.num_frames, eos_drain_settings, NULL, NULL);
+	g_assert_cmpstr(output->str, ==, reference_output->str);
+	g_string_free(output, TRUE);
+
+	/* Whether windows are dropped depends on the timing of the threads.
+	 * Either way, the remaining rows must be the same as without the
+	 * analysis thread, and each dropped window is one missing row. */
+	output = run_element_with_properties(&input, input.num_frames, drop_settings, NULL, &element);
+	g_object_get(G_OBJECT(element), "num-dropped-windows", &num_dropped_windows, NULL);
+	g_assert_cmpuint(check_row_subsequence(output, reference_output), ==, num_dropped_windows);
+	gst_object_unref(GST_OBJECT(element));
+	g_string_free(output, TRUE);
+
+	g_array_free(pulse_indices, TRUE);
+	g_string_free(reference_output, TRUE);
+	test_input_clear(&input);
+}
+
+
+static void test_analysis_threads(gconstpointer data)
+{
+	/* The 4 non-reference channels are split among the threads evenly,
+	 * unevenly, and one per thread. The analysis thread is included, since
+	 * the channel threads then work for its detector instead. */
+	static gchar *two_threads_settings[] = { "n-threads=2", NULL };
+	static gchar *three_threads_settings[] = { "n-threads=3", NULL };
+	static gchar *four_threads_settings[] = { "n-threads=4", NULL };
+	static gchar *analysis_queue_settings[] = { "n-threads=3", "analysis-queue-size=2", NULL };
+	static gchar **property_settings[] = { two_threads_settings, three_threads_settings, four_threads_settings, analysis_queue_settings };
+	TestInput input;
+	GString *reference_output;
+	GArray *pulse_indices = g_array_new(FALSE, FALSE, sizeof(guint64));
+	guint i;
+
+	test_input_init(&input, data, DEFAULT_DURATION, 1.0);
+	reference_output = run_element(&input, DEFAULT_BUFFER_NUM_FRAMES);
+
+	check_rows(&input, reference_output, pulse_indices);
+	g_assert_cmpuint(pulse_indices->len, ==, get_num_measurable_pulses(&input));
+
+	/* Each channel is analyzed the same way in any thread,
+	 * so the drifts of all channels must be identical. */
+	for (i = 0; i < G_N_ELEMENTS(property_settings); ++i)
+	{
+		GString *output = run_element_with_properties(&input, DEFAULT_BUFFER_NUM_FRAMES, property_settings[i], NULL, NULL);
+		g_assert_cmpstr(output->str, ==, reference_output->str);
+		g_string_free(output, TRUE);
+	}
+
+	g_array_free(pulse_indices, TRUE);
+	g_string_free(reference_output, TRUE);
+	test_input_clear(&input);
+}
+
+
+static void test_output_batches(gconstpointer data)
+{
+	static gchar *rows_settings[] = { "output-batch-rows=4", NULL };
+	static gchar *size_settings[] = { "output-batch-rows=1024", "output-batch-size=100", NULL };
+	/* Rows are pushed by the latency limit only; the first one
+	 * once each row is due right away, the second one at EOS. */
+	static gchar *short_latency_settings[] = { "output-batch-rows=1024", "output-batch-latency=1", NULL };
+	static gchar *long_latency_settings[] = { "output-batch-rows=1024", "output-batch-latency=3600000000000", NULL };
+	static gchar *rows_and_latency_settings[] = { "output-batch-rows=4", "output-batch-latency=1000000", NULL };
+	static gchar **property_settings[] = { rows_settings, size_settings, short_latency_settings, long_latency_settings, rows_and_latency_settings };
+	TestInput input;
+	GString *reference_output;
+	guint i;
+
+	test_input_init(&input, data, DEFAULT_DURATION, 1.0);
+	reference_output = run_element(&input, DEFAULT_BUFFER_NUM_FRAMES);
+
+	/* However the rows are split into buffers, the
+	 * concatenated output must be the same. */
+	for (i = 0; i < G_N_ELEMENTS(property_settings); ++i)
+	{
+		GString *output = run_element_with_properties(&input, DEFAULT_BUFFER_NUM_FRAMES, property_settings[i], NULL, NULL);
+		g_assert_cmpstr(output->str, ==, reference_output->str);
+		g_string_free(output, TRUE);
+	}
+
+	g_string_free(reference_output, TRUE);
+	test_input_clear(&input);
+}
+
+
+static void test_binary_output(gconstpointer data)
+{
+	static gchar *batch_settings[] = { "output-batch-rows=3", NULL };
+	static gchar **property_settings[] = { NULL, batch_settings };
+	TestInput input;
+	GString *reference_output;
+	GstCaps *binary_caps = gst_caps_new_empty_simple("application/x-driftmeasure");
+	guint i;
+
+	test_input_init(&input, data, DEFAULT_DURATION, 1.0);
+	reference_output = run_element(&input, DEFAULT_BUFFER_NUM_FRAMES);
+
+	/* Records must not be split or misaligned by the batching either. */
+	for (i = 0; i < G_N_ELEMENTS(property_settings); ++i)
+	{
+		GString *binary_output = run_element_with_properties(&input, DEFAULT_BUFFER_NUM_FRAMES, property_settings[i], binary_caps, NULL);
+		GString *output = convert_binary_output(binary_output);
+
+		g_assert_cmpstr(output->str, ==, reference_output->str);
+
+		g_string_free(output, TRUE);
+		g_string_free(binary_output, TRUE);
+	}
+
+	gst_caps_unref(binary_caps);
+	g_string_free(reference_output, TRUE);
+	test_input_clear(&input);
+}
+
+
+static void test_statistics_output(gconstpointer data)
+{
+	static gchar *statistics_settings[] = { "output-mode=statistics", "statistics-pulses=4", NULL };
+	/* With the default statistics-window, the slope is fitted over all
+	 * measurements so far, which span at least 3 seconds. Their errors
+	 * are within the 100 ns tolerance of the test case, so the slope is
+	 * off by less than 0.1 ppm. */
+	static gdouble const slope_tolerance = 0.5;
+	TestInput input;
+	GString *measurement_output, *output;
+	GArray *pulse_indices = g_array_new(FALSE, FALSE, sizeof(guint64));
+	gchar **rows;
+	guint row, num_measurements = 0;
+
+	test_input_init(&input, data, DEFAULT_DURATION, 1.0);
+	measurement_output = run_element(&input, DEFAULT_BUFFER_NUM_FRAMES);
+	check_rows(&input, measurement_output, pulse_indices);
+
+	/* An interval ends after 4 measurements, and
+	 * at EOS with the remaining measurements. */
+	output = run_element_with_properties(&input, DEFAULT_BUFFER_NUM_FRAMES, statistics_settings, NULL, NULL);
+	rows = g_strsplit(output->str, "\n", -1);
+
+	for (row = 0; rows[row] != NULL; ++row)
+	{
+		gchar **columns;
+		guint count, channel, i;
+
+		if (rows[row][0] == '\0')
+			continue;
+
+		columns = g_strsplit(rows[row], ",", -1);
+		g_assert_cmpuint(g_strv_length(columns), ==, 1 + (NUM_CHANNELS - 1) * 7);
+
+		count = MIN(4, pulse_indices->len - num_measurements);
+		g_assert_cmpuint(count, >, 0);
+
+		/* The timestamp is the one of the last measurement in the interval. */
+		g_assert_cmpuint(get_pulse_index(&input, g_ascii_strtoll(columns[0], NULL, 10)), ==, g_array_index(pulse_indices, guint64, num_measurements + count - 1));
+
+		for (channel = 1; channel < NUM_CHANNELS; ++channel)
+		{
+			gchar **channel_columns = columns + 1 + (channel - 1) * 7;
+			gdouble true_mean = 0.0;
+
+			for (i = 0; i < count; ++i)
+				true_mean += get_true_drift(&input, channel, g_array_index(pulse_indices, guint64, num_measurements + i));
+			true_mean /= count;
+
+			/* count, mean, standard deviation, minimum,
+			 * maximum, moving average, and slope */
+			g_assert_cmpuint(g_ascii_strtoull(channel_columns[0], NULL, 10), ==, count);
+			g_assert_cmpfloat(fabs(g_ascii_strtoll(channel_columns[1], NULL, 10) - true_mean), <=, input.test_case->tolerance);
+
+			/* There is no slope before there are two measurements. */
+			if ((num_measurements + count) >= 2)
+			{
+				g_assert_cmpstr(channel_columns[6], !=, "");
+				g_assert_cmpfloat(fabs(g_ascii_strtod(channel_columns[6], NULL) - get_true_drift_slope(&input, channel)), <=, slope_tolerance);
+			}
+		}
+
+		num_measurements += count;
+		g_strfreev(columns);
+	}
+
+	g_assert_cmpuint(num_measurements, ==, pulse_indices->len);
+
+	g_strfreev(rows);
+	g_array_free(pulse_indices, TRUE);
+	g_string_free(output, TRUE);
+	g_string_free(measurement_output, TRUE);
+	test_input_clear(&input);
+}
+
+
+static void test_tracking_output(gconstpointer data)
+{
+	/* The measurement noise matches the accuracy of the
+	 * measurements, so the offsets are not smoothed much. */
+	static gchar *tracking_settings[] = { "output-tracking=true", "tracking-measurement-noise=100", NULL };
+	/* After two measurements that are within the 100 ns tolerance of the
+	 * test case and 1 second apart, the rate is off by at most 0.2 ppm. */
+	static gdouble const rate_tolerance = 1.0;
+	TestInput input;
+	GString *measurement_output, *output;
+	gchar **rows, **measurement_rows;
+	guint row, measurement_row = 0;
+
+	test_input_init(&input, data, DEFAULT_DURATION, 1.0);
+	measurement_output = run_element(&input, DEFAULT_BUFFER_NUM_FRAMES);
+	output = run_element_with_properties(&input, DEFAULT_BUFFER_NUM_FRAMES, tracking_settings, NULL, NULL);
+
+	rows = g_strsplit(output->str, "\n", -1);
+	measurement_rows = g_strsplit(measurement_output->str, "\n", -1);
+
+	for (row = 0; rows[row] != NULL; ++row)
+	{
+		gchar **columns;
+		guint64 pulse_index;
+		guint channel;
+
+		if (rows[row][0] == '\0')
+			continue;
+
+		/* The measured drifts come first, and are the same as without
+		 * tracking. Then there are 3 tracking columns per channel. */
+		g_assert_nonnull(measurement_rows[measurement_row]);
+		g_assert_true(g_str_has_prefix(rows[row], measurement_rows[measurement_row]));
+		g_assert_cmpint(rows[row][strlen(measurement_rows[measurement_row])], ==, ',');
+
+		columns = g_strsplit(rows[row], ",", -1);
+		g_assert_cmpuint(g_strv_length(columns), ==, NUM_CHANNELS + (NUM_CHANNELS - 1) * 3);
+
+		pulse_index = get_pulse_index(&input, g_ascii_strtoll(columns[0], NULL, 10));
+
+		for (channel = 1; channel < NUM_CHANNELS; ++channel)
+		{
+			gchar **tracking_columns = columns + NUM_CHANNELS + (channel - 1) * 3;
+
+			/* offset, clock rate error, and its standard deviation */
+			g_assert_cmpstr(tracking_columns[0], !=, "");
+			g_assert_cmpfloat(fabs(g_ascii_strtoll(tracking_columns[0], NULL, 10) - get_true_drift(&input, channel, pulse_index)), <=, 2.0 * input.test_case->tolerance);
+
+			/* A single measurement says nothing about the rate,
+			 * which its standard deviation has to reflect. */
+			if (measurement_row == 0)
+			{
+				g_assert_cmpfloat(g_ascii_strtod(tracking_columns[2], NULL), >, rate_tolerance);
+				continue;
+			}
+
+			g_assert_cmpfloat(fabs(g_ascii_strtod(tracking_columns[1], NULL) - get_true_drift_slope(&input, channel)), <=, rate_tolerance);
+			g_assert_cmpfloat(g_ascii_strtod(tracking_columns[2], NULL), <=, rate_tolerance);
+		}
+
+		/* The measurement rows have no empty lines in between. */
+		++measurement_row;
+		g_strfreev(columns);
+	}
+
+	g_assert_cmpuint(measurement_row, ==, get_num_measurable_pulses(&input));
+
+	g_strfreev(measurement_rows);
+	g_strfreev(rows);
+	g_string_free(output, TRUE);
+	g_string_free(measurement_output, TRUE);
+	test_input_clear(&input);
+}
+
+
+static void test_request_pads(gconstpointer data)
+{
+	AccuracyTestCase const *test_case = data;
+	TestInput input;
+	GString *reference_output, *output = g_string_new(NULL);
+	GstElement *element;
+	DriftMeasureElementHarness *harness;
+	GstAudioInfo audio_infos[2];
+	guint8 *reference_frames, *measured_frames;
+	gsize sample_size, measured_frame_size, frame;
+
+	test_input_init(&input, test_case, DEFAULT_DURATION, 1.0);
+	reference_output = run_element(&input, DEFAULT_BUFFER_NUM_FRAMES);
+
+	/* sink_0 gets the reference channel, and sink_1 the other channels,
+	 * so the combined frames have the same channels in the same order. */
+	sample_size = input.bytes_per_frame / NUM_CHANNELS;
+	measured_frame_size = (NUM_CHANNELS - 1) * sample_size;
+	reference_frames = g_malloc(input.num_frames * sample_size);
+	measured_frames = g_malloc(input.num_frames * measured_frame_size);
+
+	for (frame = 0; frame < input.num_frames; ++frame)
+	{
+		guint8 const *source = input.frames + frame * input.bytes_per_frame;
+		memcpy(reference_frames + frame * sample_size, source, sample_size);
+		memcpy(measured_frames + frame * measured_frame_size, source + sample_size, measured_frame_size);
+	}
+
+	element = GST_ELEMENT(gst_object_ref_sink(g_object_new(GST_TYPE_DRIFT_MEASURE, NULL)));
+	gst_util_set_object_arg(G_OBJECT(element), "detection-method", test_case->detection_method);
+	gst_util_set_object_arg(G_OBJECT(element), "peak-interpolation", test_case->peak_interpolation);
+
+	gst_audio_info_init(&(audio_infos[0]));
+	gst_audio_info_set_format(&(audio_infos[0]), test_case->format, SAMPLE_RATE, 1, NULL);
+	gst_audio_info_init(&(audio_infos[1]));
+	gst_audio_info_set_format(&(audio_infos[1]), test_case->format, SAMPLE_RATE, NUM_CHANNELS - 1, NULL);
+	harness = drift_measure_element_harness_new_for_request_pads(element, "accuracy-test", audio_infos, 2, 0, append_output, output);
+
+	/* The request pads take turns, with one buffer each. */
+	for (frame = 0; frame < input.num_frames; frame += DEFAULT_BUFFER_NUM_FRAMES)
+	{
+		gsize num_frames = MIN(DEFAULT_BUFFER_NUM_FRAMES, input.num_frames - frame);
+
+		drift_measure_element_harness_push_input_frames(harness, 0, reference_frames + frame * sample_size, num_frames, num_frames);
+		drift_measure_element_harness_push_input_frames(harness, 1, measured_frames + frame * measured_frame_size, num_frames, num_frames);
+	}
+
+	g_assert_cmpint(drift_measure_element_harness_finish(harness), ==, GST_FLOW_OK);
+
+	drift_measure_element_harness_free(harness);
+	gst_object_unref(GST_OBJECT(element));
+
+	g_assert_cmpstr(output->str, ==, reference_output->str);
+
+	g_free(measured_frames);
+	g_free(reference_frames);
+	g_string_free(output, TRUE);
+	g_string_free(reference_output, TRUE);
+	test_input_clear(&input);
+}
+
+
+int main(int argc, char *argv[])
+{
+	guint i;
+
+	g_test_init(&argc, &argv, NULL);
+	gst_init(&argc, &argv);
+
+	for (i = 0; i < G_N_ELEMENTS(accuracy_test_cases); ++i)
+	{
+		gchar *path = g_strdup_printf("/driftmeasure/accuracy/%s", accuracy_test_cases[i].name);
+		g_test_add_data_func(path, &(accuracy_test_cases[i]), test_accuracy);
+		g_free(path);
+	}
+
+	/* The first three test cases are the fractional delay ones
+	 * of the three detection methods. */
+	for (i = 0; i < 3; ++i)
+	{
+		gchar *path;
+
+		path = g_strdup_printf("/driftmeasure/edge-cases/peak-at-end-of-buffer/%s", accuracy_test_cases[i].detection_method);
+		g_test_add_data_func(path, &(accuracy_test_cases[i]), test_peak_at_end_of_buffer);
+		g_free(path);
+
+		path = g_strdup_printf("/driftmeasure/edge-cases/buffer-sizes/%s", accuracy_test_cases[i].detection_method);
+		g_test_add_data_func(path, &(accuracy_test_cases[i]), test_buffer_sizes);
+		g_free(path);
+
+		path = g_strdup_printf("/driftmeasure/threading/analysis-queue/%s", accuracy_test_cases[i].detection_method);
+		g_test_add_data_func(path, &(accuracy_test_cases[i]), test_analysis_queue);
+		g_free(path);
+
+		path = g_strdup_printf("/driftmeasure/threading/analysis-threads/%s", accuracy_test_cases[i].detection_method);
+		g_test_add_data_func(path, &(accuracy_test_cases[i]), test_analysis_threads);
+		g_free(path);
+
+		path = g_strdup_printf("/driftmeasure/request-pads/%s", accuracy_test_cases[i].detection_method);
+		g_test_add_data_func(path, &(accuracy_test_cases[i]), test_request_pads);
+		g_free(path);
+	}
+
+	g_test_add_data_func("/driftmeasure/output/batches", &(accuracy_test_cases[0]), test_output_batches);
+	g_test_add_data_func("/driftmeasure/output/binary", &(accuracy_test_cases[0]), test_binary_output);
+	g_test_add_data_func("/driftmeasure/output/statistics", get_test_case("skew/peak"), test_statistics_output);
+	g_test_add_data_func("/driftmeasure/output/tracking", get_test_case("skew/peak"), test_tracking_output);
+
+	g_test_add_func("/driftmeasure/edge-cases/peak-within-first-half-window", test_peak_within_first_half_window);
+	g_test_add_func("/driftmeasure/edge-cases/pulse-at-end-of-stream", test_pulse_at_end_of_stream);
+
+	return g_test_run();
+}
@@ -0,0 +1,379 @@
+/* Compares each set of vectorized peak search kernels that this CPU
+ * supports (not just the one that drift_measure_peak_kernels_get_optimized()
+ * picks) with the scalar reference kernels. Both must produce exactly the
+ * same (value, index) results, including the tie-breaking rule, for any
+ * number of channels, for data that does not start at an aligned address,
+ * and for frames that are passed in several runs.
+ *
+ * The samples are taken from a small set of levels, so that most channels
+ * contain several samples with the largest value. Kernel sets that the CPU
+ * does not support are skipped. */
+
+#include <string.h>
+#include <glib.h>
+#include "peakkernels.h"
+
+
+#define MAX_CHANNELS 17
+#define MAX_FRAMES 1000
+/* Number of extra samples in front of the data, so that it
+ * can start at addresses that are not aligned to a vector. */
+#define MAX_START_OFFSET 7
+/* Samples are multiples of 1/NUM_LEVELS of full scale. */
+#define NUM_LEVELS 8
+
+
+typedef struct
+{
+	DriftMeasureSampleFormat format;
+	gsize sample_size;
+}
+PeakKernelsTestFormat;
+
+
+static PeakKernelsTestFormat const f32_format = { DRIFT_MEASURE_SAMPLE_FORMAT_F32, sizeof(gfloat) };
+static PeakKernelsTestFormat const s16_format = { DRIFT_MEASURE_SAMPLE_FORMAT_S16, sizeof(gint16) };
+static PeakKernelsTestFormat const s32_format = { DRIFT_MEASURE_SAMPLE_FORMAT_S32, sizeof(gint32) };
+
+static DriftMeasurePeakKernelsIsa const vectorized_isas[] = { DRIFT_MEASURE_PEAK_KERNELS_ISA_SSE2, DRIFT_MEASURE_PEAK_KERNELS_ISA_AVX2, DRIFT_MEASURE_PEAK_KERNELS_ISA_NEON };
+static guint const channel_counts[] = { 1, 2, 3, 5, 7, 8, 17 };
+/* Around the vector widths, and some larger odd ones. */
+static gsize const frame_counts[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 257, MAX_FRAMES };
+static gfloat const thresholds[] = { -1.0f, 0.0f, 0.3f, 0.5f, 1.0f };
+
+
+typedef enum
+{
+	/* Random levels, so there are many ties. */
+	FILL_MODE_RANDOM,
+	/* All samples have the same level. Every sample ties. */
+	FILL_MODE_CONSTANT,
+	/* Full scale samples in between random ones, which tests
+	 * the largest and smallest values of the integer formats. */
+	FILL_MODE_EXTREMES
+}
+FillMode;
+
+
+static void write_sample(DriftMeasureSampleFormat format, gpointer samples, gsize index, gint level)
+{
+	switch (format)
+	{
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S16:
+			((gint16 *)samples)[index] = (gint16)CLAMP((gint64)level * (32768 / NUM_LEVELS), G_MININT16, G_MAXINT16);
+			break;
+
+		case DRIFT_MEASURE_SAMPLE_FORMAT_S32:
+			((gint32 *)samples)[index] = (gint32)CLAMP((gint64)level * (G_GINT64_CONSTANT(2147483648) / NUM_LEVELS), G_MININT32, G_MAXINT32);
+			break;
+
+		default:
+			((gfloat *)samples)[index] = (gfloat)level / NUM_LEVELS;
+			break;
+	}
+}
+
+
+static void fill_samples(DriftMeasureSampleFormat format, gpointer samples, gsize num_samples, FillMode fill_mode)
+{
+	gint constant_level = g_test_rand_int_range(-NUM_LEVELS, NUM_LEVELS + 1);
+	gsize i;
+
+	for (i = 0; i < num_samples; ++i)
+	{
+		gint level;
+
+		switch (fill_mode)
+		{
+			case FILL_MODE_CONSTANT:
+				level = constant_level;
+				break;
+
+			case FILL_MODE_EXTREMES:
+				if (g_test_rand_int_range(0, 4) == 0)
+				{
+					level = g_test_rand_bit() ? NUM_LEVELS : -NUM_LEVELS;
+					break;
+				}
+				/* fall through */
+
+			default:
+				level = g_test_rand_int_range(-NUM_LEVELS, NUM_LEVELS + 1);
+				break;
+		}
+
+		write_sample(format, samples, i, level);
+	}
+}
+
+
+/* Splits num_frames into runs of random length, which end up at random
+ * alignments. Returns the number of runs. */
+static guint split_into_runs(gsize num_frames, gsize *run_lengths)
+{
+	guint num_runs = 0;
+
+	while (num_frames > 0)
+	{
+		gsize run_length = g_test_rand_int_range(1, 40);
+		run_length = MIN(run_length, num_frames);
+		run_lengths[num_runs++] = run_length;
+		num_frames -= run_length;
+	}
+
+	return num_runs;
+}
+
+
+static void find_largest_frames_in_runs(DriftMeasurePeakKernels const *kernels, PeakKernelsTestFormat const *format, guint8 const *samples, guint num_channels, guint64 first_frame, gsize const *run_lengths, guint num_runs, DriftMeasureSampleValue threshold, DriftMeasureChannelPeak *channel_peaks)
+{
+	guint channel, run;
+
+	for (channel = 0; channel < num_channels; ++channel)
+		channel_peaks[channel].largest_frame_index = DRIFT_MEASURE_UNDEFINED_INDEX;
+
+	for (run = 0; run < num_runs; ++run)
+	{
+		kernels->find_largest_frames(samples, num_channels, first_frame, run_lengths[run], threshold, channel_peaks);
+		samples += run_lengths[run] * num_channels * format->sample_size;
+		first_frame += run_lengths[run];
+	}
+}
+
+
+static void check_channel_peaks(DriftMeasureSampleFormat format, DriftMeasureChannelPeak const *expected, DriftMeasureChannelPeak const *actual, guint num_channels)
+{
+	guint channel;
+
+	for (channel = 0; channel < num_channels; ++channel)
+	{
+		g_assert_cmpuint(actual[channel].largest_frame_index, ==, expected[channel].largest_frame_index);
+
+		if (expected[channel].largest_frame_index == DRIFT_MEASURE_UNDEFINED_INDEX)
+			continue;
+
+		if (format == DRIFT_MEASURE_SAMPLE_FORMAT_F32)
+			g_assert_cmpfloat(actual[channel].largest_sample.f32, ==, expected[channel].largest_sample.f32);
+		else
+			g_assert_cmpint(actual[channel].largest_sample.s32, ==, expected[channel].largest_sample.s32);
+	}
+}
+
+
+static void check_find_largest_frames(DriftMeasurePeakKernels const *optimized, PeakKernelsTestFormat const *format, guint num_channels, gsize num_frames, FillMode fill_mode)
+{
+	DriftMeasurePeakKernels const *reference = drift_measure_peak_kernels_get_reference(format->format);
+	guint8 *buffer = g_malloc((MAX_START_OFFSET + MAX_FRAMES * MAX_CHANNELS) * format->sample_size);
+	guint8 *samples = buffer + g_test_rand_int_range(0, MAX_START_OFFSET + 1) * format->sample_size;
+	gsize *run_lengths = g_new(gsize, MAX_FRAMES);
+	gsize single_run[1] = { num_frames };
+	guint num_single_runs = (num_frames > 0) ? 1 : 0;
+	DriftMeasureChannelPeak expected[MAX_CHANNELS], expected_in_runs[MAX_CHANNELS], actual[MAX_CHANNELS], actual_in_runs[MAX_CHANNELS];
+	/* Frame indices beyond 32 bits must survive the vector code. */
+	guint64 first_frame = ((guint64)g_test_rand_int_range(0, 1000) << 32) | (guint32)g_test_rand_int();
+	guint num_runs, i;
+
+	fill_samples(format->format, samples, num_frames * num_channels, fill_mode);
+	num_runs = split_into_runs(num_frames, run_lengths);
+
+	for (i = 0; i < G_N_ELEMENTS(thresholds); ++i)
+	{
+		DriftMeasureSampleValue threshold = drift_measure_peak_kernels_convert_threshold(format->format, thresholds[i]);
+
+		find_largest_frames_in_runs(reference, format, samples, num_channels, first_frame, single_run, num_single_runs, threshold, expected);
+		find_largest_frames_in_runs(optimized, format, samples, num_channels, first_frame, single_run, num_single_runs, threshold, actual);
+		check_channel_peaks(format->format, expected, actual, num_channels);
+
+		/* Runs must not change the result, so a tie in a later
+		 * run must not replace the peak of an earlier one. */
+		find_largest_frames_in_runs(reference, format, samples, num_channels, first_frame, run_lengths, num_runs, threshold, expected_in_runs);
+		find_largest_frames_in_runs(optimized, format, samples, num_channels, first_frame, run_lengths, num_runs, threshold, actual_in_runs);
+		check_channel_peaks(format->format, expected, expected_in_runs, num_channels);
+		check_channel_peaks(format->format, expected, actual_in_runs, num_channels);
+	}
+
+	g_free(run_lengths);
+	g_free(buffer);
+}
+
+
+static void check_find_first_frame_above_threshold(DriftMeasurePeakKernels const *optimized, PeakKernelsTestFormat const *format, guint num_channels, gsize num_frames, FillMode fill_mode)
+{
+	DriftMeasurePeakKernels const *reference = drift_measure_peak_kernels_get_reference(format->format);
+	guint8 *buffer = g_malloc((MAX_START_OFFSET + MAX_FRAMES * MAX_CHANNELS) * format->sample_size);
+	guint8 *samples = buffer + g_test_rand_int_range(0, MAX_START_OFFSET + 1) * format->sample_size;
+	guint i;
+
+	fill_samples(format->format, samples, num_frames * num_channels, fill_mode);
+
+	for (i = 0; i < G_N_ELEMENTS(thresholds); ++i)
+	{
+		DriftMeasureSampleValue threshold = drift_measure_peak_kernels_convert_threshold(format->format, thresholds[i]);
+		gsize first_frame;
+		guint channel;
+
+		/* Starting the search at different frames also
+		 * starts it at different alignments. */
+		for (first_frame = 0; first_frame <= MIN(num_frames, 9); ++first_frame)
+		{
+			guint8 const *search_start = samples + first_frame * num_channels * format->sample_size;
+
+			for (channel = 0; channel < num_channels; ++channel)
+			{
+				gsize expected = reference->find_first_frame_above_threshold(search_start, num_channels, channel, num_frames - first_frame, threshold);
+				gsize actual = optimized->find_first_frame_above_threshold(search_start, num_channels, channel, num_frames - first_frame, threshold);
+				g_assert_cmpuint(actual, ==, expected);
+			}
+		}
+	}
+
+	g_free(buffer);
+}
+
+
+/* Returns the vectorized kernels for the format of the test that use the
+ * instruction set with the given index in vectorized_isas, or NULL if the
+ * CPU does not support them. */
+static DriftMeasurePeakKernels const * get_vectorized_kernels(PeakKernelsTestFormat const *format, guint isa_index)
+{
+	DriftMeasurePeakKernels const *kernels = drift_measure_peak_kernels_get_for_isa(vectorized_isas[isa_index], format->format);
+
+	if (kernels != NULL)
+		g_test_message("comparing %s kernels with reference kernels", kernels->name);
+
+	return kernels;
+}
+
+
+static void test_find_largest_frames(gconstpointer data)
+{
+	guint isa_index, i, j;
+	FillMode fill_mode;
+
+	for (isa_index = 0; isa_index < G_N_ELEMENTS(vectorized_isas); ++isa_index)
+	{
+		DriftMeasurePeakKernels const *optimized = get_vectorized_kernels(data, isa_index);
+		if (optimized == NULL)
+			continue;
+
+		for (i = 0; i < G_N_ELEMENTS(channel_counts); ++i)
+		{
+			for (j = 0; j < G_N_ELEMENTS(frame_counts); ++j)
+			{
+				for (fill_mode = FILL_MODE_RANDOM; fill_mode <= FILL_MODE_EXTREMES; ++fill_mode)
+					check_find_largest_frames(optimized, data, channel_counts[i], frame_counts[j], fill_mode);
+			}
+		}
+	}
+}
+
+
+static void check_ties(DriftMeasurePeakKernels const *optimized, PeakKernelsTestFormat const *format)
+{
+	DriftMeasureSampleValue threshold = drift_measure_peak_kernels_convert_threshold(format->format, 0.0f);
+	guint8 *samples = g_malloc0(MAX_FRAMES * MAX_CHANNELS * format->sample_size);
+	DriftMeasureChannelPeak channel_peaks[MAX_CHANNELS];
+	guint num_channels = 5, channel;
+	gsize frame;
+
+	/* Each channel has its largest value first in frame 10 + channel, and
+	 * then again in every 7th frame after that, in all vector lanes. */
+	for (frame = 0; frame < MAX_FRAMES; ++frame)
+	{
+		for (channel = 0; channel < num_channels; ++channel)
+		{
+			gboolean is_peak = (frame >= (10 + channel)) && (((frame - 10 - channel) % 7) == 0);
+			write_sample(format->format, samples, frame * num_channels + channel, is_peak ? NUM_LEVELS : 1);
+		}
+	}
+
+	for (channel = 0; channel < num_channels; ++channel)
+		channel_peaks[channel].largest_frame_index = DRIFT_MEASURE_UNDEFINED_INDEX;
+
+	/* The second half only contains ties of the first one. */
+	optimized->find_largest_frames(samples, num_channels, 1000, MAX_FRAMES / 2, threshold, channel_peaks);
+	optimized->find_largest_frames(samples + (MAX_FRAMES / 2) * num_channels * format->sample_size, num_channels, 1000 + MAX_FRAMES / 2, MAX_FRAMES / 2, threshold, channel_peaks);
+
+	for (channel = 0; channel < num_channels; ++channel)
+		g_assert_cmpuint(channel_peaks[channel].largest_frame_index, ==, 1000 + 10 + channel);
+
+	g_free(samples);
+}
+
+
+static void test_ties(gconstpointer data)
+{
+	guint isa_index;
+
+	/* The reference kernels must get this right as well. */
+	check_ties(drift_measure_peak_kernels_get_reference(((PeakKernelsTestFormat const *)data)->format), data);
+
+	for (isa_index = 0; isa_index < G_N_ELEMENTS(vectorized_isas); ++isa_index)
+	{
+		DriftMeasurePeakKernels const *optimized = get_vectorized_kernels(data, isa_index);
+		if (optimized != NULL)
+			check_ties(optimized, data);
+	}
+}
+
+
+static void test_find_first_frame_above_threshold(gconstpointer data)
+{
+	guint isa_index, i, j;
+	FillMode fill_mode;
+
+	for (isa_index = 0; isa_index < G_N_ELEMENTS(vectorized_isas); ++isa_index)
+	{
+		DriftMeasurePeakKernels const *optimized = get_vectorized_kernels(data, isa_index);
+		if (optimized == NULL)
+			continue;
+
+		for (i = 0; i < G_N_ELEMENTS(channel_counts); ++i)
+		{
+			for (j = 0; j < G_N_ELEMENTS(frame_counts); ++j)
+			{
+				for (fill_mode = FILL_MODE_RANDOM; fill_mode <= FILL_MODE_EXTREMES; ++fill_mode)
+					check_find_first_frame_above_threshold(optimized, data, channel_counts[i], frame_counts[j], fill_mode);
+			}
+		}
+	}
+}
+
+
+/* The dispatcher must pick one of the kernel sets that are tested above. */
+static void test_optimized(gconstpointer data)
+{
+	PeakKernelsTestFormat const *format = data;
+	DriftMeasurePeakKernels const *optimized = drift_measure_peak_kernels_get_optimized(format->format);
+	gboolean found = (optimized == drift_measure_peak_kernels_get_reference(format->format));
+	guint isa_index;
+
+	for (isa_index = 0; isa_index < G_N_ELEMENTS(vectorized_isas); ++isa_index)
+		found = found || (optimized == drift_measure_peak_kernels_get_for_isa(vectorized_isas[isa_index], format->format));
+
+	g_assert_true(found);
+}
+
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_data_func("/driftmeasure/peak-kernels/f32/find-largest-frames", &f32_format, test_find_largest_frames);
+	g_test_add_data_func("/driftmeasure/peak-kernels/s16/find-largest-frames", &s16_format, test_find_largest_frames);
+	g_test_add_data_func("/driftmeasure/peak-kernels/s32/find-largest-frames", &s32_format, test_find_largest_frames);
+
+	g_test_add_data_func("/driftmeasure/peak-kernels/f32/ties", &f32_format, test_ties);
+	g_test_add_data_func("/driftmeasure/peak-kernels/s16/ties", &s16_format, test_ties);
+	g_test_add_data_func("/driftmeasure/peak-kernels/s32/ties", &s32_format, test_ties);
+
+	g_test_add_data_func("/driftmeasure/peak-kernels/f32/find-first-frame-above-threshold", &f32_format, test_find_first_frame_above_threshold);
+	g_test_add_data_func("/driftmeasure/peak-kernels/s16/find-first-frame-above-threshold", &s16_format, test_find_first_frame_above_threshold);
+	g_test_add_data_func("/driftmeasure/peak-kernels/s32/find-first-frame-above-threshold", &s32_format, test_find_first_frame_above_threshold);
+
+	g_test_add_data_func("/driftmeasure/peak-kernels/f32/optimized", &f32_format, test_optimized);
+	g_test_add_data_func("/driftmeasure/peak-kernels/s16/optimized", &s16_format, test_optimized);
+	g_test_add_data_func("/driftmeasure/peak-kernels/s32/optimized", &s32_format, test_optimized);
+
+	return g_test_run();
+}
@@ -0,0 +1,583 @@
+/* Analyzes a recorded WAV or raw file as fast as possible, and writes the
+ * same CSV that a filesrc ! wavparse ! driftmeasure ! filesink pipeline
+ * would produce.
+ *
+ * The file is mapped into memory and split into chunks, which are analyzed
+ * in parallel, each one by its own driftmeasure instance. The chunks are
+ * fed to the element directly through pads, without a pipeline (see
+ * elementharness.h), and the input buffers wrap the mapped file, so the
+ * samples are never copied before they reach the history. Chunks are
+ * only split where the reference channel stays below the peak threshold
+ * for longer than a window on either side of the split, so that no window
+ * spans two chunks, and at frames whose timestamps are whole nanoseconds,
+ * so that the timestamps in each chunk are the same as in one long
+ * stream. With the peak and cross-correlation detection methods, the CSV
+ * is byte-identical to that of the streaming element. The matched filter
+ * has a state that spans the split points, so its results can differ in
+ * the last digits.
+ *
+ * Element properties are set with --set. Since chunks are analyzed
+ * independently, the last-value handling of undetected peaks is done when
+ * the CSV rows of the chunks are merged. Statistics and tracking depend on
+ * all earlier measurements, so they are not supported.
+ *
+ * Usage: driftmeasure-offline [OPTION...] <input file> */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include "elementharness.h"
+#include "gstdriftmeasure.h"
+#include "intformat.h"
+#include "peakinterpolation.h"
+#include "peakkernels.h"
+
+
+#define DEFAULT_CHUNK_DURATION 60.0
+/* Number of frames in each buffer that is pushed into the element. */
+#define BUFFER_NUM_FRAMES 65536
+/* Number of frames that are normalized at once while looking for split points. */
+#define SCAN_BLOCK_NUM_FRAMES 4096
+
+
+typedef struct
+{
+	GMappedFile *mapped_file;
+	guint8 const *frames;
+	guint64 num_frames;
+	GstAudioInfo audio_info;
+	DriftMeasureSampleFormat sample_format;
+}
+OfflineInput;
+
+
+typedef struct
+{
+	OfflineInput const *input;
+	gchar **property_settings;
+	/* If TRUE, the chunks are analyzed with the no-value handling, and
+	 * empty drift columns are filled when the chunks are merged. */
+	gboolean merge_last_values;
+}
+OfflineSettings;
+
+
+typedef struct
+{
+	guint index;
+	guint64 first_frame;
+	guint64 num_frames;
+	GByteArray *output;
+	gboolean failed;
+}
+OfflineChunk;
+
+
+static gboolean parse_wav(OfflineInput *input, guint8 const *data, gsize size, GError **error)
+{
+	gsize offset = 12;
+	guint format_tag = 0, num_channels = 0, rate = 0, block_align = 0, bits_per_sample = 0;
+	gboolean have_format = FALSE;
+	GstAudioFormat format;
+
+	if ((size < 12) || (memcmp(data, "RIFF", 4) != 0) || (memcmp(data + 8, "WAVE", 4) != 0))
+	{
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "not a WAV file");
+		return FALSE;
+	}
+
+	while ((offset + 8) <= size)
+	{
+		guint8 const *chunk_id = data + offset;
+		gsize chunk_size = GST_READ_UINT32_LE(data + offset + 4);
+		gsize body = offset + 8;
+
+		if (memcmp(chunk_id, "fmt ", 4) == 0)
+		{
+			if ((chunk_size < 16) || ((body + chunk_size) > size))
+				break;
+
+			format_tag = GST_READ_UINT16_LE(data + body);
+			num_channels = GST_READ_UINT16_LE(data + body + 2);
+			rate = GST_READ_UINT32_LE(data + body + 4);
+			block_align = GST_READ_UINT16_LE(data + body + 12);
+			bits_per_sample = GST_READ_UINT16_LE(data + body + 14);
+
+			/* WAVE_FORMAT_EXTENSIBLE; the format tag is at the
+			 * beginning of the subformat GUID. */
+			if ((format_tag == 0xFFFE) && (chunk_size >= 26))
+				format_tag = GST_READ_UINT16_LE(data + body + 24);
+
+			have_format = TRUE;
+		}
+		else if (memcmp(chunk_id, "data", 4) == 0)
+		{
+			if (!have_format)
+				break;
+
+			/* Captures that were interrupted can have a data
+			 * chunk size that does not match the file size. */
+			input->frames = data + body;
+			input->num_frames = MIN(chunk_size, size - body) / MAX(block_align, 1);
+			break;
+		}
+
+		offset = body + chunk_size + (chunk_size & 1);
+	}
+
+	if (!have_format || (input->frames == NULL))
+	{
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "WAV file has no format or data chunk");
+		return FALSE;
+	}
+
+	if ((format_tag == 1) && (bits_per_sample == 16))
+		format = GST_AUDIO_FORMAT_S16LE;
+	else if ((format_tag == 1) && (bits_per_sample == 24))
+		format = GST_AUDIO_FORMAT_S24LE;
+	else if ((format_tag == 1) && (bits_per_sample == 32))
+		format = GST_AUDIO_FORMAT_S32LE;
+	else if ((format_tag == 3) && (bits_per_sample == 32))
+		format = GST_AUDIO_FORMAT_F32LE;
+	else
+	{
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "unsupported WAV sample format (format tag %u, %u bits per sample)", format_tag, bits_per_sample);
+		return FALSE;
+	}
+
+	if ((num_channels == 0) || (rate == 0) || (block_align != (num_channels * bits_per_sample / 8)))
+	{
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "invalid WAV format chunk");
+		return FALSE;
+	}
+
+	gst_audio_info_set_format(&(input->audio_info), format, rate, num_channels, NULL);
+
+	return TRUE;
+}
+
+
+static gboolean open_input(OfflineInput *input, gchar const *filename, gchar const *raw_format, gint raw_rate, gint raw_channels, GError **error)
+{
+	guint8 const *data;
+	gsize size;
+
+	memset(input, 0, sizeof(OfflineInput));
+	gst_audio_info_init(&(input->audio_info));
+
+	input->mapped_file = g_mapped_file_new(filename, FALSE, error);
+	if (input->mapped_file == NULL)
+		return FALSE;
+
+	data = (guint8 const *)g_mapped_file_get_contents(input->mapped_file);
+	size = g_mapped_file_get_length(input->mapped_file);
+
+	if (raw_format != NULL)
+	{
+		GstAudioFormat format = gst_audio_format_from_string(raw_format);
+
+		if ((format == GST_AUDIO_FORMAT_UNKNOWN) || (raw_rate <= 0) || (raw_channels <= 0))
+		{
+			g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "raw input needs a valid format, rate and number of channels");
+			return FALSE;
+		}
+
+		gst_audio_info_set_format(&(input->audio_info), format, raw_rate, raw_channels, NULL);
+		input->frames = data;
+		input->num_frames = size / GST_AUDIO_INFO_BPF(&(input->audio_info));
+	}
+	else if (!parse_wav(input, data, size, error))
+		return FALSE;
+
+	switch (GST_AUDIO_INFO_FORMAT(&(input->audio_info)))
+	{
+		case GST_AUDIO_FORMAT_F32LE: input->sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_F32; break;
+		case GST_AUDIO_FORMAT_S16LE: input->sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_S16; break;
+		case GST_AUDIO_FORMAT_S24LE: input->sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_S24; break;
+		case GST_AUDIO_FORMAT_S32LE: input->sample_format = DRIFT_MEASURE_SAMPLE_FORMAT_S32; break;
+		default:
+			g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "unsupported sample format %s", GST_AUDIO_INFO_NAME(&(input->audio_info)));
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+static gchar const * get_enum_property_nick(GstElement *element, gchar const *name)
+{
+	GParamSpec *pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(element), name);
+	GEnumValue *enum_value;
+	gint value;
+
+	g_object_get(G_OBJECT(element), name, &value, NULL);
+	enum_value = g_enum_get_value(G_PARAM_SPEC_ENUM(pspec)->enum_class, value);
+
+	return (enum_value != NULL) ? enum_value->value_nick : "";
+}
+
+
+static guint64 get_split_point_granularity(guint rate)
+{
+	/* Frame F has the timestamp F * GST_SECOND / rate, which is a whole
+	 * number of nanoseconds if F is a multiple of rate / gcd(rate, GST_SECOND). */
+
+	guint64 a = GST_SECOND, b = rate;
+
+	while (b != 0)
+	{
+		guint64 remainder = a % b;
+		a = b;
+		b = remainder;
+	}
+
+	return rate / a;
+}
+
+
+static guint64 find_split_point(OfflineInput const *input, guint reference_channel, gfloat threshold, guint64 first_frame, guint64 guard, guint64 granularity)
+{
+	/* Returns the first frame at or after first_frame + guard that is a
+	 * multiple of granularity, and that has no reference channel sample
+	 * at or above the threshold within guard frames on either side. If
+	 * there is no such frame, the number of frames in the file is
+	 * returned. */
+
+	guint num_channels = GST_AUDIO_INFO_CHANNELS(&(input->audio_info));
+	guint bytes_per_sample = GST_AUDIO_INFO_BPS(&(input->audio_info));
+	guint bytes_per_frame = GST_AUDIO_INFO_BPF(&(input->audio_info));
+	gfloat values[SCAN_BLOCK_NUM_FRAMES];
+	guint64 quiet_start = first_frame;
+	guint64 frame = first_frame;
+
+	while (frame < input->num_frames)
+	{
+		gsize num_block_frames = MIN(SCAN_BLOCK_NUM_FRAMES, input->num_frames - frame);
+		gsize i;
+
+		drift_measure_peak_kernels_normalize_samples(
+			input->sample_format,
+			input->frames + frame * bytes_per_frame + reference_channel * bytes_per_sample,
+			num_channels,
+			num_block_frames,
+			values
+		);
+
+		for (i = 0; i < num_block_frames; ++i)
+		{
+			guint64 split_point;
+
+			if (fabsf(values[i]) >= threshold)
+			{
+				quiet_start = frame + i + 1;
+				continue;
+			}
+
+			split_point = (quiet_start + guard + granularity - 1) / granularity * granularity;
+			if ((frame + i + 1) >= (split_point + guard))
+				return split_point;
+		}
+
+		frame += num_block_frames;
+	}
+
+	return input->num_frames;
+}
+
+
+static void append_chunk_output(guint8 const *data, gsize size, gpointer user_data)
+{
+	OfflineChunk *chunk = user_data;
+
+	g_byte_array_append(chunk->output, data, size);
+}
+
+
+static void process_chunk(gpointer data, gpointer user_data)
+{
+	OfflineChunk *chunk = data;
+	OfflineSettings const *settings = user_data;
+	OfflineInput const *input = settings->input;
+	GstAudioInfo const *audio_info = &(input->audio_info);
+	GstElement *element;
+	DriftMeasureElementHarness *harness;
+	GstClockTime base;
+	gchar *stream_id;
+
+	element = GST_ELEMENT(gst_object_ref_sink(g_object_new(GST_TYPE_DRIFT_MEASURE, NULL)));
+	drift_measure_element_harness_set_properties(element, settings->property_settings, NULL);
+	if (settings->merge_last_values)
+		gst_util_set_object_arg(G_OBJECT(element), "undetected-peak-handling", "no-value");
+
+	/* The chunk starts at a whole nanosecond, so adding this
+	 * to the timestamps within the chunk is exact. */
+	base = gst_util_uint64_scale_int(chunk->first_frame, GST_SECOND, GST_AUDIO_INFO_RATE(audio_info));
+
+	stream_id = g_strdup_printf("driftmeasure-offline-%u", chunk->index);
+	harness = drift_measure_element_harness_new(element, stream_id, audio_info, base, append_chunk_output, chunk);
+	g_free(stream_id);
+
+	drift_measure_element_harness_push_frames(harness, input->frames + chunk->first_frame * GST_AUDIO_INFO_BPF(audio_info), chunk->num_frames, BUFFER_NUM_FRAMES);
+	if (drift_measure_element_harness_finish(harness) != GST_FLOW_OK)
+		chunk->failed = TRUE;
+
+	drift_measure_element_harness_free(harness);
+	gst_object_unref(GST_OBJECT(element));
+}
+
+
+static gboolean write_merged_rows(FILE *output_file, GByteArray const *output, guint num_drifts, gint64 fill_value, gchar **last_values)
+{
+	/* Writes CSV rows, replacing empty drift columns with the last value
+	 * in that column, just like the element does with the last-value
+	 * handling. Columns that had no value yet get the fill value. */
+
+	gchar const *row = (gchar const *)(output->data);
+	gchar const *end = row + output->len;
+
+	while (row < end)
+	{
+		gchar const *row_end = memchr(row, '\n', end - row);
+		gchar **columns;
+		gchar *line;
+		guint i;
+
+		if (row_end == NULL)
+			row_end = end;
+
+		line = g_strndup(row, row_end - row);
+		columns = g_strsplit(line, ",", -1);
+		g_free(line);
+
+		if (g_strv_length(columns) != (num_drifts + 1))
+		{
+			g_strfreev(columns);
+			return FALSE;
+		}
+
+		for (i = 0; i < num_drifts; ++i)
+		{
+			if (columns[i + 1][0] != '\0')
+			{
+				g_free(last_values[i]);
+				last_values[i] = g_strdup(columns[i + 1]);
+			}
+			else if (last_values[i] == NULL)
+			{
+				gchar fill_value_string[DRIFT_MEASURE_MAX_FORMATTED_INT64_LENGTH + 1];
+				fill_value_string[drift_measure_format_int64(fill_value_string, fill_value)] = '\0';
+				last_values[i] = g_strdup(fill_value_string);
+			}
+		}
+
+		fputs(columns[0], output_file);
+		for (i = 0; i < num_drifts; ++i)
+		{
+			fputc(',', output_file);
+			fputs(last_values[i], output_file);
+		}
+		fputc('\n', output_file);
+
+		g_strfreev(columns);
+		row = row_end + 1;
+	}
+
+	return TRUE;
+}
+
+
+int main(int argc, char *argv[])
+{
+	gchar **property_settings = NULL;
+	gint num_threads = 0;
+	gdouble chunk_duration = DEFAULT_CHUNK_DURATION;
+	gchar *output_filename = NULL;
+	gchar *raw_format = NULL;
+	gint raw_rate = 0, raw_channels = 0;
+	GOptionEntry option_entries[] =
+	{
+		{ "set", 's', 0, G_OPTION_ARG_STRING_ARRAY, &property_settings, "Set a driftmeasure property (can be used multiple times)", "NAME=VALUE" },
+		{ "threads", 't', 0, G_OPTION_ARG_INT, &num_threads, "Number of chunks to analyze in parallel (default: number of CPU cores)", "N" },
+		{ "chunk-duration", 'c', 0, G_OPTION_ARG_DOUBLE, &chunk_duration, "Minimum duration of a chunk in seconds (default: 60)", "SECONDS" },
+		{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &output_filename, "CSV output file (default: standard output)", "FILENAME" },
+		{ "raw-format", 0, 0, G_OPTION_ARG_STRING, &raw_format, "Read a raw interleaved file with this sample format (F32LE, S16LE, S24LE, S32LE) instead of a WAV file", "FORMAT" },
+		{ "raw-rate", 0, 0, G_OPTION_ARG_INT, &raw_rate, "Sample rate of the raw file", "RATE" },
+		{ "raw-channels", 0, 0, G_OPTION_ARG_INT, &raw_channels, "Number of channels of the raw file", "CHANNELS" },
+		{ NULL, 0, 0, 0, NULL, NULL, NULL }
+	};
+	GOptionContext *option_context;
+	GError *error = NULL;
+	OfflineInput input;
+	OfflineSettings settings;
+	GstElement *element;
+	GPtrArray *chunks;
+	GThreadPool *thread_pool;
+	FILE *output_file;
+	guint rate, num_channels, reference_channel;
+	guint64 window_size, pulse_length, guard, granularity, chunk_num_frames, first_frame;
+	gfloat peak_threshold;
+	gint64 fill_value;
+	gchar **last_values;
+	gboolean output_tracking;
+	guint i;
+	int ret = 1;
+
+	option_context = g_option_context_new("<input file>");
+	g_option_context_add_main_entries(option_context, option_entries, NULL);
+	g_option_context_add_group(option_context, gst_init_get_option_group());
+	if (!g_option_context_parse(option_context, &argc, &argv, &error))
+	{
+		g_printerr("%s\n", error->message);
+		return 1;
+	}
+	g_option_context_free(option_context);
+
+	if (argc != 2)
+	{
+		g_printerr("expected exactly one input file\n");
+		return 1;
+	}
+
+	if (!open_input(&input, argv[1], raw_format, raw_rate, raw_channels, &error))
+	{
+		g_printerr("could not open %s: %s\n", argv[1], error->message);
+		return 1;
+	}
+
+	rate = GST_AUDIO_INFO_RATE(&(input.audio_info));
+	num_channels = GST_AUDIO_INFO_CHANNELS(&(input.audio_info));
+
+	/* Validate the property settings, and get the ones
+	 * that are needed for finding split points. */
+	element = GST_ELEMENT(gst_object_ref_sink(g_object_new(GST_TYPE_DRIFT_MEASURE, NULL)));
+	if (!drift_measure_element_harness_set_properties(element, property_settings, &error))
+	{
+		g_printerr("%s\n", error->message);
+		return 1;
+	}
+
+	g_object_get(
+		G_OBJECT(element),
+		"window-size", &window_size,
+		"pulse-length", &pulse_length,
+		"peak-threshold", &peak_threshold,
+		"reference-channel", &reference_channel,
+		"undetected-peak-fill-value", &fill_value,
+		"output-tracking", &output_tracking,
+		NULL
+	);
+
+	if ((strcmp(get_enum_property_nick(element, "output-mode"), "measurements") != 0) || output_tracking)
+	{
+		g_printerr("statistics and tracking are not supported, since chunks are analyzed independently\n");
+		return 1;
+	}
+
+	if (strcmp(get_enum_property_nick(element, "detection-method"), "matched-filter") == 0)
+		g_printerr("warning: matched filter results can differ slightly from those of the streaming element\n");
+
+	settings.input = &input;
+	settings.property_settings = property_settings;
+	settings.merge_last_values = (strcmp(get_enum_property_nick(element, "undetected-peak-handling"), "last-value") == 0);
+
+	gst_object_unref(GST_OBJECT(element));
+
+	if ((num_channels < 2) || (reference_channel >= num_channels))
+	{
+		g_printerr("input needs at least 2 channels, and the reference channel must be one of them\n");
+		return 1;
+	}
+
+	/* Split points need room for half a window plus a pulse on either side
+	 * (with some margin for the interpolation neighbourhoods), and must be
+	 * at frames whose timestamps are whole nanoseconds. */
+	guard = gst_util_uint64_scale_int_ceil(window_size, rate, GST_SECOND) / 2 + 2 * gst_util_uint64_scale_int_ceil(pulse_length, rate, GST_SECOND) + 2 * DRIFT_MEASURE_PEAK_INTERPOLATION_HALF_LENGTH;
+	granularity = get_split_point_granularity(rate);
+	chunk_num_frames = MAX((guint64)(chunk_duration * rate), guard * 2);
+
+	chunks = g_ptr_array_new();
+	first_frame = 0;
+	while (first_frame < input.num_frames)
+	{
+		OfflineChunk *chunk = g_new0(OfflineChunk, 1);
+		guint64 split_point = input.num_frames;
+
+		if ((first_frame + chunk_num_frames) < input.num_frames)
+			split_point = find_split_point(&input, reference_channel, peak_threshold, first_frame + chunk_num_frames - guard, guard, granularity);
+
+		chunk->index = chunks->len;
+		chunk->first_frame = first_frame;
+		chunk->num_frames = split_point - first_frame;
+		chunk->output = g_byte_array_new();
+		g_ptr_array_add(chunks, chunk);
+
+		first_frame = split_point;
+	}
+
+	if (num_threads <= 0)
+		num_threads = g_get_num_processors();
+
+	thread_pool = g_thread_pool_new(process_chunk, &settings, num_threads, TRUE, NULL);
+	for (i = 0; i < chunks->len; ++i)
+		g_thread_pool_push(thread_pool, g_ptr_array_index(chunks, i), NULL);
+	/* Wait until all chunks are analyzed. */
+	g_thread_pool_free(thread_pool, FALSE, TRUE);
+
+	output_file = (output_filename != NULL) ? fopen(output_filename, "wb") : stdout;
+	if (output_file == NULL)
+	{
+		g_printerr("could not open %s for writing\n", output_filename);
+		return 1;
+	}
+
+	last_values = g_new0(gchar *, num_channels - 1);
+	ret = 0;
+
+	for (i = 0; i < chunks->len; ++i)
+	{
+		OfflineChunk *chunk = g_ptr_array_index(chunks, i);
+
+		if (chunk->failed)
+		{
+			g_printerr("analysis of chunk %u failed\n", chunk->index);
+			ret = 1;
+			break;
+		}
+
+		if (settings.merge_last_values)
+		{
+			if (!write_merged_rows(output_file, chunk->output, num_channels - 1, fill_value, last_values))
+			{
+				g_printerr("unexpected CSV row in chunk %u\n", chunk->index);
+				ret = 1;
+				break;
+			}
+		}
+		else
+			fwrite(chunk->output->data, 1, chunk->output->len, output_file);
+	}
+
+	for (i = 0; i < (num_channels - 1); ++i)
+		g_free(last_values[i]);
+	g_free(last_values);
+
+	for (i = 0; i < chunks->len; ++i)
+	{
+		OfflineChunk *chunk = g_ptr_array_index(chunks, i);
+		g_byte_array_free(chunk->output, TRUE);
+		g_free(chunk);
+	}
+	g_ptr_array_free(chunks, TRUE);
+
+	if (output_file != stdout)
+		fclose(output_file);
+
+	g_mapped_file_unref(input.mapped_file);
+	g_strfreev(property_settings);
+	g_free(output_filename);
+	g_free(raw_format);
+
+	return ret;
+}
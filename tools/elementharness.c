@@ -0,0 +1,281 @@
+#include "elementharness.h"
+
+
+/* A source pad of the harness, linked to the sink pad
+ * or to one of the request pads of the element. */
+typedef struct
+{
+	GstPad *srcpad;
+	GstPad *element_sinkpad;
+	gsize bytes_per_frame;
+}
+DriftMeasureElementHarnessInput;
+
+
+struct _DriftMeasureElementHarness
+{
+	GstElement *element;
+	DriftMeasureElementHarnessInput *inputs;
+	guint num_inputs;
+	gboolean request_pads;
+	GstPad *sinkpad, *element_srcpad;
+	GstCaps *output_caps;
+	DriftMeasureElementHarnessOutputFunc output_func;
+	gpointer user_data;
+	GstFlowReturn flow_ret;
+};
+
+
+static gboolean harness_sink_query(GstPad *pad, GstObject *parent, GstQuery *query)
+{
+	if (GST_QUERY_TYPE(query) == GST_QUERY_CAPS)
+	{
+		DriftMeasureElementHarness *harness = gst_pad_get_element_private(pad);
+		GstCaps *filter, *caps;
+
+		gst_query_parse_caps(query, &filter);
+		caps = gst_caps_ref(harness->output_caps);
+		if (filter != NULL)
+		{
+			GstCaps *intersection = gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
+			gst_caps_unref(caps);
+			caps = intersection;
+		}
+
+		gst_query_set_caps_result(query, caps);
+		gst_caps_unref(caps);
+
+		return TRUE;
+	}
+
+	return gst_pad_query_default(pad, parent, query);
+}
+
+
+static gboolean harness_sink_event(G_GNUC_UNUSED GstPad *pad, G_GNUC_UNUSED GstObject *parent, GstEvent *event)
+{
+	gst_event_unref(event);
+	return TRUE;
+}
+
+
+static GstFlowReturn harness_sink_chain(GstPad *pad, G_GNUC_UNUSED GstObject *parent, GstBuffer *buffer)
+{
+	DriftMeasureElementHarness *harness = gst_pad_get_element_private(pad);
+	GstMapInfo map_info;
+
+	if (!gst_buffer_map(buffer, &map_info, GST_MAP_READ))
+	{
+		gst_buffer_unref(buffer);
+		return GST_FLOW_ERROR;
+	}
+
+	harness->output_func(map_info.data, map_info.size, harness->user_data);
+
+	gst_buffer_unmap(buffer, &map_info);
+	gst_buffer_unref(buffer);
+
+	return GST_FLOW_OK;
+}
+
+
+gboolean drift_measure_element_harness_set_properties(GstElement *element, gchar **property_settings, GError **error)
+{
+	gchar **setting;
+
+	for (setting = property_settings; (setting != NULL) && (*setting != NULL); ++setting)
+	{
+		gchar **name_and_value = g_strsplit(*setting, "=", 2);
+
+		if ((name_and_value[0] == NULL) || (name_and_value[1] == NULL) || (g_object_class_find_property(G_OBJECT_GET_CLASS(element), name_and_value[0]) == NULL))
+		{
+			g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "invalid property setting \"%s\"", *setting);
+			g_strfreev(name_and_value);
+			return FALSE;
+		}
+
+		gst_util_set_object_arg(G_OBJECT(element), name_and_value[0], name_and_value[1]);
+		g_strfreev(name_and_value);
+	}
+
+	return TRUE;
+}
+
+
+DriftMeasureElementHarness * drift_measure_element_harness_new(GstElement *element, gchar const *stream_id, GstAudioInfo const *audio_info, GstClockTime base, DriftMeasureElementHarnessOutputFunc output_func, gpointer user_data)
+{
+	DriftMeasureElementHarness *harness;
+	GstCaps *output_caps = gst_caps_new_empty_simple("text/x-csv");
+
+	harness = drift_measure_element_harness_new_with_output_caps(element, stream_id, audio_info, base, output_caps, output_func, user_data);
+	gst_caps_unref(output_caps);
+
+	return harness;
+}
+
+
+static DriftMeasureElementHarness * harness_new(GstElement *element, gchar const *stream_id, GstAudioInfo const *audio_infos, guint num_inputs, gboolean request_pads, GstClockTime base, GstCaps *output_caps, DriftMeasureElementHarnessOutputFunc output_func, gpointer user_data)
+{
+	DriftMeasureElementHarness *harness = g_new0(DriftMeasureElementHarness, 1);
+	GstPadTemplate *request_pad_template = NULL;
+	guint i;
+
+	harness->element = GST_ELEMENT(gst_object_ref(GST_OBJECT(element)));
+	harness->inputs = g_new0(DriftMeasureElementHarnessInput, num_inputs);
+	harness->num_inputs = num_inputs;
+	harness->request_pads = request_pads;
+	harness->output_caps = gst_caps_ref(output_caps);
+	harness->output_func = output_func;
+	harness->user_data = user_data;
+	harness->flow_ret = GST_FLOW_OK;
+
+	harness->sinkpad = gst_pad_new("sink", GST_PAD_SINK);
+	gst_pad_set_element_private(harness->sinkpad, harness);
+	gst_pad_set_query_function(harness->sinkpad, harness_sink_query);
+	gst_pad_set_event_function(harness->sinkpad, harness_sink_event);
+	gst_pad_set_chain_function(harness->sinkpad, harness_sink_chain);
+
+	harness->element_srcpad = gst_element_get_static_pad(element, "src");
+	gst_pad_link(harness->element_srcpad, harness->sinkpad);
+
+	if (request_pads)
+		request_pad_template = gst_element_class_get_pad_template(GST_ELEMENT_GET_CLASS(element), "sink_%u");
+
+	/* Request pads are combined in the order they were requested. */
+	for (i = 0; i < num_inputs; ++i)
+	{
+		DriftMeasureElementHarnessInput *input = &(harness->inputs[i]);
+		gchar *pad_name = g_strdup_printf("src_%u", i);
+
+		input->srcpad = gst_pad_new(pad_name, GST_PAD_SRC);
+		input->element_sinkpad = request_pads ? gst_element_request_pad(element, request_pad_template, NULL, NULL) : gst_element_get_static_pad(element, "sink");
+		input->bytes_per_frame = GST_AUDIO_INFO_BPF(&(audio_infos[i]));
+		gst_pad_link(input->srcpad, input->element_sinkpad);
+
+		g_free(pad_name);
+	}
+
+	gst_pad_set_active(harness->sinkpad, TRUE);
+	gst_element_set_state(element, GST_STATE_PAUSED);
+
+	for (i = 0; i < num_inputs; ++i)
+	{
+		DriftMeasureElementHarnessInput *input = &(harness->inputs[i]);
+		GstSegment segment;
+		GstCaps *caps;
+		gchar *input_stream_id;
+
+		gst_pad_set_active(input->srcpad, TRUE);
+
+		/* Request pads carry separate streams. */
+		input_stream_id = request_pads ? g_strdup_printf("%s-%u", stream_id, i) : g_strdup(stream_id);
+		gst_pad_push_event(input->srcpad, gst_event_new_stream_start(input_stream_id));
+		g_free(input_stream_id);
+
+		caps = gst_audio_info_to_caps(&(audio_infos[i]));
+		if (!gst_pad_push_event(input->srcpad, gst_event_new_caps(caps)))
+			harness->flow_ret = GST_FLOW_NOT_NEGOTIATED;
+		gst_caps_unref(caps);
+
+		gst_segment_init(&segment, GST_FORMAT_TIME);
+		segment.base = base;
+		gst_pad_push_event(input->srcpad, gst_event_new_segment(&segment));
+	}
+
+	return harness;
+}
+
+
+DriftMeasureElementHarness * drift_measure_element_harness_new_with_output_caps(GstElement *element, gchar const *stream_id, GstAudioInfo const *audio_info, GstClockTime base, GstCaps *output_caps, DriftMeasureElementHarnessOutputFunc output_func, gpointer user_data)
+{
+	return harness_new(element, stream_id, audio_info, 1, FALSE, base, output_caps, output_func, user_data);
+}
+
+
+DriftMeasureElementHarness * drift_measure_element_harness_new_for_request_pads(GstElement *element, gchar const *stream_id, GstAudioInfo const *audio_infos, guint num_inputs, GstClockTime base, DriftMeasureElementHarnessOutputFunc output_func, gpointer user_data)
+{
+	DriftMeasureElementHarness *harness;
+	GstCaps *output_caps = gst_caps_new_empty_simple("text/x-csv");
+
+	harness = harness_new(element, stream_id, audio_infos, num_inputs, TRUE, base, output_caps, output_func, user_data);
+	gst_caps_unref(output_caps);
+
+	return harness;
+}
+
+
+void drift_measure_element_harness_free(DriftMeasureElementHarness *harness)
+{
+	guint i;
+
+	if (harness == NULL)
+		return;
+
+	for (i = 0; i < harness->num_inputs; ++i)
+		gst_pad_set_active(harness->inputs[i].srcpad, FALSE);
+	gst_element_set_state(harness->element, GST_STATE_NULL);
+	gst_pad_set_active(harness->sinkpad, FALSE);
+
+	for (i = 0; i < harness->num_inputs; ++i)
+	{
+		DriftMeasureElementHarnessInput *input = &(harness->inputs[i]);
+
+		gst_pad_unlink(input->srcpad, input->element_sinkpad);
+		if (harness->request_pads)
+			gst_element_release_request_pad(harness->element, input->element_sinkpad);
+		gst_object_unref(GST_OBJECT(input->element_sinkpad));
+		gst_object_unref(GST_OBJECT(input->srcpad));
+	}
+
+	gst_pad_unlink(harness->element_srcpad, harness->sinkpad);
+	gst_object_unref(GST_OBJECT(harness->element_srcpad));
+	gst_object_unref(GST_OBJECT(harness->sinkpad));
+	gst_object_unref(GST_OBJECT(harness->element));
+	gst_caps_unref(harness->output_caps);
+
+	g_free(harness->inputs);
+	g_free(harness);
+}
+
+
+GstFlowReturn drift_measure_element_harness_push_frames(DriftMeasureElementHarness *harness, guint8 const *frames, gsize num_frames, gsize buffer_num_frames)
+{
+	return drift_measure_element_harness_push_input_frames(harness, 0, frames, num_frames, buffer_num_frames);
+}
+
+
+GstFlowReturn drift_measure_element_harness_push_input_frames(DriftMeasureElementHarness *harness, guint input_index, guint8 const *frames, gsize num_frames, gsize buffer_num_frames)
+{
+	DriftMeasureElementHarnessInput *input;
+	gsize frame;
+
+	g_assert(input_index < harness->num_inputs);
+	input = &(harness->inputs[input_index]);
+
+	for (frame = 0; (harness->flow_ret == GST_FLOW_OK) && (frame < num_frames); frame += buffer_num_frames)
+	{
+		gsize num_buffer_frames = MIN(buffer_num_frames, num_frames - frame);
+		gsize size = num_buffer_frames * input->bytes_per_frame;
+		guint8 *buffer_data = (guint8 *)(frames + frame * input->bytes_per_frame);
+
+		harness->flow_ret = gst_pad_push(input->srcpad, gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, buffer_data, size, 0, size, NULL, NULL));
+	}
+
+	return harness->flow_ret;
+}
+
+
+GstFlowReturn drift_measure_element_harness_finish(DriftMeasureElementHarness *harness)
+{
+	guint i;
+
+	/* With request pads, the first EOS already finishes the combined
+	 * stream, but each request pad has to get one nonetheless. */
+	if (harness->flow_ret == GST_FLOW_OK)
+	{
+		for (i = 0; i < harness->num_inputs; ++i)
+			gst_pad_push_event(harness->inputs[i].srcpad, gst_event_new_eos());
+	}
+
+	return harness->flow_ret;
+}
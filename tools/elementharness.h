@@ -0,0 +1,78 @@
+#ifndef ELEMENTHARNESS_H
+#define ELEMENTHARNESS_H
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+
+
+G_BEGIN_DECLS
+
+
+/* Feeds a driftmeasure element through pads, without a pipeline.
+ *
+ * The harness links a source pad to the sink pad of the element (or one
+ * source pad to each of several sink_%u request pads), and a sink pad to
+ * its source pad. The sink pad asks for CSV output (unless
+ * other output caps are given), drops all events, and passes the contents of each output buffer to a
+ * callback. Input buffers wrap the frames of the caller, so the samples
+ * are not copied before they reach the element. Used by the offline
+ * analysis tool, the detection benchmark and the accuracy test. */
+
+
+/* Called with the contents of each output buffer of the element. */
+typedef void (*DriftMeasureElementHarnessOutputFunc)(guint8 const *data, gsize size, gpointer user_data);
+
+
+typedef struct _DriftMeasureElementHarness DriftMeasureElementHarness;
+
+
+/* Sets the properties of the element from "name=value" strings. Returns
+ * FALSE and sets error if a setting is malformed or names a property that
+ * the element does not have; the settings before it are still applied. */
+gboolean drift_measure_element_harness_set_properties(GstElement *element, gchar **property_settings, GError **error);
+
+/* Links and activates the pads, sets the element to PAUSED, and pushes
+ * the stream-start event with the given stream ID, the caps of audio_info,
+ * and a time segment with the given base. The harness keeps a reference
+ * to the element. */
+DriftMeasureElementHarness * drift_measure_element_harness_new(GstElement *element, gchar const *stream_id, GstAudioInfo const *audio_info, GstClockTime base, DriftMeasureElementHarnessOutputFunc output_func, gpointer user_data);
+
+/* Like drift_measure_element_harness_new(), but the sink pad only accepts
+ * output_caps instead of CSV, for example to get binary output. The
+ * harness keeps a reference to the caps. */
+DriftMeasureElementHarness * drift_measure_element_harness_new_with_output_caps(GstElement *element, gchar const *stream_id, GstAudioInfo const *audio_info, GstClockTime base, GstCaps *output_caps, DriftMeasureElementHarnessOutputFunc output_func, gpointer user_data);
+
+/* Like drift_measure_element_harness_new(), but requests num_inputs
+ * sink_%u pads instead of using the sink pad, and feeds them streams with
+ * the formats in audio_infos. The streams get their own stream IDs, which
+ * are stream_id followed by the index of the request pad. */
+DriftMeasureElementHarness * drift_measure_element_harness_new_for_request_pads(GstElement *element, gchar const *stream_id, GstAudioInfo const *audio_infos, guint num_inputs, GstClockTime base, DriftMeasureElementHarnessOutputFunc output_func, gpointer user_data);
+
+/* Sets the element back to NULL, and unlinks and releases the pads,
+ * including the request pads of the element. */
+void drift_measure_element_harness_free(DriftMeasureElementHarness *harness);
+
+/* Pushes num_frames interleaved frames, in buffers of up to
+ * buffer_num_frames frames. The frames must stay valid until the harness
+ * is freed. Returns the first flow return that is not GST_FLOW_OK, which
+ * includes GST_FLOW_NOT_NEGOTIATED if the caps were not accepted. */
+GstFlowReturn drift_measure_element_harness_push_frames(DriftMeasureElementHarness *harness, guint8 const *frames, gsize num_frames, gsize buffer_num_frames);
+
+/* Like drift_measure_element_harness_push_frames(), but pushes into the
+ * request pad with the given index. A request pad blocks while it has
+ * max-input-queue-time of frames that the others did not get yet, so when
+ * pushing from one thread, the request pads have to take turns, with at
+ * most that much audio per turn. */
+GstFlowReturn drift_measure_element_harness_push_input_frames(DriftMeasureElementHarness *harness, guint input_index, guint8 const *frames, gsize num_frames, gsize buffer_num_frames);
+
+/* Pushes EOS into each input, unless an earlier push failed, and returns the flow return
+ * of the earlier pushes. EOS also waits for the windows that are still
+ * being analyzed, so all output has been passed to the callback after
+ * this returns. */
+GstFlowReturn drift_measure_element_harness_finish(DriftMeasureElementHarness *harness);
+
+
+G_END_DECLS
+
+
+#endif /* ELEMENTHARNESS_H */